@@ -0,0 +1,257 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FRAME_PIPELINE_H_
+#define _FRAME_PIPELINE_H_
+
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+
+#include "CameraBackend.h"
+#include "CommonDefs.h"
+#include "FrameTrace.h"
+#include "Logger.h"
+
+namespace thermal {
+
+/**
+ * @brief Turns a captured frame into a display ready RGBA frame.
+ *
+ * The sensor geometry comes from the camera backend at compile time, so the
+ * scale + rotate is folded into one remap table built once for that geometry
+ * and nothing on the frame path branches on the resolution.
+ *
+ * Digital zoom is folded into the same table, centred on the reticle so the
+ * zero holds at any magnification. Tables are built and cached on the
+ * control thread (SetView/Prepare) and handed to the frame thread with an
+ * atomic pointer swap, so changing the view never stalls a frame.
+ *
+ * @tparam Camera the camera backend traits.
+ */
+template <camera::CameraBackend Camera>
+class FramePipeline {
+    static_assert(Camera::kPixelFormat == camera::PixelFormat::kBgr24, "the frame kernels take BGR frames");
+
+public:
+    static constexpr size_t kSourceWidth = Camera::kWidth;
+    static constexpr size_t kSourceHeight = Camera::kHeight;
+    static constexpr bool kNeedsScaling = (kSourceWidth != kDisplayWidth) || (kSourceHeight != kDisplayHeight);
+
+    // zoom 0..kMaxZoomLevel maps linearly onto 1x..kMaxMagnification
+    static constexpr uint32_t kMaxZoomLevel = 100u;
+    static constexpr float kMaxMagnification = 4.0f;
+
+    // tables for the profiles plus a few recent edits, ~350KB each
+    static constexpr size_t kMaxCachedTables = 8u;
+
+    FramePipeline() 
+        : FramePipeline(trace::FrameTracer::Instance()) {
+        return;
+    }
+
+    /**
+     * @param tracer where the stages are marked, for pipelines that don't
+     *        run on the capture thread (the offline renderer has one per
+     *        worker).
+     */
+    explicit FramePipeline(trace::FrameTracer& tracer)
+        : mTracer(tracer)
+        , mActive(nullptr)
+        , mTables()
+        , mUseCount(0u) {
+        SetView(0u, 0, 0);
+        return;
+    }
+
+    /**
+     * @brief Builds the table for a view ahead of time so a later SetView()
+     *        with the same parameters is instant. Control thread only.
+     *
+     * @param zoom zoom level, 0 is no zoom.
+     * @param x reticle x offset in display pixels, the zoom centre.
+     * @param y reticle y offset in display pixels, the zoom centre.
+     */
+    void Prepare(uint32_t zoom, int32_t x, int32_t y) {
+        GetTable(zoom, x, y);
+        return;
+    }
+
+    /**
+     * @brief Switches the frame path to a view. The next frame uses it, the
+     *        frame in flight finishes with the old one. Control thread only.
+     *
+     * @param zoom zoom level, 0 is no zoom.
+     * @param x reticle x offset in display pixels, the zoom centre.
+     * @param y reticle y offset in display pixels, the zoom centre.
+     */
+    void SetView(uint32_t zoom, int32_t x, int32_t y) {
+        mActive.store(GetTable(zoom, x, y));
+        return;
+    }
+
+    /**
+     * @brief Scales, rotates and converts a frame for the LCD.
+     *
+     * @param frame the captured frame, in the backend's pixel format or its
+     *        raw one.
+     * @param output receives the 240x240 RGBA frame. Reused between calls.
+     * @return false if the frame does not have the backend's geometry.
+     */
+    bool Process(const cv::Mat& frame, cv::Mat& output) {
+        if (frame.cols != static_cast<int32_t>(kSourceWidth) || frame.rows < static_cast<int32_t>(kSourceHeight)) {
+            DLOG_WARN("unexpected frame %dx%d for %s", frame.cols, frame.rows, Camera::kName);
+            return false;
+        }
+
+        // Only the top plane is picture when the thermal plane rides along.
+        const cv::Mat* image = &frame;
+        cv::Mat roi;
+        if constexpr (Camera::kRawLayout == camera::RawPlaneLayout::kImageOverThermal) {
+            if (frame.rows != static_cast<int32_t>(kSourceHeight)) {
+                roi = frame(cv::Rect(0, 0, kSourceWidth, kSourceHeight));
+                image = &roi;
+            }
+        }
+
+        // A raw frame (raw capture, or a raw recording replayed) is still in
+        // the sensor's format, the kernels below take BGR.
+        if (image->type() != CV_8UC3) {
+            if constexpr (Camera::kRawPixelFormat == camera::PixelFormat::kYuyv) {
+                if (image->type() == CV_8UC2) {
+                    cv::cvtColor(*image, mConverted, cv::COLOR_YUV2BGR_YUYV);
+                    image = &mConverted;
+                }
+            }
+            if (image->type() != CV_8UC3) {
+                DLOG_WARN("unsupported frame type %d for %s", image->type(), Camera::kName);
+                return false;
+            }
+        }
+
+        // pinned for the whole frame, a view change swaps in a new table
+        std::shared_ptr<const RemapTable> table = mActive.load();
+        if (table != nullptr) {
+            cv::remap(*image, mTransformed, table->mapA, table->mapB, cv::INTER_LINEAR);
+        } else {
+            cv::rotate(*image, mTransformed, cv::ROTATE_90_COUNTERCLOCKWISE);
+        }
+        mTracer.Mark(trace::Stage::kTransform);
+
+        cv::cvtColor(mTransformed, output, cv::COLOR_BGR2RGBA);
+        mTracer.Mark(trace::Stage::kConvert);
+        return true;
+    }
+
+private:
+    struct RemapTable {
+        cv::Mat mapA; ///< fixed point source coordinates
+        cv::Mat mapB; ///< interpolation weights
+    };
+
+    struct CachedTable {
+        std::shared_ptr<const RemapTable> table;
+        uint64_t lastUsed;
+    };
+
+    trace::FrameTracer& mTracer;
+    std::atomic<std::shared_ptr<const RemapTable>> mActive; ///< null means a plain rotate
+    std::map<uint64_t, CachedTable> mTables; ///< control thread only
+    uint64_t mUseCount;
+    cv::Mat mConverted;   ///< raw frames converted to BGR, kept to avoid reallocating
+    cv::Mat mTransformed; ///< scaled + rotated BGR, kept to avoid reallocating
+
+    /**
+     * @brief Finds or builds the table for a view, evicting the least
+     *        recently used one when the cache is full. The frame thread keeps
+     *        an evicted table alive until it is done with it.
+     */
+    std::shared_ptr<const RemapTable> GetTable(uint32_t zoom, int32_t x, int32_t y) {
+        zoom = std::min(zoom, kMaxZoomLevel);
+        if (zoom == 0u) {
+            // the centre doesn't matter without zoom
+            x = 0;
+            y = 0;
+            if constexpr (!kNeedsScaling) {
+                return nullptr;
+            }
+        }
+
+        const uint64_t key = (static_cast<uint64_t>(zoom) << 32)
+            | (static_cast<uint64_t>(static_cast<uint16_t>(x)) << 16)
+            | static_cast<uint64_t>(static_cast<uint16_t>(y));
+
+        auto it = mTables.find(key);
+        if (it == mTables.end()) {
+            if (mTables.size() >= kMaxCachedTables) {
+                auto oldest = std::min_element(mTables.begin(), mTables.end(), [](const auto& a, const auto& b) {
+                    return a.second.lastUsed < b.second.lastUsed;
+                });
+                mTables.erase(oldest);
+            }
+            it = mTables.emplace(key, CachedTable{ BuildTable(zoom, x, y), 0u }).first;
+        }
+
+        it->second.lastUsed = ++mUseCount;
+        return it->second.table;
+    }
+
+    /**
+     * @brief Folds resize to 240x240, a 90 degree counter-clockwise rotate
+     *        and the zoom into one table. Without zoom this matches what
+     *        cv::resize + cv::rotate produced.
+     */
+    static std::shared_ptr<const RemapTable> BuildTable(uint32_t zoom, int32_t x, int32_t y) {
+        constexpr float kScaleX = static_cast<float>(kSourceWidth) / kDisplayWidth;
+        constexpr float kScaleY = static_cast<float>(kSourceHeight) / kDisplayHeight;
+
+        // the reticle sits at the centre plus its offset, zoom around it
+        const float magnification = 1.0f + (kMaxMagnification - 1.0f) * static_cast<float>(zoom) / kMaxZoomLevel;
+        const float centreCol = (kDisplayWidth - 1) / 2.0f + static_cast<float>(x);
+        const float centreRow = (kDisplayHeight - 1) / 2.0f + static_cast<float>(y);
+
+        cv::Mat mapX(kDisplayHeight, kDisplayWidth, CV_32FC1);
+        cv::Mat mapY(kDisplayHeight, kDisplayWidth, CV_32FC1);
+        for (size_t row = 0; row < kDisplayHeight; row++) {
+            float* mx = mapX.ptr<float>(row);
+            float* my = mapY.ptr<float>(row);
+            const float zoomedRow = centreRow + (static_cast<float>(row) - centreRow) / magnification;
+            for (size_t col = 0; col < kDisplayWidth; col++) {
+                const float zoomedCol = centreCol + (static_cast<float>(col) - centreCol) / magnification;
+
+                // rotated (row, col) comes from resized (col, width - 1 - row)
+                float resizedX = static_cast<float>(kDisplayWidth - 1) - zoomedRow;
+                float resizedY = zoomedCol;
+                mx[col] = (resizedX + 0.5f) * kScaleX - 0.5f;
+                my[col] = (resizedY + 0.5f) * kScaleY - 0.5f;
+            }
+        }
+
+        auto table = std::make_shared<RemapTable>();
+        cv::convertMaps(mapX, mapY, table->mapA, table->mapB, CV_16SC2);
+        DLOG_DEBUG("built %zux%zu -> %zux%zu remap for %s, zoom %u at (%d,%d)",
+            kSourceWidth, kSourceHeight, kDisplayWidth, kDisplayHeight, Camera::kName, zoom, x, y);
+        return table;
+    }
+};
+
+} // thermal
+
+#endif // _FRAME_PIPELINE_H_
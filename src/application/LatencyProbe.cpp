@@ -0,0 +1,153 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "LatencyProbe.h"
+
+#include <opencv2/core.hpp>
+#include <stdio.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "Logger.h"
+
+namespace thermal {
+
+// the lamp is put in the middle of the view, only that part is looked at
+constexpr const int32_t kProbeSize = 32;
+// slow moving average of the scene, so the camera's own drift isn't a step
+constexpr const double kBaselineWeight = 0.1;
+
+LatencyProbe::LatencyProbe(const trace::FrameTracer& tracer, bool withSensor)
+    : mTracer(tracer)
+    , mWithSensor(withSensor)
+    , mTriggerToPresent()
+    , mTriggerToGlass()
+    , mTrigger(0u)
+    , mMissed(0u)
+    , mBaseline(0.0)
+    , mHaveBaseline(false)
+    , mStimulus(false) {}
+
+void LatencyProbe::Trigger(uint64_t timestampNs) {
+    uint64_t previous = mTrigger.exchange(timestampNs, std::memory_order_acq_rel);
+    if (previous != 0u) {
+        // the rig is faster than the timeout, the old one never showed up
+        mMissed.fetch_add(1u, std::memory_order_relaxed);
+    }
+}
+
+void LatencyProbe::Observe(uint64_t timestampNs) {
+    uint64_t trigger = mTrigger.load(std::memory_order_acquire);
+    if (trigger == 0u || timestampNs < trigger) {
+        return;
+    }
+
+    mTriggerToGlass.Record(timestampNs - trigger);
+    mTrigger.compare_exchange_strong(trigger, 0u, std::memory_order_acq_rel);
+}
+
+void LatencyProbe::OnFrame(const cv::Mat& frame) {
+    mStimulus = false;
+    if (frame.cols < kProbeSize || frame.rows < kProbeSize) {
+        return;
+    }
+
+    const cv::Rect centre((frame.cols - kProbeSize) / 2, (frame.rows - kProbeSize) / 2, kProbeSize, kProbeSize);
+    const cv::Scalar mean = cv::mean(frame(centre));
+    double brightness = 0.0;
+    for (int32_t c = 0; c < std::min(frame.channels(), 3); c++) {
+        brightness += mean[c];
+    }
+    brightness /= std::min(frame.channels(), 3);
+
+    const uint64_t trigger = mTrigger.load(std::memory_order_acquire);
+    if (trigger != 0u && mHaveBaseline && std::fabs(brightness - mBaseline) > kStepThreshold) {
+        mStimulus = true;
+        // the lamp stays on, what it looks like now is the new normal
+        mBaseline = brightness;
+        return;
+    }
+
+    if (trigger != 0u && trace::Now() - trigger > static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(kTriggerTimeout).count())) {
+        uint64_t expected = trigger;
+        if (mTrigger.compare_exchange_strong(expected, 0u, std::memory_order_acq_rel)) {
+            mMissed.fetch_add(1u, std::memory_order_relaxed);
+            DLOG_WARN("latency trigger not seen within %lld ms", static_cast<long long>(kTriggerTimeout.count()));
+        }
+    }
+
+    mBaseline = mHaveBaseline ? mBaseline + kBaselineWeight * (brightness - mBaseline) : brightness;
+    mHaveBaseline = true;
+}
+
+void LatencyProbe::OnPresented() {
+    if (!mStimulus) {
+        return;
+    }
+    mStimulus = false;
+
+    uint64_t trigger = mTrigger.load(std::memory_order_acquire);
+    const uint64_t now = trace::Now();
+    if (trigger == 0u || now < trigger) {
+        return;
+    }
+
+    mTriggerToPresent.Record(now - trigger);
+    DLOG_INFO("trigger to present %.1f ms", static_cast<double>(now - trigger) / 1e6);
+    if (!mWithSensor) {
+        mTrigger.compare_exchange_strong(trigger, 0u, std::memory_order_acq_rel);
+    }
+}
+
+const trace::LatencyHistogram& LatencyProbe::GetTriggerToPresent() const {
+    return mTriggerToPresent;
+}
+
+const trace::LatencyHistogram& LatencyProbe::GetTriggerToGlass() const {
+    return mTriggerToGlass;
+}
+
+uint64_t LatencyProbe::GetMissed() const {
+    return mMissed.load(std::memory_order_relaxed);
+}
+
+std::string LatencyProbe::Report() const {
+    std::string report;
+    char line[160];
+
+    snprintf(line, sizeof(line), "\nlatency    %10s %10s %10s %10s %10s\n", "count", "p50_ms", "p99_ms", "max_ms",
+             "mean_ms");
+    report += line;
+
+    auto addRow = [&](const char* name, const trace::LatencyHistogram& histogram) {
+        snprintf(line, sizeof(line), "%-10s %10llu %10.2f %10.2f %10.2f %10.2f\n", name,
+                 static_cast<unsigned long long>(histogram.Count()), histogram.Percentile(0.5) / 1e6,
+                 histogram.Percentile(0.99) / 1e6, histogram.Max() / 1e6, histogram.Mean() / 1e6);
+        report += line;
+    };
+    addRow("capture", mTracer.GetTotal());
+    addRow("trigger", mTriggerToPresent);
+    addRow("glass", mTriggerToGlass);
+
+    snprintf(line, sizeof(line), "missed triggers %llu\n", static_cast<unsigned long long>(GetMissed()));
+    report += line;
+    return report;
+}
+
+} // thermal
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _LATENCY_PROBE_H_
+#define _LATENCY_PROBE_H_
+
+#include <stdint.h>
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "FrameTrace.h"
+
+namespace thermal {
+
+/**
+ * @brief Glass to glass latency test mode.
+ *
+ * Capture to present comes from the frame tracer (V4L2 buffer timestamp to
+ * the framebuffer write). That misses the sensor and the LCD, so a test rig
+ * can also wire up:
+ *  - a trigger gpio, pulsed when the rig switches on a lamp in front of the
+ *    lens. The first frame whose centre brightness steps after the pulse is
+ *    the stimulus, trigger to its present is recorded.
+ *  - a sensor gpio, a photodiode on the LCD. Trigger to its edge is the
+ *    real glass to glass figure.
+ *
+ * Trigger() and Observe() run on the reactor thread, OnFrame() and
+ * OnPresented() on the frame thread. Each histogram has one writer.
+ */
+class LatencyProbe {
+public:
+    // a trigger nobody saw on screen within this long is counted as missed
+    static constexpr std::chrono::milliseconds kTriggerTimeout{ 1000 };
+    // centre brightness change (0..255) that counts as the stimulus
+    static constexpr double kStepThreshold = 40.0;
+
+    /**
+     * @param tracer source of the capture to present figures.
+     * @param withSensor a photodiode is wired up, a trigger then stays
+     *        armed until Observe() instead of ending at the present.
+     */
+    LatencyProbe(const trace::FrameTracer& tracer, bool withSensor);
+
+    /**
+     * @brief The rig switched the stimulus, timestamp from the gpio edge.
+     */
+    void Trigger(uint64_t timestampNs);
+
+    /**
+     * @brief The photodiode saw the stimulus on the LCD.
+     */
+    void Observe(uint64_t timestampNs);
+
+    /**
+     * @brief Looks for the stimulus in a captured frame.
+     */
+    void OnFrame(const cv::Mat& frame);
+
+    /**
+     * @brief The frame given to the last OnFrame() reached the framebuffer.
+     */
+    void OnPresented();
+
+    const trace::LatencyHistogram& GetTriggerToPresent() const;
+    const trace::LatencyHistogram& GetTriggerToGlass() const;
+    uint64_t GetMissed() const;
+
+    /**
+     * @brief Distributions in the frame stats format.
+     */
+    std::string Report() const;
+
+private:
+    const trace::FrameTracer& mTracer;
+    const bool mWithSensor;
+    trace::LatencyHistogram mTriggerToPresent; ///< frame thread writes
+    trace::LatencyHistogram mTriggerToGlass;   ///< reactor thread writes
+    std::atomic<uint64_t> mTrigger;            ///< armed trigger, 0 when idle
+    std::atomic<uint64_t> mMissed;
+
+    // frame thread only
+    double mBaseline;
+    bool mHaveBaseline;
+    bool mStimulus;     ///< the current frame is the stimulus
+};
+
+} // thermal
+
+#endif // _LATENCY_PROBE_H_
@@ -0,0 +1,310 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PreEventBuffer.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "FrameTrace.h"
+#include "Logger.h"
+
+namespace thermal {
+
+// the encoder polls like the video recorder's writer, Submit() never wakes it
+constexpr const std::chrono::milliseconds kEncoderPollInterval(10);
+
+// entries for the maximum age at up to this rate, the arena is the real limit
+constexpr const size_t kMaxFrameRate = 64u;
+
+PreEventBuffer::PreEventBuffer(size_t budgetBytes, std::chrono::seconds maxAge)
+    : mMaxAge(maxAge)
+    , mSlots()
+    , mFree()
+    , mFilled()
+    , mMutex()
+    , mArena(budgetBytes)
+    , mEntries(static_cast<size_t>(maxAge.count()) * kMaxFrameRate + 1u)
+    , mOldest(0u)
+    , mNext(0u)
+    , mPinnedFrom(0u)
+    , mPinnedTo(0u)
+    , mWidth(0u)
+    , mHeight(0u)
+    , mType(0)
+    , mEncoderThread()
+    , mSaveThread()
+    , mRunning(false)
+    , mSaving(false)
+    , mEncoder(camera::FrameCodec::kJpeg)
+    , mEncoded()
+    , mDropped(0u)
+    , mPinnedDrops(0u)
+    , mSavedFrames(0u)
+    , mSaveNs(0u) {
+    for (size_t i = 0u; i < kSlots; i++) {
+        mFree.Push(static_cast<uint8_t>(i));
+    }
+}
+
+PreEventBuffer::~PreEventBuffer() {
+    Stop();
+}
+
+void PreEventBuffer::Start() {
+    if (mRunning.exchange(true)) {
+        return;
+    }
+    DLOG_INFO("pre-event buffer of %zu KB, up to %lld s", mArena.size() / 1024u,
+              static_cast<long long>(mMaxAge.count()));
+    mEncoderThread = std::thread(&PreEventBuffer::RunEncoder, this);
+}
+
+void PreEventBuffer::Stop() {
+    if (mRunning.exchange(false)) {
+        mEncoderThread.join();
+    }
+    if (mSaveThread.joinable()) {
+        mSaveThread.join();
+    }
+}
+
+bool PreEventBuffer::Submit(const cv::Mat& frame, uint64_t timestamp) {
+    if (!mRunning.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    uint8_t index = 0u;
+    if (!mFree.Pop(index)) {
+        mDropped.fetch_add(1u, std::memory_order_relaxed);
+        return false;
+    }
+
+    Slot& slot = mSlots[index];
+    frame.copyTo(slot.frame);
+    slot.timestamp = timestamp;
+    mFilled.Push(index);
+    return true;
+}
+
+bool PreEventBuffer::Save(const std::string& path) {
+    if (mSaving.exchange(true)) {
+        DLOG_WARN("still saving the last replay");
+        return false;
+    }
+    if (mSaveThread.joinable()) {
+        mSaveThread.join();
+    }
+
+    const uint64_t requested = trace::Now();
+    uint64_t from = 0u;
+    uint64_t to = 0u;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        from = mOldest;
+        to = mNext;
+        mPinnedFrom = from;
+        mPinnedTo = to;
+    }
+    if (from == to) {
+        mSaving.store(false);
+        return false;
+    }
+
+    mSaveThread = std::thread(&PreEventBuffer::RunSave, this, path, from, to, requested);
+    return true;
+}
+
+bool PreEventBuffer::IsSaving() const {
+    return mSaving.load(std::memory_order_relaxed);
+}
+
+double PreEventBuffer::GetSeconds() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mOldest == mNext) {
+        return 0.0;
+    }
+    const Entry& oldest = mEntries[mOldest % mEntries.size()];
+    const Entry& newest = mEntries[(mNext - 1u) % mEntries.size()];
+    return (newest.timestamp - oldest.timestamp) / 1e9;
+}
+
+std::string PreEventBuffer::Report() const {
+    uint64_t frames = 0u;
+    uint64_t bytes = 0u;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        frames = mNext - mOldest;
+        for (uint64_t sequence = mOldest; sequence < mNext; sequence++) {
+            bytes += mEntries[sequence % mEntries.size()].size;
+        }
+    }
+
+    char report[256];
+    snprintf(report, sizeof(report),
+             "\npre-event  seconds %.1f frames %llu bytes %llu of %zu dropped %llu ring_drops %llu\n"
+             "last save  frames %llu ms %.1f%s\n",
+             GetSeconds(), static_cast<unsigned long long>(frames), static_cast<unsigned long long>(bytes),
+             mArena.size(), static_cast<unsigned long long>(mDropped.load(std::memory_order_relaxed)),
+             static_cast<unsigned long long>(mPinnedDrops.load(std::memory_order_relaxed)),
+             static_cast<unsigned long long>(mSavedFrames.load(std::memory_order_relaxed)),
+             mSaveNs.load(std::memory_order_relaxed) / 1e6, IsSaving() ? " (saving)" : "");
+    return report;
+}
+
+void PreEventBuffer::RunEncoder() {
+    while (true) {
+        uint8_t index = 0u;
+        if (!mFilled.Pop(index)) {
+            if (!mRunning.load()) {
+                break;
+            }
+            std::this_thread::sleep_for(kEncoderPollInterval);
+            continue;
+        }
+
+        Slot& slot = mSlots[index];
+        if (mEncoder.Encode(slot.frame, mEncoded)) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mWidth = static_cast<uint32_t>(slot.frame.cols);
+            mHeight = static_cast<uint32_t>(slot.frame.rows);
+            mType = slot.frame.type();
+            if (!Insert(mEncoded.data(), mEncoded.size(), slot.timestamp)) {
+                mPinnedDrops.fetch_add(1u, std::memory_order_relaxed);
+            }
+        } else {
+            mDropped.fetch_add(1u, std::memory_order_relaxed);
+        }
+        mFree.Push(index);
+    }
+}
+
+void PreEventBuffer::RunSave(std::string path, uint64_t from, uint64_t to, uint64_t requested) {
+    uint32_t width = 0u;
+    uint32_t height = 0u;
+    int32_t type = 0;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        width = mWidth;
+        height = mHeight;
+        type = mType;
+    }
+
+    // oldest first, each frame is unpinned as soon as it is written so the
+    // ring gets its room back while the rest is still going out
+    camera::CompressedWriter writer;
+    bool status = writer.Open(path, camera::FrameCodec::kJpeg);
+    for (uint64_t sequence = from; sequence < to; sequence++) {
+        Entry entry;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            entry = mEntries[sequence % mEntries.size()];
+        }
+        status = status && writer.Write(width, height, type, mArena.data() + entry.offset, entry.size, entry.timestamp);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPinnedFrom = sequence + 1u;
+        }
+    }
+    status = writer.Close() && status;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPinnedFrom = 0u;
+        mPinnedTo = 0u;
+    }
+
+    const uint64_t elapsed = trace::Now() - requested;
+    mSavedFrames.store(to - from, std::memory_order_relaxed);
+    mSaveNs.store(elapsed, std::memory_order_relaxed);
+    if (status) {
+        DLOG_NOTICE("saved %llu frames to %s in %.1f ms", static_cast<unsigned long long>(to - from), path.c_str(),
+                    elapsed / 1e6);
+    } else {
+        DLOG_ERROR("failed to save the replay to %s", path.c_str());
+    }
+    mSaving.store(false);
+}
+
+// mMutex held
+bool PreEventBuffer::Insert(const uint8_t* data, size_t size, uint64_t timestamp) {
+    if (mNext - mOldest == mEntries.size() && !EvictOldest()) {
+        return false;
+    }
+    size_t offset = 0u;
+    if (!Reserve(size, offset)) {
+        return false;
+    }
+
+    std::memcpy(mArena.data() + offset, data, size);
+    mEntries[mNext % mEntries.size()] = Entry{ offset, static_cast<uint32_t>(size), timestamp };
+    mNext++;
+
+    const uint64_t maxAge = static_cast<uint64_t>(std::chrono::nanoseconds(mMaxAge).count());
+    while (mNext - mOldest > 1u && timestamp - mEntries[mOldest % mEntries.size()].timestamp > maxAge) {
+        if (!EvictOldest()) {
+            break;
+        }
+    }
+    return true;
+}
+
+// mMutex held. The live entries are one contiguous run of the arena,
+// possibly wrapping at its end; new frames go right after the newest.
+bool PreEventBuffer::Reserve(size_t size, size_t& offset) {
+    if (size > mArena.size()) {
+        return false;
+    }
+
+    while (true) {
+        if (mOldest == mNext) {
+            offset = 0u;
+            return true;
+        }
+
+        const Entry& oldest = mEntries[mOldest % mEntries.size()];
+        const Entry& newest = mEntries[(mNext - 1u) % mEntries.size()];
+        const size_t start = oldest.offset;
+        const size_t end = newest.offset + newest.size;
+        if (start < end) {
+            if (end + size <= mArena.size()) {
+                offset = end;
+                return true;
+            }
+            if (size <= start) {
+                offset = 0u;
+                return true;
+            }
+        } else if (end + size <= start) {
+            offset = end;
+            return true;
+        }
+
+        if (!EvictOldest()) {
+            return false;
+        }
+    }
+}
+
+// mMutex held
+bool PreEventBuffer::EvictOldest() {
+    if (mOldest == mNext || (mOldest >= mPinnedFrom && mOldest < mPinnedTo)) {
+        return false;
+    }
+    mOldest++;
+    return true;
+}
+
+} // thermal
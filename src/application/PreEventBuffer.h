@@ -0,0 +1,153 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _PRE_EVENT_BUFFER_H_
+#define _PRE_EVENT_BUFFER_H_
+
+#include <stdint.h>
+#include <opencv2/core.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FrameRecording.h"
+#include "SpscRing.h"
+
+namespace thermal {
+
+/**
+ * @brief Keeps the last seconds of video in memory, compressed, so a moment
+ *        can be saved after it happened.
+ *
+ * The camera thread hands frames over with Submit(), which only copies them
+ * into a free slot (or drops them when none is free). A worker thread JPEG
+ * encodes them into a fixed arena used as a ring: the oldest frames are
+ * evicted to make room, or once they are older than the maximum age. At
+ * 25 fps a 240x240 display frame is ~230 KB raw and ~15 KB encoded, so
+ * 16 MB holds about 40 s instead of under 3.
+ *
+ * Save() writes the ring to a compressed recording from another thread
+ * while capture carries on. The frames being saved are pinned until they
+ * are written, oldest first, so if the ring wraps onto them mid save the
+ * new frames are dropped instead.
+ */
+class PreEventBuffer {
+public:
+    static constexpr size_t kSlots = 4u;
+    static constexpr size_t kDefaultBudget = 16u * 1024u * 1024u;
+    static constexpr std::chrono::seconds kDefaultMaxAge{ 30 };
+
+    /**
+     * @param budgetBytes memory for the encoded frames, allocated up front.
+     * @param maxAge frames older than this (from the newest) are let go.
+     */
+    PreEventBuffer(size_t budgetBytes, std::chrono::seconds maxAge);
+    ~PreEventBuffer();
+
+    /**
+     * @brief Starts the encoder thread. Control thread.
+     */
+    void Start();
+
+    /**
+     * @brief Stops the encoder thread and waits for a running save. Control thread.
+     */
+    void Stop();
+
+    /**
+     * @brief Queues a copy of a frame. Camera thread, never blocks.
+     * @return false if the frame was dropped.
+     */
+    bool Submit(const cv::Mat& frame, uint64_t timestamp);
+
+    /**
+     * @brief Saves what the ring holds right now, in the background.
+     *        Control thread.
+     * @return false if a save is still running or the ring is empty.
+     */
+    bool Save(const std::string& path);
+
+    bool IsSaving() const;
+
+    /**
+     * @brief Seconds of video the ring holds.
+     */
+    double GetSeconds() const;
+
+    /**
+     * @brief Fill, drops and the last save, for the stats export.
+     */
+    std::string Report() const;
+
+private:
+    struct Slot {
+        cv::Mat frame;
+        uint64_t timestamp;
+    };
+
+    struct Entry {
+        size_t offset;       ///< in the arena
+        uint32_t size;
+        uint64_t timestamp;
+    };
+
+    const std::chrono::seconds mMaxAge;
+
+    // camera thread -> encoder thread
+    std::array<Slot, kSlots> mSlots;
+    utils::SpscRing<uint8_t, kSlots> mFree;
+    utils::SpscRing<uint8_t, kSlots> mFilled;
+
+    // the ring, guarded by mMutex; the bytes of pinned entries are read by
+    // the save thread without it
+    mutable std::mutex mMutex;
+    std::vector<uint8_t> mArena;
+    std::vector<Entry> mEntries;  ///< indexed by sequence % size
+    uint64_t mOldest;             ///< sequence of the oldest live entry
+    uint64_t mNext;               ///< sequence of the next entry
+    uint64_t mPinnedFrom;         ///< entries in [mPinnedFrom, mPinnedTo) are being saved
+    uint64_t mPinnedTo;
+    uint32_t mWidth;
+    uint32_t mHeight;
+    int32_t mType;
+
+    std::thread mEncoderThread;
+    std::thread mSaveThread;
+    std::atomic<bool> mRunning;
+    std::atomic<bool> mSaving;
+    camera::FrameEncoder mEncoder; ///< encoder thread only
+    std::vector<uint8_t> mEncoded;
+
+    std::atomic<uint64_t> mDropped;      ///< no free slot, the encoder fell behind
+    std::atomic<uint64_t> mPinnedDrops;  ///< no room while a save held the ring
+    std::atomic<uint64_t> mSavedFrames;
+    std::atomic<uint64_t> mSaveNs;       ///< click to file closed, last save
+
+    void RunEncoder();
+    void RunSave(std::string path, uint64_t from, uint64_t to, uint64_t requested);
+    bool Insert(const uint8_t* data, size_t size, uint64_t timestamp);
+    bool Reserve(size_t size, size_t& offset);
+    bool EvictOldest();
+};
+
+} // thermal
+
+#endif // _PRE_EVENT_BUFFER_H_
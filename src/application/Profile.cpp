@@ -0,0 +1,99 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "Profile.h"
+
+#include <algorithm>
+
+#include "Logger.h"
+
+namespace thermal {
+
+ProfileSet::ProfileSet(std::string key)
+    : persistent::BaseSaveable<std::array<Profile, kProfileCount>>(key)
+    , mProfiles()
+    , mActive(nullptr) {
+    for (size_t i = 0u; i < kProfileCount; i++) {
+        mProfiles[i] = Profile{ "P" + std::to_string(i + 1u), 0, 0, 0u, ReticleType::kDefault };
+    }
+    mActive = &mProfiles[0];
+    return;
+}
+
+Profile& ProfileSet::Active() {
+    return *mActive;
+}
+
+const Profile& ProfileSet::Active() const {
+    return *mActive;
+}
+
+size_t ProfileSet::ActiveIndex() const {
+    return static_cast<size_t>(mActive - mProfiles.data());
+}
+
+Profile& ProfileSet::At(size_t index) {
+    return mProfiles[index % kProfileCount];
+}
+
+Profile& ProfileSet::Select(size_t index) {
+    mActive = &mProfiles[index % kProfileCount];
+    DLOG_INFO("profile %s selected", mActive->name.c_str());
+    return *mActive;
+}
+
+Json::Value ProfileSet::Serialize() {
+    Json::Value json;
+    json["active"] = static_cast<Json::UInt>(ActiveIndex());
+
+    Json::Value profiles(Json::arrayValue);
+    for (const Profile& profile : mProfiles) {
+        Json::Value entry;
+        entry["name"] = profile.name;
+        entry["x"] = profile.x;
+        entry["y"] = profile.y;
+        entry["zoom"] = profile.zoom;
+        entry["reticle"] = static_cast<int32_t>(profile.reticle);
+        profiles.append(entry);
+    }
+    json["profiles"] = profiles;
+    return json;
+}
+
+void ProfileSet::Deserialize(Json::Value json) {
+    const Json::Value& profiles = json["profiles"];
+    if (profiles.isArray()) {
+        for (Json::ArrayIndex i = 0; i < profiles.size() && i < kProfileCount; i++) {
+            const Json::Value& entry = profiles[i];
+            Profile& profile = mProfiles[i];
+
+            // clamp everything, a bad value must not take the view off screen
+            profile.name = entry.get("name", profile.name).asString();
+            profile.x = std::clamp(entry.get("x", 0).asInt(), kMinOffset, kMaxOffset);
+            profile.y = std::clamp(entry.get("y", 0).asInt(), kMinOffset, kMaxOffset);
+            profile.zoom = std::min(entry.get("zoom", 0u).asUInt(), kMaxZoom);
+            int32_t reticle = entry.get("reticle", 0).asInt();
+            profile.reticle = (reticle >= 0 && reticle < static_cast<int32_t>(ReticleType::kCount))
+                ? static_cast<ReticleType>(reticle) : ReticleType::kDefault;
+        }
+    }
+
+    Select(json.get("active", 0u).asUInt());
+    return;
+}
+
+} // namespace thermal
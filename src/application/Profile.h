@@ -0,0 +1,101 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <stdint.h>
+
+#include <array>
+#include <cstddef>
+#include <string>
+
+#include "PersistentValue.h"
+#include "Reticle.h"
+
+namespace thermal {
+
+inline constexpr size_t kProfileCount = 4u;
+
+// limits of the per-profile settings, shared by the menus and the loader
+inline constexpr int32_t kMinOffset = -50;
+inline constexpr int32_t kMaxOffset = 50;
+inline constexpr uint32_t kMaxZoom = 100u;
+
+/**
+ * @brief Zero and view settings for one rifle/replica.
+ */
+struct Profile {
+    std::string name;
+    int32_t x;
+    int32_t y;
+    uint32_t zoom;
+    ReticleType reticle;
+};
+
+/**
+ * @brief All profiles, kept in memory and saved as one key.
+ *
+ * The active profile is a pointer into the set, so switching profiles is a
+ * pointer swap. Only used from the application thread.
+ */
+class ProfileSet : public persistent::BaseSaveable<std::array<Profile, kProfileCount>> {
+public:
+    /**
+     * @brief Creates the default profiles, "P1" to "P4", all zeroed.
+     * @param key The key used for persistence.
+     */
+    explicit ProfileSet(std::string key);
+    ~ProfileSet() = default;
+
+    ProfileSet(const ProfileSet&) = delete;
+    ProfileSet& operator=(const ProfileSet&) = delete;
+
+    /**
+     * @brief Gets the active profile.
+     */
+    Profile& Active();
+    const Profile& Active() const;
+
+    /**
+     * @brief Index of the active profile.
+     */
+    size_t ActiveIndex() const;
+
+    /**
+     * @brief Gets a profile by index.
+     */
+    Profile& At(size_t index);
+
+    /**
+     * @brief Makes a profile active.
+     * @param index the profile, wrapped into range.
+     * @return the new active profile.
+     */
+    Profile& Select(size_t index);
+
+    Json::Value Serialize() override;
+    void Deserialize(Json::Value json) override;
+
+private:
+    std::array<Profile, kProfileCount> mProfiles;
+    Profile* mActive;
+};
+
+} // namespace thermal
+
+#endif // _PROFILE_H_
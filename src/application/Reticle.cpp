@@ -28,8 +28,9 @@
 namespace thermal {
 
 Reticle::Reticle(const std::string& path) 
-    : mReticle()
+    : mSources()
     , mSource()
+    , mReticle()
     , mXOffset(0)
     , mYOffset(0) {
     DLOG_DEBUG("loading reticle img: %s", path.c_str());
@@ -44,27 +45,38 @@ cv::Mat& Reticle::GetOverlay() {
     return mReticle;
 }
 
-void Reticle::SetImagePath(const std::string& path) {
+void Reticle::Preload(const std::string& path) {
+    if (mSources.contains(path)) {
+        return;
+    }
+
     // Load the reticle image
-    mSource = cv::imread(path, cv::IMREAD_UNCHANGED);
+    cv::Mat source = cv::imread(path, cv::IMREAD_UNCHANGED);
     
     // Check if the file exists and can be opened
-    if (mSource.empty()) {
+    if (source.empty()) {
         DLOG_WARN("Failed to load reticle image from path: %s", path.c_str());
+        return;
     }
 
     // Ensure the reticle image is of size 240x240
-    if (mSource.size() != cv::Size(240, 240)) {
-        cv::resize(mReticle, mReticle, cv::Size(240, 240));
+    if (source.size() != cv::Size(kWidth, kHeight)) {
+        cv::resize(source, source, cv::Size(kWidth, kHeight));
     }
 
     // Ensure the reticle image is in RGBA format
-    if (mSource.channels() == 3) {
-        cv::cvtColor(mReticle, mReticle, cv::COLOR_BGR2RGBA);
+    if (source.channels() == 3) {
+        cv::cvtColor(source, source, cv::COLOR_BGR2RGBA);
     }
 
-    // Initialize mReticle with the processed mSource
-    mReticle = mSource.clone();
+    mSources.emplace(path, source);
+}
+
+void Reticle::SetImagePath(const std::string& path) {
+    Preload(path);
+
+    auto it = mSources.find(path);
+    mSource = (it != mSources.end()) ? it->second : cv::Mat(kHeight, kWidth, CV_8UC4, cv::Scalar(0, 0, 0, 0));
 
     SetOffset(mXOffset, mYOffset);
 }
@@ -73,7 +85,7 @@ void Reticle::SetImagePath(const std::string& path) {
 void Reticle::SetOffset(int32_t x, int32_t y) {
     DLOG_DEBUG("changed reticle offset (%d,%d)", x, y);
     mXOffset = x;
-    mYOffset = -y; // the y is inverted for some reason
+    mYOffset = y;
 
     // Ensure mReticle is a clone of mSource before applying the offset
     mReticle = mSource.clone();
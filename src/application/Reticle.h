@@ -19,6 +19,7 @@
 
 #include <opencv2/opencv.hpp>
 #include <string>
+#include <unordered_map>
 
 namespace thermal {
 
@@ -59,6 +60,7 @@ public:
     ~Reticle();
 
     cv::Mat& GetOverlay();
+    void Preload(const std::string& path);
     void SetImagePath(const std::string& path);
     void SetOffset(int32_t x, int32_t y);
     void SetX(int32_t x);
@@ -69,6 +71,7 @@ private:
     const size_t kHeight = 240u;
 
     ReticleType mType;
+    std::unordered_map<std::string, cv::Mat> mSources; ///< decoded images by path, switching back is free
     cv::Mat mSource;
     cv::Mat mReticle;
     int32_t mXOffset;
@@ -0,0 +1,189 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SnapshotWriter.h"
+
+#include <json/writer.h>
+#include <opencv2/imgcodecs.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "FrameTrace.h"
+#include "Logger.h"
+#include "ThermalColorizer.h"
+
+namespace thermal {
+
+// Snapshots are rare, the writer polls like the video recorder does rather
+// than having the camera thread wake it.
+constexpr const std::chrono::milliseconds kSnapshotPollInterval(10);
+
+// fast deflate, the counts are noisy and barely compress at higher levels
+constexpr const int32_t kSnapshotPngCompression = 1;
+
+SnapshotWriter::SnapshotWriter(size_t imageRows)
+    : mImageRows(imageRows)
+    , mSlots()
+    , mFree()
+    , mFilled()
+    , mThread()
+    , mRunning(false)
+    , mPending()
+    , mRequestTime(0u)
+    , mArmed(false)
+    , mSaved(0u)
+    , mFailed(0u)
+    , mCaptureNs(0u)
+    , mFileNs(0u) {
+    for (size_t i = 0u; i < kSlots; i++) {
+        mFree.Push(static_cast<uint8_t>(i));
+    }
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    Stop();
+}
+
+void SnapshotWriter::Start() {
+    if (mRunning.exchange(true)) {
+        return;
+    }
+    mThread = std::thread(&SnapshotWriter::Run, this);
+}
+
+void SnapshotWriter::Stop() {
+    if (!mRunning.exchange(false)) {
+        return;
+    }
+    mThread.join();
+}
+
+bool SnapshotWriter::Request(const SnapshotInfo& info) {
+    if (!mRunning.load() || mArmed.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    // the camera thread doesn't look at these until mArmed is set
+    mPending = info;
+    mRequestTime = trace::Now();
+    mArmed.store(true, std::memory_order_release);
+    return true;
+}
+
+bool SnapshotWriter::Submit(const cv::Mat& frame, uint64_t timestamp) {
+    if (!mArmed.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    uint8_t index = 0u;
+    if (!mFree.Pop(index)) {
+        return false;
+    }
+
+    // The counts are kept when the frame carries them, the picture is what
+    // the camera coloured and only a fallback. The slots keep their size, so
+    // the copy doesn't allocate after the first snapshot.
+    Slot& slot = mSlots[index];
+    const cv::Mat counts = (mImageRows > 0u && frame.elemSize() == sizeof(uint16_t))
+        ? ThermalColorizer::GetThermalPlane(frame, mImageRows) : cv::Mat();
+    slot.radiometric = !counts.empty();
+    if (slot.radiometric) {
+        counts.copyTo(slot.frame);
+    } else {
+        frame.copyTo(slot.frame);
+    }
+    slot.timestamp = timestamp;
+    slot.requested = mRequestTime;
+    slot.info = mPending;
+    mArmed.store(false, std::memory_order_release);
+    mFilled.Push(index);
+    return true;
+}
+
+std::string SnapshotWriter::Report() const {
+    char report[160];
+    snprintf(report, sizeof(report), "\nsnapshots\nsaved %llu failed %llu capture_ms %.2f file_ms %.2f\n",
+             static_cast<unsigned long long>(mSaved.load(std::memory_order_relaxed)),
+             static_cast<unsigned long long>(mFailed.load(std::memory_order_relaxed)),
+             mCaptureNs.load(std::memory_order_relaxed) / 1e6, mFileNs.load(std::memory_order_relaxed) / 1e6);
+    return report;
+}
+
+void SnapshotWriter::Run() {
+    while (true) {
+        uint8_t index = 0u;
+        if (!mFilled.Pop(index)) {
+            // drained, and nothing more is coming
+            if (!mRunning.load()) {
+                break;
+            }
+            std::this_thread::sleep_for(kSnapshotPollInterval);
+            continue;
+        }
+
+        const Slot& slot = mSlots[index];
+        if (Write(slot)) {
+            const uint64_t now = trace::Now();
+            mCaptureNs.store(slot.timestamp - std::min(slot.timestamp, slot.requested), std::memory_order_relaxed);
+            mFileNs.store(now - slot.requested, std::memory_order_relaxed);
+            mSaved.fetch_add(1u, std::memory_order_relaxed);
+            DLOG_NOTICE("snapshot %s.png (%s) in %.1f ms", slot.info.path.c_str(),
+                        slot.radiometric ? "counts" : "picture", (now - slot.requested) / 1e6);
+        } else {
+            mFailed.fetch_add(1u, std::memory_order_relaxed);
+            DLOG_ERROR("failed to write snapshot %s", slot.info.path.c_str());
+        }
+        mFree.Push(index);
+    }
+}
+
+bool SnapshotWriter::Write(const Slot& slot) const {
+    const std::vector<int> params = { cv::IMWRITE_PNG_COMPRESSION, kSnapshotPngCompression };
+    if (!cv::imwrite(slot.info.path + ".png", slot.frame, params)) {
+        return false;
+    }
+
+    // everything needed to read the counts back against the picture on the
+    // display, written after the image so a sidecar means a complete pair
+    const SnapshotInfo& info = slot.info;
+    Json::Value json;
+    json["image"] = info.path.substr(info.path.find_last_of('/') + 1u) + ".png";
+    json["radiometric"] = slot.radiometric;
+    json["width"] = slot.frame.cols;
+    json["height"] = slot.frame.rows;
+    json["bits"] = slot.radiometric ? 16 : 8;
+    json["capture_ns"] = static_cast<Json::UInt64>(slot.timestamp);
+    json["palette"] = p2pro::ColorToString(info.palette);
+    json["profile"] = info.profile;
+    json["offset"]["x"] = info.x;
+    json["offset"]["y"] = info.y;
+    json["zoom"] = info.zoom;
+    json["reticle"]["type"] = ReticleTypeToStr(info.reticle);
+    json["reticle"]["x"] = info.reticleX;
+    json["reticle"]["y"] = info.reticleY;
+
+    Json::StreamWriterBuilder builder;
+    std::ofstream sidecar(info.path + ".json", std::ios::trunc);
+    sidecar << Json::writeString(builder, json) << '\n';
+    sidecar.close();
+    return !sidecar.fail();
+}
+
+} // thermal
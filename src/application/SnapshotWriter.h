@@ -0,0 +1,135 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SNAPSHOT_WRITER_H_
+#define _SNAPSHOT_WRITER_H_
+
+#include <stdint.h>
+#include <opencv2/core.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>
+
+#include "P2ProManager.h"
+#include "Reticle.h"
+#include "SpscRing.h"
+
+namespace thermal {
+
+/**
+ * @brief What the scope was set to when a snapshot was taken, written to
+ *        the sidecar.
+ */
+struct SnapshotInfo {
+    std::string path;          ///< without extension, .png and .json are added
+    p2pro::ColorMode palette;
+    std::string profile;
+    int32_t x;                 ///< zero offset, display pixels
+    int32_t y;
+    uint32_t zoom;
+    ReticleType reticle;
+    int32_t reticleX;          ///< reticle centre on the display
+    int32_t reticleY;
+};
+
+/**
+ * @brief Saves stills with the thermal counts and the settings they were
+ *        taken with.
+ *
+ * Request() arms a snapshot from the control thread. The camera thread
+ * picks it up in Submit() with the next frame: it copies the 16 bit thermal
+ * plane (or the frame itself when it has none) into a preallocated slot
+ * and returns. The PNG and its JSON sidecar are written on the writer
+ * thread, so neither the camera thread nor the live view waits for the
+ * card. The time from Request() to the sidecar being written is reported.
+ */
+class SnapshotWriter {
+public:
+    static constexpr size_t kSlots = 2u;
+
+    /**
+     * @param imageRows rows of the image plane when the thermal plane rides
+     *        below it, 0 if the camera never delivers one.
+     */
+    explicit SnapshotWriter(size_t imageRows);
+    ~SnapshotWriter();
+
+    /**
+     * @brief Starts the writer thread. Control thread.
+     */
+    void Start();
+
+    /**
+     * @brief Writes what is queued and stops the writer thread. Control thread.
+     */
+    void Stop();
+
+    /**
+     * @brief Takes a snapshot of the next frame. Control thread.
+     * @return false if the previous request hasn't reached a frame yet.
+     */
+    bool Request(const SnapshotInfo& info);
+
+    /**
+     * @brief Copies the frame if a snapshot is armed. Camera thread, never
+     *        blocks, a single atomic load when nothing is armed. With both
+     *        slots still being written it stays armed for a later frame.
+     * @return true if the frame was taken.
+     */
+    bool Submit(const cv::Mat& frame, uint64_t timestamp);
+
+    /**
+     * @brief Counts and the last shutter to file time, for the stats export.
+     */
+    std::string Report() const;
+
+private:
+    struct Slot {
+        cv::Mat frame;       ///< CV_16UC1 counts, or the frame as delivered
+        bool radiometric;
+        uint64_t timestamp;  ///< capture time
+        uint64_t requested;  ///< Request() time
+        SnapshotInfo info;
+    };
+
+    const size_t mImageRows;
+
+    std::array<Slot, kSlots> mSlots;
+    utils::SpscRing<uint8_t, kSlots> mFree;    ///< writer -> camera thread
+    utils::SpscRing<uint8_t, kSlots> mFilled;  ///< camera thread -> writer
+    std::thread mThread;
+    std::atomic<bool> mRunning;
+
+    // written by Request() while mArmed is clear, read by Submit() while set
+    SnapshotInfo mPending;
+    uint64_t mRequestTime;
+    std::atomic<bool> mArmed;
+
+    std::atomic<uint64_t> mSaved;
+    std::atomic<uint64_t> mFailed;
+    std::atomic<uint64_t> mCaptureNs;  ///< request to frame, last snapshot
+    std::atomic<uint64_t> mFileNs;     ///< request to sidecar written, last snapshot
+
+    void Run();
+    bool Write(const Slot& slot) const;
+};
+
+} // thermal
+
+#endif // _SNAPSHOT_WRITER_H_
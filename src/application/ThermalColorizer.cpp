@@ -0,0 +1,118 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ThermalColorizer.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+
+namespace thermal {
+
+namespace {
+
+// closest OpenCV map for each of the camera's palettes, -1 for plain grey
+int32_t ToColorMap(p2pro::ColorMode mode) {
+    switch (mode) {
+        case p2pro::ColorMode::kPseudoIronRed:
+            return cv::COLORMAP_INFERNO;
+        case p2pro::ColorMode::kPseudoRainbow1:
+            return cv::COLORMAP_RAINBOW;
+        case p2pro::ColorMode::kPseudoRainbow2:
+            return cv::COLORMAP_JET;
+        case p2pro::ColorMode::kPseudoRainbow3:
+            return cv::COLORMAP_HSV;
+        case p2pro::ColorMode::kPseudoRedHot:
+            return cv::COLORMAP_HOT;
+        case p2pro::ColorMode::kPseudoHotRed:
+            return cv::COLORMAP_AUTUMN;
+        case p2pro::ColorMode::kPseudoRainbow4:
+            return cv::COLORMAP_PARULA;
+        case p2pro::ColorMode::kPseudoRainbow5:
+            return cv::COLORMAP_PLASMA;
+        default:
+            return -1;
+    }
+}
+
+} // namespace
+
+ThermalColorizer::ThermalColorizer()
+    : mLut()
+    , mGray()
+    , mGrayBgr()
+    , mHistogram() {
+    SetColorMode(p2pro::ColorMode::kPseudoWhiteHot);
+}
+
+void ThermalColorizer::SetColorMode(p2pro::ColorMode mode) {
+    cv::Mat ramp(1, 256, CV_8UC1);
+    for (int32_t i = 0; i < 256; i++) {
+        ramp.at<uint8_t>(0, i) = static_cast<uint8_t>(mode == p2pro::ColorMode::kPseudoBlackHot ? 255 - i : i);
+    }
+
+    const int32_t map = ToColorMap(mode);
+    if (map < 0) {
+        cv::cvtColor(ramp, mLut, cv::COLOR_GRAY2BGR);
+    } else {
+        cv::applyColorMap(ramp, mLut, map);
+    }
+    return;
+}
+
+void ThermalColorizer::Colorize(const cv::Mat& counts, cv::Mat& output) {
+    // coarse histogram, 16 counts a bin is far finer than 8 bits of output
+    mHistogram.fill(0u);
+    for (int32_t row = 0; row < counts.rows; row++) {
+        const uint16_t* pixel = counts.ptr<uint16_t>(row);
+        for (int32_t col = 0; col < counts.cols; col++) {
+            mHistogram[pixel[col] >> kHistogramShift]++;
+        }
+    }
+
+    const uint32_t clip = static_cast<uint32_t>(counts.total() * kAgcClip);
+    size_t low = 0u;
+    for (uint32_t seen = 0u; low < kHistogramBins - 1u && seen + mHistogram[low] <= clip; low++) {
+        seen += mHistogram[low];
+    }
+    size_t high = kHistogramBins - 1u;
+    for (uint32_t seen = 0u; high > low && seen + mHistogram[high] <= clip; high--) {
+        seen += mHistogram[high];
+    }
+
+    // a flat scene still gets a valid stretch
+    const double lowCount = static_cast<double>(low << kHistogramShift);
+    const double highCount = static_cast<double>(((high + 1u) << kHistogramShift) - 1u);
+    const double scale = 255.0 / std::max(highCount - lowCount, 1.0);
+    counts.convertTo(mGray, CV_8U, scale, -lowCount * scale);
+
+    // every channel of the grey frame looks up the same channel of the palette
+    cv::cvtColor(mGray, mGrayBgr, cv::COLOR_GRAY2BGR);
+    cv::LUT(mGrayBgr, mLut, output);
+    return;
+}
+
+cv::Mat ThermalColorizer::GetThermalPlane(const cv::Mat& raw, size_t imageRows) {
+    const size_t rowBytes = static_cast<size_t>(raw.cols) * raw.elemSize();
+    if (raw.empty() || rowBytes % sizeof(uint16_t) != 0u || static_cast<size_t>(raw.rows) < 2u * imageRows) {
+        return cv::Mat();
+    }
+    uint8_t* plane = const_cast<uint8_t*>(raw.ptr(static_cast<int32_t>(imageRows)));
+    return cv::Mat(static_cast<int32_t>(raw.rows - imageRows), static_cast<int32_t>(rowBytes / sizeof(uint16_t)),
+                   CV_16UC1, plane, raw.step);
+}
+
+} // thermal
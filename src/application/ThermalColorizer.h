@@ -0,0 +1,84 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _THERMAL_COLORIZER_H_
+#define _THERMAL_COLORIZER_H_
+
+#include <stdint.h>
+#include <opencv2/core.hpp>
+
+#include <array>
+#include <cstddef>
+
+#include "P2ProManager.h"
+
+namespace thermal {
+
+/**
+ * @brief Palette and AGC in software, for raw 16 bit thermal frames.
+ *
+ * On the scope the camera colours the picture itself. Raw recordings only
+ * carry the thermal counts, so offline tools run the same two steps here:
+ * a histogram AGC that stretches the counts between the low and high
+ * percentiles to 8 bits, then a palette lookup. The palettes approximate
+ * the camera's with OpenCV colour maps.
+ *
+ * The AGC looks at one frame only, so the result doesn't depend on which
+ * frames came before and frames can be rendered in any order.
+ */
+class ThermalColorizer {
+public:
+    // fraction of pixels clipped at each end of the stretch
+    static constexpr float kAgcClip = 0.005f;
+
+    ThermalColorizer();
+
+    /**
+     * @brief Picks the palette, the lookup table is built here.
+     */
+    void SetColorMode(p2pro::ColorMode mode);
+
+    /**
+     * @brief Stretches and colours a thermal plane.
+     *
+     * @param counts 16 bit thermal counts (CV_16UC1).
+     * @param output receives the BGR frame. Reused between calls.
+     */
+    void Colorize(const cv::Mat& counts, cv::Mat& output);
+
+    /**
+     * @brief The thermal plane of an image-over-thermal raw frame, as a 16
+     *        bit view into it (no copy).
+     *
+     * @param raw the raw frame, e.g. 256x384 YUYV from the P2 Pro.
+     * @param imageRows rows of the image plane on top.
+     * @return an empty Mat if the frame has no thermal plane below the image.
+     */
+    static cv::Mat GetThermalPlane(const cv::Mat& raw, size_t imageRows);
+
+private:
+    static constexpr uint32_t kHistogramShift = 4u;
+    static constexpr size_t kHistogramBins = 65536u >> kHistogramShift;
+
+    cv::Mat mLut;     ///< 256 entry BGR palette
+    cv::Mat mGray;    ///< stretched counts, kept to avoid reallocating
+    cv::Mat mGrayBgr;
+    std::array<uint32_t, kHistogramBins> mHistogram;
+};
+
+} // thermal
+
+#endif // _THERMAL_COLORIZER_H_
@@ -17,26 +17,26 @@
 #include "ThermalScopeApplication.h"
 
 #include <opencv2/opencv.hpp>
+#include <sys/epoll.h>
 
-#include <condition_variable>
-#include <mutex>
 #include <functional>
 #include <algorithm>
-
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <string>
+
+#include "GpioWatcher.h"
 #include "Logger.h"
+#include "Platform.h"
 #include "UsbControl.h"
 #include "Utils.h"
 
 namespace thermal {
 
-constexpr const size_t kP2ProResolutionWidth = 256u;
-constexpr const size_t kP2ProResolutionHeight = 192u;
-constexpr const size_t kLcd1in28Width = 240u;
-constexpr const size_t kLcd1in28Height = 240u;
-constexpr const int32_t kP2ProFrameRate = 25u;
-constexpr const int32_t kP2ProDevId = 0;
-constexpr const int32_t kFrameBufferChannels = 4;
-constexpr const int32_t kExpectedFrameSize = kLcd1in28Width * kLcd1in28Height * kFrameBufferChannels;
+constexpr const size_t kExpectedFrameSize = kDisplayWidth * kDisplayHeight * kDisplayChannels;
 
 constexpr const int32_t kSideEncoderGpioA = 13;
 constexpr const int32_t kSideEncoderGpioB = 19;
@@ -47,63 +47,206 @@ constexpr const int32_t kTopEncoderGpioBtn = 16;
 
 inline constexpr const char* const kFrameBuffer0 = "/dev/fb0";
 
+// frame stats for field debugging, on tmpfs so refreshing costs no flash
+inline constexpr const char* const kStatsDirectory = kRunDirectory;
+constexpr const std::chrono::milliseconds kStatsPeriod(1000);
+
+// Spinning faster than a detent every 60ms starts to accelerate, at a
+// detent every 12ms one detent is worth 8 steps.
+constexpr const hw::AccelerationCurve kEncoderAcceleration = {
+    std::chrono::milliseconds(60), std::chrono::milliseconds(12), 8
+};
+
+// Rotation is collected for this long before it is applied, so a fast spin
+// is one save and one redraw instead of one per detent.
+constexpr const std::chrono::milliseconds kRotationCoalesceTime(16);
+
+// The HUD numbers are for reading by eye, twice a second is plenty.
+constexpr const std::chrono::milliseconds kHudRefreshPeriod(500);
+
+// Holding a button this long does its second job instead of stepping the
+// menu: the side button saves the pre-event buffer, the top one a snapshot.
+constexpr const std::chrono::milliseconds kLongPressTime(1000);
+
+// The pre-event arena is allocated up front, past this it eats the Pi's RAM.
+constexpr const long kMaxPreEventMb = 256;
+
+// Recordings and snapshots are named after the local time they were taken at.
+static std::string MakeTimestampedPath(const char* directory, const char* pattern) {
+    char name[64];
+    const time_t now = time(nullptr);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(name, sizeof(name), pattern, &local);
+    return std::string(directory) + name;
+}
+
 using std::shared_ptr;
 using std::placeholders::_1;
-using std::mutex;
-using std::unique_lock;
+using std::placeholders::_2;
 using std::make_shared;
 using std::make_unique;
-using hw::Direction;
+using Camera = camera::ActiveCamera;
 
 ThermalScopeApplication::ThermalScopeApplication(int32_t argc, char* argv[]) 
-    : mP2ProManager(nullptr)
-    , mFrameBuffer(kFrameBuffer0)
+    : mReactor()
+    , mP2ProManager(nullptr)
+    , mCameraSupervisor(nullptr)
+    , mShutterScheduler(nullptr)
+    , mFrameBuffer(nullptr)
+    , mPipeline()
+    , mDisplayFrame()
+    , mTracer(trace::FrameTracer::Instance())
+    , mStatsExporter(mReactor, mTracer, kStatsDirectory, kStatsPeriod)
+    , mReplayPath()
+    , mReplayFast(false)
+    , mFrameBufferPath()
+    , mLatencyMode(false)
+    , mLatencyTriggerGpio(-1)
+    , mLatencySensorGpio(-1)
+    , mLatencyProbe(nullptr)
+    , mLatencyTrigger(nullptr)
+    , mLatencySensor(nullptr)
     , mSideEncoder(kSideEncoderGpioA, kSideEncoderGpioB, kSideEncoderGpioBtn)
     , mTopEncoder(kTopEncoderGpioA, kTopEncoderGpioB, kTopEncoderGpioBtn)
     , mTopMode(TopMode::kNone)
     , mSideMode(SideMode::kNone)
+    , mRotationFlushPending(false)
+    , mSystemStats()
+    , mHudTimer(0u)
+    , mHudTimerActive(false)
+    , mVideoRecorder()
+    , mRecordingSource(RecordingSource::kDisplay)
+    , mRecordingCodec(camera::FrameCodec::kJpeg)
+    , mPreEventBudget(PreEventBuffer::kDefaultBudget)
+    , mPreEvent(nullptr)
+    , mReplayHoldTimer(0u)
+    , mReplayHoldActive(false)
+    , mSnapshots((Camera::kRawLayout == camera::RawPlaneLayout::kImageOverThermal) ? Camera::kHeight : 0u)
+    , mSnapshotHoldTimer(0u)
+    , mSnapshotHoldActive(false)
     , mColorSetting(p2pro::ColorMode::kPseudoRainbow4, "color")
-    , mReticleSetting(ReticleType::kDefault, "reticle")
-    , mXOffsetSetting(0, "x")
-    , mYOffsetSetting(0, "y")
-    , mZoomSetting(0, "zoom") {}
+    , mHudSetting(false, "hud")
+    , mProfiles("profiles") {
+    ParseArguments(argc, argv);
+}
 
 ThermalScopeApplication::~ThermalScopeApplication() {}
 
 void ThermalScopeApplication::Init() {
-    shared_ptr<p2pro::Webcam> camera = make_shared<p2pro::Webcam>(
-        kP2ProResolutionWidth, kP2ProResolutionHeight, kP2ProFrameRate, kP2ProDevId);
-    shared_ptr<p2pro::UsbControl> control = make_shared<p2pro::UsbControl>();
+    DLOG_NOTICE("camera backend is %s (%ux%u @ %d fps)", Camera::kName, Camera::kWidth, Camera::kHeight, Camera::kFrameRate);
+
+    // A replayed clip has no usb device behind it, the vendor commands go to
+    // a fake transport and the camera is always present.
+    const bool replay = !mReplayPath.empty();
+    shared_ptr<p2pro::Webcam> camera = nullptr;
+    shared_ptr<p2pro::UsbControl> control = nullptr;
+    if (replay) {
+        DLOG_NOTICE("replaying %s instead of the camera", mReplayPath.c_str());
+        camera = make_shared<p2pro::Webcam>(mReplayPath, Camera::kWidth, Camera::kHeight, Camera::kFrameRate);
+        camera->SetReplayPacing(mReplayFast ? p2pro::ReplayPacing::kAsFastAsPossible : p2pro::ReplayPacing::kRealTime);
+        control = make_shared<p2pro::UsbControl>(make_unique<p2pro::FakeUsbTransport>());
+    } else {
+        camera = make_shared<p2pro::Webcam>(Camera::kWidth, Camera::kHeight, Camera::kFrameRate, Camera::kDeviceId);
+        control = make_shared<p2pro::UsbControl>();
+
+        // Take the frames raw when the thermal counts ride along, so
+        // snapshots keep them. The pipeline converts the picture plane, which
+        // costs the same YUYV conversion the capture backend did before. The
+        // latency probe measures the picture, it stays on converted frames.
+        if constexpr (Camera::kRawLayout == camera::RawPlaneLayout::kImageOverThermal) {
+            if (!mLatencyMode) {
+                camera->SetRawCapture(true, Camera::kRawHeight);
+                if (mRecordingSource == RecordingSource::kCamera && mRecordingCodec != camera::FrameCodec::kPng) {
+                    DLOG_NOTICE("camera frames are raw, recording them lossless");
+                    mRecordingCodec = camera::FrameCodec::kPng;
+                }
+            }
+        }
+    }
     mP2ProManager = make_unique<p2pro::P2ProManager>(camera, control);
 
-    // Setup the callbacks
-    camera->RegisterOnDataCallback(std::bind(&ThermalScopeApplication::OnCameraData, this, _1));
+    // Hotplug and the shutter both go through the vendor usb commands. A plain
+    // UVC camera still gets the frame watchdog.
+    std::unique_ptr<p2pro::HotplugTransport> transport = nullptr;
+    if constexpr (Camera::kHasCommandSet) {
+        if (replay) {
+            transport = make_unique<p2pro::FakeHotplugTransport>(true);
+        } else {
+            transport = make_unique<p2pro::LibUsbHotplugTransport>(Camera::kVendorId, Camera::kProductId);
+        }
+        p2pro::ShutterConfig shutterConfig;
+        shutterConfig.sceneRows = static_cast<int32_t>(Camera::kHeight);
+        mShutterScheduler = make_unique<p2pro::ShutterScheduler>(*mP2ProManager, camera, shutterConfig);
+    }
+    mCameraSupervisor = make_unique<p2pro::CameraSupervisor>(*mP2ProManager, camera, std::move(transport));
+
+    // Without the LCD the frames go to a file, the last one can be looked at
+    // with any raw image viewer.
+    if (mFrameBufferPath.empty() && kHostBuild) {
+        mFrameBufferPath = std::string(kRunDirectory) + "/fb0";
+    }
+    if (mFrameBufferPath.empty()) {
+        mFrameBuffer = make_unique<hw::FrameBuffer>(kFrameBuffer0);
+    } else {
+        mFrameBuffer = make_unique<hw::FrameBuffer>(mFrameBufferPath, kExpectedFrameSize);
+    }
+    mTracer.SetFramePeriod(1000000000u / Camera::kFrameRate);
+
+    // Setup the callbacks. Gpio edges are queued by the alert thread and
+    // drained on the reactor, so the encoder callbacks already run on its
+    // thread. The supervisor only posts onto the reactor, all application
+    // state changes on its thread.
+    camera->RegisterOnDataCallback(std::bind(&ThermalScopeApplication::OnCameraData, this, _1, _2));
+    mReactor.AddFd(gpio::GetEventFd(), EPOLLIN, std::bind(&ThermalScopeApplication::OnGpioEvents, this));
+    mSideEncoder.SetAccelerationCurve(kEncoderAcceleration);
+    mTopEncoder.SetAccelerationCurve(kEncoderAcceleration);
     mSideEncoder.SetOnClickCallback(std::bind(&ThermalScopeApplication::OnClickSide, this, _1));
     mSideEncoder.SetOnRotateCallback(std::bind(&ThermalScopeApplication::OnRotateSide, this, _1));
     mTopEncoder.SetOnClickCallback(std::bind(&ThermalScopeApplication::OnClickTop, this, _1));
     mTopEncoder.SetOnRotateCallback(std::bind(&ThermalScopeApplication::OnRotateTop, this, _1));
+    mCameraSupervisor->SetOnSignalLostCallback([this]() {
+        mReactor.Post(std::bind(&ThermalScopeApplication::OnCameraSignalLost, this));
+    });
+    mCameraSupervisor->SetOnRecoveredCallback([this]() {
+        mReactor.Post(std::bind(&ThermalScopeApplication::OnCameraRecovered, this));
+    });
+
+    if (mLatencyMode) {
+        StartLatencyMode();
+    }
+    mStatsExporter.AddSection([this]() { return mVideoRecorder.Report(); });
+    if (mPreEventBudget > 0u) {
+        mPreEvent = make_unique<PreEventBuffer>(mPreEventBudget, PreEventBuffer::kDefaultMaxAge);
+        mStatsExporter.AddSection([this]() { return mPreEvent->Report(); });
+    }
+    mStatsExporter.AddSection([this]() { return mSnapshots.Report(); });
 
     // Load settings from filesystem
     mColorSetting.Load();
-    mXOffsetSetting.Load();
-    mYOffsetSetting.Load();
-    mZoomSetting.Load();
-
-    // Initialize offset with the saved settings
-    mOverlay.SetOffset(mXOffsetSetting, mYOffsetSetting);
-
-    // todo
-    // mP2ProManager->CommandMode();
-    // p2pro::ColorMode currentColorModeSetOnDevice = mP2ProManager->GetCurrentActiveColorMode();
-    // if (mColorSetting != currentColorModeSetOnDevice) {
-    //     if (!mP2ProManager->SetPseudoColor(mColorSetting)) {
-    //         DLOG_ERROR("failed setting pseudo color");
-    //     }
-    // }
+    mHudSetting.Load();
+    LoadProfiles();
 
-    //DLOG_INFO("color setting is %s", p2pro::ColorToString(mColorSetting.Get()).c_str() );
+    // Read back what the camera is currently configured with. The set-commands
+    // compare against this and skip the usb mode switch when nothing changes.
+    if constexpr (Camera::kHasCommandSet) {
+        if (!mP2ProManager->RefreshDeviceState()) {
+            DLOG_WARN("could not query device state, settings will be re-sent");
+        }
 
-    mP2ProManager->SetPseudoColor(p2pro::ColorMode::kPseudoBlackHot);
+        DLOG_INFO("color setting is %s", p2pro::ColorToString(mColorSetting));
+        mOverlay.SetColorMode(mColorSetting);
+        if (!mP2ProManager->SetPseudoColor(mColorSetting)) {
+            DLOG_ERROR("failed setting pseudo color");
+        }
+
+        // The shutter scheduler takes over flat-field correction. Switching
+        // the camera's own timer off here, before the stream starts, saves
+        // its Start() a stream restart.
+        if (mShutterScheduler != nullptr && !mP2ProManager->SetAutoShutter(false)) {
+            DLOG_WARN("could not disable auto shutter");
+        }
+    }
 }
 
 void ThermalScopeApplication::Run() {
@@ -112,15 +255,56 @@ void ThermalScopeApplication::Run() {
         return;
     }
 
-	if (mP2ProManager->StartVideoStream()) {
-		// block here and let the app run
-		mutex mtx;
-		std::condition_variable cv;
-		unique_lock<mutex> lk(mtx);
-		cv.wait(lk);
-	} else {
+    if (!mP2ProManager->StartVideoStream()) {
         DLOG_ERROR("P2 Pro failed to start");
-	}
+        return;
+    }
+
+    mCameraSupervisor->Start();
+    if (mShutterScheduler != nullptr) {
+        mShutterScheduler->Start();
+    }
+    mStatsExporter.Start();
+    if (mPreEvent != nullptr) {
+        mPreEvent->Start();
+    }
+    mSnapshots.Start();
+    SetHudEnabled(mHudSetting);
+
+    // block here and let the app run until SIGINT/SIGTERM
+    mReactor.Run();
+
+    DLOG_NOTICE("shutting down");
+    mStatsExporter.Stop();
+    SetHudEnabled(false);
+    SetRecording(false);
+    if (mReplayHoldActive) {
+        mReactor.CancelTimer(mReplayHoldTimer);
+        mReplayHoldActive = false;
+    }
+    if (mPreEvent != nullptr) {
+        mPreEvent->Stop();
+    }
+    if (mSnapshotHoldActive) {
+        mReactor.CancelTimer(mSnapshotHoldTimer);
+        mSnapshotHoldActive = false;
+    }
+    mSnapshots.Stop();
+    if (mLatencyProbe != nullptr) {
+        DLOG_NOTICE("latency:%s", mLatencyProbe->Report().c_str());
+    }
+    mCameraSupervisor->Stop();
+    if (mShutterScheduler != nullptr) {
+        // take the stream down first, restoring the camera's auto shutter is
+        // then a plain command instead of a stream restart
+        mP2ProManager->CommandMode();
+        mShutterScheduler->Stop();
+    }
+    mP2ProManager->ReleaseDevice();
+
+    if (gpio::GetDroppedEvents() > 0u) {
+        DLOG_WARN("dropped %llu gpio events", static_cast<unsigned long long>(gpio::GetDroppedEvents()));
+    }
 }
 
 bool ThermalScopeApplication::OnCameraData(cv::Mat &frame, bool lastFrame) {
@@ -128,25 +312,39 @@ bool ThermalScopeApplication::OnCameraData(cv::Mat &frame, bool lastFrame) {
         
     }
 
-    size_t width = frame.cols;
-    size_t height = frame.rows;
-
-    // Resize the image to the size of the LCD screen 240x240
-    cv::Mat resized;
-    cv::resize(frame, resized, cv::Size(240, 240));
-    cv::rotate(resized, resized, cv::ROTATE_90_COUNTERCLOCKWISE);
+    if (mLatencyProbe != nullptr) {
+        mLatencyProbe->OnFrame(frame);
+    }
+    if (mRecordingSource == RecordingSource::kCamera) {
+        mVideoRecorder.Submit(frame, mTracer.GetCaptureTime());
+    }
+    mSnapshots.Submit(frame, mTracer.GetCaptureTime());
 
-    // Convert the resized image to 32 bpp (8 bits each for R, G, B, and transparency)
-    cv::Mat formatted;
-    cv::cvtColor(resized, formatted, cv::COLOR_BGR2RGBA);
+    // Resize to the 240x240 LCD, rotate and convert to 32 bpp (8 bits each
+    // for R, G, B, and transparency). The kernel is specialised for the
+    // camera backend's geometry.
+    if (!mPipeline.Process(frame, mDisplayFrame)) {
+        return false;
+    }
 
     // Apply the overlay. 
-    mOverlay.Overlay(formatted);
+    mOverlay.Overlay(mDisplayFrame);
+    mTracer.Mark(trace::Stage::kOverlay);
 
     // Write frame to /dev/fb0 (this is where the image gets displayed)
-    size_t dataSize = formatted.rows * formatted.cols * formatted.channels();
+    size_t dataSize = mDisplayFrame.rows * mDisplayFrame.cols * mDisplayFrame.channels();
     if (dataSize == kExpectedFrameSize) {
-        mFrameBuffer.Write(formatted.data, dataSize);
+        mFrameBuffer->Write(mDisplayFrame.data, dataSize);
+        mTracer.Mark(trace::Stage::kPresent);
+        if (mLatencyProbe != nullptr) {
+            mLatencyProbe->OnPresented();
+        }
+        if (mRecordingSource == RecordingSource::kDisplay) {
+            mVideoRecorder.Submit(mDisplayFrame, mTracer.GetCaptureTime());
+        }
+        if (mPreEvent != nullptr) {
+            mPreEvent->Submit(mDisplayFrame, mTracer.GetCaptureTime());
+        }
         return true;
     } else {
         DLOG_WARN("unexpected data size %u, should be %u", dataSize, kExpectedFrameSize);
@@ -154,25 +352,257 @@ bool ThermalScopeApplication::OnCameraData(cv::Mat &frame, bool lastFrame) {
     }
 }
 
-void ThermalScopeApplication::OnRotateSide(Direction direction) {
-    // incrememnt is +1 and decrememnt is -1
-    int32_t adjustment = (direction == hw::Direction::kIncrement) ? +1 : -1;
+void ThermalScopeApplication::ParseArguments(int32_t argc, char* argv[]) {
+    for (int32_t i = 1; i < argc; i++) {
+        const std::string arg(argv[i]);
+        if (arg.rfind("--replay=", 0) == 0) {
+            mReplayPath = arg.substr(std::strlen("--replay="));
+        } else if (arg == "--replay-fast") {
+            mReplayFast = true;
+        } else if (arg == "--record-camera") {
+            mRecordingSource = RecordingSource::kCamera;
+        } else if (arg == "--record-lossless") {
+            mRecordingCodec = camera::FrameCodec::kPng;
+        } else if (arg.rfind("--pre-event-mb=", 0) == 0) {
+            const char* value = arg.c_str() + std::strlen("--pre-event-mb=");
+            char* end = nullptr;
+            long mb = std::strtol(value, &end, 10);
+            if (end == value || *end != '\0' || mb < 0) {
+                DLOG_WARN("ignoring %s, expected a size in MB, 0 turns it off", argv[i]);
+                continue;
+            }
+            if (mb > kMaxPreEventMb) {
+                DLOG_WARN("pre-event buffer of %ld MB clamped to %ld MB", mb, kMaxPreEventMb);
+                mb = kMaxPreEventMb;
+            }
+            mPreEventBudget = static_cast<size_t>(mb) * 1024u * 1024u;
+        } else if (arg.rfind("--framebuffer=", 0) == 0) {
+            mFrameBufferPath = arg.substr(std::strlen("--framebuffer="));
+        } else if (arg == "--latency") {
+            mLatencyMode = true;
+        } else if (arg.rfind("--latency-trigger=", 0) == 0) {
+            mLatencyMode = true;
+            mLatencyTriggerGpio = std::atoi(arg.c_str() + std::strlen("--latency-trigger="));
+        } else if (arg.rfind("--latency-sensor=", 0) == 0) {
+            mLatencyMode = true;
+            mLatencySensorGpio = std::atoi(arg.c_str() + std::strlen("--latency-sensor="));
+        } else {
+            DLOG_WARN("ignoring unknown argument %s", argv[i]);
+        }
+    }
+}
+
+void ThermalScopeApplication::StartLatencyMode() {
+    DLOG_NOTICE("latency mode, trigger gpio %d, sensor gpio %d", mLatencyTriggerGpio, mLatencySensorGpio);
+    mLatencyProbe = make_unique<LatencyProbe>(mTracer, mLatencySensorGpio >= 0);
+    mStatsExporter.AddSection([this]() { return mLatencyProbe->Report(); });
+
+    // the rig drives both lines, rising edges only
+    if (mLatencyTriggerGpio >= 0) {
+        mLatencyTrigger = make_unique<gpio::Watcher>(mLatencyTriggerGpio, LG_SET_PULL_NONE);
+        mLatencyTrigger->RegisterOnChangeCallback([this](const gpio::EdgeEvent& event) {
+            if (event.level) {
+                mLatencyProbe->Trigger(event.timestamp);
+            }
+        });
+    }
+    if (mLatencySensorGpio >= 0) {
+        mLatencySensor = make_unique<gpio::Watcher>(mLatencySensorGpio, LG_SET_PULL_NONE);
+        mLatencySensor->RegisterOnChangeCallback([this](const gpio::EdgeEvent& event) {
+            if (event.level) {
+                mLatencyProbe->Observe(event.timestamp);
+            }
+        });
+    }
+}
+
+void ThermalScopeApplication::OnCameraSignalLost() {
+    cv::Mat frame;
+    mOverlay.RenderNoSignal(frame);
+    mFrameBuffer->Write(frame.data, frame.rows * frame.cols * frame.channels());
+}
+
+void ThermalScopeApplication::OnCameraRecovered() {
+    // the camera powers up with its default palette and auto shutter
+    if constexpr (Camera::kHasCommandSet) {
+        if (!mP2ProManager->SetPseudoColor(mColorSetting)) {
+            DLOG_ERROR("failed restoring pseudo color");
+        }
+        if (!mP2ProManager->SetAutoShutter(false)) {
+            DLOG_ERROR("failed disabling auto shutter");
+        }
+    }
+}
+
+void ThermalScopeApplication::LoadProfiles() {
+    if (!mProfiles.Load()) {
+        // First start with profiles, the old single zero becomes the first one
+        persistent::Value<int32_t, ReticleType> reticle(ReticleType::kDefault, "reticle");
+        persistent::Value<int32_t> x(0, "x");
+        persistent::Value<int32_t> y(0, "y");
+        persistent::Value<uint32_t> zoom(0, "zoom");
+        reticle.Load();
+        x.Load();
+        y.Load();
+        zoom.Load();
+
+        Profile& first = mProfiles.At(0u);
+        first.x = std::clamp<int32_t>(x, kMinOffset, kMaxOffset);
+        first.y = std::clamp<int32_t>(y, kMinOffset, kMaxOffset);
+        first.zoom = std::min<uint32_t>(zoom, kMaxZoom);
+        first.reticle = reticle;
+        mProfiles.Save();
+    }
+
+    // Everything a switch needs is built now, at startup, so switching
+    // later is only a pointer swap in the pipeline and a cached redraw.
+    for (size_t i = 0u; i < kProfileCount; i++) {
+        const Profile& profile = mProfiles.At(i);
+        mPipeline.Prepare(profile.zoom, profile.x, profile.y);
+        mOverlay.PreloadReticle(profile.reticle);
+    }
+    ApplyProfile();
+}
+
+void ThermalScopeApplication::ApplyProfile() {
+    const Profile& profile = mProfiles.Active();
+    DLOG_INFO("profile %s: offset (%d,%d) zoom %u reticle %s", profile.name.c_str(),
+        profile.x, profile.y, profile.zoom, ReticleTypeToStr(profile.reticle));
+    mPipeline.SetView(profile.zoom, profile.x, profile.y);
+    mOverlay.SetProfile(profile);
+}
+
+void ThermalScopeApplication::SetHudEnabled(bool enabled) {
+    if (enabled && !mHudTimerActive) {
+        // fill the tile before it is first shown, the first cpu sample only
+        // sets the baseline
+        mSystemStats.SampleCpuLoad();
+        RefreshHud();
+        mHudTimer = mReactor.AddTimer(kHudRefreshPeriod, std::bind(&ThermalScopeApplication::RefreshHud, this), kHudRefreshPeriod);
+        mHudTimerActive = true;
+    } else if (!enabled && mHudTimerActive) {
+        mReactor.CancelTimer(mHudTimer);
+        mHudTimerActive = false;
+    }
+    mOverlay.SetHudEnabled(enabled);
+}
+
+void ThermalScopeApplication::RefreshHud() {
+    // mean capture to present over the last few frames, smoother to read
+    // than a single frame and cheaper than the histogram percentiles
+    std::array<trace::FrameRecord, 16> records;
+    const size_t count = mTracer.GetRecent(records.data(), records.size());
+    uint64_t latencySum = 0u;
+    size_t latencyCount = 0u;
+    for (size_t i = 0u; i < count; i++) {
+        const trace::FrameRecord& record = records[i];
+        const uint64_t presented = record.end[static_cast<size_t>(trace::Stage::kPresent)];
+        if (record.presented && record.capture != 0u && presented > record.capture) {
+            latencySum += presented - record.capture;
+            latencyCount++;
+        }
+    }
+
+    HudStats stats;
+    stats.fps = mTracer.GetFps();
+    stats.latencyMs = (latencyCount > 0u) ? (latencySum / 1e6) / latencyCount : 0.0;
+    stats.dropped = mTracer.GetDropped();
+    stats.cpuLoad = mSystemStats.SampleCpuLoad();
+    stats.socTemp = mSystemStats.ReadSocTemperature();
+    mOverlay.UpdateHud(stats);
+}
+
+void ThermalScopeApplication::SetRecording(bool recording) {
+    if (recording && !mVideoRecorder.IsRecording()) {
+        std::error_code error;
+        std::filesystem::create_directories(kRecordingDirectory, error);
+        if (!mVideoRecorder.Start(MakeTimestampedPath(kRecordingDirectory, "rec-%Y%m%d-%H%M%S.tsc"), mRecordingCodec)) {
+            DLOG_ERROR("could not start recording in %s", kRecordingDirectory);
+        }
+    } else if (!recording) {
+        mVideoRecorder.Stop();
+    }
+    mOverlay.SetRecording(mVideoRecorder.IsRecording());
+}
+
+void ThermalScopeApplication::SaveReplay() {
+    if (mPreEvent == nullptr) {
+        return;
+    }
+
+    // The save runs on its own thread, capture carries on meanwhile.
+    std::error_code error;
+    std::filesystem::create_directories(kRecordingDirectory, error);
+    const std::string path = MakeTimestampedPath(kRecordingDirectory, "replay-%Y%m%d-%H%M%S.tsc");
+    if (mPreEvent->Save(path)) {
+        DLOG_NOTICE("saving the last %.1f s to %s", mPreEvent->GetSeconds(), path.c_str());
+    } else {
+        DLOG_WARN("replay not saved, a save is running or nothing is buffered");
+    }
+}
+
+void ThermalScopeApplication::TakeSnapshot() {
+    const Profile& profile = mProfiles.Active();
+    SnapshotInfo info;
+    info.path = MakeTimestampedPath(kSnapshotDirectory, "snap-%Y%m%d-%H%M%S");
+    info.palette = mColorSetting;
+    info.profile = profile.name;
+    info.x = profile.x;
+    info.y = profile.y;
+    info.zoom = profile.zoom;
+    info.reticle = profile.reticle;
+    info.reticleX = static_cast<int32_t>(kDisplayWidth / 2u) + profile.x;
+    info.reticleY = static_cast<int32_t>(kDisplayHeight / 2u) + profile.y;
+
+    // the next frame is taken on the camera thread and written in the background
+    std::error_code error;
+    std::filesystem::create_directories(kSnapshotDirectory, error);
+    if (!mSnapshots.Request(info)) {
+        DLOG_WARN("snapshot not taken, the last one is still waiting for a frame");
+    }
+}
+
+void ThermalScopeApplication::OnGpioEvents() {
+    gpio::DispatchEvents();
+
+    // the encoders have collected the edges, deliver them once the burst
+    // has had a chance to finish
+    if (mRotationFlushPending) {
+        return;
+    }
+    if (mSideEncoder.HasPendingRotation() || mTopEncoder.HasPendingRotation()) {
+        mRotationFlushPending = true;
+        mReactor.AddTimer(kRotationCoalesceTime, [this]() {
+            mRotationFlushPending = false;
+            mSideEncoder.Flush();
+            mTopEncoder.Flush();
+        });
+    }
+}
+
+void ThermalScopeApplication::OnRotateSide(const hw::Rotation& rotation) {
+    if (mShutterScheduler != nullptr) {
+        mShutterScheduler->NotifyUserInput();
+    }
+
+    // accelerated steps, positive is increment
+    int32_t adjustment = rotation.delta;
+    Profile& profile = mProfiles.Active();
     
     switch (mSideMode) {
     case SideMode::kYOffset: {
-        constexpr const int32_t kMin = -50;
-        constexpr const int32_t kMax = 50;
-        mYOffsetSetting = std::clamp(mYOffsetSetting + adjustment, kMin, kMax);
-        mYOffsetSetting.Save();
-        mOverlay.SetY(mYOffsetSetting);
+        profile.y = std::clamp(profile.y + adjustment, kMinOffset, kMaxOffset);
+        mProfiles.Save();
+        mOverlay.SetY(profile.y);
+        mPipeline.SetView(profile.zoom, profile.x, profile.y);
     } break;
     
     case SideMode::kZoom: {
-        constexpr const uint32_t kMin = 0u;
-        constexpr const uint32_t kMax = 100u;
-        mZoomSetting = std::clamp(mZoomSetting + adjustment, kMin, kMax);
-        mZoomSetting.Save();
-        mOverlay.SetZoom(mZoomSetting);
+        // signed math so turning down at 0 doesn't wrap around
+        profile.zoom = static_cast<uint32_t>(std::clamp(static_cast<int32_t>(profile.zoom) + adjustment, 0, static_cast<int32_t>(kMaxZoom)));
+        mProfiles.Save();
+        mOverlay.SetZoom(profile.zoom);
+        mPipeline.SetView(profile.zoom, profile.x, profile.y);
     } break;
 
     case SideMode::kNone:
@@ -181,30 +611,58 @@ void ThermalScopeApplication::OnRotateSide(Direction direction) {
     }
 }
 
-void ThermalScopeApplication::OnRotateTop(hw::Direction direction) {
-    // incrememnt is +1 and decrememnt is -1
-    int32_t adjustment = (direction == hw::Direction::kIncrement) ? +1 : -1;
+void ThermalScopeApplication::OnRotateTop(const hw::Rotation& rotation) {
+    if (mShutterScheduler != nullptr) {
+        mShutterScheduler->NotifyUserInput();
+    }
+
+    // offsets use the accelerated steps, the pickers go one entry per detent
+    int32_t adjustment = rotation.detents;
+    Profile& profile = mProfiles.Active();
     
     switch (mTopMode) {
     case TopMode::kXOffset: {
-        constexpr const int32_t kMin = -50;
-        constexpr const int32_t kMax = 50;
-        mXOffsetSetting = std::clamp(mXOffsetSetting + adjustment, kMin, kMax);
-        mXOffsetSetting.Save();
-        mOverlay.SetX(mXOffsetSetting);
+        profile.x = std::clamp(profile.x + rotation.delta, kMinOffset, kMaxOffset);
+        mProfiles.Save();
+        mOverlay.SetX(profile.x);
+        mPipeline.SetView(profile.zoom, profile.x, profile.y);
     } break;
 
     case TopMode::kPickReticle: {
-        mReticleSetting = utils::RotateEnum<ReticleType>(mReticleSetting, static_cast<int32_t>(ReticleType::kCount), adjustment);
-        mReticleSetting.Save();
-        mOverlay.SetReticleType(mReticleSetting);
+        profile.reticle = utils::RotateEnum<ReticleType>(profile.reticle, static_cast<int32_t>(ReticleType::kCount), adjustment);
+        mProfiles.Save();
+        mOverlay.SetReticleType(profile.reticle);
+    } break;
+
+    case TopMode::kPickProfile: {
+        size_t index = static_cast<size_t>(utils::RotateEnum<int32_t>(static_cast<int32_t>(mProfiles.ActiveIndex()), static_cast<int32_t>(kProfileCount), adjustment));
+        mProfiles.Select(index);
+        mProfiles.Save();
+        ApplyProfile();
     } break;
   
     case TopMode::kPickColor: {
         mColorSetting = utils::RotateEnum<p2pro::ColorMode>(mColorSetting, static_cast<int32_t>(p2pro::ColorMode::kCount), adjustment);
         mColorSetting.Save();
         mOverlay.SetColorMode(mColorSetting);
-        mP2ProManager->SetPseudoColor(mColorSetting);
+        if constexpr (Camera::kHasCommandSet) {
+            mP2ProManager->SetPseudoColor(mColorSetting);
+        }
+    } break;
+
+    case TopMode::kHud: {
+        // a two entry picker, every other detent lands back where it started
+        if (adjustment % 2 != 0) {
+            mHudSetting = !mHudSetting;
+            mHudSetting.Save();
+            SetHudEnabled(mHudSetting);
+        }
+    } break;
+
+    case TopMode::kRecord: {
+        if (adjustment % 2 != 0) {
+            SetRecording(!mVideoRecorder.IsRecording());
+        }
     } break;
 
     case TopMode::kNone:
@@ -214,20 +672,57 @@ void ThermalScopeApplication::OnRotateTop(hw::Direction direction) {
 }
 
 void ThermalScopeApplication::OnClickSide(bool level) {
+    if (mShutterScheduler != nullptr) {
+        mShutterScheduler->NotifyUserInput();
+    }
+
     if (level == false) {
         auto old = mSideMode;
         mSideMode = utils::RotateEnum<SideMode>(mSideMode, static_cast<int32_t>(SideMode::kCount));
         DLOG_DEBUG("%s -> %s", SideModeToString(old), SideModeToString(mSideMode));
         mOverlay.SetSideMenuMode(mSideMode);
+
+        // The encoder only reports the level, a long press is timed here.
+        // When it turns out to be one the menu step is taken back.
+        if (mPreEvent != nullptr && !mReplayHoldActive) {
+            mReplayHoldActive = true;
+            mReplayHoldTimer = mReactor.AddTimer(kLongPressTime, [this, old]() {
+                mReplayHoldActive = false;
+                mSideMode = old;
+                mOverlay.SetSideMenuMode(mSideMode);
+                SaveReplay();
+            });
+        }
+    } else if (mReplayHoldActive) {
+        mReactor.CancelTimer(mReplayHoldTimer);
+        mReplayHoldActive = false;
     }
 }
 
 void ThermalScopeApplication::OnClickTop(bool level) {
+    if (mShutterScheduler != nullptr) {
+        mShutterScheduler->NotifyUserInput();
+    }
+
     if  (level == false) {
         auto old = mTopMode;
         mTopMode = utils::RotateEnum<TopMode>(mTopMode, static_cast<int32_t>(TopMode::kCount));
         DLOG_DEBUG("%s -> %s", TopModeToString(old), TopModeToString(mTopMode));
         mOverlay.SetTopMenuMode(mTopMode);
+
+        // timed like the side button, a long press takes a snapshot
+        if (!mSnapshotHoldActive) {
+            mSnapshotHoldActive = true;
+            mSnapshotHoldTimer = mReactor.AddTimer(kLongPressTime, [this, old]() {
+                mSnapshotHoldActive = false;
+                mTopMode = old;
+                mOverlay.SetTopMenuMode(mTopMode);
+                TakeSnapshot();
+            });
+        }
+    } else if (mSnapshotHoldActive) {
+        mReactor.CancelTimer(mSnapshotHoldTimer);
+        mSnapshotHoldActive = false;
     }
 }
     
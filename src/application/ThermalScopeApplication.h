@@ -21,14 +21,29 @@
 #include <opencv2/videoio.hpp>
 
 #include <memory>
+#include <string>
 
+#include "CameraBackend.h"
+#include "CameraSupervisor.h"
 #include "CommonDefs.h"
 #include "FrameBuffer.h"
+#include "FramePipeline.h"
+#include "FrameTrace.h"
+#include "GpioWatcher.h"
+#include "LatencyProbe.h"
 #include "PersistentValue.h"
 #include "P2ProManager.h"
+#include "PreEventBuffer.h"
+#include "Profile.h"
+#include "Reactor.h"
 #include "Reticle.h"
+#include "SnapshotWriter.h"
+#include "ShutterScheduler.h"
+#include "StatsExporter.h"
+#include "SystemStats.h"
 #include "UsbControl.h"
 #include "VideoOverlay.h"
+#include "VideoRecorder.h"
 #include "Webcam.h"
 
 namespace thermal {
@@ -42,24 +57,78 @@ public:
     void Run();
 
 private:
+    friend class FrameBench; ///< drives OnCameraData() without a camera
+
+    utils::Reactor mReactor; ///< First so its signal mask is inherited by every other thread
     std::unique_ptr<p2pro::P2ProManager> mP2ProManager;
-    hw::FrameBuffer mFrameBuffer;
+    std::unique_ptr<p2pro::CameraSupervisor> mCameraSupervisor;
+    std::unique_ptr<p2pro::ShutterScheduler> mShutterScheduler;
+    std::unique_ptr<hw::FrameBuffer> mFrameBuffer; ///< mapped in Init()
+    FramePipeline<camera::ActiveCamera> mPipeline;
+    cv::Mat mDisplayFrame;
+    trace::FrameTracer& mTracer;
+    trace::StatsExporter mStatsExporter;
+
+    // stand-ins for the camera and LCD, see ParseArguments()
+    std::string mReplayPath;
+    bool mReplayFast;
+    std::string mFrameBufferPath;
+
+    // latency test mode, see LatencyProbe, off unless asked for
+    bool mLatencyMode;
+    int32_t mLatencyTriggerGpio;
+    int32_t mLatencySensorGpio;
+    std::unique_ptr<LatencyProbe> mLatencyProbe;
+    std::unique_ptr<gpio::Watcher> mLatencyTrigger;
+    std::unique_ptr<gpio::Watcher> mLatencySensor;
     hw::Encoder mSideEncoder;
     hw::Encoder mTopEncoder;
     VideoOverlay mOverlay;
     TopMode mTopMode;
     SideMode mSideMode;
+    bool mRotationFlushPending;
+
+    // performance HUD, sampled on the reactor while it is shown
+    utils::SystemStats mSystemStats;
+    utils::TimerId mHudTimer;
+    bool mHudTimerActive;
+
+    // video recording to the card, toggled from the top menu
+    VideoRecorder mVideoRecorder;
+    RecordingSource mRecordingSource;
+    camera::FrameCodec mRecordingCodec;
+
+    // the last seconds of video in memory, saved by holding the side button
+    size_t mPreEventBudget; ///< bytes, 0 turns it off
+    std::unique_ptr<PreEventBuffer> mPreEvent;
+    utils::TimerId mReplayHoldTimer;
+    bool mReplayHoldActive;
+
+    // stills with the thermal counts, taken by holding the top button
+    SnapshotWriter mSnapshots;
+    utils::TimerId mSnapshotHoldTimer;
+    bool mSnapshotHoldActive;
 
     // persistent settings
     persistent::Value<int32_t, p2pro::ColorMode> mColorSetting;
-    persistent::Value<int32_t, ReticleType> mReticleSetting;
-    persistent::Value<int32_t> mXOffsetSetting;
-    persistent::Value<int32_t> mYOffsetSetting;
-    persistent::Value<uint32_t> mZoomSetting;
+    persistent::Value<bool> mHudSetting;
+    ProfileSet mProfiles; ///< zero, zoom and reticle per rifle
 
+    void ParseArguments(int32_t argc, char* argv[]);
+    void StartLatencyMode();
     bool OnCameraData(cv::Mat& frame, bool lastFrame);
-    void OnRotateSide(hw::Direction direction);
-    void OnRotateTop(hw::Direction direction);
+    void OnCameraSignalLost();
+    void OnCameraRecovered();
+    void LoadProfiles();
+    void ApplyProfile();
+    void SetHudEnabled(bool enabled);
+    void RefreshHud();
+    void SetRecording(bool recording);
+    void SaveReplay();
+    void TakeSnapshot();
+    void OnGpioEvents();
+    void OnRotateSide(const hw::Rotation& rotation);
+    void OnRotateTop(const hw::Rotation& rotation);
     void OnClickSide(bool level);
     void OnClickTop(bool level);
 };
@@ -18,32 +18,47 @@
 
 #include <opencv2/opencv.hpp>
 
+#include <cmath>
+#include <cstdio>
 #include <unordered_map>
 
 #include "Reticle.h"
 #include "Logger.h"
+#include "Platform.h"
 
 namespace thermal {
 
  const std::unordered_map<ReticleType, std::string> kReticlePaths = {
-    { ReticleType::kDefault, "/etc/thermal-scope/reticles/default.png"},
-    { ReticleType::kCross, "/etc/thermal-scope/reticles/cross.png"},
-    { ReticleType::kChevron, "/etc/thermal-scope/reticles/chevron.png"},
-    { ReticleType::kSmall, "/etc/thermal-scope/reticles/small.png"},
-    { ReticleType::kDot, "/etc/thermal-scope/reticles/dot.png"},
-    { ReticleType::kEotech, "/etc/thermal-scope/reticles/eotech.png"},
+    { ReticleType::kDefault, std::string(kReticleDirectory) + "default.png"},
+    { ReticleType::kCross, std::string(kReticleDirectory) + "cross.png"},
+    { ReticleType::kChevron, std::string(kReticleDirectory) + "chevron.png"},
+    { ReticleType::kSmall, std::string(kReticleDirectory) + "small.png"},
+    { ReticleType::kDot, std::string(kReticleDirectory) + "dot.png"},
+    { ReticleType::kEotech, std::string(kReticleDirectory) + "eotech.png"},
 };
 
 constexpr int32_t kThickness = 2;
 constexpr int32_t kFontFace = cv::FONT_HERSHEY_SIMPLEX;
 
+// HUD tile, two lines of small text across the lower part of the round LCD
+constexpr int32_t kHudTop = 180;
+constexpr int32_t kHudHeight = 36;
+constexpr double kHudTextSize = 0.35;
+constexpr int32_t kHudThickness = 1;
+
 
 VideoOverlay::VideoOverlay() 
     : mReticle(kReticlePaths.at(ReticleType::kDefault))
-    , mFinalOverlay()
+    , mSnapshots()
+    , mHudSnapshots()
+    , mHudEnabled(false)
+    , mHudText()
     , mTopMsg{{TopMode::kXOffset, ""},
               {TopMode::kPickColor, ""},
-              {TopMode::kPickReticle, ""}}
+              {TopMode::kPickReticle, ""},
+              {TopMode::kPickProfile, ""},
+              {TopMode::kHud, "Off"},
+              {TopMode::kRecord, "Off"}}
     , mSideMsg{{SideMode::kYOffset, ""},
                {SideMode::kZoom, ""}}
     , mTopMode(TopMode::kNone)
@@ -58,29 +73,49 @@ VideoOverlay::~VideoOverlay() {
 }
 
 void VideoOverlay::Overlay(cv::Mat& frame) const {
+    // Pin the latest snapshot for the whole frame, Redraw() builds the next
+    // one in another slot so this never sees a half drawn reticle.
+    auto snapshot = mSnapshots.Acquire();
+    if (!snapshot) {
+        return;
+    }
 
-    if (frame.size() != mFinalOverlay.size()) {
+    const cv::Mat& finalOverlay = *snapshot;
+    if (frame.size() != finalOverlay.size()) {
         DLOG_ERROR("Frame size does not match reticle size.");
+        return;
     }
 
     // Blend the reticle with the frame
-    for (int y = 0; y < frame.rows; ++y) {
-        for (int x = 0; x < frame.cols; ++x) {
-            cv::Vec4b& framePixel = frame.at<cv::Vec4b>(y, x);
-            const cv::Vec4b& reticlePixel = mFinalOverlay.at<cv::Vec4b>(y, x);
-
-            // Blend only if the reticle pixel is not fully transparent
-            if (reticlePixel[3] > 0) {
-                float alpha = reticlePixel[3] / 255.0f;
-                for (int c = 0; c < 3; ++c) {
-                    framePixel[c] = framePixel[c] * (1 - alpha) + reticlePixel[c] * alpha;
-                }
-            }
+    Blend(frame, finalOverlay, 0);
+
+    // The HUD is its own small tile, so it costs a blend of a strip of the
+    // frame rather than a full redraw when its numbers change.
+    if (mHudEnabled.load(std::memory_order_relaxed)) {
+        auto hud = mHudSnapshots.Acquire();
+        if (hud) {
+            Blend(frame, *hud, kHudTop);
         }
     }
     return;
 }
 
+void VideoOverlay::RenderNoSignal(cv::Mat& frame) const {
+    // Same 240x240 RGBA layout as a camera frame so it can go straight to the
+    // framebuffer, with the reticle still drawn on top.
+    frame.create(cv::Size(kDisplayWidth, kDisplayHeight), CV_8UC4);
+    frame.setTo(cv::Scalar(0, 0, 0, 255));
+
+    std::string text = "NO SIGNAL";
+    int baseline = 0;
+    cv::Size textSize = cv::getTextSize(text, kFontFace, 0.6, kThickness, &baseline);
+    cv::Point textOrg((frame.cols - textSize.width) / 2, frame.rows - 60);
+    cv::putText(frame, text, textOrg, kFontFace, 0.6, cv::Scalar(255, 255, 255, 255), kThickness);
+
+    Overlay(frame);
+    return;
+}
+
 void VideoOverlay::SetOffset(int32_t x, int32_t y) {
     mReticle.SetOffset(x, y);
     Redraw();
@@ -120,6 +155,30 @@ void VideoOverlay::SetColorMode(p2pro::ColorMode pseudocolor) {
     return;
 }
 
+void VideoOverlay::SetProfile(const Profile& profile) {
+    DLOG_DEBUG("switching to profile %s", profile.name.c_str());
+
+    // everything a profile changes, with a single redraw
+    if (kReticlePaths.contains(profile.reticle)) {
+        mReticle.SetImagePath(kReticlePaths.at(profile.reticle));
+    }
+    mReticle.SetOffset(profile.x, profile.y);
+    mTopMsg[TopMode::kXOffset] = std::to_string(profile.x);
+    mTopMsg[TopMode::kPickReticle] = std::string(ReticleTypeToStr(profile.reticle));
+    mTopMsg[TopMode::kPickProfile] = profile.name;
+    mSideMsg[SideMode::kYOffset] = std::to_string(profile.y);
+    mSideMsg[SideMode::kZoom] = std::to_string(profile.zoom);
+    Redraw();
+    return;
+}
+
+void VideoOverlay::PreloadReticle(ReticleType reticleType) {
+    if (kReticlePaths.contains(reticleType)) {
+        mReticle.Preload(kReticlePaths.at(reticleType));
+    }
+    return;
+}
+
 void VideoOverlay::SetTopMenuMode(TopMode mode) {
     mTopMode = mode;
     Redraw();
@@ -132,9 +191,69 @@ void VideoOverlay::SetSideMenuMode(SideMode mode) {
     return;
 }
 
+void VideoOverlay::SetHudEnabled(bool enabled) {
+    DLOG_DEBUG("hud %s", enabled ? "on" : "off");
+    mHudEnabled.store(enabled, std::memory_order_relaxed);
+    mTopMsg[TopMode::kHud] = enabled ? "On" : "Off";
+    Redraw();
+    return;
+}
+
+void VideoOverlay::SetRecording(bool recording) {
+    mTopMsg[TopMode::kRecord] = recording ? "On" : "Off";
+    Redraw();
+    return;
+}
+
+bool VideoOverlay::IsHudEnabled() const {
+    return mHudEnabled.load(std::memory_order_relaxed);
+}
+
+void VideoOverlay::UpdateHud(const HudStats& stats) {
+    char top[48];
+    char bottom[48];
+    snprintf(top, sizeof(top), "%.1ffps %.1fms", stats.fps, stats.latencyMs);
+
+    // sensors that can't be read show as dashes rather than hiding the line
+    char cpu[8] = "--";
+    char temp[8] = "--";
+    if (stats.cpuLoad >= 0.0f) {
+        snprintf(cpu, sizeof(cpu), "%d%%", static_cast<int>(std::lround(stats.cpuLoad * 100.0f)));
+    }
+    if (!std::isnan(stats.socTemp)) {
+        snprintf(temp, sizeof(temp), "%dC", static_cast<int>(std::lround(stats.socTemp)));
+    }
+    snprintf(bottom, sizeof(bottom), "drop %llu cpu %s %s", static_cast<unsigned long long>(stats.dropped), cpu, temp);
+
+    // nothing moved since the last tile, keep it
+    std::string text = std::string(top) + "\n" + bottom;
+    if (text == mHudText) {
+        return;
+    }
+
+    cv::Mat* tile = mHudSnapshots.BeginWrite();
+    if (tile == nullptr) {
+        return;
+    }
+    tile->create(cv::Size(kDisplayWidth, kHudHeight), CV_8UC4);
+    tile->setTo(cv::Scalar(0, 0, 0, 0));
+    DrawTextCentreAligned(*tile, top, cv::Point(kDisplayWidth / 2, 9), kHudTextSize, kHudThickness);
+    DrawTextCentreAligned(*tile, bottom, cv::Point(kDisplayWidth / 2, 27), kHudTextSize, kHudThickness);
+    mHudSnapshots.Publish();
+    mHudText = std::move(text);
+    return;
+}
+
 void VideoOverlay::Redraw() {
     DLOG_DEBUG("recalculating overlay");
-    mReticle.GetOverlay().copyTo(mFinalOverlay);
+
+    // Build into a recycled slot, the render thread keeps using the current one.
+    cv::Mat* finalOverlay = mSnapshots.BeginWrite();
+    if (finalOverlay == nullptr) {
+        DLOG_WARN("no free overlay snapshot, skipping redraw");
+        return;
+    }
+    mReticle.GetOverlay().copyTo(*finalOverlay);
 
     if (mTopMode != TopMode::kNone) {
         static const std::unordered_map<TopMode, std::string> map {
@@ -142,11 +261,16 @@ void VideoOverlay::Redraw() {
             {TopMode::kXOffset, "Zero X"},
             {TopMode::kPickReticle, "Reticle"},
             {TopMode::kPickColor, "Colour Mode"},
+            {TopMode::kPickProfile, "Profile"},
+            {TopMode::kHud, "HUD"},
+            {TopMode::kRecord, "Record"},
         };
 
-        std::string text = map.at(mTopMode);
-        bool status = DrawTextCentreAligned(mFinalOverlay, text, cv::Point(120, 35), 0.4, kThickness);
-        status &= DrawTextCentreAligned(mFinalOverlay, mTopMsg[mTopMode], cv::Point(120, 55), 0.4, kThickness);
+        // an entry missing here must not take the UI down
+        const auto title = map.find(mTopMode);
+        const std::string text = (title != map.end()) ? title->second : TopModeToString(mTopMode);
+        bool status = DrawTextCentreAligned(*finalOverlay, text, cv::Point(120, 35), 0.4, kThickness);
+        status &= DrawTextCentreAligned(*finalOverlay, mTopMsg[mTopMode], cv::Point(120, 55), 0.4, kThickness);
     }
 
     if (mSideMode != SideMode::kNone) {
@@ -156,10 +280,40 @@ void VideoOverlay::Redraw() {
             {SideMode::kZoom, "Zoom"},
         };
 
-        std::string text = map.at(mSideMode);
-        bool status = DrawTextCentreAligned(mFinalOverlay, text, cv::Point(190, 110), 0.4, kThickness);
-        status &= DrawTextCentreAligned(mFinalOverlay, mSideMsg[mSideMode], cv::Point(190, 130), 0.4, kThickness);
+        const auto title = map.find(mSideMode);
+        const std::string text = (title != map.end()) ? title->second : SideModeToString(mSideMode);
+        bool status = DrawTextCentreAligned(*finalOverlay, text, cv::Point(190, 110), 0.4, kThickness);
+        status &= DrawTextCentreAligned(*finalOverlay, mSideMsg[mSideMode], cv::Point(190, 130), 0.4, kThickness);
     }
+
+    mSnapshots.Publish();
+}
+
+uint64_t VideoOverlay::GetVersion() const {
+    return mSnapshots.Version();
+}
+
+void VideoOverlay::Blend(cv::Mat& frame, const cv::Mat& overlay, int32_t top) const {
+    if (overlay.cols != frame.cols || top + overlay.rows > frame.rows) {
+        DLOG_ERROR("Overlay does not fit the frame.");
+        return;
+    }
+
+    for (int y = 0; y < overlay.rows; ++y) {
+        for (int x = 0; x < overlay.cols; ++x) {
+            cv::Vec4b& framePixel = frame.at<cv::Vec4b>(top + y, x);
+            const cv::Vec4b& overlayPixel = overlay.at<cv::Vec4b>(y, x);
+
+            // Blend only if the overlay pixel is not fully transparent
+            if (overlayPixel[3] > 0) {
+                float alpha = overlayPixel[3] / 255.0f;
+                for (int c = 0; c < 3; ++c) {
+                    framePixel[c] = framePixel[c] * (1 - alpha) + overlayPixel[c] * alpha;
+                }
+            }
+        }
+    }
+    return;
 }
 
 bool VideoOverlay::DrawTextCentreAligned(cv::Mat& image, const std::string& text, cv::Point centerPos, double size, int32_t thickness) const {
@@ -19,42 +19,85 @@
 
 #include <stdint.h>
 #include <opencv2/videoio.hpp>
+#include <atomic>
+#include <string>
 #include <unordered_map>
 
 #include "CommonDefs.h"
 #include "Encoder.h"
 #include "Reticle.h"
 #include "P2ProManager.h"
+#include "Profile.h"
+#include "SnapshotPool.h"
 
 namespace thermal {
 
+/**
+ * @brief What the performance HUD shows.
+ */
+struct HudStats {
+    double fps;         ///< presented frames per second
+    double latencyMs;   ///< capture to present, mean over the recent frames
+    uint64_t dropped;   ///< frames missed since start
+    float cpuLoad;      ///< 0..1, negative if unknown
+    float socTemp;      ///< degrees C, NaN if unknown
+};
+
 class VideoOverlay {
 public:
     VideoOverlay();
     ~VideoOverlay();
 
-    // Method to overlay the reticle on a given frame
+    // Method to overlay the reticle on a given frame. Safe to call from the
+    // render thread while the menus are being redrawn, it never blocks.
     void Overlay(cv::Mat& frame) const;
+    void RenderNoSignal(cv::Mat& frame) const;
     void SetOffset(int32_t x, int32_t y);
     void SetX(int32_t x);
     void SetY(int32_t y);
     void SetZoom(int32_t level);
     void SetReticleType(ReticleType reticleType);
     void SetColorMode(p2pro::ColorMode pseudocolor);
+    void SetProfile(const Profile& profile);
+    void PreloadReticle(ReticleType reticleType);
     void SetTopMenuMode(TopMode mode);
     void SetSideMenuMode(SideMode mode);
 
+    /**
+     * @brief Shows or hides the performance HUD. The HUD is a small tile of
+     * its own, separate from the reticle and menus, so updating it never
+     * needs a Redraw().
+     */
+    void SetHudEnabled(bool enabled);
+    bool IsHudEnabled() const;
+
+    /**
+     * @brief Shows whether a video recording is running in the menu.
+     */
+    void SetRecording(bool recording);
+
+    /**
+     * @brief Refreshes the HUD tile. Only re-renders when the formatted text
+     * changed, meant to be called a couple of times a second.
+     */
+    void UpdateHud(const HudStats& stats);
+
     void Redraw();
+    uint64_t GetVersion() const;
 
 private:
     Reticle mReticle;
-    cv::Mat mFinalOverlay;
+    utils::SnapshotPool<cv::Mat> mSnapshots; ///< Published overlays, the render thread reads the latest
+    utils::SnapshotPool<cv::Mat> mHudSnapshots; ///< Published HUD tiles, blended after the overlay when enabled
+    std::atomic<bool> mHudEnabled;
+    std::string mHudText; ///< text of the latest HUD tile
     std::unordered_map<TopMode, std::string> mTopMsg;
     std::unordered_map<SideMode, std::string> mSideMsg;
 
     TopMode mTopMode;
     SideMode mSideMode;
 
+    void Blend(cv::Mat& frame, const cv::Mat& overlay, int32_t top) const;
     bool DrawTextCentreAligned(cv::Mat& image, const std::string& text, cv::Point centrePos, double size, int32_t thickness) const;
 };
 
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "VideoRecorder.h"
+
+#include <chrono>
+#include <cstdio>
+
+#include "FrameTrace.h"
+#include "Logger.h"
+
+namespace thermal {
+
+// The writer polls like the logger does, so Submit() never has to wake it.
+// Well under a frame period, the slots cover the rest.
+constexpr const std::chrono::milliseconds kWriterPollInterval(10);
+
+VideoRecorder::VideoRecorder()
+    : mSlots()
+    , mFree()
+    , mFilled()
+    , mThread()
+    , mRecording(false)
+    , mSession(0u)
+    , mEncoder(camera::FrameCodec::kJpeg)
+    , mWriter()
+    , mEncoded()
+    , mPath()
+    , mFrames(0u)
+    , mDropped(0u)
+    , mBytes(0u)
+    , mEncodeNs(0u)
+    , mStartTime(0u)
+    , mStopTime(0u) {
+    for (size_t i = 0u; i < kSlots; i++) {
+        mFree.Push(static_cast<uint8_t>(i));
+    }
+}
+
+VideoRecorder::~VideoRecorder() {
+    Stop();
+}
+
+bool VideoRecorder::Start(const std::string& path, camera::FrameCodec codec) {
+    if (mRecording.load()) {
+        return false;
+    }
+
+    // opened here so a full or missing card shows up straight away
+    if (!mWriter.Open(path, codec)) {
+        return false;
+    }
+    mEncoder = camera::FrameEncoder(codec);
+    mPath = path;
+    mFrames.store(0u);
+    mDropped.store(0u);
+    mBytes.store(0u);
+    mEncodeNs.store(0u);
+    mStartTime.store(trace::Now());
+    mStopTime.store(0u);
+    mSession.fetch_add(1u);
+
+    DLOG_NOTICE("recording %s as %s", path.c_str(), (codec == camera::FrameCodec::kJpeg) ? "MJPEG" : "PNG");
+    mRecording.store(true);
+    mThread = std::thread(&VideoRecorder::Run, this);
+    return true;
+}
+
+void VideoRecorder::Stop() {
+    if (!mRecording.exchange(false)) {
+        return;
+    }
+
+    mThread.join();
+    mStopTime.store(trace::Now());
+    if (!mWriter.Close()) {
+        DLOG_ERROR("recording %s is incomplete", mPath.c_str());
+    }
+    DLOG_NOTICE("stopped recording:%s", Report().c_str());
+}
+
+bool VideoRecorder::IsRecording() const {
+    return mRecording.load(std::memory_order_relaxed);
+}
+
+bool VideoRecorder::Submit(const cv::Mat& frame, uint64_t timestamp) {
+    if (!mRecording.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    uint8_t index = 0u;
+    if (!mFree.Pop(index)) {
+        mDropped.fetch_add(1u, std::memory_order_relaxed);
+        return false;
+    }
+
+    // the slots reach the frame size on the first pass and stay there
+    Slot& slot = mSlots[index];
+    frame.copyTo(slot.frame);
+    slot.timestamp = timestamp;
+    slot.session = mSession.load(std::memory_order_relaxed);
+    mFilled.Push(index);
+    return true;
+}
+
+uint64_t VideoRecorder::GetFrames() const {
+    return mFrames.load(std::memory_order_relaxed);
+}
+
+uint64_t VideoRecorder::GetDropped() const {
+    return mDropped.load(std::memory_order_relaxed);
+}
+
+std::string VideoRecorder::Report() const {
+    const uint64_t start = mStartTime.load(std::memory_order_relaxed);
+    const uint64_t stop = mStopTime.load(std::memory_order_relaxed);
+    const uint64_t end = (stop != 0u) ? stop : trace::Now();
+    const double seconds = (start != 0u && end > start) ? (end - start) / 1e9 : 0.0;
+    const uint64_t frames = GetFrames();
+    const uint64_t bytes = mBytes.load(std::memory_order_relaxed);
+
+    char report[256];
+    snprintf(report, sizeof(report),
+             "\nrecording  %s\nframes %llu dropped %llu bytes %llu seconds %.1f write_mb_s %.2f encode_ms %.2f\n",
+             IsRecording() ? "on" : "off", static_cast<unsigned long long>(frames),
+             static_cast<unsigned long long>(GetDropped()), static_cast<unsigned long long>(bytes), seconds,
+             (seconds > 0.0) ? bytes / seconds / 1e6 : 0.0,
+             (frames > 0u) ? mEncodeNs.load(std::memory_order_relaxed) / 1e6 / frames : 0.0);
+    return report;
+}
+
+void VideoRecorder::Run() {
+    const uint32_t session = mSession.load();
+    bool failed = false;
+    while (true) {
+        uint8_t index = 0u;
+        if (!mFilled.Pop(index)) {
+            // drained, and nothing more is coming
+            if (!mRecording.load()) {
+                break;
+            }
+            std::this_thread::sleep_for(kWriterPollInterval);
+            continue;
+        }
+
+        // a failed card write stops the recording, the frames count as dropped
+        Slot& slot = mSlots[index];
+        if (slot.session == session && !failed) {
+            const uint64_t start = trace::Now();
+            const bool encoded = mEncoder.Encode(slot.frame, mEncoded);
+            mEncodeNs.fetch_add(trace::Now() - start, std::memory_order_relaxed);
+            if (encoded && mWriter.Write(slot.frame, mEncoded, slot.timestamp)) {
+                mFrames.fetch_add(1u, std::memory_order_relaxed);
+                mBytes.store(mWriter.GetBytesWritten(), std::memory_order_relaxed);
+            } else {
+                DLOG_ERROR("failed to record frame %llu", static_cast<unsigned long long>(GetFrames()));
+                failed = true;
+                mDropped.fetch_add(1u, std::memory_order_relaxed);
+            }
+        } else if (failed) {
+            mDropped.fetch_add(1u, std::memory_order_relaxed);
+        }
+        mFree.Push(index);
+    }
+}
+
+} // thermal
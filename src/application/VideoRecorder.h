@@ -0,0 +1,120 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _VIDEO_RECORDER_H_
+#define _VIDEO_RECORDER_H_
+
+#include <stdint.h>
+#include <opencv2/core.hpp>
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FrameRecording.h"
+#include "SpscRing.h"
+
+namespace thermal {
+
+/**
+ * @brief What a recording is made of.
+ */
+enum class RecordingSource : uint8_t {
+    kDisplay,  ///< the 240x240 frames the LCD shows, overlay included
+    kCamera,   ///< the frames as the camera delivered them, raw if it runs raw
+};
+
+/**
+ * @brief Records frames to the card from a background thread.
+ *
+ * The camera thread hands frames over with Submit(), which copies them into
+ * one of a few preallocated slots and returns. Encoding and writing happen
+ * on the writer thread. If the writer falls behind and no slot is free, the
+ * frame is dropped and counted; the camera thread never waits for the card.
+ */
+class VideoRecorder {
+public:
+    static constexpr size_t kSlots = 8u; ///< ~0.3 s of frames at 25 fps
+
+    VideoRecorder();
+    ~VideoRecorder();
+
+    /**
+     * @brief Starts a recording. Control thread.
+     * @param path the file, a compressed recording.
+     * @param codec kJpeg for MJPEG, kPng for lossless.
+     */
+    bool Start(const std::string& path, camera::FrameCodec codec);
+
+    /**
+     * @brief Writes what is queued and closes the file. Control thread.
+     */
+    void Stop();
+
+    bool IsRecording() const;
+
+    /**
+     * @brief Queues a copy of a frame. Camera thread, never blocks.
+     * @param frame the frame, same geometry for the whole recording.
+     * @param timestamp capture time, monotonic ns.
+     * @return false if not recording or the frame was dropped.
+     */
+    bool Submit(const cv::Mat& frame, uint64_t timestamp);
+
+    uint64_t GetFrames() const;
+    uint64_t GetDropped() const;
+
+    /**
+     * @brief Frames, drops and write throughput of the current (or last)
+     *        recording, for the stats export.
+     */
+    std::string Report() const;
+
+private:
+    struct Slot {
+        cv::Mat frame;
+        uint64_t timestamp;
+        uint32_t session;  ///< frames queued for an earlier recording are skipped
+    };
+
+    std::array<Slot, kSlots> mSlots;
+    utils::SpscRing<uint8_t, kSlots> mFree;    ///< writer -> camera thread
+    utils::SpscRing<uint8_t, kSlots> mFilled;  ///< camera thread -> writer
+    std::thread mThread;
+    std::atomic<bool> mRecording;
+    std::atomic<uint32_t> mSession;
+
+    // writer thread only while recording
+    camera::FrameEncoder mEncoder;
+    camera::CompressedWriter mWriter;
+    std::vector<uint8_t> mEncoded;
+    std::string mPath;
+
+    std::atomic<uint64_t> mFrames;
+    std::atomic<uint64_t> mDropped;
+    std::atomic<uint64_t> mBytes;
+    std::atomic<uint64_t> mEncodeNs;
+    std::atomic<uint64_t> mStartTime;
+    std::atomic<uint64_t> mStopTime;   ///< 0 while recording
+
+    void Run();
+};
+
+} // thermal
+
+#endif // _VIDEO_RECORDER_H_
@@ -20,6 +20,7 @@
 #include "ThermalScopeApplication.h"
 
 int main(int32_t argc, char* argv[]) {
+    int32_t status = 1;
     try {
         thermal::log::LogInit();
         DLOG_NOTICE("Starting thermal scope application");
@@ -27,7 +28,7 @@ int main(int32_t argc, char* argv[]) {
         thermal::ThermalScopeApplication app(argc, argv);
         app.Init();
         app.Run();
-        return 0;
+        status = 0;
     
     } catch (const std::exception &e) {
         DLOG_ALERT("unhandled runtime exception %s", e.what());
@@ -36,4 +37,8 @@ int main(int32_t argc, char* argv[]) {
     } catch (...) {
         DLOG_ALERT("Unhandled exception in thermal camera application");
     }
+
+    // flush whatever is still queued for the logger thread
+    thermal::log::LogDeinit();
+    return status;
 }
@@ -0,0 +1,298 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Microbenchmarks of every kernel on the frame path, and of the whole of
+// ThermalScopeApplication::OnCameraData, on synthetic frames with the camera
+// backend's geometry (256x192 for the P2 Pro). Prints one JSON object with
+// ns/frame, throughput and heap allocations per frame for each stage, so
+// runs can be diffed between commits. --input runs it on the BGR frames of a
+// recording (thermal-scope-record) instead.
+//
+//   thermal-scope-bench [--iterations N] [--filter <substring>]
+//                       [--input <recording>]
+
+#include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "CameraBackend.h"
+#include "CommonDefs.h"
+#include "FrameBuffer.h"
+#include "FramePipeline.h"
+#include "FrameRecording.h"
+#include "FrameTrace.h"
+#include "GpioBackend.h"
+#include "Logger.h"
+#include "Platform.h"
+#include "Reticle.h"
+#include "SimulatedGpioBackend.h"
+#include "ThermalScopeApplication.h"
+#include "VideoOverlay.h"
+
+using namespace thermal;
+using Camera = camera::ActiveCamera;
+
+namespace {
+
+constexpr const size_t kDefaultIterations = 500u;
+constexpr const size_t kWarmupIterations = 20u;
+constexpr const size_t kSyntheticFrames = 8u;
+constexpr const size_t kFrameSize = kDisplayWidth * kDisplayHeight * kDisplayChannels;
+
+// every heap allocation in the process, the frame path should make none.
+// cv::Mat buffers come from OpenCV's own aligned malloc, but each one also
+// news its UMatData header, so they are counted here too.
+std::atomic<uint64_t> gAllocations(0u);
+
+struct Result {
+    std::string name;
+    size_t iterations;
+    double nsPerFrame;
+    double framesPerSecond;
+    double allocsPerFrame;
+};
+
+uint64_t MonotonicNow() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// a bar sweeping over a gradient, every frame a little different
+std::vector<cv::Mat> MakeSyntheticFrames() {
+    std::vector<cv::Mat> frames;
+    for (size_t i = 0u; i < kSyntheticFrames; i++) {
+        cv::Mat frame(Camera::kHeight, Camera::kWidth, CV_8UC3);
+        for (int32_t row = 0; row < frame.rows; row++) {
+            frame.row(row).setTo(cv::Scalar(row % 256, (row * 2) % 256, 128));
+        }
+        const int32_t x = static_cast<int32_t>(i * Camera::kWidth / kSyntheticFrames);
+        cv::rectangle(frame, cv::Rect(x, 0, 16, frame.rows), cv::Scalar(255, 255, 255), cv::FILLED);
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+/**
+ * @brief Runs body(i) for the warm up and then the timed iterations. Buffers
+ *        grown during the warm up are not counted, steady state is what
+ *        matters on the frame path.
+ */
+template <typename Body>
+Result Measure(const char* name, size_t iterations, Body&& body) {
+    for (size_t i = 0u; i < kWarmupIterations; i++) {
+        body(i);
+    }
+
+    const uint64_t allocations = gAllocations.load(std::memory_order_relaxed);
+    const uint64_t start = MonotonicNow();
+    for (size_t i = 0u; i < iterations; i++) {
+        body(i);
+    }
+    const uint64_t elapsed = MonotonicNow() - start;
+    const uint64_t allocated = gAllocations.load(std::memory_order_relaxed) - allocations;
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerFrame = static_cast<double>(elapsed) / iterations;
+    result.framesPerSecond = (elapsed > 0u) ? 1e9 * iterations / elapsed : 0.0;
+    result.allocsPerFrame = static_cast<double>(allocated) / iterations;
+    return result;
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    gAllocations.fetch_add(1u, std::memory_order_relaxed);
+    void* pointer = std::malloc(size == 0u ? 1u : size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace thermal {
+
+/**
+ * @brief Friend of the application, runs its frame callback without a
+ *        camera and with the framebuffer in memory.
+ */
+class FrameBench {
+public:
+    static void UseMemoryFrameBuffer(ThermalScopeApplication& app) {
+        app.mFrameBuffer = std::make_unique<hw::FrameBuffer>(kFrameSize);
+    }
+
+    static bool OnCameraData(ThermalScopeApplication& app, cv::Mat& frame) {
+        return app.OnCameraData(frame, false);
+    }
+};
+
+} // namespace thermal
+
+int main(int argc, char* argv[]) {
+    size_t iterations = kDefaultIterations;
+    std::string filter;
+    std::string input;
+    for (int32_t i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--iterations") == 0) {
+            iterations = std::max<size_t>(1u, std::strtoul(argv[i + 1], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--filter") == 0) {
+            filter = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--input") == 0) {
+            input = argv[i + 1];
+        } else {
+            fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    log::LogInit();
+    log::SetLogLevel(log::LogLevel::kNotice);
+    gpio::SetBackend(std::make_shared<gpio::SimulatedBackend>());
+
+    // recorded frames stay in the mapping, the kernels read them in place
+    camera::RecordingReader recording;
+    std::vector<cv::Mat> frames;
+    if (input.empty()) {
+        frames = MakeSyntheticFrames();
+    } else if (recording.Open(input) && recording.GetType() == CV_8UC3 && recording.GetWidth() == Camera::kWidth
+               && recording.GetHeight() >= Camera::kHeight) {
+        for (size_t i = 0u; i < recording.GetFrameCount(); i++) {
+            frames.push_back(recording.GetFrame(i));
+        }
+    } else {
+        fprintf(stderr, "%s is not a %zux%zu BGR recording\n", input.c_str(), Camera::kWidth, Camera::kHeight);
+        log::LogDeinit();
+        return 1;
+    }
+    std::vector<cv::Mat> inputs(frames.size());
+    cv::Mat resized;
+    cv::Mat rotated;
+    cv::Mat converted;
+    cv::Mat display;
+
+    trace::FrameTracer& tracer = trace::FrameTracer::Instance();
+    tracer.SetFramePeriod(1000000000u / Camera::kFrameRate);
+    FramePipeline<Camera> pipeline;
+    VideoOverlay overlay;
+    Reticle reticle(std::string(kReticleDirectory) + "default.png");
+    hw::FrameBuffer frameBuffer(kFrameSize);
+
+    char* appArgs[] = { argv[0], nullptr };
+    ThermalScopeApplication app(1, appArgs);
+    FrameBench::UseMemoryFrameBuffer(app);
+
+    pipeline.Process(frames[0], display);
+    const HudStats hud = { 25.0, 41.5, 3u, 0.25f, 48.0f };
+
+    std::vector<Result> results;
+    auto run = [&](const char* name, auto&& body) {
+        if (filter.empty() || std::strstr(name, filter.c_str()) != nullptr) {
+            results.push_back(Measure(name, iterations, body));
+        }
+    };
+
+    // the separate kernels the frame path was built from, for reference
+    run("resize", [&](size_t i) {
+        cv::resize(frames[i % frames.size()], resized, cv::Size(kDisplayWidth, kDisplayHeight), 0, 0, cv::INTER_LINEAR);
+    });
+    run("rotate", [&](size_t) {
+        cv::rotate(resized, rotated, cv::ROTATE_90_COUNTERCLOCKWISE);
+    });
+    run("convert", [&](size_t) {
+        cv::cvtColor(rotated, converted, cv::COLOR_BGR2RGBA);
+    });
+
+    // what the application runs, the resize + rotate folded into one remap
+    run("pipeline", [&](size_t i) {
+        pipeline.Process(frames[i % frames.size()], display);
+    });
+    run("overlay", [&](size_t) {
+        overlay.Overlay(display);
+    });
+    run("overlay_hud", [&](size_t i) {
+        if (i == 0u) {
+            overlay.SetHudEnabled(true);
+            overlay.UpdateHud(hud);
+        }
+        overlay.Overlay(display);
+    });
+    overlay.SetHudEnabled(false);
+    run("redraw", [&](size_t) {
+        overlay.Redraw();
+    });
+    run("reticle_set_offset", [&](size_t i) {
+        reticle.SetOffset(static_cast<int32_t>(i % 2u), 0);
+    });
+    run("framebuffer_write", [&](size_t) {
+        frameBuffer.Write(display.data, kFrameSize);
+    });
+
+    // the whole frame callback, a fresh input each time like a capture
+    run("on_camera_data", [&](size_t i) {
+        cv::Mat& input = inputs[i % inputs.size()];
+        frames[i % frames.size()].copyTo(input);
+        tracer.BeginFrame(trace::Now());
+        FrameBench::OnCameraData(app, input);
+        tracer.EndFrame();
+    });
+
+    printf("{\"camera\":\"%s\",\"width\":%zu,\"height\":%zu,\"iterations\":%zu,\"stages\":[",
+           Camera::kName, Camera::kWidth, Camera::kHeight, iterations);
+    for (size_t i = 0u; i < results.size(); i++) {
+        const Result& result = results[i];
+        printf("%s{\"name\":\"%s\",\"ns_per_frame\":%.0f,\"frames_per_second\":%.1f,\"allocs_per_frame\":%.2f}",
+               (i == 0u) ? "" : ",", result.name.c_str(), result.nsPerFrame, result.framesPerSecond,
+               result.allocsPerFrame);
+    }
+    printf("]}\n");
+
+    log::LogDeinit();
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Replays simulated encoder spins through the real gpio queue, encoder
+// decoding and overlay redraw, and reports how many detents made it and how
+// long an edge takes to show up in the overlay.
+
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Encoder.h"
+#include "GpioWatcher.h"
+#include "Logger.h"
+#include "Reactor.h"
+#include "SimulatedGpioBackend.h"
+#include "VideoOverlay.h"
+
+using namespace thermal;
+
+namespace {
+
+// same pins and coalescing as the application's top encoder
+constexpr const int32_t kGpioA = 20;
+constexpr const int32_t kGpioB = 21;
+constexpr const int32_t kGpioBtn = 16;
+constexpr const std::chrono::milliseconds kRotationCoalesceTime(16);
+
+// time the reactor keeps running after the last edge to drain everything
+constexpr const std::chrono::milliseconds kSettleTime(100);
+
+// every scenario spins for about this long
+constexpr const double kSpinSeconds = 1.0;
+
+struct Scenario {
+    double edgesPerSecond;
+    int32_t maxBounces;
+    std::chrono::microseconds bounceWindow;
+};
+
+constexpr const Scenario kScenarios[] = {
+    { 100.0,  0, std::chrono::microseconds(0) },
+    { 250.0,  0, std::chrono::microseconds(0) },
+    { 500.0,  0, std::chrono::microseconds(0) },
+    { 1000.0, 0, std::chrono::microseconds(0) },
+    { 100.0,  3, std::chrono::microseconds(200) },
+    { 250.0,  3, std::chrono::microseconds(200) },
+    { 500.0,  3, std::chrono::microseconds(200) },
+    { 1000.0, 3, std::chrono::microseconds(200) },
+};
+
+uint64_t MonotonicNow() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+double Percentile(std::vector<uint64_t>& samples, double p) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t index = static_cast<size_t>(p * static_cast<double>(samples.size() - 1u) + 0.5);
+    return static_cast<double>(samples[index]) / 1e6;
+}
+
+} // namespace
+
+int main() {
+    log::LogInit();
+
+    auto backend = std::make_shared<gpio::SimulatedBackend>();
+    gpio::SetBackend(backend);
+
+    utils::Reactor reactor;
+    hw::Encoder encoder(kGpioA, kGpioB, kGpioBtn);
+    VideoOverlay overlay;
+
+    bool flushPending = false;
+    reactor.AddFd(gpio::GetEventFd(), EPOLLIN, [&](uint32_t) {
+        gpio::DispatchEvents();
+        if (!flushPending && encoder.HasPendingRotation()) {
+            flushPending = true;
+            reactor.AddTimer(kRotationCoalesceTime, [&]() {
+                flushPending = false;
+                encoder.Flush();
+            });
+        }
+    });
+
+    printf("%10s %8s %8s %8s %8s %8s %8s %9s %9s %9s\n",
+        "edges/s", "bounce", "expect", "decoded", "dropped", "wrong", "updates", "p50 ms", "p99 ms", "max ms");
+
+    int32_t sign = 1;
+    for (const Scenario& scenario : kScenarios) {
+        const int32_t detents = sign * std::max(25, static_cast<int32_t>(scenario.edgesPerSecond * kSpinSeconds / 4.0));
+        gpio::Trace trace = gpio::MakeQuadratureSpin(kGpioA, kGpioB, detents, scenario.edgesPerSecond);
+        gpio::AddContactBounce(trace, scenario.maxBounces, scenario.bounceWindow, 1234u);
+
+        int32_t correct = 0;
+        int32_t wrong = 0;
+        int32_t updates = 0;
+        int32_t x = 0;
+        std::vector<uint64_t> latencies;
+        encoder.SetOnRotateCallback([&](const hw::Rotation& rotation) {
+            if ((rotation.detents > 0) == (detents > 0)) {
+                correct += std::abs(rotation.detents);
+            } else {
+                wrong += std::abs(rotation.detents);
+            }
+
+            // the same work the application does for an x offset change
+            x = std::clamp(x + rotation.delta, -50, 50);
+            overlay.SetX(x);
+            updates++;
+            latencies.push_back(MonotonicNow() - rotation.timestamp);
+        });
+
+        std::thread replay([&]() {
+            backend->Replay(trace, true);
+            reactor.Post([&]() {
+                reactor.AddTimer(kSettleTime, [&]() { reactor.Stop(); });
+            });
+        });
+        reactor.Run();
+        replay.join();
+
+        printf("%10.0f %8d %8d %8d %8d %8d %8d %9.2f %9.2f %9.2f\n",
+            scenario.edgesPerSecond, scenario.maxBounces, std::abs(detents), correct,
+            std::max(0, std::abs(detents) - correct), wrong, updates,
+            Percentile(latencies, 0.5), Percentile(latencies, 0.99), Percentile(latencies, 1.0));
+        sign = -sign;
+    }
+
+    printf("queue drops %llu, bounce edges filtered %llu\n",
+        static_cast<unsigned long long>(gpio::GetDroppedEvents()),
+        static_cast<unsigned long long>(backend->GetFilteredEdges()));
+
+    log::LogDeinit();
+    return 0;
+}
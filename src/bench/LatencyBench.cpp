@@ -0,0 +1,164 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+// Offline latency check: replays a clip through the real capture loop,
+// frame pipeline, overlay and a file backed framebuffer, and reports
+// capture to present latency. Without a clip a synthetic one is generated,
+// so it runs on any build machine. Exits non zero if p99 is over the limit
+// given with --max-p99-ms, so a regression fails the build.
+//
+//   thermal-scope-latency-bench [--clip <file or pattern>] [--frames N]
+//                               [--fb <file>] [--max-p99-ms X]
+
+#include <stdio.h>
+
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "CameraBackend.h"
+#include "CommonDefs.h"
+#include "FrameBuffer.h"
+#include "FramePipeline.h"
+#include "FrameTrace.h"
+#include "Logger.h"
+#include "VideoOverlay.h"
+#include "Webcam.h"
+
+using namespace thermal;
+using Camera = camera::ActiveCamera;
+
+namespace {
+
+constexpr const char * const kDefaultDirectory = "/tmp/thermal-scope-latency-bench";
+constexpr const size_t kDefaultFrames = 250u;
+constexpr const size_t kSyntheticFrames = 50u;
+constexpr const size_t kFrameSize = kDisplayWidth * kDisplayHeight * kDisplayChannels;
+
+// a bar sweeping over a gradient, enough to keep every kernel honest
+std::string MakeSyntheticClip(const std::filesystem::path& directory) {
+    std::filesystem::create_directories(directory);
+    for (size_t i = 0u; i < kSyntheticFrames; i++) {
+        cv::Mat frame(Camera::kHeight, Camera::kWidth, CV_8UC3);
+        for (int32_t row = 0; row < frame.rows; row++) {
+            frame.row(row).setTo(cv::Scalar(row % 256, (row * 2) % 256, 128));
+        }
+        const int32_t x = static_cast<int32_t>(i * Camera::kWidth / kSyntheticFrames);
+        cv::rectangle(frame, cv::Rect(x, 0, 16, frame.rows), cv::Scalar(255, 255, 255), cv::FILLED);
+
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%03zu.png", i);
+        cv::imwrite((directory / name).string(), frame);
+    }
+    return (directory / "frame_%03d.png").string();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string clip;
+    std::string fbPath = std::string(kDefaultDirectory) + "/fb0";
+    size_t frames = kDefaultFrames;
+    double maxP99 = 0.0;
+    for (int32_t i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--clip") == 0) {
+            clip = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--frames") == 0) {
+            frames = std::strtoul(argv[i + 1], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--fb") == 0) {
+            fbPath = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--max-p99-ms") == 0) {
+            maxP99 = std::strtod(argv[i + 1], nullptr);
+        } else {
+            fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    log::LogInit();
+    log::SetLogLevel(log::LogLevel::kNotice);
+    if (clip.empty()) {
+        clip = MakeSyntheticClip(std::filesystem::path(kDefaultDirectory) / "clip");
+    }
+
+    trace::FrameTracer& tracer = trace::FrameTracer::Instance();
+    tracer.SetFramePeriod(1000000000u / Camera::kFrameRate);
+
+    std::filesystem::create_directories(std::filesystem::path(fbPath).parent_path());
+    hw::FrameBuffer frameBuffer(fbPath, kFrameSize);
+    FramePipeline<Camera> pipeline;
+    VideoOverlay overlay;
+    cv::Mat display;
+
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t presented = 0u;
+
+    // the same work ThermalScopeApplication::OnCameraData does
+    p2pro::Webcam webcam(clip, Camera::kWidth, Camera::kHeight, Camera::kFrameRate);
+    webcam.RegisterOnDataCallback([&](cv::Mat& frame, bool) {
+        if (!pipeline.Process(frame, display)) {
+            return false;
+        }
+        overlay.Overlay(display);
+        tracer.Mark(trace::Stage::kOverlay);
+        frameBuffer.Write(display.data, kFrameSize);
+        tracer.Mark(trace::Stage::kPresent);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++presented == frames) {
+            done.notify_one();
+        }
+        return true;
+    });
+
+    if (!webcam.Open() || !webcam.Start()) {
+        fprintf(stderr, "cannot replay %s\n", clip.c_str());
+        log::LogDeinit();
+        return 1;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]() { return presented >= frames; });
+    }
+    webcam.Stop();
+    webcam.ReleaseCamera();
+
+    printf("%s", tracer.Report().c_str());
+
+    const trace::LatencyHistogram& total = tracer.GetTotal();
+    const double p99 = total.Percentile(0.99) / 1e6;
+    printf("{\"camera\":\"%s\",\"frames\":%llu,\"dropped\":%llu,\"late\":%llu,"
+           "\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f}\n",
+           Camera::kName, static_cast<unsigned long long>(total.Count()),
+           static_cast<unsigned long long>(tracer.GetDropped()), static_cast<unsigned long long>(tracer.GetLate()),
+           total.Percentile(0.5) / 1e6, p99, total.Max() / 1e6);
+
+    log::LogDeinit();
+    if (maxP99 > 0.0 && p99 > maxP99) {
+        fprintf(stderr, "p99 %.3f ms is over the %.3f ms limit\n", p99, maxP99);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Drives the settings store the way the encoders do and reports how many
+// bytes reach the card per setting change (write amplification), then
+// replays the journal to check nothing was lost. Fails if a change appends
+// more than one record.
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+#include <json/writer.h>
+
+#include "Logger.h"
+#include "SettingsJournal.h"
+#include "SettingsStore.h"
+
+using namespace thermal;
+
+namespace {
+
+constexpr const char * const kDefaultDirectory = "/tmp/thermal-scope-settings-bench";
+constexpr const int32_t kChanges = 2000;
+constexpr const size_t kCompactThreshold = 16u * 1024u;
+// long enough that the delayed writer never fires on its own, every change
+// is written by Sync() right away, the worst case for the card
+constexpr const std::chrono::seconds kDelay(60);
+
+// keys and ranges like the application's offsets and zoom
+struct Key {
+    const char* name;
+    int32_t min;
+    int32_t max;
+};
+
+constexpr const Key kKeys[] = {
+    { "x", -50, 50 },
+    { "y", -50, 50 },
+    { "zoom", 0, 100 },
+};
+
+int32_t ValueFor(const Key& key, int32_t change) {
+    return key.min + (change * 7) % (key.max - key.min + 1);
+}
+
+// the same shape persistent::Value saves
+Json::Value Wrap(int32_t value) {
+    Json::Value json;
+    json["value"] = value;
+    return json;
+}
+
+// the largest record a change can append, header + payload + crc, with the
+// payload serialized the way the store does
+size_t MaxRecordSize() {
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    size_t size = 0u;
+    for (const Key& key : kKeys) {
+        for (int32_t value : { key.min, key.max }) {
+            const std::string payload = Json::writeString(builder, Wrap(value));
+            std::string record;
+            if (persistent::Journal::EncodeRecord(persistent::KeyId(key.name), payload, record)) {
+                size = std::max(size, record.size());
+            }
+        }
+    }
+    return size;
+}
+
+} // namespace
+
+int main(int32_t argc, char* argv[]) {
+    log::LogInit();
+
+    const std::string directory = (argc > 1) ? argv[1] : kDefaultDirectory;
+    const std::string path = directory + "/settings.journal";
+    std::filesystem::remove_all(directory);
+
+    int32_t result = 0;
+    {
+        persistent::Store store(path, kDelay, kCompactThreshold);
+        for (int32_t change = 0; change < kChanges; change++) {
+            const Key& key = kKeys[change % std::size(kKeys)];
+            store.Set(key.name, Wrap(ValueFor(key, change)));
+            store.Sync();
+        }
+
+        const persistent::JournalStats stats = store.GetStats();
+        const size_t recordSize = MaxRecordSize();
+        printf("changes              %llu\n", static_cast<unsigned long long>(stats.recordsAppended));
+        printf("record size          %zu bytes\n", recordSize);
+        printf("bytes appended       %llu\n", static_cast<unsigned long long>(stats.bytesAppended));
+        printf("compactions          %llu (%llu bytes)\n",
+            static_cast<unsigned long long>(stats.compactions), static_cast<unsigned long long>(stats.bytesCompacted));
+        const double changes = static_cast<double>(stats.recordsAppended);
+        printf("appended per change  %.1f bytes\n", static_cast<double>(stats.bytesAppended) / changes);
+        printf("written per change   %.1f bytes\n",
+            static_cast<double>(stats.bytesAppended + stats.bytesCompacted) / changes);
+
+        // compaction rewrites are counted apart, appends alone are one record per change
+        if (stats.recordsAppended != static_cast<uint64_t>(kChanges) ||
+            stats.bytesAppended > stats.recordsAppended * recordSize) {
+            printf("write amplification  FAILED, more than %zu bytes appended per change\n", recordSize);
+            result = 1;
+        }
+    }
+
+    // everything above must come back on the next boot
+    persistent::Store replayed(path, kDelay, kCompactThreshold);
+    bool replayOk = true;
+    for (size_t i = 0u; i < std::size(kKeys); i++) {
+        int32_t last = kChanges - 1;
+        while (last % static_cast<int32_t>(std::size(kKeys)) != static_cast<int32_t>(i)) {
+            last--;
+        }
+
+        Json::Value value;
+        const int32_t expected = ValueFor(kKeys[i], last);
+        if (!replayed.Get(kKeys[i].name, value) || value["value"].asInt() != expected) {
+            printf("replay mismatch for %s, expected %d\n", kKeys[i].name, expected);
+            replayOk = false;
+            result = 1;
+        }
+    }
+    printf("replay               %s\n", replayOk ? "ok" : "FAILED");
+
+    log::LogDeinit();
+    return result;
+}
@@ -0,0 +1,262 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Drives unplug/replug cycles through the fake hotplug transport and checks
+// the camera supervisor recovers from each of them: a brief glitch, and an
+// unplug longer than the reconnect timeout after which the camera is slow
+// to deliver its first frame. The stream is a replayed
+// synthetic recording and the vendor commands go to the fake usb transport,
+// so it runs on any build machine. Exits non zero if a cycle does not
+// recover, needs more than one restart, or a recovered stream is torn down
+// again.
+//
+// Then checks the shutter scheduler's forced shutter, each of which costs a
+// stream restart: overdue while a knob turns it must wait, it must fire once
+// the knob rests, and past its grace period it must fire anyway.
+//
+//   thermal-scope-supervisor-bench [--long-unplug-ms N]
+
+#include <stdio.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <opencv2/core.hpp>
+
+#include "CameraBackend.h"
+#include "CameraSupervisor.h"
+#include "FrameRecording.h"
+#include "HotplugTransport.h"
+#include "Logger.h"
+#include "P2ProManager.h"
+#include "ShutterScheduler.h"
+#include "UsbControl.h"
+#include "UsbTransport.h"
+#include "Webcam.h"
+
+using namespace thermal;
+using Camera = camera::ActiveCamera;
+
+namespace {
+
+constexpr const char * const kDefaultDirectory = "/tmp/thermal-scope-supervisor-bench";
+constexpr const size_t kSyntheticFrames = 25u;
+constexpr const std::chrono::milliseconds kGlitch(200);
+// longer than the supervisor's reconnect timeout plus its frame timeout
+constexpr const std::chrono::milliseconds kDefaultLongUnplug(7000);
+// a camera that was off for a while takes longer than one supervisor poll
+// to send its first frame
+constexpr const std::chrono::milliseconds kSlowFirstFrame(1500);
+// how long a recovered stream must keep going to count
+constexpr const std::chrono::milliseconds kSettleTime(3000);
+constexpr const std::chrono::milliseconds kRecoverTimeout(10000);
+// encoder input while turning, and slack for a poll plus a stream restart
+constexpr const std::chrono::milliseconds kInputPeriod(100);
+constexpr const std::chrono::milliseconds kShutterSlack(1500);
+
+std::string MakeSyntheticRecording(const std::filesystem::path& directory) {
+    std::filesystem::create_directories(directory);
+    const std::string path = (directory / "clip.rec").string();
+    camera::FrameRecorder recorder;
+    if (!recorder.Open(path)) {
+        return std::string();
+    }
+    const uint64_t period = 1000000000u / Camera::kFrameRate;
+    for (size_t i = 0u; i < kSyntheticFrames; i++) {
+        cv::Mat frame(Camera::kHeight, Camera::kWidth, CV_8UC3, cv::Scalar(i * 10 % 256, 128, 64));
+        recorder.Write(frame, i * period);
+    }
+    return recorder.Close() ? path : std::string();
+}
+
+// only the forced path, on a short clock
+p2pro::ShutterConfig MakeForcedShutterConfig() {
+    p2pro::ShutterConfig config;
+    config.idleTime = std::chrono::hours(1);
+    config.stableTime = std::chrono::hours(1);
+    config.minInterval = std::chrono::seconds(0);
+    config.maxInterval = std::chrono::seconds(2);
+    config.forcedIdleTime = std::chrono::milliseconds(1000);
+    config.forcedGrace = std::chrono::seconds(4);
+    return config;
+}
+
+void TurnKnobUntil(p2pro::ShutterScheduler& scheduler, std::chrono::steady_clock::time_point until) {
+    while (std::chrono::steady_clock::now() < until) {
+        scheduler.NotifyUserInput();
+        std::this_thread::sleep_for(kInputPeriod);
+    }
+}
+
+// starts counts stream starts, one per shutter
+bool RunForcedShutter(p2pro::ShutterScheduler& scheduler, const p2pro::ShutterConfig& config,
+                      std::atomic<uint32_t>& starts) {
+    const auto begin = std::chrono::steady_clock::now();
+    scheduler.Start();
+    // switching the auto shutter off restarts the stream once
+    std::this_thread::sleep_for(kShutterSlack);
+    starts.store(0u);
+
+    TurnKnobUntil(scheduler, begin + config.maxInterval + kShutterSlack);
+    if (starts.load() != 0u) {
+        printf("forced shutter fired while a knob was turning\n");
+        return false;
+    }
+
+    std::this_thread::sleep_for(config.forcedIdleTime + kShutterSlack);
+    if (starts.load() != 1u) {
+        printf("forced shutter took %u restarts once the knob rested, expected 1\n", starts.load());
+        return false;
+    }
+
+    starts.store(0u);
+    TurnKnobUntil(scheduler, std::chrono::steady_clock::now() + config.maxInterval + config.forcedGrace + kShutterSlack);
+    if (starts.load() != 1u) {
+        printf("forced shutter took %u restarts past its grace period, expected 1\n", starts.load());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::chrono::milliseconds longUnplug = kDefaultLongUnplug;
+    for (int32_t i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--long-unplug-ms") == 0) {
+            longUnplug = std::chrono::milliseconds(std::strtoul(argv[i + 1], nullptr, 10));
+        } else {
+            fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    log::LogInit();
+    log::SetLogLevel(log::LogLevel::kNotice);
+    const std::string recording = MakeSyntheticRecording(kDefaultDirectory);
+    if (recording.empty()) {
+        fprintf(stderr, "cannot write the synthetic recording\n");
+        log::LogDeinit();
+        return 1;
+    }
+
+    auto webcam = std::make_shared<p2pro::Webcam>(recording, Camera::kWidth, Camera::kHeight, Camera::kFrameRate);
+    auto control = std::make_shared<p2pro::UsbControl>(std::make_unique<p2pro::FakeUsbTransport>());
+    p2pro::P2ProManager manager(webcam, control);
+
+    // registered ahead of the supervisor, so it sees the delayed frame late
+    std::atomic<bool> slowStart(false);
+    std::atomic<uint32_t> starts(0u);
+    std::chrono::steady_clock::time_point lastStart;
+    webcam->RegisterOnDataCallback([&](cv::Mat&, bool) {
+        if (webcam->GetStartTime() != lastStart) {
+            lastStart = webcam->GetStartTime();
+            starts.fetch_add(1u);
+            if (slowStart.load()) {
+                std::this_thread::sleep_for(kSlowFirstFrame);
+            }
+        }
+        return true;
+    });
+    auto transport = std::make_unique<p2pro::FakeHotplugTransport>(true);
+    p2pro::FakeHotplugTransport& hotplug = *transport;
+    p2pro::CameraSupervisor supervisor(manager, webcam, std::move(transport));
+    // registered before the stream starts, started after the unplug cycles
+    const p2pro::ShutterConfig shutterConfig = MakeForcedShutterConfig();
+    p2pro::ShutterScheduler scheduler(manager, webcam, shutterConfig);
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    uint32_t recovered = 0u;
+    supervisor.SetOnRecoveredCallback([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        recovered++;
+        changed.notify_all();
+    });
+
+    if (!manager.StartVideoStream() || !supervisor.Start()) {
+        fprintf(stderr, "cannot start the replayed stream\n");
+        log::LogDeinit();
+        return 1;
+    }
+
+    // A real unplug takes the stream with it, the replay has to be stopped
+    // by hand. The manager's lock keeps this off a restart in progress.
+    int32_t result = 0;
+    const std::chrono::milliseconds unplugs[] = { kGlitch, longUnplug };
+    for (const std::chrono::milliseconds unplug : unplugs) {
+        const uint32_t before = recovered;
+        hotplug.SimulateDisconnect();
+        manager.StopVideoStream();
+        std::this_thread::sleep_for(unplug);
+        slowStart.store(unplug == longUnplug);
+        starts.store(0u);
+        hotplug.SimulateReconnect();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!changed.wait_for(lock, kRecoverTimeout, [&]() { return recovered > before; })) {
+            printf("unplug of %lld ms did not recover\n", static_cast<long long>(unplug.count()));
+            result = 1;
+            break;
+        }
+        lock.unlock();
+
+        // the recovered stream has to stay up, not be torn down by a stale timer
+        std::this_thread::sleep_for(kSettleTime);
+        if (supervisor.GetState() != p2pro::SupervisorState::kStreaming) {
+            printf("unplug of %lld ms recovered, then lost the stream again (%s)\n",
+                   static_cast<long long>(unplug.count()), p2pro::SupervisorStateToStr(supervisor.GetState()));
+            result = 1;
+            break;
+        }
+        if (starts.load() != 1u) {
+            printf("unplug of %lld ms took %u restarts\n", static_cast<long long>(unplug.count()), starts.load());
+            result = 1;
+            break;
+        }
+    }
+
+    supervisor.Stop();
+    const p2pro::RecoveryStats stats = supervisor.GetRecoveryStats();
+    if (result == 0 && (stats.losses != std::size(unplugs) || stats.recoveries != std::size(unplugs))) {
+        printf("expected %zu losses and recoveries\n", std::size(unplugs));
+        result = 1;
+    }
+
+    bool shutterOk = (result == 0) && RunForcedShutter(scheduler, shutterConfig, starts);
+    if (!shutterOk) {
+        result = 1;
+    }
+    scheduler.Stop();
+    manager.ReleaseDevice();
+
+    printf("{\"losses\":%u,\"recoveries\":%u,\"failed_attempts\":%u,\"last_ms\":%lld,\"max_ms\":%lld,"
+           "\"forced_shutter\":\"%s\",\"result\":\"%s\"}\n",
+           stats.losses, stats.recoveries, stats.failedAttempts,
+           static_cast<long long>(stats.lastRecovery.count()), static_cast<long long>(stats.maxRecovery.count()),
+           shutterOk ? "ok" : "FAILED", (result == 0) ? "ok" : "FAILED");
+
+    log::LogDeinit();
+    return result;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CAMERA_BACKEND_H_
+#define _CAMERA_BACKEND_H_
+
+#include <stdint.h>
+
+#include <concepts>
+#include <cstddef>
+
+#include "UsbControl.h"
+
+namespace thermal {
+namespace camera {
+
+// Format of the frames handed to the data callbacks.
+enum class PixelFormat : uint8_t {
+    kBgr24,  ///< 8 bit BGR, converted by the capture backend
+    kYuyv,   ///< packed YUV 4:2:2 straight from the sensor
+    kY16,    ///< 16 bit thermal counts
+};
+
+// How the raw (unconverted) frame is laid out in memory.
+enum class RawPlaneLayout : uint8_t {
+    kImageOnly,         ///< a single visible image
+    kImageOverThermal,  ///< visible image on top, 16 bit thermal plane below it
+};
+
+// Every sensor model is described by one of these. Everything is a compile
+// time constant so the frame kernels can be specialised per geometry.
+template <typename T>
+concept CameraBackend = requires {
+    { T::kName } -> std::convertible_to<const char*>;
+    { T::kWidth } -> std::convertible_to<size_t>;
+    { T::kHeight } -> std::convertible_to<size_t>;
+    { T::kFrameRate } -> std::convertible_to<int32_t>;
+    { T::kDeviceId } -> std::convertible_to<int32_t>;
+    { T::kPixelFormat } -> std::convertible_to<PixelFormat>;
+    { T::kRawPixelFormat } -> std::convertible_to<PixelFormat>;
+    { T::kRawLayout } -> std::convertible_to<RawPlaneLayout>;
+    { T::kRawHeight } -> std::convertible_to<size_t>;
+    { T::kHasCommandSet } -> std::convertible_to<bool>;
+    { T::kVendorId } -> std::convertible_to<uint16_t>;
+    { T::kProductId } -> std::convertible_to<uint16_t>;
+};
+
+// InfiRay P2 Pro. In raw mode the 256x384 YUYV frame holds the image in the
+// top half and the 16 bit thermal counts in the bottom half.
+struct P2ProBackend {
+    static constexpr const char* kName = "P2 Pro";
+    static constexpr size_t kWidth = 256u;
+    static constexpr size_t kHeight = 192u;
+    static constexpr int32_t kFrameRate = 25;
+    static constexpr int32_t kDeviceId = 0;
+    static constexpr PixelFormat kPixelFormat = PixelFormat::kBgr24;
+    static constexpr PixelFormat kRawPixelFormat = PixelFormat::kYuyv;
+    static constexpr RawPlaneLayout kRawLayout = RawPlaneLayout::kImageOverThermal;
+    static constexpr size_t kRawHeight = 384u;
+    static constexpr bool kHasCommandSet = true;
+    static constexpr uint16_t kVendorId = p2pro::kVendorId;
+    static constexpr uint16_t kProductId = p2pro::kProductId;
+};
+
+// InfiRay TC001. Same sensor core, frame layout and vendor command set as
+// the P2 Pro, a separate entry so the two can diverge.
+struct Tc001Backend {
+    static constexpr const char* kName = "TC001";
+    static constexpr size_t kWidth = 256u;
+    static constexpr size_t kHeight = 192u;
+    static constexpr int32_t kFrameRate = 25;
+    static constexpr int32_t kDeviceId = 0;
+    static constexpr PixelFormat kPixelFormat = PixelFormat::kBgr24;
+    static constexpr PixelFormat kRawPixelFormat = PixelFormat::kYuyv;
+    static constexpr RawPlaneLayout kRawLayout = RawPlaneLayout::kImageOverThermal;
+    static constexpr size_t kRawHeight = 384u;
+    static constexpr bool kHasCommandSet = true;
+    static constexpr uint16_t kVendorId = p2pro::kVendorId;
+    static constexpr uint16_t kProductId = p2pro::kProductId;
+};
+
+// Any UVC camera. No vendor commands, so no palette, shutter or state queries.
+struct GenericUvcBackend {
+    static constexpr const char* kName = "UVC";
+    static constexpr size_t kWidth = 640u;
+    static constexpr size_t kHeight = 480u;
+    static constexpr int32_t kFrameRate = 30;
+    static constexpr int32_t kDeviceId = 0;
+    static constexpr PixelFormat kPixelFormat = PixelFormat::kBgr24;
+    static constexpr PixelFormat kRawPixelFormat = PixelFormat::kYuyv;
+    static constexpr RawPlaneLayout kRawLayout = RawPlaneLayout::kImageOnly;
+    static constexpr size_t kRawHeight = 480u;
+    static constexpr bool kHasCommandSet = false;
+    static constexpr uint16_t kVendorId = 0u;
+    static constexpr uint16_t kProductId = 0u;
+};
+
+// Picked at build time with -DTHERMAL_SCOPE_CAMERA=<P2PRO|TC001|UVC>.
+#if defined(THERMAL_SCOPE_CAMERA_TC001)
+using ActiveCamera = Tc001Backend;
+#elif defined(THERMAL_SCOPE_CAMERA_UVC)
+using ActiveCamera = GenericUvcBackend;
+#else
+using ActiveCamera = P2ProBackend;
+#endif
+
+static_assert(CameraBackend<P2ProBackend>);
+static_assert(CameraBackend<Tc001Backend>);
+static_assert(CameraBackend<GenericUvcBackend>);
+static_assert(CameraBackend<ActiveCamera>);
+
+} // camera
+} // thermal
+
+#endif // _CAMERA_BACKEND_H_
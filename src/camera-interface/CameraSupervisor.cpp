@@ -0,0 +1,276 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CameraSupervisor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "Logger.h"
+
+namespace thermal {
+namespace p2pro {
+
+// At 25 fps a second without frames is a dead stream, not a slow one.
+constexpr const std::chrono::milliseconds kFrameTimeout(1000);
+constexpr const std::chrono::milliseconds kRetryInterval(250);
+constexpr const std::chrono::milliseconds kReconnectTimeout(5000);
+// a restarted stream gets this long for its first frame before it counts as dead
+constexpr const std::chrono::milliseconds kFirstFrameTimeout(2000);
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::placeholders::_1;
+using std::placeholders::_2;
+
+static int64_t NowNs() {
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+CameraSupervisor::CameraSupervisor(P2ProManager& manager, std::shared_ptr<Webcam> webcam, std::unique_ptr<HotplugTransport> transport)
+    : mManager(manager)
+    , mWebcam(webcam)
+    , mTransport(std::move(transport))
+    , mSignalLostCallback(nullptr)
+    , mRecoveredCallback(nullptr)
+    , mState(SupervisorState::kStopped)
+    , mStats()
+    , mRunFlag(false)
+    , mLossReported(false)
+    , mArrived(false)
+    , mLossTime()
+    , mRestartTime()
+    , mLastFrameNs(0) {
+    mWebcam->RegisterOnDataCallback(std::bind(&CameraSupervisor::OnFrame, this, _1, _2));
+    mWebcam->SetOnSignalLostCallback([this]() { ReportLoss("webcam read failures"); });
+    return;
+}
+
+CameraSupervisor::~CameraSupervisor() {
+    Stop();
+    return;
+}
+
+bool CameraSupervisor::Start() {
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mRunFlag) {
+            return true;
+        }
+        mRunFlag = true;
+        mState = SupervisorState::kStreaming;
+        mLastFrameNs = NowNs();
+    }
+
+    // Without hotplug we still have the watchdog and the webcam read errors.
+    if (mTransport == nullptr || !mTransport->Start(std::bind(&CameraSupervisor::OnPresenceChanged, this, _1))) {
+        DLOG_WARN("no hotplug events, relying on frame watchdog only");
+    }
+
+    mThread = std::thread(&CameraSupervisor::Runloop, this);
+    return true;
+}
+
+void CameraSupervisor::Stop() {
+    if (mTransport != nullptr) {
+        mTransport->Stop();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mRunFlag = false;
+        mState = SupervisorState::kStopped;
+    }
+    mCv.notify_all();
+
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    return;
+}
+
+void CameraSupervisor::SetOnSignalLostCallback(SupervisorCallback callback) {
+    mSignalLostCallback = callback;
+    return;
+}
+
+void CameraSupervisor::SetOnRecoveredCallback(SupervisorCallback callback) {
+    mRecoveredCallback = callback;
+    return;
+}
+
+SupervisorState CameraSupervisor::GetState() const {
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mState;
+}
+
+RecoveryStats CameraSupervisor::GetRecoveryStats() const {
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+/// @brief called on the capture thread for every frame, so only touches the atomic.
+bool CameraSupervisor::OnFrame([[maybe_unused]] cv::Mat& frame, [[maybe_unused]] bool lastFrame) {
+    int64_t previous = mLastFrameNs.exchange(NowNs());
+    if (previous == 0) {
+        // first frame after a restart, let the supervisor thread log the metric
+        mCv.notify_all();
+    }
+    return true;
+}
+
+void CameraSupervisor::OnPresenceChanged(bool present) {
+    if (present) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mArrived = true;
+        mCv.notify_all();
+    } else {
+        ReportLoss("device left the bus");
+    }
+}
+
+void CameraSupervisor::ReportLoss(const char* reason) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (mState != SupervisorState::kStreaming) {
+        return;
+    }
+
+    DLOG_WARN("camera signal lost: %s", reason);
+    mState = SupervisorState::kSignalLost;
+    mStats.losses++;
+    mLossTime = steady_clock::now();
+    mLossReported = false;
+    mCv.notify_all();
+}
+
+bool CameraSupervisor::TryRecover() {
+    auto deadline = steady_clock::now() + kReconnectTimeout;
+    mLastFrameNs = 0;
+
+    while (steady_clock::now() < deadline) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (!mRunFlag) {
+                return false;
+            }
+        }
+
+        // No point hammering the bus while hotplug says the camera is gone.
+        if (mTransport == nullptr || mTransport->IsPresent()) {
+            if (mManager.RestartVideoStream()) {
+                return true;
+            }
+
+            std::unique_lock<std::mutex> lock(mMutex);
+            mStats.failedAttempts++;
+        }
+        std::this_thread::sleep_for(kRetryInterval);
+    }
+    return false;
+}
+
+void CameraSupervisor::Runloop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mRunFlag) {
+        mCv.wait_for(lock, kFrameTimeout);
+        if (!mRunFlag) {
+            break;
+        }
+
+        switch (mState) {
+            case SupervisorState::kStreaming: {
+                // Palette changes stop the stream on purpose, so only count
+                // from whichever is later: the last frame or the last start.
+                if (mWebcam->GetState() != WebcamState::kRunning) {
+                    break;
+                }
+                auto lastFrame = steady_clock::time_point(nanoseconds(mLastFrameNs.load()));
+                auto reference = std::max(lastFrame, mWebcam->GetStartTime());
+                if (steady_clock::now() - reference > kFrameTimeout) {
+                    lock.unlock();
+                    ReportLoss("frame watchdog expired");
+                    lock.lock();
+                }
+            } break;
+
+            case SupervisorState::kSignalLost: {
+                if (!mLossReported) {
+                    mLossReported = true;
+                    lock.unlock();
+                    if (mSignalLostCallback) {
+                        mSignalLostCallback();
+                    }
+                    lock.lock();
+                }
+
+                // A brief glitch leaves the device enumerated, so try straight
+                // away. A real unplug waits for the arrival event.
+                if (mArrived || mTransport == nullptr || mTransport->IsPresent()) {
+                    mArrived = false;
+                    mState = SupervisorState::kRecovering;
+                    lock.unlock();
+                    bool restarted = TryRecover();
+                    lock.lock();
+
+                    if (restarted) {
+                        mRestartTime = steady_clock::now();
+                    } else {
+                        DLOG_ERROR("failed to restart camera within %lld ms", static_cast<long long>(kReconnectTimeout.count()));
+                        if (mState == SupervisorState::kRecovering) {
+                            mState = SupervisorState::kSignalLost;
+                        }
+                    }
+                }
+            } break;
+
+            case SupervisorState::kRecovering: {
+                if (mLastFrameNs != 0) {
+                    auto elapsed = duration_cast<milliseconds>(steady_clock::now() - mLossTime);
+                    mStats.recoveries++;
+                    mStats.lastRecovery = elapsed;
+                    mStats.maxRecovery = std::max(mStats.maxRecovery, elapsed);
+                    mState = SupervisorState::kStreaming;
+                    DLOG_NOTICE("camera recovered in %lld ms (losses=%u, max=%lld ms)",
+                        static_cast<long long>(elapsed.count()), mStats.losses,
+                        static_cast<long long>(mStats.maxRecovery.count()));
+
+                    lock.unlock();
+                    if (mRecoveredCallback) {
+                        mRecoveredCallback();
+                    }
+                    lock.lock();
+
+                } else if (steady_clock::now() - mRestartTime > kFirstFrameTimeout) {
+                    // restarted but never produced a frame, go around again
+                    DLOG_WARN("restarted stream produced no frames");
+                    mState = SupervisorState::kSignalLost;
+                }
+            } break;
+
+            case SupervisorState::kStopped:
+            default:
+                break;
+        }
+    }
+    return;
+}
+
+} // p2pro
+} // thermal
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CAMERA_SUPERVISOR_H_
+#define _CAMERA_SUPERVISOR_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "HotplugTransport.h"
+#include "P2ProManager.h"
+#include "Webcam.h"
+
+namespace thermal {
+namespace p2pro {
+
+enum class SupervisorState : uint8_t {
+    kStopped,
+    kStreaming,
+    kSignalLost,
+    kRecovering,
+};
+
+inline const char * SupervisorStateToStr(SupervisorState state) {
+    switch (state) {
+        case SupervisorState::kStopped:
+            return "STOPPED";
+        case SupervisorState::kStreaming:
+            return "STREAMING";
+        case SupervisorState::kSignalLost:
+            return "SIGNAL LOST";
+        case SupervisorState::kRecovering:
+            return "RECOVERING";
+        default:
+            return "ERR";
+    }
+}
+
+// Time-to-recover is measured from the moment the loss is detected to the
+// first frame delivered by the restarted stream.
+struct RecoveryStats {
+    uint32_t losses = 0u;
+    uint32_t recoveries = 0u;
+    uint32_t failedAttempts = 0u;
+    std::chrono::milliseconds lastRecovery{0};
+    std::chrono::milliseconds maxRecovery{0};
+};
+
+typedef std::function<void()> SupervisorCallback;
+
+// Keeps the video stream alive across brown-outs and cable jiggles. Loss is
+// detected by hotplug removal, by the webcam reporting failed reads, or by a
+// frame watchdog, whichever fires first. Recovery restarts the stream through
+// the P2ProManager with a bounded number of attempts.
+class CameraSupervisor {
+public:
+    CameraSupervisor(P2ProManager& manager, std::shared_ptr<Webcam> webcam, std::unique_ptr<HotplugTransport> transport);
+    ~CameraSupervisor();
+
+    bool Start();
+    void Stop();
+    void SetOnSignalLostCallback(SupervisorCallback callback);
+    void SetOnRecoveredCallback(SupervisorCallback callback);
+    SupervisorState GetState() const;
+    RecoveryStats GetRecoveryStats() const;
+
+private:
+    P2ProManager& mManager;
+    std::shared_ptr<Webcam> mWebcam;
+    std::unique_ptr<HotplugTransport> mTransport;
+    SupervisorCallback mSignalLostCallback;
+    SupervisorCallback mRecoveredCallback;
+
+    std::thread mThread;
+    mutable std::mutex mMutex;
+    std::condition_variable mCv;
+    SupervisorState mState;
+    RecoveryStats mStats;
+    bool mRunFlag;
+    bool mLossReported;
+    bool mArrived;
+    std::chrono::steady_clock::time_point mLossTime;
+    std::chrono::steady_clock::time_point mRestartTime; ///< the first frame is waited for from here
+    std::atomic<int64_t> mLastFrameNs;
+
+    bool OnFrame(cv::Mat& frame, bool lastFrame);
+    void OnPresenceChanged(bool present);
+    void ReportLoss(const char* reason);
+    bool TryRecover();
+    void Runloop();
+};
+
+} // p2pro
+} // thermal
+
+#endif // _CAMERA_SUPERVISOR_H_
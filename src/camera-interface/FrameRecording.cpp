@@ -0,0 +1,385 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameRecording.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <cstring>
+
+#include "Logger.h"
+
+namespace thermal {
+namespace camera {
+
+FrameRecorder::FrameRecorder()
+    : mFd(-1)
+    , mPath()
+    , mHeader{}
+    , mIndex()
+    , mSlot()
+    , mBytesWritten(0u) {
+    return;
+}
+
+FrameRecorder::~FrameRecorder() {
+    Close();
+}
+
+bool FrameRecorder::Open(const std::string& path) {
+    Close();
+
+    mFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (mFd < 0) {
+        DLOG_ERROR("failed to create %s (%s)", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    mPath = path;
+    mHeader = RecordingHeader{};
+    mHeader.magic = kRecordingMagic;
+    mHeader.version = kRecordingVersion;
+    mHeader.headerBytes = sizeof(RecordingHeader);
+    mIndex.clear();
+    mBytesWritten = 0u;
+
+    // the header goes out again with the final counts on Close()
+    return WriteAll(&mHeader, sizeof(mHeader), 0u);
+}
+
+bool FrameRecorder::Write(const cv::Mat& frame, uint64_t timestamp) {
+    if (mFd < 0 || frame.empty()) {
+        return false;
+    }
+
+    const size_t rowBytes = static_cast<size_t>(frame.cols) * frame.elemSize();
+    if (mIndex.empty()) {
+        mHeader.width = static_cast<uint32_t>(frame.cols);
+        mHeader.height = static_cast<uint32_t>(frame.rows);
+        mHeader.type = frame.type();
+        mHeader.frameBytes = static_cast<uint32_t>(rowBytes * frame.rows);
+        mHeader.slotBytes = static_cast<uint32_t>((sizeof(FrameHeader) + mHeader.frameBytes + kSlotAlignment - 1u)
+                                                  / kSlotAlignment * kSlotAlignment);
+        mSlot.assign(mHeader.slotBytes, 0u);
+        DLOG_NOTICE("recording %ux%u type %d frames to %s", mHeader.width, mHeader.height, mHeader.type, mPath.c_str());
+    } else if (static_cast<uint32_t>(frame.cols) != mHeader.width || static_cast<uint32_t>(frame.rows) != mHeader.height
+               || frame.type() != mHeader.type) {
+        DLOG_WARN("frame %dx%d type %d does not match the recording", frame.cols, frame.rows, frame.type());
+        return false;
+    }
+
+    // header and pixels in one buffer, so each frame is a single write
+    FrameHeader header = { timestamp, static_cast<uint64_t>(mIndex.size()) };
+    std::memcpy(mSlot.data(), &header, sizeof(header));
+    uint8_t* pixels = mSlot.data() + sizeof(header);
+    if (frame.isContinuous()) {
+        std::memcpy(pixels, frame.data, mHeader.frameBytes);
+    } else {
+        for (int32_t row = 0; row < frame.rows; row++) {
+            std::memcpy(pixels + row * rowBytes, frame.ptr(row), rowBytes);
+        }
+    }
+
+    const uint64_t offset = sizeof(RecordingHeader) + mIndex.size() * static_cast<uint64_t>(mHeader.slotBytes);
+    if (!WriteAll(mSlot.data(), mSlot.size(), offset)) {
+        return false;
+    }
+    mIndex.push_back(IndexEntry{ offset, timestamp });
+    return true;
+}
+
+bool FrameRecorder::Close() {
+    if (mFd < 0) {
+        return true;
+    }
+
+    mHeader.frameCount = mIndex.size();
+    mHeader.indexOffset = sizeof(RecordingHeader) + mIndex.size() * static_cast<uint64_t>(mHeader.slotBytes);
+    bool status = WriteAll(mIndex.data(), mIndex.size() * sizeof(IndexEntry), mHeader.indexOffset);
+    status &= WriteAll(&mHeader, sizeof(mHeader), 0u);
+    if (::fsync(mFd) != 0) {
+        DLOG_WARN("failed to sync %s (%s)", mPath.c_str(), strerror(errno));
+    }
+    ::close(mFd);
+    mFd = -1;
+
+    DLOG_NOTICE("recorded %llu frames, %llu bytes to %s", static_cast<unsigned long long>(mHeader.frameCount),
+                static_cast<unsigned long long>(mBytesWritten), mPath.c_str());
+    return status;
+}
+
+uint64_t FrameRecorder::GetFrameCount() const {
+    return mIndex.size();
+}
+
+uint64_t FrameRecorder::GetBytesWritten() const {
+    return mBytesWritten;
+}
+
+bool FrameRecorder::WriteAll(const void* data, size_t size, uint64_t offset) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    size_t written = 0u;
+    while (written < size) {
+        ssize_t n = ::pwrite(mFd, bytes + written, size - written, static_cast<off_t>(offset + written));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            DLOG_ERROR("failed to write %s (%s)", mPath.c_str(), strerror(errno));
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    mBytesWritten += size;
+    return true;
+}
+
+RecordingReader::RecordingReader()
+    : mMapping(nullptr)
+    , mMappingSize(0u)
+    , mHeader{}
+    , mFrameCount(0u) {
+    return;
+}
+
+RecordingReader::~RecordingReader() {
+    Close();
+}
+
+bool RecordingReader::Probe(const std::string& path) {
+    int32_t fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    uint32_t magic = 0u;
+    const bool status = (::read(fd, &magic, sizeof(magic)) == sizeof(magic)) && (magic == kRecordingMagic);
+    ::close(fd);
+    return status;
+}
+
+bool RecordingReader::Open(const std::string& path) {
+    Close();
+
+    int32_t fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        DLOG_ERROR("failed to open %s (%s)", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(RecordingHeader)) {
+        DLOG_ERROR("%s is too short for a recording", path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    // private and writable: in place edits of a frame copy the page
+    mMappingSize = static_cast<size_t>(st.st_size);
+    void* mapping = ::mmap(nullptr, mMappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        DLOG_ERROR("failed to map %s (%s)", path.c_str(), strerror(errno));
+        mMappingSize = 0u;
+        return false;
+    }
+    mMapping = static_cast<uint8_t*>(mapping);
+    ::madvise(mMapping, mMappingSize, MADV_SEQUENTIAL);
+
+    std::memcpy(&mHeader, mMapping, sizeof(mHeader));
+    if (mHeader.magic != kRecordingMagic || mHeader.version != kRecordingVersion
+        || mHeader.headerBytes != sizeof(RecordingHeader)) {
+        DLOG_ERROR("%s is not a version %u recording", path.c_str(), kRecordingVersion);
+        Close();
+        return false;
+    }
+
+    // an unclosed recording has no index, count the whole slots instead
+    const size_t slots = (mHeader.slotBytes > 0u) ? (mMappingSize - sizeof(RecordingHeader)) / mHeader.slotBytes : 0u;
+    const bool indexed = mHeader.frameCount > 0u
+        && mHeader.indexOffset + mHeader.frameCount * sizeof(IndexEntry) <= mMappingSize;
+    mFrameCount = indexed ? static_cast<size_t>(mHeader.frameCount) : slots;
+    if (!indexed && mFrameCount > 0u) {
+        DLOG_WARN("%s was not closed, recovered %zu frames", path.c_str(), mFrameCount);
+    }
+
+    DLOG_NOTICE("mapped %s, %zu frames of %ux%u type %d", path.c_str(), mFrameCount, mHeader.width, mHeader.height,
+                mHeader.type);
+    return mFrameCount > 0u;
+}
+
+void RecordingReader::Close() {
+    if (mMapping != nullptr) {
+        ::munmap(mMapping, mMappingSize);
+    }
+    mMapping = nullptr;
+    mMappingSize = 0u;
+    mFrameCount = 0u;
+    return;
+}
+
+size_t RecordingReader::GetFrameCount() const {
+    return mFrameCount;
+}
+
+size_t RecordingReader::GetWidth() const {
+    return mHeader.width;
+}
+
+size_t RecordingReader::GetHeight() const {
+    return mHeader.height;
+}
+
+int32_t RecordingReader::GetType() const {
+    return mHeader.type;
+}
+
+cv::Mat RecordingReader::GetFrame(size_t index) const {
+    const FrameHeader* header = GetFrameHeader(index);
+    if (header == nullptr) {
+        return cv::Mat();
+    }
+    uint8_t* pixels = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(header + 1));
+    return cv::Mat(static_cast<int32_t>(mHeader.height), static_cast<int32_t>(mHeader.width), mHeader.type, pixels);
+}
+
+uint64_t RecordingReader::GetTimestamp(size_t index) const {
+    const FrameHeader* header = GetFrameHeader(index);
+    return (header != nullptr) ? header->timestamp : 0u;
+}
+
+const FrameHeader* RecordingReader::GetFrameHeader(size_t index) const {
+    if (index >= mFrameCount) {
+        return nullptr;
+    }
+
+    // slots are fixed size, the index is only needed by tools that seek by time
+    uint64_t offset = sizeof(RecordingHeader) + index * static_cast<uint64_t>(mHeader.slotBytes);
+    if (offset + mHeader.slotBytes > mMappingSize) {
+        return nullptr;
+    }
+    return reinterpret_cast<const FrameHeader*>(mMapping + offset);
+}
+
+FrameEncoder::FrameEncoder(FrameCodec codec)
+    : mCodec(codec)
+    , mParams()
+    , mConverted() {
+    if (codec == FrameCodec::kJpeg) {
+        mParams = { cv::IMWRITE_JPEG_QUALITY, kJpegQuality };
+    } else {
+        mParams = { cv::IMWRITE_PNG_COMPRESSION, kPngCompression };
+    }
+}
+
+bool FrameEncoder::Encode(const cv::Mat& frame, std::vector<uint8_t>& output) {
+    const cv::Mat* image = &frame;
+    cv::Mat view;
+    const int32_t channels = frame.channels();
+    if (frame.depth() == CV_8U && channels == 4) {
+        // the alpha channel of a display frame is always opaque
+        cv::cvtColor(frame, mConverted, cv::COLOR_RGBA2BGR);
+        image = &mConverted;
+    } else if ((frame.depth() == CV_8U && channels == 2) || frame.depth() == CV_16U) {
+        if (mCodec != FrameCodec::kPng || !frame.isContinuous()) {
+            return false;
+        }
+        // raw bytes as 16 bit grey, PNG keeps every bit of them
+        view = cv::Mat(frame.rows, static_cast<int32_t>(frame.cols * frame.elemSize() / sizeof(uint16_t)), CV_16UC1,
+                       frame.data);
+        image = &view;
+    } else if (frame.depth() != CV_8U || (channels != 1 && channels != 3)) {
+        return false;
+    }
+
+    return cv::imencode((mCodec == FrameCodec::kJpeg) ? ".jpg" : ".png", *image, output, mParams);
+}
+
+FrameCodec FrameEncoder::GetCodec() const {
+    return mCodec;
+}
+
+CompressedWriter::CompressedWriter()
+    : mFile()
+    , mCodec(FrameCodec::kJpeg)
+    , mSequence(0u) {
+    return;
+}
+
+bool CompressedWriter::Open(const std::string& path, FrameCodec codec) {
+    mCodec = codec;
+    mSequence = 0u;
+    return mFile.Open(path);
+}
+
+bool CompressedWriter::Write(const cv::Mat& frame, const std::vector<uint8_t>& encoded, uint64_t timestamp) {
+    return Write(static_cast<uint32_t>(frame.cols), static_cast<uint32_t>(frame.rows), frame.type(), encoded.data(),
+                 encoded.size(), timestamp);
+}
+
+bool CompressedWriter::Write(uint32_t width, uint32_t height, int32_t type, const uint8_t* encoded, size_t size,
+                             uint64_t timestamp) {
+    if (mSequence == 0u) {
+        CompressedHeader header{};
+        header.magic = kCompressedMagic;
+        header.version = kCompressedVersion;
+        header.headerBytes = sizeof(CompressedHeader);
+        header.codec = static_cast<uint32_t>(mCodec);
+        header.width = width;
+        header.height = height;
+        header.type = type;
+        if (!mFile.Append(&header, sizeof(header))) {
+            return false;
+        }
+    }
+
+    PacketHeader packet = { static_cast<uint32_t>(size), mSequence, timestamp };
+    if (!mFile.Append(&packet, sizeof(packet)) || !mFile.Append(encoded, size)) {
+        return false;
+    }
+    mSequence++;
+    return true;
+}
+
+bool CompressedWriter::Close() {
+    return mFile.Close();
+}
+
+bool CompressedWriter::IsOpen() const {
+    return mFile.IsOpen();
+}
+
+bool CompressedWriter::IsDirect() const {
+    return mFile.IsDirect();
+}
+
+uint32_t CompressedWriter::GetFrameCount() const {
+    return mSequence;
+}
+
+uint64_t CompressedWriter::GetBytesWritten() const {
+    return mFile.GetSize();
+}
+
+} // camera
+} // thermal
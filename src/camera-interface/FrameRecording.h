@@ -0,0 +1,273 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FRAME_RECORDING_H_
+#define _FRAME_RECORDING_H_
+
+#include <stdint.h>
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "AlignedFileWriter.h"
+
+namespace thermal {
+namespace camera {
+
+inline constexpr uint32_t kRecordingMagic = 0x43525354; ///< "TSRC"
+inline constexpr uint16_t kRecordingVersion = 1u;
+inline constexpr uint32_t kCompressedMagic = 0x56435354; ///< "TSCV"
+inline constexpr uint16_t kCompressedVersion = 1u;
+
+/**
+ * @brief First 64 bytes of a recording.
+ *
+ * A recording is a header, then one fixed size slot per frame, then an index:
+ *
+ *     header | slot 0 | slot 1 | ... | index
+ *     slot  = FrameHeader | rows * cols * elemSize bytes | pad to 64 bytes
+ *     index = frameCount * IndexEntry
+ *
+ * little-endian. Every frame has the geometry and type of the first one and
+ * the pixels are packed, so a slot maps straight onto a cv::Mat. frameCount
+ * and indexOffset are filled in when the recorder closes; a recording that
+ * was never closed is still read, the frames are counted from the file size.
+ */
+struct RecordingHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerBytes;
+    uint32_t width;
+    uint32_t height;
+    int32_t type;         ///< cv::Mat type, e.g. CV_8UC3 for BGR or CV_8UC2 for raw YUYV
+    uint32_t frameBytes;  ///< pixel bytes of one frame
+    uint32_t slotBytes;   ///< FrameHeader + pixels, rounded up to kSlotAlignment
+    uint32_t reserved0;
+    uint64_t frameCount;
+    uint64_t indexOffset;
+    uint64_t reserved1[2];
+};
+static_assert(sizeof(RecordingHeader) == 64u);
+
+struct FrameHeader {
+    uint64_t timestamp;   ///< capture time, monotonic ns
+    uint64_t sequence;    ///< frame number in the recording
+};
+static_assert(sizeof(FrameHeader) == 16u);
+
+struct IndexEntry {
+    uint64_t offset;      ///< of the slot from the start of the file
+    uint64_t timestamp;
+};
+static_assert(sizeof(IndexEntry) == 16u);
+
+/**
+ * @brief Writes captured frames, as they are, into a recording.
+ *
+ * Writes go straight to the file with one write() per frame, so this is
+ * meant for capture sessions on the bench rather than the live view.
+ */
+class FrameRecorder {
+public:
+    static constexpr size_t kSlotAlignment = 64u;
+
+    FrameRecorder();
+    ~FrameRecorder();
+
+    /**
+     * @brief Creates (or truncates) the recording.
+     * @return false if the file could not be created.
+     */
+    bool Open(const std::string& path);
+
+    /**
+     * @brief Appends a frame. The first frame fixes the geometry and type,
+     *        frames that don't match it are rejected.
+     * @param frame the frame, BGR or raw.
+     * @param timestamp capture time, monotonic ns.
+     */
+    bool Write(const cv::Mat& frame, uint64_t timestamp);
+
+    /**
+     * @brief Writes the index and the final header and closes the file.
+     */
+    bool Close();
+
+    uint64_t GetFrameCount() const;
+    uint64_t GetBytesWritten() const;
+
+private:
+    int32_t mFd;
+    std::string mPath;
+    RecordingHeader mHeader;
+    std::vector<IndexEntry> mIndex;
+    std::vector<uint8_t> mSlot;   ///< one slot, reused
+    uint64_t mBytesWritten;
+
+    bool WriteAll(const void* data, size_t size, uint64_t offset);
+};
+
+/**
+ * @brief Maps a recording and hands out its frames without copying.
+ *
+ * The mapping is private and writable, so a frame handed to code that
+ * modifies it in place copies that page and leaves the file alone.
+ */
+class RecordingReader {
+public:
+    RecordingReader();
+    ~RecordingReader();
+
+    /**
+     * @brief Whether a file starts like a recording.
+     */
+    static bool Probe(const std::string& path);
+
+    bool Open(const std::string& path);
+    void Close();
+
+    size_t GetFrameCount() const;
+    size_t GetWidth() const;
+    size_t GetHeight() const;
+    int32_t GetType() const;
+
+    /**
+     * @brief A frame, as a cv::Mat header over the mapping. Valid until
+     *        Close().
+     */
+    cv::Mat GetFrame(size_t index) const;
+
+    /**
+     * @brief Capture time of a frame, monotonic ns.
+     */
+    uint64_t GetTimestamp(size_t index) const;
+
+private:
+    uint8_t* mMapping;
+    size_t mMappingSize;
+    RecordingHeader mHeader;
+    size_t mFrameCount;
+
+    const FrameHeader* GetFrameHeader(size_t index) const;
+};
+
+enum class FrameCodec : uint32_t {
+    kJpeg = 0u,  ///< 8 bit colour, lossy, the frames of an MJPEG stream
+    kPng = 1u,   ///< lossless, 16 bit for raw frames
+};
+
+/**
+ * @brief First 64 bytes of a compressed recording.
+ *
+ * A compressed recording is a header followed by packets, each a
+ * PacketHeader and one encoded frame (a complete JPEG or PNG file). The
+ * packets are not aligned and there is no index; a reader walks them from
+ * the start, which also works on a file that was cut short.
+ */
+struct CompressedHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerBytes;
+    uint32_t codec;       ///< FrameCodec
+    uint32_t width;
+    uint32_t height;
+    int32_t type;         ///< cv::Mat type of the frames before encoding
+    uint32_t reserved[10];
+};
+static_assert(sizeof(CompressedHeader) == 64u);
+
+struct PacketHeader {
+    uint32_t bytes;       ///< encoded frame that follows
+    uint32_t sequence;
+    uint64_t timestamp;   ///< capture time, monotonic ns
+};
+static_assert(sizeof(PacketHeader) == 16u);
+
+/**
+ * @brief Encodes frames for a compressed recording.
+ *
+ * 3 channel frames are BGR and 4 channel frames the display's RGBA, both
+ * stored as 8 bit colour. Raw frames (2 channel YUYV, or 16 bit counts) are
+ * stored as 16 bit greyscale PNG with every byte kept, JPEG can't take them.
+ */
+class FrameEncoder {
+public:
+    static constexpr int32_t kJpegQuality = 85;
+    static constexpr int32_t kPngCompression = 1; ///< fast, most of the gain
+
+    explicit FrameEncoder(FrameCodec codec);
+
+    /**
+     * @brief Encodes a frame, reusing the output's storage.
+     * @return false if the frame can't be encoded with this codec.
+     */
+    bool Encode(const cv::Mat& frame, std::vector<uint8_t>& output);
+
+    FrameCodec GetCodec() const;
+
+private:
+    FrameCodec mCodec;
+    std::vector<int32_t> mParams;
+    cv::Mat mConverted;   ///< colour conversion, kept to avoid reallocating
+};
+
+/**
+ * @brief Writes encoded frames into a compressed recording, through an
+ *        utils::AlignedFileWriter so the card sees large sequential writes.
+ */
+class CompressedWriter {
+public:
+    CompressedWriter();
+
+    /**
+     * @brief Creates the recording.
+     * @param path the file.
+     * @param codec how the frames are encoded.
+     */
+    bool Open(const std::string& path, FrameCodec codec);
+
+    /**
+     * @brief Appends an encoded frame. The first one also writes the header.
+     * @param frame the frame before encoding, for its geometry and type.
+     * @param encoded the frame as FrameEncoder produced it.
+     * @param timestamp capture time, monotonic ns.
+     */
+    bool Write(const cv::Mat& frame, const std::vector<uint8_t>& encoded, uint64_t timestamp);
+
+    /**
+     * @brief Same, for frames kept encoded in memory without the original.
+     */
+    bool Write(uint32_t width, uint32_t height, int32_t type, const uint8_t* encoded, size_t size,
+               uint64_t timestamp);
+    bool Close();
+
+    bool IsOpen() const;
+    bool IsDirect() const;
+    uint32_t GetFrameCount() const;
+    uint64_t GetBytesWritten() const;
+
+private:
+    utils::AlignedFileWriter mFile;
+    FrameCodec mCodec;
+    uint32_t mSequence;
+};
+
+} // camera
+} // thermal
+
+#endif // _FRAME_RECORDING_H_
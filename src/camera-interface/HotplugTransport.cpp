@@ -0,0 +1,181 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HotplugTransport.h"
+
+#include <sys/time.h>
+#include <libusb.h>
+
+#include <thread>
+
+#include "Logger.h"
+
+namespace thermal {
+namespace p2pro {
+
+constexpr const int32_t kEventTimeoutMs = 250;
+
+LibUsbHotplugTransport::LibUsbHotplugTransport(uint16_t vendorId, uint16_t productId)
+    : mVendorId(vendorId)
+    , mProductId(productId)
+    , mContext(nullptr)
+    , mCallbackHandle()
+    , mCallback(nullptr)
+    , mRunFlag(false)
+    , mPresent(false) {
+    return;
+}
+
+LibUsbHotplugTransport::~LibUsbHotplugTransport() {
+    Stop();
+    return;
+}
+
+bool LibUsbHotplugTransport::Start(PresenceCallback callback) {
+    if (mRunFlag) {
+        DLOG_WARN("hotplug transport already running");
+        return true;
+    }
+
+    if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+        DLOG_ERROR("libusb was built without hotplug support");
+        return false;
+    }
+
+    int32_t res = libusb_init(&mContext);
+    if (res < 0) {
+        DLOG_ERROR("failed to initialize usb (err=%d)", res);
+        return false;
+    }
+
+    mCallback = callback;
+
+    // ENUMERATE makes libusb report an arrival for a camera that is already
+    // plugged in, so the initial presence comes through the same path.
+    res = libusb_hotplug_register_callback(mContext,
+        LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+        LIBUSB_HOTPLUG_ENUMERATE, mVendorId, mProductId, LIBUSB_HOTPLUG_MATCH_ANY,
+        &LibUsbHotplugTransport::OnHotplugEvent, this, &mCallbackHandle);
+    if (res != LIBUSB_SUCCESS) {
+        DLOG_ERROR("failed to register hotplug callback (err=%d)", res);
+        libusb_exit(mContext);
+        mContext = nullptr;
+        return false;
+    }
+
+    mRunFlag = true;
+    mEventThread = std::thread(&LibUsbHotplugTransport::EventLoop, this);
+    DLOG_INFO("watching for %04x:%04x hotplug events", mVendorId, mProductId);
+    return true;
+}
+
+void LibUsbHotplugTransport::Stop() {
+    mRunFlag = false;
+    if (mEventThread.joinable()) {
+        mEventThread.join();
+    }
+
+    if (mContext != nullptr) {
+        libusb_hotplug_deregister_callback(mContext, mCallbackHandle);
+        libusb_exit(mContext);
+        mContext = nullptr;
+    }
+    return;
+}
+
+bool LibUsbHotplugTransport::IsPresent() const {
+    return mPresent;
+}
+
+void LibUsbHotplugTransport::EventLoop() {
+    while (mRunFlag == true) {
+        timeval timeout = { 0, kEventTimeoutMs * 1000 };
+        int32_t res = libusb_handle_events_timeout_completed(mContext, &timeout, nullptr);
+        if (res < 0) {
+            DLOG_WARN("libusb event handling failed (err=%d)", res);
+        }
+    }
+    return;
+}
+
+int LibUsbHotplugTransport::OnHotplugEvent([[maybe_unused]] libusb_context* ctx,
+                                           [[maybe_unused]] libusb_device* device,
+                                           libusb_hotplug_event event,
+                                           void* userData) {
+    auto self = static_cast<LibUsbHotplugTransport*>(userData);
+    bool present = (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED);
+    DLOG_NOTICE("camera %s", present ? "arrived" : "left");
+
+    self->mPresent = present;
+    if (self->mCallback) {
+        self->mCallback(present);
+    }
+
+    // returning 0 keeps the callback registered
+    return 0;
+}
+
+FakeHotplugTransport::FakeHotplugTransport(bool present)
+    : mCallback(nullptr)
+    , mPresent(present) {
+    return;
+}
+
+FakeHotplugTransport::~FakeHotplugTransport() {
+    Stop();
+    return;
+}
+
+bool FakeHotplugTransport::Start(PresenceCallback callback) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCallback = callback;
+    if (mPresent && mCallback) {
+        mCallback(true);
+    }
+    return true;
+}
+
+void FakeHotplugTransport::Stop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCallback = nullptr;
+    return;
+}
+
+bool FakeHotplugTransport::IsPresent() const {
+    return mPresent;
+}
+
+void FakeHotplugTransport::SimulateDisconnect() {
+    DLOG_NOTICE("simulating camera disconnect");
+    SetPresent(false);
+}
+
+void FakeHotplugTransport::SimulateReconnect() {
+    DLOG_NOTICE("simulating camera re-enumeration");
+    SetPresent(true);
+}
+
+void FakeHotplugTransport::SetPresent(bool present) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mPresent = present;
+    if (mCallback) {
+        mCallback(present);
+    }
+    return;
+}
+
+} // p2pro
+} // thermal
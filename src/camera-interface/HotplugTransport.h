@@ -0,0 +1,97 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _HOTPLUG_TRANSPORT_H_
+#define _HOTPLUG_TRANSPORT_H_
+
+#include <stdint.h>
+#include <libusb.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace thermal {
+namespace p2pro {
+
+// Called with true when the camera enumerates and false when it disappears.
+typedef std::function<void(bool)> PresenceCallback;
+
+// Source of camera arrival/removal events. The supervisor only cares about
+// presence, so the libusb implementation can be swapped for a fake one that
+// simulates the cable being pulled.
+class HotplugTransport {
+public:
+    virtual ~HotplugTransport() = default;
+
+    virtual bool Start(PresenceCallback callback) = 0;
+    virtual void Stop() = 0;
+    virtual bool IsPresent() const = 0;
+};
+
+// Watches for a vid/pid using libusb hotplug callbacks. libusb only
+// delivers them while events are being handled, so this owns a small thread
+// that does nothing else.
+class LibUsbHotplugTransport : public HotplugTransport {
+public:
+    LibUsbHotplugTransport(uint16_t vendorId, uint16_t productId);
+    ~LibUsbHotplugTransport() override;
+
+    bool Start(PresenceCallback callback) override;
+    void Stop() override;
+    bool IsPresent() const override;
+
+private:
+    const uint16_t mVendorId;
+    const uint16_t mProductId;
+    libusb_context* mContext;
+    libusb_hotplug_callback_handle mCallbackHandle;
+    PresenceCallback mCallback;
+    std::thread mEventThread;
+    std::atomic<bool> mRunFlag;
+    std::atomic<bool> mPresent;
+
+    void EventLoop();
+    static int OnHotplugEvent(libusb_context* ctx, libusb_device* device, libusb_hotplug_event event, void* userData);
+};
+
+// Transport with no hardware behind it. Disconnects and re-enumeration are
+// triggered by hand.
+class FakeHotplugTransport : public HotplugTransport {
+public:
+    FakeHotplugTransport(bool present = true);
+    ~FakeHotplugTransport() override;
+
+    bool Start(PresenceCallback callback) override;
+    void Stop() override;
+    bool IsPresent() const override;
+
+    void SimulateDisconnect();
+    void SimulateReconnect();
+
+private:
+    std::mutex mMutex;
+    PresenceCallback mCallback;
+    std::atomic<bool> mPresent;
+
+    void SetPresent(bool present);
+};
+
+} // p2pro
+} // thermal
+
+#endif // _HOTPLUG_TRANSPORT_H_
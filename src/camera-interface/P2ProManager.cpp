@@ -16,6 +16,8 @@
 
 #include "P2ProManager.h"
 
+#include <algorithm>
+
 #include "UsbControl.h"
 #include "Webcam.h"
 
@@ -27,7 +29,8 @@ namespace p2pro {
 P2ProManager::P2ProManager(std::shared_ptr<Webcam> cam, std::shared_ptr<UsbControl> control)
     : mWebcam(cam)
     , mUsbControl(control)
-    , mUsbMode(UsbMode::kNone) {
+    , mUsbMode(UsbMode::kNone)
+    , mDeviceState() {
     return;
 }
 
@@ -36,6 +39,7 @@ P2ProManager::~P2ProManager() {
 }
 
 bool P2ProManager::StartVideoStream() {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
     if (!SwitchUsbMode(UsbMode::kVideo)) {
        DLOG_ERROR("Err: failed to set usb focus to video");
        return false;
@@ -44,6 +48,7 @@ bool P2ProManager::StartVideoStream() {
 }
 
 bool P2ProManager::CommandMode() {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
     if (!SwitchUsbMode(UsbMode::kCommand)) {
         DLOG_ERROR("Err: failed to set usb focus to command");
         return false;
@@ -52,38 +57,256 @@ bool P2ProManager::CommandMode() {
 }
 
 bool P2ProManager::StopVideoStream() {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
     return mWebcam->Stop();
 }
 
+bool P2ProManager::ReleaseDevice() {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    return SwitchUsbMode(UsbMode::kNone);
+}
+
 UsbMode P2ProManager::GetUsbMode() const {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
     return mUsbMode;
 }
 
+std::optional<ColorMode> P2ProManager::GetCurrentActiveColorMode() const {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    return mDeviceState.colorMode;
+}
+
+DeviceState P2ProManager::GetDeviceState() const {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    return mDeviceState;
+}
+
+bool P2ProManager::RefreshDeviceState() {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    DLOG_DEBUG("querying device state");
+
+    // Every query needs the command interface, so do them all in one go
+    // rather than paying for a usb mode switch per value.
+    bool status = RunInCommandMode([this]() {
+        mDeviceState.colorMode = ReadPseudoColor();
+        mDeviceState.shutterVtemp = ReadVtemp(CmdCode_t::kShutterVtemp);
+        mDeviceState.currentVtemp = ReadVtemp(CmdCode_t::kCurVtemp);
+        std::optional<uint32_t> autoShutter = ReadAutoShutterParam(AutoShutterParam_t::kSwitch);
+        mDeviceState.autoShutter = autoShutter ? std::optional<bool>(*autoShutter != 0u) : std::nullopt;
+        mDeviceState.autoShutterMinInterval = ReadAutoShutterParam(AutoShutterParam_t::kMinInterval);
+        mDeviceState.autoShutterMaxInterval = ReadAutoShutterParam(AutoShutterParam_t::kMaxInterval);
+        mDeviceState.partNumber = ReadDeviceInfo(DeviceInfo_t::kPartNumber);
+        mDeviceState.serialNumber = ReadDeviceInfo(DeviceInfo_t::kSerialNumber);
+        mDeviceState.firmwareVersion = ReadDeviceInfo(DeviceInfo_t::kFwBuildVersion);
+        return mDeviceState.colorMode.has_value();
+    });
+
+    DLOG_INFO("device pn=%s sn=%s fw=%s color=%s auto-shutter=%s",
+        mDeviceState.partNumber.c_str(),
+        mDeviceState.serialNumber.c_str(),
+        mDeviceState.firmwareVersion.c_str(),
+        mDeviceState.colorMode ? ColorToString(*mDeviceState.colorMode) : "UNKNOWN",
+        mDeviceState.autoShutter ? (*mDeviceState.autoShutter ? "ON" : "OFF") : "UNKNOWN");
+    return status;
+}
+
+void P2ProManager::InvalidateDeviceState() {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    mDeviceState = DeviceState();
+    return;
+}
+
+bool P2ProManager::RestartVideoStream() {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    DLOG_NOTICE("restarting video stream from %s", UsbModeToStr(mUsbMode));
+
+    // Tear down whatever was holding the device. After a brown-out the old
+    // handles point at a device that no longer exists, so failures here are
+    // expected and only logged.
+    if (mWebcam->GetState() == WebcamState::kRunning) {
+        mWebcam->Stop();
+    }
+    if (mWebcam->GetState() == WebcamState::kConnectedAndStopped) {
+        mWebcam->ReleaseCamera();
+    }
+    if (mUsbControl->IsAcquired()) {
+        mUsbControl->Release();
+    }
+
+    // The camera comes back with its power-on defaults.
+    mDeviceState = DeviceState();
+    mUsbMode = UsbMode::kNone;
+    return SwitchUsbMode(UsbMode::kVideo);
+}
+
+std::optional<ColorMode> P2ProManager::ReadPseudoColor() {
+    std::vector<uint8_t> data;
+    uint16_t command = (static_cast<uint16_t>(CmdCode_t::kPseudoColor) | static_cast<uint16_t>(CmdDir_t::kGet));
+    if (!mUsbControl->ReadCommand(command, 0, 1, data)) {
+        DLOG_ERROR("Err: failed to read pseudo color");
+        return std::nullopt;
+    }
+
+    if (data[0] == 0 || data[0] >= static_cast<uint8_t>(ColorMode::kCount)) {
+        DLOG_WARN("device reported unknown pseudo color %u", data[0]);
+        return std::nullopt;
+    }
+    return static_cast<ColorMode>(data[0]);
+}
+
+std::optional<int16_t> P2ProManager::ReadVtemp(CmdCode_t cmd) {
+    std::vector<uint8_t> data;
+    uint16_t command = (static_cast<uint16_t>(cmd) | static_cast<uint16_t>(CmdDir_t::kGet));
+    if (!mUsbControl->ReadCommand(command, 0, sizeof(int16_t), data)) {
+        DLOG_ERROR("Err: failed to read cmd 0x%04x", command);
+        return std::nullopt;
+    }
+    return static_cast<int16_t>(data[0] | (data[1] << 8));
+}
+
+std::string P2ProManager::ReadDeviceInfo(DeviceInfo_t info) {
+    std::vector<uint8_t> data;
+    uint16_t command = (static_cast<uint16_t>(CmdCode_t::kGetDeviceInfo) | static_cast<uint16_t>(CmdDir_t::kGet));
+    if (!mUsbControl->ReadCommand(command, static_cast<uint32_t>(info), DeviceInfoLength(info), data)) {
+        DLOG_ERROR("Err: failed to read device info %u", static_cast<uint32_t>(info));
+        return std::string();
+    }
+
+    // strings are null padded to the fixed length
+    auto end = std::find(data.begin(), data.end(), 0);
+    return std::string(data.begin(), end);
+}
+
 bool P2ProManager::SetPseudoColor(ColorMode color) {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    if (mDeviceState.colorMode == color) {
+        DLOG_DEBUG("pseudo-color is already %s, skipping", ColorToString(color));
+        return true;
+    }
+
     DLOG_DEBUG("setting pseudo-color to %s", ColorToString(color));
 
-    bool status = false;
+    return RunInCommandMode([this, color]() {
+        std::vector<uint8_t> data = { static_cast<uint8_t>(color) };
+        uint16_t command = (static_cast<uint16_t>(CmdCode_t::kPseudoColor) | static_cast<uint16_t>(CmdDir_t::kSet));
+        bool status = mUsbControl->SendCommand(command, 0, data);
+        if (status) {
+            mDeviceState.colorMode = color;
+        } else {
+            DLOG_ERROR("Err: failed to send pseudo color cmd");
+            mDeviceState.colorMode.reset();
+        }
+        return status;
+    });
+}
+
+bool P2ProManager::TriggerShutter() {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    DLOG_DEBUG("triggering shutter");
+
+    // The vendor commands go to interface 0, which the uvc driver holds while
+    // streaming, so from video mode this stops and releases the stream and
+    // opens and restarts it afterwards. The picture freezes for that restart
+    // (about a second, longer if the device is slow to report ready) on top
+    // of the shutter itself.
+
+    return RunInCommandMode([this]() {
+        uint16_t command = static_cast<uint16_t>(CmdCode_t::kShutterManual);
+        bool status = mUsbControl->SendCommand(command);
+        if (!status) {
+            DLOG_ERROR("Err: failed to send shutter cmd");
+        }
+        return status;
+    });
+}
+
+bool P2ProManager::SetAutoShutter(bool enabled) {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    if (mDeviceState.autoShutter == enabled) {
+        DLOG_DEBUG("auto shutter is already %s, skipping", enabled ? "on" : "off");
+        return true;
+    }
+
+    DLOG_DEBUG("setting auto shutter %s", enabled ? "on" : "off");
+
+    return RunInCommandMode([this, enabled]() {
+        bool status = WriteAutoShutterParam(AutoShutterParam_t::kSwitch, enabled ? 1u : 0u);
+        if (status) {
+            mDeviceState.autoShutter = enabled;
+        } else {
+            mDeviceState.autoShutter.reset();
+        }
+        return status;
+    });
+}
+
+bool P2ProManager::SetAutoShutterInterval(std::chrono::seconds minInterval, std::chrono::seconds maxInterval) {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    uint32_t minSeconds = static_cast<uint32_t>(minInterval.count());
+    uint32_t maxSeconds = static_cast<uint32_t>(maxInterval.count());
+    if (mDeviceState.autoShutterMinInterval == minSeconds && mDeviceState.autoShutterMaxInterval == maxSeconds) {
+        DLOG_DEBUG("auto shutter interval is already %u-%u s, skipping", minSeconds, maxSeconds);
+        return true;
+    }
+
+    DLOG_DEBUG("setting auto shutter interval %u-%u s", minSeconds, maxSeconds);
+
+    return RunInCommandMode([this, minSeconds, maxSeconds]() {
+        bool status = WriteAutoShutterParam(AutoShutterParam_t::kMinInterval, minSeconds);
+        status &= WriteAutoShutterParam(AutoShutterParam_t::kMaxInterval, maxSeconds);
+        if (status) {
+            mDeviceState.autoShutterMinInterval = minSeconds;
+            mDeviceState.autoShutterMaxInterval = maxSeconds;
+        } else {
+            mDeviceState.autoShutterMinInterval.reset();
+            mDeviceState.autoShutterMaxInterval.reset();
+        }
+        return status;
+    });
+}
+
+bool P2ProManager::RunInCommandMode(const std::function<bool()>& command) {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+    bool status = true;
     UsbMode oldMode = mUsbMode;
     if (oldMode != UsbMode::kCommand) {
         status = SwitchUsbMode(UsbMode::kCommand);
     }
 
     if (status == true) {
-        std::vector<uint8_t> data = { static_cast<uint8_t>(color) };
-        uint16_t command = (static_cast<uint16_t>(CmdCode_t::kPseudoColor) | static_cast<uint16_t>(CmdDir_t::kSet));
-        status = mUsbControl->SendCommand(command, 0, data);
-        if (!status) {
-            DLOG_ERROR("Err: failed to send pseudo color cmd");
-        }
+        status = command();
+    } else {
+        DLOG_ERROR("Err: could not enter command mode");
     }
 
     if (oldMode == UsbMode::kVideo) {
-        status = SwitchUsbMode(UsbMode::kVideo);
+        status &= SwitchUsbMode(UsbMode::kVideo);
     }
     return status;
 }
 
+bool P2ProManager::WriteAutoShutterParam(AutoShutterParam_t param, uint32_t value) {
+    uint16_t command = (static_cast<uint16_t>(CmdCode_t::kPropAutoShutterParams) | static_cast<uint16_t>(CmdDir_t::kSet));
+    if (!mUsbControl->SendLongCommand(command, static_cast<uint16_t>(param), value)) {
+        DLOG_ERROR("Err: failed to write auto shutter param %u", static_cast<uint32_t>(param));
+        return false;
+    }
+    return true;
+}
+
+std::optional<uint32_t> P2ProManager::ReadAutoShutterParam(AutoShutterParam_t param) {
+    std::vector<uint8_t> data;
+    uint16_t command = (static_cast<uint16_t>(CmdCode_t::kPropAutoShutterParams) | static_cast<uint16_t>(CmdDir_t::kGet));
+    if (!mUsbControl->ReadLongCommand(command, static_cast<uint16_t>(param), 0, 0, sizeof(uint16_t), data)) {
+        DLOG_ERROR("Err: failed to read auto shutter param %u", static_cast<uint32_t>(param));
+        return std::nullopt;
+    }
+    return static_cast<uint32_t>((data[0] << 8) | data[1]);
+}
+
 bool P2ProManager::SwitchUsbMode(UsbMode newMode) {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
     bool status = true;
     UsbMode prevMode = mUsbMode;
     DLOG_DEBUG("Switching USB mode: %s -> %s", UsbModeToStr(prevMode),  UsbModeToStr(newMode));
@@ -114,7 +337,18 @@ bool P2ProManager::SwitchUsbMode(UsbMode newMode) {
             status &= mWebcam->Start();
         } break;
         
-        case UsbMode::kNone:
+        case UsbMode::kNone: {
+            if (mWebcam->GetState() == WebcamState::kRunning) {
+                mWebcam->Stop();
+            }
+            if (mWebcam->GetState() == WebcamState::kConnectedAndStopped) {
+                mWebcam->ReleaseCamera();
+            }
+            if (mUsbControl->IsAcquired()) {
+                status = mUsbControl->Release();
+            }
+        } break;
+
         default:
             DLOG_ERROR("unexpected mode %d", static_cast<int32_t>(newMode));
             break;
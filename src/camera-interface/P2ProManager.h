@@ -23,9 +23,14 @@
 #include "UsbControl.h"
 #include "Webcam.h"
 
+#include <chrono>
 #include <cstddef>
+#include <functional>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
 
 namespace thermal {
 namespace p2pro {
@@ -79,7 +84,7 @@ inline constexpr const char * ColorToString(ColorMode color) {
 // Only one driver can aquire the device at a time. This enum will keep track
 // of which driver is currently holding the device.
 enum class UsbMode : uint8_t {
-    kNone,
+    kNone,     ///< neither, the kernel driver has the device back
     kVideo,
     kCommand,
 };
@@ -97,23 +102,54 @@ inline const char * UsbModeToStr(UsbMode focus) {
     }
 }
 
+// Last known values read back from the device. Anything that could not be
+// read is left empty so that the next set-command is always sent.
+struct DeviceState {
+    std::optional<ColorMode> colorMode;
+    std::optional<int16_t> shutterVtemp;
+    std::optional<int16_t> currentVtemp;
+    std::optional<bool> autoShutter;
+    std::optional<uint32_t> autoShutterMinInterval; ///< seconds
+    std::optional<uint32_t> autoShutterMaxInterval; ///< seconds
+    std::string partNumber;
+    std::string serialNumber;
+    std::string firmwareVersion;
+};
+
 class P2ProManager {
 public:
     P2ProManager(std::shared_ptr<Webcam> cam, std::shared_ptr<UsbControl> control);
     ~P2ProManager();
 
     bool SetPseudoColor(ColorMode color);
+    bool TriggerShutter();
+    bool SetAutoShutter(bool enabled);
+    bool SetAutoShutterInterval(std::chrono::seconds minInterval, std::chrono::seconds maxInterval);
     bool SwitchUsbMode(UsbMode mode);
     bool StartVideoStream();
     bool StopVideoStream();
+    bool ReleaseDevice();
     bool CommandMode();
+    bool RefreshDeviceState();
+    void InvalidateDeviceState();
+    bool RestartVideoStream();
     UsbMode GetUsbMode() const;
-    p2pro::ColorMode GetCurrentActiveColorMode() const;
+    std::optional<ColorMode> GetCurrentActiveColorMode() const;
+    DeviceState GetDeviceState() const; // a copy, the supervisor thread rewrites it
 
 private:
     std::shared_ptr<Webcam> mWebcam;
     std::shared_ptr<UsbControl> mUsbControl;
     UsbMode mUsbMode;
+    DeviceState mDeviceState;
+    mutable std::recursive_mutex mMutex; ///< The supervisor restarts the stream from its own thread
+
+    bool RunInCommandMode(const std::function<bool()>& command);
+    bool WriteAutoShutterParam(AutoShutterParam_t param, uint32_t value);
+    std::optional<uint32_t> ReadAutoShutterParam(AutoShutterParam_t param);
+    std::optional<ColorMode> ReadPseudoColor();
+    std::optional<int16_t> ReadVtemp(CmdCode_t cmd);
+    std::string ReadDeviceInfo(DeviceInfo_t info);
 };
 
 } // p2pro
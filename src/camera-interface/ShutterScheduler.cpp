@@ -0,0 +1,214 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ShutterScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+
+#include "Logger.h"
+
+namespace thermal {
+namespace p2pro {
+
+// Anything longer than a few frame periods is the shutter, not jitter.
+constexpr const std::chrono::milliseconds kFreezeThreshold(150);
+constexpr const std::chrono::milliseconds kPollInterval(500);
+constexpr const int32_t kSceneSampleStep = 16;
+constexpr const double kSceneSmoothing = 0.2;
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::placeholders::_1;
+using std::placeholders::_2;
+
+static int64_t NowNs() {
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+ShutterScheduler::ShutterScheduler(P2ProManager& manager, std::shared_ptr<Webcam> webcam, ShutterConfig config)
+    : mManager(manager)
+    , mConfig(config)
+    , mRunFlag(false)
+    , mStats()
+    , mLastInputNs(0)
+    , mLastChangeNs(0)
+    , mLastShutterNs(0)
+    , mLastFrameNs(0)
+    , mSceneLevel(0.0) {
+    webcam->RegisterOnDataCallback(std::bind(&ShutterScheduler::OnFrame, this, _1, _2));
+    return;
+}
+
+ShutterScheduler::~ShutterScheduler() {
+    Stop();
+    return;
+}
+
+bool ShutterScheduler::Start() {
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mRunFlag) {
+            return true;
+        }
+        mRunFlag = true;
+    }
+
+    int64_t now = NowNs();
+    mLastInputNs = now;
+    mLastChangeNs = now;
+    mLastShutterNs = now;
+
+    // Free when the application already switched it off before the stream
+    // started, otherwise this costs a stream restart.
+    if (!mManager.SetAutoShutter(false)) {
+        DLOG_WARN("could not disable auto shutter, the camera will still shutter on its own");
+    }
+
+    mThread = std::thread(&ShutterScheduler::Runloop, this);
+    return true;
+}
+
+void ShutterScheduler::Stop() {
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (!mRunFlag) {
+            return;
+        }
+        mRunFlag = false;
+    }
+    mCv.notify_all();
+
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+
+    // Hand flat-field correction back to the camera. Only a plain command if
+    // the caller took the stream down first, a stream restart otherwise.
+    mManager.SetAutoShutter(true);
+    return;
+}
+
+void ShutterScheduler::NotifyUserInput() {
+    mLastInputNs = NowNs();
+    return;
+}
+
+FreezeStats ShutterScheduler::GetFreezeStats() const {
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+bool ShutterScheduler::OnFrame(cv::Mat& frame, [[maybe_unused]] bool lastFrame) {
+    int64_t now = NowNs();
+    int64_t previous = mLastFrameNs.exchange(now);
+
+    // A gap in the stream is a freeze. It is ours if the shutter was
+    // triggered after the last frame before the gap.
+    if (previous != 0) {
+        auto gap = duration_cast<milliseconds>(nanoseconds(now - previous));
+        if (gap > kFreezeThreshold) {
+            bool scheduled = mLastShutterNs >= previous;
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (scheduled) {
+                mStats.scheduledCount++;
+                mStats.scheduledTotal += gap;
+            } else {
+                mStats.unscheduledCount++;
+                mStats.unscheduledTotal += gap;
+            }
+            mStats.longest = std::max(mStats.longest, gap);
+            DLOG_NOTICE("image froze for %lld ms (%s, scheduled=%u unscheduled=%u)",
+                static_cast<long long>(gap.count()), scheduled ? "scheduled" : "unscheduled",
+                mStats.scheduledCount, mStats.unscheduledCount);
+        }
+    }
+
+    double level = MeasureScene(frame);
+    if (std::abs(level - mSceneLevel) > mConfig.stableThreshold) {
+        mLastChangeNs = now;
+    }
+    mSceneLevel += (level - mSceneLevel) * kSceneSmoothing;
+    return true;
+}
+
+/// @brief mean brightness over a sparse grid, cheap enough to run every frame.
+double ShutterScheduler::MeasureScene(const cv::Mat& frame) const {
+    if (frame.empty()) {
+        return mSceneLevel;
+    }
+
+    uint64_t sum = 0u;
+    uint32_t count = 0u;
+    // the thermal plane of a raw frame is noise to this, only the picture counts
+    const int32_t channels = frame.channels();
+    const int32_t rows = (mConfig.sceneRows > 0) ? std::min(frame.rows, mConfig.sceneRows) : frame.rows;
+    for (int32_t y = 0; y < rows; y += kSceneSampleStep) {
+        const uint8_t* row = frame.ptr<uint8_t>(y);
+        for (int32_t x = 0; x < frame.cols; x += kSceneSampleStep) {
+            sum += row[x * channels];
+            count++;
+        }
+    }
+    return (count > 0u) ? static_cast<double>(sum) / count : mSceneLevel;
+}
+
+bool ShutterScheduler::IsDue(int64_t now) const {
+    auto sinceShutter = nanoseconds(now - mLastShutterNs);
+    if (sinceShutter >= mConfig.maxInterval) {
+        // the restart freezes longer than the camera's own shutter, not
+        // while a knob is turning unless the camera has drifted for too long
+        bool resting = nanoseconds(now - mLastInputNs) >= mConfig.forcedIdleTime;
+        return resting || (sinceShutter >= mConfig.maxInterval + mConfig.forcedGrace);
+    }
+
+    bool idle = nanoseconds(now - mLastInputNs) >= mConfig.idleTime;
+    bool stable = nanoseconds(now - mLastChangeNs) >= mConfig.stableTime;
+    return idle && stable && (sinceShutter >= mConfig.minInterval);
+}
+
+void ShutterScheduler::Runloop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mRunFlag) {
+        mCv.wait_for(lock, kPollInterval);
+        if (!mRunFlag) {
+            break;
+        }
+
+        int64_t now = NowNs();
+        if (!IsDue(now)) {
+            continue;
+        }
+
+        bool forced = nanoseconds(now - mLastShutterNs) >= mConfig.maxInterval;
+        DLOG_INFO("running %s shutter", forced ? "forced" : "idle");
+
+        mLastShutterNs = now;
+        lock.unlock();
+        if (!mManager.TriggerShutter()) {
+            DLOG_ERROR("shutter trigger failed");
+        }
+        lock.lock();
+    }
+    return;
+}
+
+} // p2pro
+} // thermal
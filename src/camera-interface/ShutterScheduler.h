@@ -0,0 +1,103 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SHUTTER_SCHEDULER_H_
+#define _SHUTTER_SCHEDULER_H_
+
+#include <stdint.h>
+#include <opencv2/videoio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "P2ProManager.h"
+#include "Webcam.h"
+
+namespace thermal {
+namespace p2pro {
+
+struct ShutterConfig {
+    std::chrono::seconds idleTime{3};          ///< no encoder input for this long counts as idle
+    std::chrono::seconds stableTime{2};        ///< scene must not have changed for this long
+    std::chrono::seconds minInterval{60};      ///< never shutter more often than this
+    std::chrono::seconds maxInterval{300};     ///< shutter even while the scene moves after this long
+    std::chrono::milliseconds forcedIdleTime{1000}; ///< a forced shutter still waits for the encoders to rest this long
+    std::chrono::seconds forcedGrace{60};      ///< past maxInterval plus this it stops waiting
+    double stableThreshold = 2.0;              ///< mean brightness change still considered stable
+    int32_t sceneRows = 0;                     ///< rows of picture on top of a raw frame, 0 for all of it
+};
+
+// Freeze bookkeeping, split by whether we asked for the shutter or the
+// camera did it on its own.
+struct FreezeStats {
+    uint32_t scheduledCount = 0u;
+    uint32_t unscheduledCount = 0u;
+    std::chrono::milliseconds scheduledTotal{0};
+    std::chrono::milliseconds unscheduledTotal{0};
+    std::chrono::milliseconds longest{0};
+};
+
+// Takes flat-field correction away from the camera's own timer and runs it
+// while the scope is idle: no encoder input and a stable scene. The camera's
+// auto shutter is switched off while this is running and restored on Stop().
+//
+// Each trigger costs a stream restart on top of the shutter (see
+// P2ProManager::TriggerShutter()), so a scheduled freeze is longer than the
+// camera's own. The point is when it happens: idle triggers land while
+// nobody is aiming. The forced one after maxInterval skips the idle and
+// stable checks but still waits for a short break in encoder input; only
+// once forcedGrace has run out too can it land mid aim.
+class ShutterScheduler {
+public:
+    ShutterScheduler(P2ProManager& manager, std::shared_ptr<Webcam> webcam, ShutterConfig config = ShutterConfig());
+    ~ShutterScheduler();
+
+    bool Start();
+    void Stop();
+    void NotifyUserInput();
+    FreezeStats GetFreezeStats() const;
+
+private:
+    P2ProManager& mManager;
+    ShutterConfig mConfig;
+
+    std::thread mThread;
+    mutable std::mutex mMutex;
+    std::condition_variable mCv;
+    bool mRunFlag;
+    FreezeStats mStats;
+
+    // written on the capture thread or encoder thread, read by the scheduler
+    std::atomic<int64_t> mLastInputNs;
+    std::atomic<int64_t> mLastChangeNs;
+    std::atomic<int64_t> mLastShutterNs;
+    std::atomic<int64_t> mLastFrameNs;
+    double mSceneLevel;
+
+    bool OnFrame(cv::Mat& frame, bool lastFrame);
+    double MeasureScene(const cv::Mat& frame) const;
+    bool IsDue(int64_t now) const;
+    void Runloop();
+};
+
+} // p2pro
+} // thermal
+
+#endif // _SHUTTER_SCHEDULER_H_
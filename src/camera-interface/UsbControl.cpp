@@ -16,24 +16,24 @@
 
 #include "UsbControl.h"
 
-#include <libusb.h>
-
 #include <cstring>
 #include <vector>
 #include <chrono>
 #include <thread>
+#include <algorithm>
 
 #include "Logger.h"
 
 namespace thermal {
 namespace p2pro {
 
-constexpr uint32_t kVendorId = 0x0BDA;
-constexpr uint32_t kProductId = 0x5830;
-
 UsbControl::UsbControl()
-    : mHandle(nullptr)
-    , mContext(nullptr) 
+    : UsbControl(std::make_unique<LibUsbTransport>()) {
+    return;
+}
+
+UsbControl::UsbControl(std::unique_ptr<UsbTransport> transport)
+    : mTransport(std::move(transport))
     , mOpen(false) {
     return;
 }
@@ -42,45 +42,30 @@ UsbControl::~UsbControl() {
     DLOG_DEBUG("shutting down");
     
     // Release the interface
-    if (mHandle != nullptr && mOpen) {
-        libusb_release_interface(mHandle, 0);
-    }
-
-    // Close the USB device
-    if (mHandle != nullptr) {
-        libusb_close(mHandle);
-        mHandle = nullptr;
+    if (mTransport->IsOpen() && mOpen) {
+        mTransport->ReleaseInterface(0);
     }
 
-    // Deinitialize libusb
-    if (mContext != nullptr) {
-        libusb_exit(mContext);
-        mContext = nullptr;
-    }
+    // Close the USB device, the transport deinitializes libusb
+    mTransport->Close();
     return;
 }
 
 bool UsbControl::Acquire() {
     bool status = true;
-    int32_t res = libusb_init(&mContext);
+    int32_t res = mTransport->Open(kVendorId, kProductId);
     if (res < 0) {
-        DLOG_ERROR("failed to initialize usb (err=%d)", res);
+        DLOG_ERROR("failed to open usb (err=%d)", res);
         return false;
     }
 
-    mHandle = libusb_open_device_with_vid_pid(mContext, kVendorId, kProductId);
-    if (mHandle == NULL) {
-        DLOG_ERROR("failed to open usb");
-        return false;
-    }
-
-    res = libusb_detach_kernel_driver(mHandle, 0);
+    res = mTransport->DetachKernelDriver(0);
     if (res < 0) {
         DLOG_WARN("Failed to detach kernel driver (err=%d)", res);
         status = false;
     }
 
-    res = libusb_claim_interface(mHandle, 0);
+    res = mTransport->ClaimInterface(0);
     if (res < 0) {
         DLOG_ERROR("Failed to claim interface (err=%d)", res);
         return false;
@@ -95,29 +80,26 @@ bool UsbControl::Release() {
     DLOG_DEBUG("Releasing USB control");
 
     // Release the interface
-    if (mHandle == nullptr) {
+    if (!mTransport->IsOpen()) {
         DLOG_ERROR("handle is nullptr");
         mOpen = false;
         return true;
     }
 
     bool status = true;
-    int32_t res = libusb_release_interface(mHandle, 0);
+    int32_t res = mTransport->ReleaseInterface(0);
     if (res < 0) {
         DLOG_ERROR("Failed to release interface (err=%d)", res);
         status = false;
     }
 
-    res = libusb_attach_kernel_driver(mHandle, 0);
+    res = mTransport->AttachKernelDriver(0);
     if (res < 0) {
         DLOG_ERROR("Failed to attach kernel driver (err=%d)", res);
         status = false;
     }
 
-    if (mHandle != nullptr) {
-        libusb_close(mHandle);
-        mHandle = nullptr;
-    }
+    mTransport->Close();
 
     mOpen = false;
     DLOG_INFO("Released USB Control");
@@ -140,7 +122,7 @@ bool UsbControl::SendCommand(uint16_t cmd, uint32_t cmd_param, std::vector<uint8
         std::memcpy(d.data(), &cmd, 2);
         std::memcpy(d.data() + 2, &cmd_param, 4);
 
-        libusb_control_transfer(mHandle, 0x41, 0x45, 0x78, 0x1d00, d.data(), d.size(), 1000);
+        mTransport->ControlTransfer(0x41, 0x45, 0x78, 0x1d00, d.data(), d.size(), 1000);
         BlockUntilDeviceIsReady();
         return true;
     }
@@ -159,7 +141,7 @@ bool UsbControl::SendCommand(uint16_t cmd, uint32_t cmd_param, std::vector<uint8
         uint16_t chunk_size = outer_chunk.size();
         std::memcpy(initial_data.data() + 6, &chunk_size, 2);
 
-        libusb_control_transfer(mHandle, 0x41, 0x45, 0x78, 0x9d00, initial_data.data(), initial_data.size(), 1000);
+        mTransport->ControlTransfer(0x41, 0x45, 0x78, 0x9d00, initial_data.data(), initial_data.size(), 1000);
         BlockUntilDeviceIsReady();
 
         // Sending inner chunks
@@ -168,14 +150,14 @@ bool UsbControl::SendCommand(uint16_t cmd, uint32_t cmd_param, std::vector<uint8
             int to_send = outer_chunk.size() - j;
 
             if (to_send <= 8) {
-                libusb_control_transfer(mHandle, 0x41, 0x45, 0x78, 0x1d08 + j, inner_chunk.data(), inner_chunk.size(), 1000);
+                mTransport->ControlTransfer(0x41, 0x45, 0x78, 0x1d08 + j, inner_chunk.data(), inner_chunk.size(), 1000);
                 BlockUntilDeviceIsReady();
             } else if (to_send <= 64) {
-                libusb_control_transfer(mHandle, 0x41, 0x45, 0x78, 0x9d08 + j, inner_chunk.data(), inner_chunk.size() - 8, 1000);
-                libusb_control_transfer(mHandle, 0x41, 0x45, 0x78, 0x1d08 + j + to_send - 8, inner_chunk.data() + inner_chunk.size() - 8, 8, 1000);
+                mTransport->ControlTransfer(0x41, 0x45, 0x78, 0x9d08 + j, inner_chunk.data(), inner_chunk.size() - 8, 1000);
+                mTransport->ControlTransfer(0x41, 0x45, 0x78, 0x1d08 + j + to_send - 8, inner_chunk.data() + inner_chunk.size() - 8, 8, 1000);
                 BlockUntilDeviceIsReady();
             } else {
-                libusb_control_transfer(mHandle, 0x41, 0x45, 0x78, 0x9d08 + j, inner_chunk.data(), inner_chunk.size(), 1000);
+                mTransport->ControlTransfer(0x41, 0x45, 0x78, 0x9d08 + j, inner_chunk.data(), inner_chunk.size(), 1000);
             }
         }
     }
@@ -183,16 +165,129 @@ bool UsbControl::SendCommand(uint16_t cmd, uint32_t cmd_param, std::vector<uint8
     return true;
 }
 
+bool UsbControl::ReadCommand(uint16_t cmd, uint32_t cmd_param, size_t length, std::vector<uint8_t>& result) {
+    DLOG_INFO("Reading USB command");
+    result.clear();
+
+    if (!mTransport->IsOpen()) {
+        DLOG_ERROR("handle is nullptr");
+        return false;
+    }
+
+    const size_t outer_chunk_size = 0x100;
+    cmd_param = __builtin_bswap32(cmd_param);
+    result.reserve(length);
+
+    for (size_t i = 0; i < length; i += outer_chunk_size) {
+        uint16_t to_read = static_cast<uint16_t>(std::min(length - i, outer_chunk_size));
+
+        // Tell the camera what we want to read, the length is sent big endian
+        std::vector<uint8_t> initial_data(8);
+        std::memcpy(initial_data.data(), &cmd, 2);
+        uint32_t param = cmd_param + i;
+        std::memcpy(initial_data.data() + 2, &param, 4);
+        uint16_t chunk_size = __builtin_bswap16(to_read);
+        std::memcpy(initial_data.data() + 6, &chunk_size, 2);
+
+        mTransport->ControlTransfer(0x41, 0x45, 0x78, 0x1d00, initial_data.data(), initial_data.size(), 1000);
+        if (!BlockUntilDeviceIsReady()) {
+            DLOG_ERROR("timed out waiting for cmd 0x%04x", cmd);
+            return false;
+        }
+
+        // Read the response back
+        std::vector<uint8_t> chunk(to_read);
+        int transferred = mTransport->ControlTransfer(0xC1, 0x44, 0x78, 0x1d08, chunk.data(), chunk.size(), 1000);
+        if (transferred != to_read) {
+            DLOG_ERROR("short read for cmd 0x%04x (%d of %u)", cmd, transferred, to_read);
+            return false;
+        }
+        result.insert(result.end(), chunk.begin(), chunk.end());
+    }
+
+    return true;
+}
+
+// Property commands carry their parameters in two 8 byte packets instead of
+// a data phase. All parameters are big endian, the command code is not.
+bool UsbControl::SendLongCommand(uint16_t cmd, uint16_t p1, uint32_t p2, uint32_t p3, uint32_t p4) {
+    DLOG_INFO("Sending long USB command");
+
+    if (!mTransport->IsOpen()) {
+        DLOG_ERROR("handle is nullptr");
+        return false;
+    }
+
+    std::vector<uint8_t> first(8);
+    std::vector<uint8_t> second(8);
+    p1 = __builtin_bswap16(p1);
+    p2 = __builtin_bswap32(p2);
+    p3 = __builtin_bswap32(p3);
+    p4 = __builtin_bswap32(p4);
+    std::memcpy(first.data(), &cmd, 2);
+    std::memcpy(first.data() + 2, &p1, 2);
+    std::memcpy(first.data() + 4, &p2, 4);
+    std::memcpy(second.data(), &p3, 4);
+    std::memcpy(second.data() + 4, &p4, 4);
+
+    mTransport->ControlTransfer(0x41, 0x45, 0x78, 0x9d00, first.data(), first.size(), 1000);
+    mTransport->ControlTransfer(0x41, 0x45, 0x78, 0x1d08, second.data(), second.size(), 1000);
+    return BlockUntilDeviceIsReady();
+}
+
+bool UsbControl::ReadLongCommand(uint16_t cmd, uint16_t p1, uint32_t p2, uint32_t p3, size_t length, std::vector<uint8_t>& result) {
+    DLOG_INFO("Reading long USB command");
+    result.clear();
+
+    if (!mTransport->IsOpen()) {
+        DLOG_ERROR("handle is nullptr");
+        return false;
+    }
+
+    std::vector<uint8_t> first(8);
+    std::vector<uint8_t> second(8);
+    uint32_t len = __builtin_bswap32(static_cast<uint32_t>(length));
+    p1 = __builtin_bswap16(p1);
+    p2 = __builtin_bswap32(p2);
+    p3 = __builtin_bswap32(p3);
+    std::memcpy(first.data(), &cmd, 2);
+    std::memcpy(first.data() + 2, &p1, 2);
+    std::memcpy(first.data() + 4, &p2, 4);
+    std::memcpy(second.data(), &p3, 4);
+    std::memcpy(second.data() + 4, &len, 4);
+
+    mTransport->ControlTransfer(0x41, 0x45, 0x78, 0x9d00, first.data(), first.size(), 1000);
+    mTransport->ControlTransfer(0x41, 0x45, 0x78, 0x1d08, second.data(), second.size(), 1000);
+    if (!BlockUntilDeviceIsReady()) {
+        DLOG_ERROR("timed out waiting for cmd 0x%04x", cmd);
+        return false;
+    }
+
+    result.resize(length);
+    int transferred = mTransport->ControlTransfer(0xC1, 0x44, 0x78, 0x1d10, result.data(), result.size(), 1000);
+    if (transferred != static_cast<int>(length)) {
+        DLOG_ERROR("short read for cmd 0x%04x (%d of %u)", cmd, transferred, length);
+        result.clear();
+        return false;
+    }
+    return true;
+}
+
 bool UsbControl::IsAcquired() {
     return mOpen;
 }
 
 
-bool UsbControl::CheckIfDeviceIsReady() {
+bool UsbControl::CheckIfDeviceIsReady(bool* failed) {
     uint8_t ret[1];
-    int transferred = libusb_control_transfer(mHandle, 0xC1, 0x44, 0x78, 0x200, ret, sizeof(ret), 1000);
+    int transferred = mTransport->ControlTransfer(0xC1, 0x44, 0x78, 0x200, ret, sizeof(ret), 1000);
     if (transferred < 0) {
-        throw std::runtime_error("Control transfer failed");
+        // the camera was unplugged or reset mid command, not ready
+        DLOG_ERROR("status transfer failed (err=%d)", transferred);
+        if (failed != nullptr) {
+            *failed = true;
+        }
+        return false;
     }
     if ((ret[0] & 1) == 0 && (ret[0] & 2) == 0) {
         return true;
@@ -206,9 +301,14 @@ bool UsbControl::CheckIfDeviceIsReady() {
 bool UsbControl::BlockUntilDeviceIsReady(int timeout) {
     auto start = std::chrono::steady_clock::now();
     while (true) {
-        if (CheckIfDeviceIsReady()) {
+        bool failed = false;
+        if (CheckIfDeviceIsReady(&failed)) {
             return true;
         }
+        if (failed) {
+            // a dead handle fails every poll, no point waiting out the timeout
+            return false;
+        }
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
         auto now = std::chrono::steady_clock::now();
         if (std::chrono::duration_cast<std::chrono::seconds>(now - start).count() > timeout) {
@@ -18,21 +18,28 @@
 #define _USB_CONTROL_H_
 
 #include <stdint.h>
-#include <libusb.h>
 
 #include <cstddef>
+#include <memory>
 #include <vector>
 
+#include "UsbTransport.h"
+
 namespace thermal {
 namespace p2pro {
 
+inline constexpr uint16_t kVendorId = 0x0BDA;
+inline constexpr uint16_t kProductId = 0x5830;
+
 enum class CmdCode_t : uint32_t {
     kSysResetToRom = 0x0805,
     kSpiTransfer = 0x8201,
     kGetDeviceInfo = 0x8405,
     kPseudoColor = 0x8409,
     kShutterVtemp = 0x840c,
+    kShutterManual = 0xc10d,
     kPropTpdParams = 0x8514,
+    kPropAutoShutterParams = 0x8515,
     kCurVtemp = 0x8b0d,
     kPreviewStart = 0xc10f,
     kPreviewStop = 0x020f,
@@ -45,21 +52,71 @@ enum class CmdDir_t : uint32_t {
     kSet = 0x4000,
 };
 
+// Selector passed as the first parameter of kPropAutoShutterParams.
+enum class AutoShutterParam_t : uint16_t {
+    kSwitch = 0,
+    kMinInterval = 1,
+    kMaxInterval = 2,
+    kTempThresholdOoc = 3,
+    kTempThresholdB = 4,
+    kProtectSwitch = 5,
+    kAnyInterval = 6,
+};
+
+// Selector passed as the parameter of kGetDeviceInfo.
+enum class DeviceInfo_t : uint32_t {
+    kChipId = 0,
+    kFwCompileDate = 1,
+    kDevQualification = 2,
+    kIrInfo = 3,
+    kProjectInfo = 4,
+    kFwBuildVersion = 5,
+    kPartNumber = 6,
+    kSerialNumber = 7,
+    kSensorId = 8,
+};
+
+// Number of bytes the device returns for each DeviceInfo_t selector.
+inline constexpr size_t DeviceInfoLength(DeviceInfo_t info) {
+    switch (info) {
+        case DeviceInfo_t::kChipId:
+        case DeviceInfo_t::kFwCompileDate:
+        case DeviceInfo_t::kDevQualification:
+            return 8u;
+        case DeviceInfo_t::kIrInfo:
+            return 26u;
+        case DeviceInfo_t::kProjectInfo:
+        case DeviceInfo_t::kSensorId:
+            return 4u;
+        case DeviceInfo_t::kFwBuildVersion:
+            return 50u;
+        case DeviceInfo_t::kPartNumber:
+            return 48u;
+        case DeviceInfo_t::kSerialNumber:
+            return 16u;
+        default:
+            return 0u;
+    }
+}
+
 class UsbControl {
 public:
     UsbControl();
+    explicit UsbControl(std::unique_ptr<UsbTransport> transport);
     ~UsbControl();
     bool Acquire();
     bool Release();
     bool SendCommand(uint16_t cmd, uint32_t cmd_param = 0, std::vector<uint8_t> data = {0});
+    bool ReadCommand(uint16_t cmd, uint32_t cmd_param, size_t length, std::vector<uint8_t>& result);
+    bool SendLongCommand(uint16_t cmd, uint16_t p1, uint32_t p2, uint32_t p3 = 0, uint32_t p4 = 0);
+    bool ReadLongCommand(uint16_t cmd, uint16_t p1, uint32_t p2, uint32_t p3, size_t length, std::vector<uint8_t>& result);
     bool IsAcquired();
 
 private:
+    std::unique_ptr<UsbTransport> mTransport; ///< libusb, or a fake without the camera
     bool mOpen;
-    libusb_device_handle* mHandle;
-    libusb_context* mContext;
 
-    bool CheckIfDeviceIsReady();
+    bool CheckIfDeviceIsReady(bool* failed = nullptr); // failed is set when the status transfer errors
     bool BlockUntilDeviceIsReady(int timeout = 5);
 };
 
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "UsbTransport.h"
+
+#include <libusb.h>
+
+#include <cstring>
+
+#include "Logger.h"
+
+namespace thermal {
+namespace p2pro {
+
+// direction bit of bmRequestType, set for device to host
+constexpr const uint8_t kDeviceToHost = 0x80;
+
+LibUsbTransport::LibUsbTransport()
+    : mContext(nullptr)
+    , mHandle(nullptr) {
+    return;
+}
+
+LibUsbTransport::~LibUsbTransport() {
+    Close();
+
+    // Deinitialize libusb
+    if (mContext != nullptr) {
+        libusb_exit(mContext);
+        mContext = nullptr;
+    }
+    return;
+}
+
+int32_t LibUsbTransport::Open(uint16_t vendorId, uint16_t productId) {
+    if (mContext == nullptr) {
+        int32_t res = libusb_init(&mContext);
+        if (res < 0) {
+            mContext = nullptr;
+            return res;
+        }
+    }
+
+    mHandle = libusb_open_device_with_vid_pid(mContext, vendorId, productId);
+    return (mHandle != nullptr) ? LIBUSB_SUCCESS : LIBUSB_ERROR_NO_DEVICE;
+}
+
+int32_t LibUsbTransport::DetachKernelDriver(int32_t interface) {
+    return libusb_detach_kernel_driver(mHandle, interface);
+}
+
+int32_t LibUsbTransport::AttachKernelDriver(int32_t interface) {
+    return libusb_attach_kernel_driver(mHandle, interface);
+}
+
+int32_t LibUsbTransport::ClaimInterface(int32_t interface) {
+    return libusb_claim_interface(mHandle, interface);
+}
+
+int32_t LibUsbTransport::ReleaseInterface(int32_t interface) {
+    return libusb_release_interface(mHandle, interface);
+}
+
+void LibUsbTransport::Close() {
+    if (mHandle != nullptr) {
+        libusb_close(mHandle);
+        mHandle = nullptr;
+    }
+    return;
+}
+
+bool LibUsbTransport::IsOpen() const {
+    return mHandle != nullptr;
+}
+
+int32_t LibUsbTransport::ControlTransfer(uint8_t requestType, uint8_t request, uint16_t value, uint16_t index,
+                                         uint8_t* data, uint16_t length, uint32_t timeoutMs) {
+    return libusb_control_transfer(mHandle, requestType, request, value, index, data, length, timeoutMs);
+}
+
+FakeUsbTransport::FakeUsbTransport()
+    : mOpen(false)
+    , mTransfers(0u) {
+    return;
+}
+
+FakeUsbTransport::~FakeUsbTransport() {
+    DLOG_DEBUG("fake usb transport handled %llu transfers", static_cast<unsigned long long>(GetTransfers()));
+    return;
+}
+
+int32_t FakeUsbTransport::Open(uint16_t vendorId, uint16_t productId) {
+    DLOG_INFO("fake usb device %04x:%04x opened", vendorId, productId);
+    mOpen = true;
+    return LIBUSB_SUCCESS;
+}
+
+int32_t FakeUsbTransport::DetachKernelDriver(int32_t interface) {
+    return LIBUSB_SUCCESS;
+}
+
+int32_t FakeUsbTransport::AttachKernelDriver(int32_t interface) {
+    return LIBUSB_SUCCESS;
+}
+
+int32_t FakeUsbTransport::ClaimInterface(int32_t interface) {
+    return LIBUSB_SUCCESS;
+}
+
+int32_t FakeUsbTransport::ReleaseInterface(int32_t interface) {
+    return LIBUSB_SUCCESS;
+}
+
+void FakeUsbTransport::Close() {
+    mOpen = false;
+    return;
+}
+
+bool FakeUsbTransport::IsOpen() const {
+    return mOpen;
+}
+
+int32_t FakeUsbTransport::ControlTransfer(uint8_t requestType, uint8_t request, uint16_t value, uint16_t index,
+                                          uint8_t* data, uint16_t length, uint32_t timeoutMs) {
+    if (!mOpen) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    mTransfers.fetch_add(1u, std::memory_order_relaxed);
+
+    // reads, including the status poll, come back zeroed: ready and no error
+    if ((requestType & kDeviceToHost) != 0u && data != nullptr) {
+        std::memset(data, 0, length);
+    }
+    return length;
+}
+
+uint64_t FakeUsbTransport::GetTransfers() const {
+    return mTransfers.load(std::memory_order_relaxed);
+}
+
+} // p2pro
+} // thermal
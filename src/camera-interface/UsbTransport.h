@@ -0,0 +1,98 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _USB_TRANSPORT_H_
+#define _USB_TRANSPORT_H_
+
+#include <stdint.h>
+#include <libusb.h>
+
+#include <atomic>
+
+namespace thermal {
+namespace p2pro {
+
+// The libusb calls UsbControl makes, one to one. The command encoding stays
+// in UsbControl, so it runs the same against the fake transport on a
+// machine without the camera.
+class UsbTransport {
+public:
+    virtual ~UsbTransport() = default;
+
+    // All of these return a libusb error code (< 0) on failure.
+    virtual int32_t Open(uint16_t vendorId, uint16_t productId) = 0;
+    virtual int32_t DetachKernelDriver(int32_t interface) = 0;
+    virtual int32_t AttachKernelDriver(int32_t interface) = 0;
+    virtual int32_t ClaimInterface(int32_t interface) = 0;
+    virtual int32_t ReleaseInterface(int32_t interface) = 0;
+    virtual void Close() = 0;
+    virtual bool IsOpen() const = 0;
+
+    // Returns the number of bytes transferred.
+    virtual int32_t ControlTransfer(uint8_t requestType, uint8_t request, uint16_t value, uint16_t index,
+                                    uint8_t* data, uint16_t length, uint32_t timeoutMs) = 0;
+};
+
+// The camera's vendor interface through libusb.
+class LibUsbTransport : public UsbTransport {
+public:
+    LibUsbTransport();
+    ~LibUsbTransport() override;
+
+    int32_t Open(uint16_t vendorId, uint16_t productId) override;
+    int32_t DetachKernelDriver(int32_t interface) override;
+    int32_t AttachKernelDriver(int32_t interface) override;
+    int32_t ClaimInterface(int32_t interface) override;
+    int32_t ReleaseInterface(int32_t interface) override;
+    void Close() override;
+    bool IsOpen() const override;
+    int32_t ControlTransfer(uint8_t requestType, uint8_t request, uint16_t value, uint16_t index,
+                            uint8_t* data, uint16_t length, uint32_t timeoutMs) override;
+
+private:
+    libusb_context* mContext;
+    libusb_device_handle* mHandle;
+};
+
+// Transport with no hardware behind it. Every command is accepted, the
+// device always reports ready and reads come back zeroed, which is enough
+// for the application to run against a replayed clip.
+class FakeUsbTransport : public UsbTransport {
+public:
+    FakeUsbTransport();
+    ~FakeUsbTransport() override;
+
+    int32_t Open(uint16_t vendorId, uint16_t productId) override;
+    int32_t DetachKernelDriver(int32_t interface) override;
+    int32_t AttachKernelDriver(int32_t interface) override;
+    int32_t ClaimInterface(int32_t interface) override;
+    int32_t ReleaseInterface(int32_t interface) override;
+    void Close() override;
+    bool IsOpen() const override;
+    int32_t ControlTransfer(uint8_t requestType, uint8_t request, uint16_t value, uint16_t index,
+                            uint8_t* data, uint16_t length, uint32_t timeoutMs) override;
+
+    uint64_t GetTransfers() const;
+
+private:
+    bool mOpen;
+    std::atomic<uint64_t> mTransfers;
+};
+
+} // p2pro
+} // thermal
+
+#endif // _USB_TRANSPORT_H_
@@ -16,25 +16,78 @@
 
 #include "Webcam.h"
 
+#include <opencv2/imgproc.hpp>
+#include <errno.h>
+#include <time.h>
+
 #include <thread>
 #include <condition_variable>
 #include <chrono>
 #include <mutex>
 #include <chrono>
 
+#include "FrameTrace.h"
 #include "Logger.h"
 
 namespace thermal {
 namespace p2pro {
 
+// A device that dropped off the bus fails every read straight away, so back
+// off between attempts and only report the loss once.
+constexpr const uint32_t kMaxMissedFrames = 10u;
+constexpr const std::chrono::milliseconds kMissedFrameBackoff(20);
+
 Webcam::Webcam(size_t w, size_t h, int32_t fps, int32_t devId) 
-    : mCameraSource()
+    : mSignalLostCallback(nullptr)
+    , mCameraSource()
     , mState(WebcamState::kNotConnected)
     , mWidth(w)
     , mHeight(h)
     , mFrameRate(fps)
     , mDeviceId(devId)
-    , mRunFlag(false) {
+    , mReplayPath()
+    , mSourceName("/dev/video" + std::to_string(devId))
+    , mReplayDue(0u)
+    , mReplayPacing(ReplayPacing::kRealTime)
+    , mRecording(nullptr)
+    , mRecordingIndex(0u)
+    , mRecordingEpoch(0u)
+    , mRawCapture(false)
+    , mRawHeight(h)
+    , mRunFlag(false)
+    , mStartTime() {
+    return;
+}
+
+Webcam::Webcam(std::string path, size_t w, size_t h, int32_t fps)
+    : mSignalLostCallback(nullptr)
+    , mCameraSource()
+    , mState(WebcamState::kNotConnected)
+    , mWidth(w)
+    , mHeight(h)
+    , mFrameRate(fps)
+    , mDeviceId(-1)
+    , mReplayPath(path)
+    , mSourceName(path)
+    , mReplayDue(0u)
+    , mReplayPacing(ReplayPacing::kRealTime)
+    , mRecording(nullptr)
+    , mRecordingIndex(0u)
+    , mRecordingEpoch(0u)
+    , mRawCapture(false)
+    , mRawHeight(h)
+    , mRunFlag(false)
+    , mStartTime() {
+    return;
+}
+
+Webcam::~Webcam() {
+    if (mState.load() == WebcamState::kRunning) {
+        Stop();
+    }
+    if (mState.load() == WebcamState::kConnectedAndStopped) {
+        ReleaseCamera();
+    }
     return;
 }
 
@@ -56,37 +109,72 @@ void Webcam::UnregisterCallback(VideoCallback fptr) {
     return;
 }
 
+void Webcam::SetOnSignalLostCallback(SignalLostCallback callback) {
+    mSignalLostCallback = callback;
+    return;
+}
+
 bool Webcam::Start() {
-    if (mState != WebcamState::kConnectedAndStopped) {
-        DLOG_ERROR("Err: cannot transition from %s to Running", WebcamStateToStr(mState));
+    if (mState.load() != WebcamState::kConnectedAndStopped) {
+        DLOG_ERROR("Err: cannot transition from %s to Running", WebcamStateToStr(mState.load()));
         return false;
     }
 
     DLOG_INFO("Starting webcam");
-    mRunFlag = true;
+    mRunFlag.store(true);
+    mStartTime = std::chrono::steady_clock::now();
     mReadThread = std::thread(&Webcam::Runloop, this);
-    mState = WebcamState::kRunning;
+    mState.store(WebcamState::kRunning);
     return true;
 }
 
 bool Webcam::Stop() {
     bool status = true;
-    if (mState != WebcamState::kRunning) {
-        DLOG_ERROR("Err: cannot transition from %s to Connected and Stopped", WebcamStateToStr(mState));
+    if (mState.load() != WebcamState::kRunning) {
+        DLOG_ERROR("Err: cannot transition from %s to Connected and Stopped", WebcamStateToStr(mState.load()));
         status = false;
         return status;
     }
 
-    mRunFlag = false;
+    mRunFlag.store(false);
     mReadThread.join();
 
-    mState = WebcamState::kConnectedAndStopped;
+    mState.store(WebcamState::kConnectedAndStopped);
     return status;
 }
 
+void Webcam::SetReplayPacing(ReplayPacing pacing) {
+    mReplayPacing = pacing;
+    return;
+}
+
+void Webcam::SetRawCapture(bool raw, size_t rawHeight) {
+    mRawCapture = raw;
+    mRawHeight = rawHeight;
+    return;
+}
+
 bool Webcam::Open() {
-    DLOG_NOTICE("opening /dev/video%d", mDeviceId);
-    mCameraSource.open(mDeviceId);
+    DLOG_NOTICE("opening %s", mSourceName.c_str());
+    if (!mReplayPath.empty() && camera::RecordingReader::Probe(mReplayPath)) {
+        mRecording = std::make_unique<camera::RecordingReader>();
+        if (!mRecording->Open(mReplayPath)) {
+            mRecording.reset();
+            mState.store(WebcamState::kNotConnected);
+            return false;
+        }
+        DLOG_NOTICE("replaying recording %s, %zu frames", mSourceName.c_str(), mRecording->GetFrameCount());
+        mRecordingIndex = 0u;
+        mRecordingEpoch = 0u;
+        mState.store(WebcamState::kConnectedAndStopped);
+        return true;
+    }
+
+    if (mReplayPath.empty()) {
+        mCameraSource.open(mDeviceId);
+    } else {
+        mCameraSource.open(mReplayPath);
+    }
 
     std::mutex mtx;
     std::unique_lock<std::mutex> lock(mtx);
@@ -96,29 +184,41 @@ bool Webcam::Open() {
         return mCameraSource.isOpened();
     });
 
-    if (mCameraSource.isOpened()) {
-        DLOG_NOTICE("opened /dev/video%d", mDeviceId);
+    if (mCameraSource.isOpened() && !mReplayPath.empty()) {
+        DLOG_NOTICE("replaying %s at %d fps", mSourceName.c_str(), mFrameRate);
+        mState.store(WebcamState::kConnectedAndStopped);
+
+    } else if (mCameraSource.isOpened()) {
+        DLOG_NOTICE("opened %s", mSourceName.c_str());
         mCameraSource.set(cv::CAP_PROP_FPS, static_cast<double>(mFrameRate));
         mCameraSource.set(cv::CAP_PROP_FRAME_WIDTH, static_cast<double>(mWidth));
-        mCameraSource.set(cv::CAP_PROP_FRAME_HEIGHT, static_cast<double>(mHeight));
-        mState = WebcamState::kConnectedAndStopped;
+        mCameraSource.set(cv::CAP_PROP_FRAME_HEIGHT, static_cast<double>(mRawCapture ? mRawHeight : mHeight));
+        if (mRawCapture) {
+            mCameraSource.set(cv::CAP_PROP_CONVERT_RGB, 0.0);
+        }
+        mState.store(WebcamState::kConnectedAndStopped);
         DLOG_DEBUG("finished setting camera props");
 
     } else {
-        DLOG_NOTICE("failed to open /dev/video%d", mDeviceId);
-        mState = WebcamState::kNotConnected;
+        DLOG_NOTICE("failed to open %s", mSourceName.c_str());
+        mState.store(WebcamState::kNotConnected);
     }
 
-    return (mState == WebcamState::kConnectedAndStopped);
+    return (mState.load() == WebcamState::kConnectedAndStopped);
 }
 
 void Webcam::ReleaseCamera() {
-    DLOG_INFO("releasing /dev/video%d", mDeviceId);
+    DLOG_INFO("releasing %s", mSourceName.c_str());
 
-    if (mCameraSource.isOpened()) {
+    if (mRecording != nullptr) {
+        mRecording.reset();
+        mState.store(WebcamState::kNotConnected);
+        DLOG_NOTICE("Released %s", mSourceName.c_str());
+
+    } else if (mCameraSource.isOpened()) {
         mCameraSource.release();
-        mState = WebcamState::kNotConnected;
-        DLOG_NOTICE("Released /dev/video%d", mDeviceId);
+        mState.store(WebcamState::kNotConnected);
+        DLOG_NOTICE("Released %s", mSourceName.c_str());
 
     } else {
         DLOG_WARN("did not release camera because it was not open.");
@@ -127,17 +227,129 @@ void Webcam::ReleaseCamera() {
 }
 
 WebcamState Webcam::GetState() const {
-    return mState;
+    return mState.load();
+}
+
+std::chrono::steady_clock::time_point Webcam::GetStartTime() const {
+    return mStartTime;
+}
+
+bool Webcam::ReadFrame(cv::Mat& frame) {
+    if (mReplayPath.empty()) {
+        if (!mCameraSource.read(frame)) {
+            return false;
+        }
+        // V4L2 hands an unconverted frame over as one row of bytes, give it
+        // the sensor's geometry back (no copy)
+        const size_t rawBytes = mWidth * mRawHeight * 2u;
+        if (mRawCapture && frame.rows == 1 && frame.total() * frame.elemSize() == rawBytes) {
+            frame = frame.reshape(2, static_cast<int32_t>(mRawHeight));
+        }
+        return true;
+    }
+    if (mRecording != nullptr) {
+        return ReadRecordedFrame(frame);
+    }
+
+    // pace the clip like the sensor, on absolute deadlines so it doesn't drift
+    const uint64_t period = 1000000000u / static_cast<uint64_t>(mFrameRate);
+    const uint64_t now = trace::Now();
+    if (mReplayPacing == ReplayPacing::kAsFastAsPossible) {
+        mReplayDue = now;
+    } else {
+        mReplayDue = (mReplayDue == 0u || now > mReplayDue + period) ? now : mReplayDue + period;
+        WaitUntil(mReplayDue);
+    }
+
+    if (!mCameraSource.read(frame)) {
+        mCameraSource.set(cv::CAP_PROP_POS_FRAMES, 0.0);
+        if (!mCameraSource.read(frame)) {
+            return false;
+        }
+    }
+
+    // clips recorded at another size still feed the pipeline
+    if (!frame.empty() && (static_cast<size_t>(frame.cols) != mWidth || static_cast<size_t>(frame.rows) != mHeight)) {
+        cv::resize(frame, frame, cv::Size(static_cast<int32_t>(mWidth), static_cast<int32_t>(mHeight)));
+    }
+    return true;
+}
+
+bool Webcam::ReadRecordedFrame(cv::Mat& frame) {
+    const size_t count = mRecording->GetFrameCount();
+    const uint64_t first = mRecording->GetTimestamp(0u);
+    const uint64_t now = trace::Now();
+
+    if (mReplayPacing == ReplayPacing::kAsFastAsPossible) {
+        mReplayDue = now;
+    } else {
+        // Keep the recorded spacing. Each pass starts one average frame
+        // period after the last frame of the previous one, and a replay that
+        // fell far behind (a stopped debugger) starts over from now.
+        if (mRecordingIndex >= count) {
+            const uint64_t span = mRecording->GetTimestamp(count - 1u) - first;
+            const uint64_t period = (count > 1u) ? span / (count - 1u) : 1000000000u / mFrameRate;
+            mRecordingEpoch += span + period;
+            mRecordingIndex = 0u;
+        }
+        mReplayDue = mRecordingEpoch + (mRecording->GetTimestamp(mRecordingIndex) - first);
+        if (mRecordingEpoch == 0u || now > mReplayDue + 1000000000u) {
+            mRecordingEpoch = now - (mRecording->GetTimestamp(mRecordingIndex) - first);
+            mReplayDue = now;
+        }
+        WaitUntil(mReplayDue);
+    }
+
+    if (mRecordingIndex >= count) {
+        mRecordingIndex = 0u;
+    }
+    frame = mRecording->GetFrame(mRecordingIndex++);
+    return true;
+}
+
+void Webcam::WaitUntil(uint64_t due) {
+    struct timespec deadline = { static_cast<time_t>(due / 1000000000u), static_cast<long>(due % 1000000000u) };
+    while (::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {}
+    return;
+}
+
+uint64_t Webcam::GetCaptureTimestamp() {
+    if (!mReplayPath.empty()) {
+        return mReplayDue;
+    }
+
+    // V4L2 stamps the buffer with CLOCK_MONOTONIC when the frame is
+    // complete, OpenCV hands it out in ms. 0 if the backend has none.
+    const double milliseconds = mCameraSource.get(cv::CAP_PROP_POS_MSEC);
+    if (milliseconds <= 0.0) {
+        return 0u;
+    }
+    return static_cast<uint64_t>(milliseconds * 1e6);
 }
 
 void Webcam::Runloop() {
-    while (mRunFlag == true) {
+    trace::FrameTracer& tracer = trace::FrameTracer::Instance();
+    uint32_t missedFrames = 0u;
+    while (mRunFlag.load()) {
         cv::Mat imgData;
-        mCameraSource >> imgData;
-        
+        if (!ReadFrame(imgData) || imgData.empty()) {
+            missedFrames++;
+            if (missedFrames == kMaxMissedFrames) {
+                DLOG_WARN("no data from %s after %u reads", mSourceName.c_str(), missedFrames);
+                if (mSignalLostCallback) {
+                    mSignalLostCallback();
+                }
+            }
+            std::this_thread::sleep_for(kMissedFrameBackoff);
+            continue;
+        }
+        missedFrames = 0u;
+
+        tracer.BeginFrame(GetCaptureTimestamp());
         for (auto callback : mDataCallbacks) {
-            callback(imgData, mRunFlag);
+            callback(imgData, mRunFlag.load());
         }
+        tracer.EndFrame();
     }
     return;
 }
@@ -20,15 +20,21 @@
 #include <opencv2/videoio.hpp>
 #include <stdint.h>
 
+#include <atomic>
 #include <vector>
 #include <functional>
+#include <string>
 #include <thread>
 #include <chrono>
+#include <memory>
+
+#include "FrameRecording.h"
 
 namespace thermal {
 namespace p2pro {
 
 typedef std::function<bool(cv::Mat&, bool)> VideoCallback;
+typedef std::function<void()> SignalLostCallback;
 
 enum class WebcamState : uint8_t {
     kNotConnected,
@@ -49,30 +55,80 @@ inline const char * WebcamStateToStr(WebcamState webcamState) {
     }
 }
 
+enum class ReplayPacing : uint8_t {
+    kRealTime,          ///< frames are due when they were captured (or at fps)
+    kAsFastAsPossible   ///< no waiting, stamped with the time they were read
+};
+
 class Webcam {
 public:
     Webcam(size_t w, size_t h, int32_t fps, int32_t devId);
 
+    /**
+     * @brief Replays a recorded clip (or an image sequence such as
+     * frame_%03d.png) instead of a device. Frames are handed out at fps on
+     * the monotonic clock and stamped with the time they were due, like a
+     * sensor would, and the clip loops until Stop().
+     *
+     * A recording written by camera::FrameRecorder is mapped instead and
+     * its frames are handed out zero-copy, with the recorded spacing and at
+     * their recorded size and format.
+     */
+    Webcam(std::string path, size_t w, size_t h, int32_t fps);
+    ~Webcam();
+
     void RegisterOnDataCallback(VideoCallback fptr);
     void UnregisterCallback(VideoCallback fptr);
+    void SetOnSignalLostCallback(SignalLostCallback callback);
     bool Open();
     bool Start();
     bool Stop();
     void ReleaseCamera();
     WebcamState GetState() const;
 
+    /**
+     * @brief How a replay is paced. Set before Start().
+     */
+    void SetReplayPacing(ReplayPacing pacing);
+
+    /**
+     * @brief Asks the device for unconverted frames, e.g. the P2 Pro's
+     * image-over-thermal YUYV frame, delivered as rawHeight rows of
+     * CV_8UC2. Set before Open().
+     *
+     * @param raw true for raw frames.
+     * @param rawHeight rows of the raw frame.
+     */
+    void SetRawCapture(bool raw, size_t rawHeight);
+    std::chrono::steady_clock::time_point GetStartTime() const;
+
 private:
     std::vector<VideoCallback> mDataCallbacks;
+    SignalLostCallback mSignalLostCallback;
     cv::VideoCapture mCameraSource;
     std::thread mReadThread;
-    WebcamState mState;
+    std::atomic<WebcamState> mState; ///< written under P2ProManager's lock, read by the supervisor without it
     size_t mWidth;
     size_t mHeight;
     int32_t mFrameRate;
     int32_t mDeviceId;
-    bool mRunFlag;
+    std::string mReplayPath;   ///< empty for a device
+    std::string mSourceName;
+    uint64_t mReplayDue;       ///< when the current replayed frame was due
+    ReplayPacing mReplayPacing;
+    std::unique_ptr<camera::RecordingReader> mRecording; ///< set when replaying a recording
+    size_t mRecordingIndex;    ///< next frame of the recording
+    uint64_t mRecordingEpoch;  ///< when frame 0 of the current pass is due
+    bool mRawCapture;
+    size_t mRawHeight;
+    std::atomic<bool> mRunFlag; ///< cleared by Stop() while the read thread polls it
+    std::atomic<std::chrono::steady_clock::time_point> mStartTime;
 
     void Runloop();
+    bool ReadFrame(cv::Mat& frame);
+    bool ReadRecordedFrame(cv::Mat& frame);
+    void WaitUntil(uint64_t due);
+    uint64_t GetCaptureTimestamp();
 };
 
 } // namespace webcam
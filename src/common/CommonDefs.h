@@ -19,13 +19,23 @@
 
 #include <stdint.h>
 
+#include <cstddef>
+
 namespace thermal {
 
+// 1.28" round LCD driven through /dev/fb0 as 32 bpp RGBA
+inline constexpr size_t kDisplayWidth = 240u;
+inline constexpr size_t kDisplayHeight = 240u;
+inline constexpr size_t kDisplayChannels = 4u;
+
 enum class TopMode : int8_t {
     kNone = 0,
     kXOffset = 1,
     kPickReticle = 2,
     kPickColor = 3,
+    kPickProfile = 4,
+    kHud = 5,
+    kRecord = 6,
     kCount,
 };
 
@@ -39,6 +49,12 @@ inline constexpr const char * TopModeToString(TopMode color) {
             return "RETICLE";
         case TopMode::kPickColor:
             return "COLOR";
+        case TopMode::kPickProfile:
+            return "PROFILE";
+        case TopMode::kHud:
+            return "HUD";
+        case TopMode::kRecord:
+            return "RECORD";
         default:
             return "UNKNOWN";
     }
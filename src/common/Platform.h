@@ -0,0 +1,53 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _PLATFORM_H_
+#define _PLATFORM_H_
+
+// Where the application keeps its files. The defaults are the paths on the
+// scope; the host build points them into its build directory so it runs
+// without root.
+#ifndef THERMAL_SCOPE_ETC_DIR
+#define THERMAL_SCOPE_ETC_DIR "/etc/thermal-scope"
+#endif
+
+#ifndef THERMAL_SCOPE_DATA_DIR
+#define THERMAL_SCOPE_DATA_DIR "/var/data/persist"
+#endif
+
+#ifndef THERMAL_SCOPE_RUN_DIR
+#define THERMAL_SCOPE_RUN_DIR "/run/thermal-scope"
+#endif
+
+namespace thermal {
+
+// Built for a workstation, see THERMAL_SCOPE_HOST in CMakeLists.txt. There is
+// no camera, LCD or gpio chip, the application runs on stand-ins for them.
+#ifdef THERMAL_SCOPE_HOST
+inline constexpr bool kHostBuild = true;
+#else
+inline constexpr bool kHostBuild = false;
+#endif
+
+inline constexpr const char* const kReticleDirectory = THERMAL_SCOPE_ETC_DIR "/reticles/";
+inline constexpr const char* const kPersistentDirectory = THERMAL_SCOPE_DATA_DIR "/";
+inline constexpr const char* const kRunDirectory = THERMAL_SCOPE_RUN_DIR;
+inline constexpr const char* const kRecordingDirectory = THERMAL_SCOPE_DATA_DIR "/recordings/";
+inline constexpr const char* const kSnapshotDirectory = THERMAL_SCOPE_DATA_DIR "/snapshots/";
+
+} // thermal
+
+#endif // _PLATFORM_H_
@@ -23,17 +23,46 @@ namespace hw {
 
 using std::bind;
 using std::placeholders::_1;
-using std::placeholders::_2;
+
+// Quarter step for every (previous AB, current AB) transition, indexed by
+// (previous << 2) | current. Transitions that skip a state (both pins changed)
+// are bounce or a missed edge and count as 0.
+constexpr const int8_t kTransitionTable[16] = {
+     0,  1, -1,  0,
+    -1,  0,  0,  1,
+     1,  0,  0, -1,
+     0, -1,  1,  0
+};
+
+// Both pins are pulled up, the encoder rests at AB = 11 between detents.
+constexpr const uint8_t kDetentState = 0b11;
+
+// Quarter steps needed within one detent to count it. A full detent is 4,
+// accepting 2 tolerates a lost edge without accepting plain bounce.
+constexpr const int8_t kStepsPerDetent = 2;
 
 Encoder::Encoder(int32_t pinA, int32_t pinB, int32_t btnPin)
     : mRotateCallback(nullptr)
     , mClickCallback(nullptr)
     , mGpioA(pinA)
     , mGpioB(pinB)
-    , mGpioBtn(btnPin) {
-    mGpioA.RegisterOnChangeCallback(bind(&Encoder::OnRotateEvent, this, _1, _2));
-    mGpioB.RegisterOnChangeCallback(bind(&Encoder::OnRotateEvent, this, _1, _2));
-    mGpioBtn.RegisterOnChangeCallback(bind(&Encoder::OnClickEvent, this, _1, _2));
+    , mGpioBtn(btnPin)
+    , mLevelA(true)
+    , mLevelB(true)
+    , mState(kDetentState)
+    , mSteps(0)
+    , mCurve(kNoAcceleration)
+    , mLastDetentTime(0u)
+    , mLastDetentDirection(0)
+    , mPending{ 0, 0, 0u } {
+    // only time the pins are read, after this the levels come from the edges
+    mLevelA = mGpioA.Read();
+    mLevelB = mGpioB.Read();
+    mState = (mLevelA << 1) | mLevelB;
+
+    mGpioA.RegisterOnChangeCallback(bind(&Encoder::OnRotateEvent, this, _1));
+    mGpioB.RegisterOnChangeCallback(bind(&Encoder::OnRotateEvent, this, _1));
+    mGpioBtn.RegisterOnChangeCallback(bind(&Encoder::OnClickEvent, this, _1));
     return;
 }
 
@@ -51,6 +80,33 @@ void Encoder::SetOnClickCallback(ClickCallback callback) {
     return;
 }
 
+void Encoder::SetAccelerationCurve(const AccelerationCurve& curve) {
+    mCurve = curve;
+    if (mCurve.maxMultiplier < 1) {
+        mCurve.maxMultiplier = 1;
+    }
+    return;
+}
+
+bool Encoder::HasPendingRotation() const {
+    // spins that cancel out still carry an accelerated delta
+    return mPending.detents != 0 || mPending.delta != 0;
+}
+
+void Encoder::Flush() {
+    bool pending = HasPendingRotation();
+    Rotation rotation = mPending;
+    mPending = { 0, 0, 0u };
+    if (!pending) {
+        return;
+    }
+
+    DLOG_DEBUG("rotate %d detents, delta %d", rotation.detents, rotation.delta);
+    if (mRotateCallback) {
+        mRotateCallback(rotation);
+    }
+}
+
 void Encoder::ClearOnRotateCallback() {
     mRotateCallback = nullptr;
     return;
@@ -61,44 +117,68 @@ void Encoder::ClearOnClickCallback() {
     return;
 }
 
-// from https://www.allaboutcircuits.com/projects/how-to-use-a-rotary-encoder-in-a-mcu-based-project/
-void Encoder::OnRotateEvent([[maybe_unused]] int32_t, [[maybe_unused]] bool) {
-
-    // Read A and B signals
-    bool currentA = mGpioA.Read();
-    bool currentB = mGpioB.Read();
-    
-    // Record the A and B signals in seperate sequences
-    mSeqA <<= 1;
-    mSeqA |= currentA;
-    
-    mSeqB <<= 1;
-    mSeqB |= currentB;
-    
-    // Mask the MSB four bits
-    mSeqA &= 0b00001111;
-    mSeqB &= 0b00001111;
-
-    // Compare the recorded sequence with the expected sequence
-    if ((mSeqA == 0b00001001) && (mSeqB == 0b00000011)) {
-        DLOG_DEBUG("INCREMENT");
-        mRotateCallback(Direction::kIncrement);
+/// @brief called for every edge on A or B, in the order they happened.
+///        Uses the level carried by the edge, by the time it is dispatched
+///        the pin may have moved on already.
+/// @param event - the edge
+void Encoder::OnRotateEvent(const gpio::EdgeEvent& event) {
+    if (event.gpio == mGpioA.Gpio()) {
+        mLevelA = event.level;
+    } else {
+        mLevelB = event.level;
+    }
+
+    const uint8_t current = (mLevelA << 1) | mLevelB;
+    mSteps += kTransitionTable[(mState << 2) | current];
+    mState = current;
+
+    if (current != kDetentState) {
+        return;
+    }
+
+    if (mSteps >= kStepsPerDetent) {
+        OnDetent(+1, event.timestamp);
+    } else if (mSteps <= -kStepsPerDetent) {
+        OnDetent(-1, event.timestamp);
     }
-    
-    if ((mSeqA == 0b00000011) && (mSeqB == 0b00001001)) {
-        DLOG_DEBUG("DECREMENT");
-        mRotateCallback(Direction::kDecrement);
+    mSteps = 0;
+}
+
+/// @brief scales the detent by how long ago the previous one was. The
+///        timestamps come from the kernel, so queueing delay doesn't count
+///        as speed. A change of direction always starts slow.
+void Encoder::OnDetent(int32_t direction, uint64_t timestamp) {
+    int32_t multiplier = 1;
+
+    if (direction == mLastDetentDirection && timestamp > mLastDetentTime) {
+        const int64_t interval = static_cast<int64_t>(timestamp - mLastDetentTime);
+        const int64_t slow = std::chrono::nanoseconds(mCurve.slowInterval).count();
+        const int64_t fast = std::chrono::nanoseconds(mCurve.fastInterval).count();
+
+        if (interval <= fast) {
+            multiplier = mCurve.maxMultiplier;
+        } else if (interval < slow) {
+            // linear between (slow, 1) and (fast, max), rounded
+            const int64_t span = slow - fast;
+            multiplier = 1 + static_cast<int32_t>(((mCurve.maxMultiplier - 1) * (slow - interval) + span / 2) / span);
+        }
     }
+
+    mLastDetentTime = timestamp;
+    mLastDetentDirection = direction;
+    mPending.detents += direction;
+    mPending.delta += direction * multiplier;
+    mPending.timestamp = timestamp;
 }
 
 /// @brief called by the gpio::watcher automatically when the gpio level flips.
-/// @param gpio - gpio number
-/// @param level - high/low
-void Encoder::OnClickEvent([[maybe_unused]] int32_t, bool level) {
-    mClickCallback(level);
+/// @param event - the edge, level high/low
+void Encoder::OnClickEvent(const gpio::EdgeEvent& event) {
+    if (mClickCallback) {
+        mClickCallback(event.level);
+    }
 }
 
 
-
 } // namespace hw
 } // namespace thermal
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 
+#include <chrono>
 #include <vector>
 #include <functional>
 
@@ -28,18 +29,38 @@ namespace thermal {
 namespace hw {
 
 /**
- * @brief Enum class to represent the direction of rotation.
+ * @brief Maps how fast the knob turns to how far one detent moves.
+ *        Detents further apart than slowInterval move by 1, closer than
+ *        fastInterval by maxMultiplier, and linearly in between.
  */
-enum class Direction : int8_t {
-    kDecrement = -1, ///< Decrement direction
-    kIncrement = 1   ///< Increment direction
+struct AccelerationCurve {
+    std::chrono::milliseconds slowInterval; ///< Interval at and above which there is no acceleration
+    std::chrono::milliseconds fastInterval; ///< Interval at and below which the full multiplier applies
+    int32_t maxMultiplier;                  ///< Step size of one detent at full speed
+};
+
+/**
+ * @brief Curve that always moves one step per detent.
+ */
+inline constexpr AccelerationCurve kNoAcceleration = {
+    std::chrono::milliseconds(0), std::chrono::milliseconds(0), 1
+};
+
+/**
+ * @brief Rotation collected since the last delivery.
+ */
+struct Rotation {
+    int32_t detents; ///< Signed number of detents turned, positive is increment
+    int32_t delta;   ///< Signed steps after acceleration
+    uint64_t timestamp; ///< Edge timestamp of the last detent, nanoseconds
 };
 
 /**
  * @brief Typedef for the callback function for rotation events.
- *        This is called once per step.
+ *        This is called once per Flush() with everything turned since the
+ *        previous one, never with zero detents.
  */
-typedef std::function<void(Direction)> RotateCallback;
+typedef std::function<void(const Rotation&)> RotateCallback;
 
 /**
  * @brief Typedef for the callback function for click events.
@@ -77,6 +98,24 @@ public:
      */
     void SetOnClickCallback(ClickCallback callback);
 
+    /**
+     * @brief Set how fast spins scale the step size.
+     * @param curve the acceleration curve, kNoAcceleration to turn it off.
+     */
+    void SetAccelerationCurve(const AccelerationCurve& curve);
+
+    /**
+     * @brief Check if there is rotation that hasn't been delivered yet.
+     * @return true if Flush() would call the rotate callback.
+     */
+    bool HasPendingRotation() const;
+
+    /**
+     * @brief Deliver the rotation collected since the last flush as one
+     *        callback, so a burst of detents costs a single update.
+     */
+    void Flush();
+
     /**
      * @brief Clear the callback function for rotate events.
      */
@@ -93,22 +132,33 @@ private:
     gpio::Watcher mGpioA;           ///< GPIO watcher for the A pin.
     gpio::Watcher mGpioB;           ///< GPIO watcher for the B pin.
     gpio::Watcher mGpioBtn;         ///< GPIO watcher for the button pin.
-    uint8_t mSeqA = 0;              ///< Holds the last 4 states in a bitfield
-    uint8_t mSeqB = 0;              ///< Holds the last 4 states in a bitfield
+    bool mLevelA;                   ///< Last reported level of the A pin
+    bool mLevelB;                   ///< Last reported level of the B pin
+    uint8_t mState;                 ///< Last AB state, (A << 1) | B
+    int8_t mSteps;                  ///< Quarter steps since the last detent
+    AccelerationCurve mCurve;       ///< Step size as a function of spin speed
+    uint64_t mLastDetentTime;       ///< Edge timestamp of the last detent, nanoseconds
+    int32_t mLastDetentDirection;   ///< +1/-1 of the last detent, 0 if none yet
+    Rotation mPending;              ///< Rotation not yet delivered
+
+    /**
+     * @brief Internal method to count one detent.
+     * @param direction +1 or -1.
+     * @param timestamp edge timestamp in nanoseconds.
+     */
+    void OnDetent(int32_t direction, uint64_t timestamp);
 
     /**
      * @brief Internal method to handle rotation events.
-     * @param gpio unused.
-     * @param level unused.
+     * @param event the edge on either the A or B pin.
      */
-    void OnRotateEvent(int32_t, bool);
+    void OnRotateEvent(const gpio::EdgeEvent& event);
     
     /**
      * @brief Internal method to handle click events.
-     * @param gpio unused.
-     * @param level The level of the GPIO pin (true for high, false for low).
+     * @param event the edge on the button pin, level true for high, false for low.
      */
-    void OnClickEvent(int32_t, bool level);
+    void OnClickEvent(const gpio::EdgeEvent& event);
 };
 
 } // namespace hw
@@ -43,7 +43,7 @@ FrameBuffer::FrameBuffer(std::string device)
 
     // Open the file for reading and writing
     mFileDescriptor = ::open(device.c_str(), O_RDWR);
-    if (!mFileDescriptor) {
+    if (mFileDescriptor < 0) {
         DLOG_ERROR("cannot open %s", device.c_str());
         return;
     }
@@ -64,17 +64,69 @@ FrameBuffer::FrameBuffer(std::string device)
     mBufferSize = mFInfo.smem_len;
     mFrameBufferPtr = (char*)::mmap(0, mBufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFileDescriptor, 0);
 
-    if (reinterpret_cast<int32_t>(mFrameBufferPtr) == -1) {
+    if (mFrameBufferPtr == MAP_FAILED) {
         DLOG_ERROR("Failed to mmap");
+        mFrameBufferPtr = nullptr;
+        mBufferSize = 0u;
     } else {
         DLOG_DEBUG("Initialize mmap at %p", mFrameBufferPtr);
     }
     return;
 }
 
+FrameBuffer::FrameBuffer(std::string path, size_t size)
+    : mFileDescriptor(-1)
+    , mDeviceName(path)
+    , mBufferSize(0u)
+    , mFInfo{}
+    , mVInfo{}
+    , mFrameBufferPtr(nullptr) {
+    mFileDescriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (mFileDescriptor < 0) {
+        DLOG_ERROR("cannot open %s (%s)", path.c_str(), strerror(errno));
+        return;
+    }
+
+    if (::ftruncate(mFileDescriptor, static_cast<off_t>(size)) != 0) {
+        DLOG_ERROR("cannot size %s to %zu (%s)", path.c_str(), size, strerror(errno));
+        return;
+    }
+
+    void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFileDescriptor, 0);
+    if (mapping == MAP_FAILED) {
+        DLOG_ERROR("Failed to mmap %s (%s)", path.c_str(), strerror(errno));
+        return;
+    }
+
+    mFrameBufferPtr = static_cast<char*>(mapping);
+    mBufferSize = size;
+    DLOG_NOTICE("%s is a file backed framebuffer of %zu bytes", path.c_str(), size);
+}
+
+FrameBuffer::FrameBuffer(size_t size)
+    : mFileDescriptor(-1)
+    , mDeviceName("memory")
+    , mBufferSize(0u)
+    , mFInfo{}
+    , mVInfo{}
+    , mFrameBufferPtr(nullptr) {
+    void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        DLOG_ERROR("Failed to mmap %zu bytes (%s)", size, strerror(errno));
+        return;
+    }
+
+    mFrameBufferPtr = static_cast<char*>(mapping);
+    mBufferSize = size;
+}
+
 FrameBuffer::~FrameBuffer() {
-    ::munmap(mFrameBufferPtr, mBufferSize);
-    ::close(mFileDescriptor);
+    if (mFrameBufferPtr != nullptr) {
+        ::munmap(mFrameBufferPtr, mBufferSize);
+    }
+    if (mFileDescriptor >= 0) {
+        ::close(mFileDescriptor);
+    }
 	return;
 }
 
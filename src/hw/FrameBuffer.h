@@ -29,7 +29,24 @@ namespace hw {
 
 class FrameBuffer {
 public:
+    /**
+     * @brief Maps a framebuffer device, e.g. /dev/fb0.
+     */
     FrameBuffer(std::string device);
+
+    /**
+     * @brief Maps a regular file of the given size instead of a device, so
+     * the frame path can run on a machine without the LCD. The file always
+     * holds the last frame written.
+     */
+    FrameBuffer(std::string path, size_t size);
+
+    /**
+     * @brief Anonymous memory of the given size, for benchmarking the
+     * write without any file or device behind it.
+     */
+    explicit FrameBuffer(size_t size);
+
     ~FrameBuffer();
     bool Write(uint8_t* image, size_t size);
 
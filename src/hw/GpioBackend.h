@@ -0,0 +1,81 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _GPIO_BACKEND_H_
+#define _GPIO_BACKEND_H_
+
+#include <stdint.h>
+
+#include <memory>
+
+#include "GpioWatcher.h"
+
+namespace thermal {
+namespace gpio {
+
+/**
+ * @brief Where the gpio lines come from.
+ *
+ * A backend claims lines for the watchers and reports their edges with
+ * QueueEdges() from a single thread of its own. Everything above it
+ * (the queue, the dispatch and the encoders) is the same for every backend.
+ */
+class Backend {
+public:
+    virtual ~Backend() = default;
+
+    /**
+     * @brief Claims a line as an input and starts reporting its edges.
+     * @param gpio the gpio number.
+     * @param pullup pull setting, LG_SET_PULL_UP/LG_SET_PULL_DOWN/LG_SET_PULL_NONE.
+     * @return true if the line was claimed.
+     */
+    virtual bool Claim(int32_t gpio, int32_t pullup) = 0;
+
+    /**
+     * @brief Stops reporting edges and frees the line.
+     * @param gpio the gpio number.
+     */
+    virtual void Release(int32_t gpio) = 0;
+
+    /**
+     * @brief Reads the current level of a claimed line.
+     * @param gpio the gpio number.
+     * @return true if high.
+     */
+    virtual bool Read(int32_t gpio) const = 0;
+};
+
+/**
+ * @brief Replaces the backend used by watchers created from now on.
+ *        Must be called before the first Watcher, normally from main() or
+ *        a benchmark. Without it the lgpio backend is used, or the
+ *        simulated one in the host build.
+ * @param backend the backend.
+ */
+void SetBackend(std::shared_ptr<Backend> backend);
+
+/**
+ * @brief Gets the current backend, creating the default one on first use.
+ * @return the backend.
+ */
+std::shared_ptr<Backend> GetBackend();
+
+} // namespace gpio
+} // namespace thermal
+
+#endif // _GPIO_BACKEND_H_
@@ -16,133 +16,154 @@
 
 #include "GpioWatcher.h"
 
-#include <unordered_map>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <functional>
-#include <thread>
+#include <mutex>
 
+#include "GpioBackend.h"
 #include "Logger.h"
+#include "SpscRing.h"
+
+// the host build has no gpio chip and doesn't link lgpio
+#ifdef THERMAL_SCOPE_HOST
+#include "SimulatedGpioBackend.h"
+#else
+#include "LgpioBackend.h"
+#endif
 
 namespace thermal {
 namespace gpio {
 
-constexpr const int32_t kGpioChip0 = 0;
-constexpr const int32_t kDebounceTime = 500; // microseconds
+// Enough for a few hundred milliseconds of fast spinning on both encoders
+// even if the consumer is busy with a redraw.
+constexpr const size_t kEventQueueSize = 1024u;
 
-static std::unordered_map<int32_t, std::vector<gpio::Callback>> sCallbackMap;
+static std::array<Watcher*, kMaxGpio> sWatchers = {};
+static utils::SpscRing<EdgeEvent, kEventQueueSize> sEventQueue;
+static std::atomic<bool> sNotifyPending(false);
+static std::shared_ptr<Backend> sBackend = nullptr;
+static std::mutex sBackendMutex;
 
-void DelegateCallback(int32_t numEvents, lgGpioAlert_p alert, void* userData) {
+int32_t GetEventFd() {
+    static int32_t fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return fd;
+}
 
-    // handle each event
-    for (int32_t i = 0; i < numEvents; i++) {
+uint64_t GetDroppedEvents() {
+    return sEventQueue.Dropped();
+}
 
-        // gpio report contains details about the pin
-        lgGpioReport_t gpioInfo = alert[i].report;
-        if (sCallbackMap.contains(gpioInfo.gpio)) {
+void QueueEdges(const EdgeEvent* events, size_t count) {
+    if (count == 0u) {
+        return;
+    }
 
-            // handle each callback
-            for (auto cb : sCallbackMap.at(gpioInfo.gpio)) {
-                //DLOG_INFO("gpio%d changed to %s", gpioInfo.gpio, gpioInfo.level == 1 ? "HIGH" : "LOW");
-                cb(gpioInfo.gpio, (gpioInfo.level == /* HIGH */ 1));
-            }
+    for (size_t i = 0u; i < count; i++) {
+        sEventQueue.Push(events[i]);
+    }
+
+    // Only wake the consumer if it isn't already due to drain, so a fast
+    // spin costs one eventfd write per drain rather than one per edge.
+    if (!sNotifyPending.exchange(true)) {
+        uint64_t one = 1u;
+        if (::write(GetEventFd(), &one, sizeof(one)) < 0) {
+            sNotifyPending = false;
         }
     }
     return;
 }
 
-Watcher::Watcher(int32_t gpioNumber, int32_t pullup) 
-    : mGpioDeviceNumber(gpioNumber) {
-
-    // Static handle should be initialized by the first instance.
-    // If this is the first instance, then it needs to be opened.
-    if (sHandle < 0) {
-
-        // Open GPIO chip 0. This is what it is on my RPI Zero 2W.
-        sHandle = ::lgGpiochipOpen(kGpioChip0);
-        if (sHandle < 0) {
-            DLOG_ERROR("Failed to open GPIO /dev/gpiochip0 (err %d)", sHandle);
-            return;
-        } else {
-            DLOG_INFO("successfully opened /dev/gpiochip0");
-        }
-    }
+void SetBackend(std::shared_ptr<Backend> backend) {
+    std::lock_guard<std::mutex> lock(sBackendMutex);
+    sBackend = backend;
+}
 
-    // Set the GPIO pin as an input
-    int32_t status = ::lgGpioClaimInput(sHandle, pullup, gpioNumber);
-    if (status == 0) {
-        DLOG_DEBUG("claimed gpio%d", gpioNumber);
-    } else {
-        DLOG_ERROR("Failed to set gpio%d as input (err %d)", gpioNumber, status);
-        return;
+std::shared_ptr<Backend> GetBackend() {
+    std::lock_guard<std::mutex> lock(sBackendMutex);
+    if (sBackend == nullptr) {
+#ifdef THERMAL_SCOPE_HOST
+        sBackend = std::make_shared<SimulatedBackend>();
+#else
+        sBackend = std::make_shared<LgpioBackend>();
+#endif
     }
+    return sBackend;
+}
 
-    status = ::lgGpioSetDebounce(sHandle, mGpioDeviceNumber, kDebounceTime);
-    if (status == 0) {
-        DLOG_DEBUG("Successfully set debounce time on gpio%d", gpioNumber);
-    } else {
-        DLOG_ERROR("Failed to set debounce time on gpio%d (err %d)", gpioNumber, status);
+size_t DispatchEvents() {
+    // clear before draining, anything queued after this wakes us again
+    sNotifyPending = false;
+    uint64_t count = 0u;
+    while (::read(GetEventFd(), &count, sizeof(count)) > 0) {}
+
+    size_t dispatched = 0u;
+    EdgeEvent event;
+    while (sEventQueue.Pop(event)) {
+        Watcher* watcher = (event.gpio >= 0 && event.gpio < kMaxGpio) ? sWatchers[event.gpio] : nullptr;
+        if (watcher != nullptr) {
+            for (const auto& cb : watcher->mCallbacks) {
+                cb(event);
+            }
+        }
+        dispatched++;
     }
+    return dispatched;
+}
 
-    status = ::lgGpioClaimAlert(sHandle, pullup, LG_BOTH_EDGES, gpioNumber, gpioNumber);
-    if (status == 0) {
-        DLOG_DEBUG("Successfully claimed alert on gpio%d", gpioNumber);
-    } else {
-        DLOG_ERROR("Failed to claim alert for gpio%d (err %d)", gpioNumber, status);
+Watcher::Watcher(int32_t gpioNumber, int32_t pullup) 
+    : mBackend(GetBackend())
+    , mGpioDeviceNumber(gpioNumber)
+    , mClaimed(false)
+    , mCallbacks() {
+
+    if (gpioNumber < 0 || gpioNumber >= kMaxGpio) {
+        DLOG_ERROR("gpio%d is out of range", gpioNumber);
+        return;
     }
+    sWatchers[gpioNumber] = this;
 
-    // Set up the alert function for the GPIO pin
-    status = ::lgGpioSetAlertsFunc(sHandle, gpioNumber, &DelegateCallback, nullptr);
-    if (status == 0) {
-        DLOG_DEBUG("Successfully registered a callback on gpio%d", gpioNumber);
-    } else {
-        DLOG_ERROR("Failed to set alert function for gpio%d (err %d)", gpioNumber, status);
+    mClaimed = mBackend->Claim(gpioNumber, pullup);
+    if (!mClaimed) {
+        DLOG_ERROR("failed to watch gpio%d", gpioNumber);
     }
     return;
 }
 
 Watcher::~Watcher() {
     DLOG_DEBUG("");
-    
-    if (mThread.joinable()) {
-        mThread.join();
-    }
 
-    if (sHandle > 0) {
-        ::lgGpiochipClose(sHandle);
+    if (mClaimed) {
+        mBackend->Release(mGpioDeviceNumber);
     }
     
-    if (sCallbackMap.contains(mGpioDeviceNumber)) {
-        sCallbackMap.erase(mGpioDeviceNumber);
+    if (mGpioDeviceNumber >= 0 && mGpioDeviceNumber < kMaxGpio) {
+        sWatchers[mGpioDeviceNumber] = nullptr;
     }
     return;
 }
 
 void Watcher::RegisterOnChangeCallback(Callback callback) {
-    sCallbackMap[mGpioDeviceNumber].push_back(callback);
+    mCallbacks.push_back(callback);
     return;
 }
 
 void Watcher::UnregisterOnChangeCallback(Callback callback) {
-    auto vec = sCallbackMap[mGpioDeviceNumber];
-    auto it = std::remove_if(vec.begin(), vec.end(), [&callback](const Callback& cb) {
-            return cb.target<void(int32_t, bool)>() == callback.target<void(int32_t, bool)>();
+    auto it = std::remove_if(mCallbacks.begin(), mCallbacks.end(), [&callback](const Callback& cb) {
+            return cb.target<void(const EdgeEvent&)>() == callback.target<void(const EdgeEvent&)>();
         });
 
-    if (it != vec.end()) {
-        vec.erase(it, vec.end());
+    if (it != mCallbacks.end()) {
+        mCallbacks.erase(it, mCallbacks.end());
     }
 }
 
-constexpr const int32_t Watcher::Gpio() const {
-    return mGpioDeviceNumber;
-}
-
 bool Watcher::Read() const {
-    int32_t value = ::lgGpioRead(sHandle, mGpioDeviceNumber);
-    if (value < 0) {
-        DLOG_ERROR("failed to read the gpio%d (err %d)", mGpioDeviceNumber, value);
-    }
-
-    return (value == /* HIGH */ 1);
+    return mBackend->Read(mGpioDeviceNumber);
 }
 
 } // namespace gpio
@@ -29,14 +29,37 @@ extern "C" {
 
 #include <stdint.h>
 
+#include <cstddef>
+#include <memory>
 #include <vector>
 #include <functional>
-#include <thread>
 
 namespace thermal {
 namespace gpio {
 
-typedef std::function<void(int32_t, bool)> Callback;
+// Highest gpio number + 1 that can be watched, sizes the dispatch table.
+inline constexpr int32_t kMaxGpio = 64;
+
+// One edge as reported by the kernel, with the level after the edge.
+struct EdgeEvent {
+    uint64_t timestamp; ///< nanoseconds, taken by the kernel when the edge happened
+    int32_t gpio;
+    bool level;
+};
+
+typedef std::function<void(const EdgeEvent&)> Callback;
+
+class Backend;
+
+// Edges are queued by the backend's thread (the lgpio alert thread on the
+// device) and handed to the callbacks by DispatchEvents() on whichever thread
+// drains the queue. That thread waits on GetEventFd(), which becomes readable
+// when there is something to drain. QueueEdges() must only ever be called from
+// one thread at a time.
+void QueueEdges(const EdgeEvent* events, size_t count);
+int32_t GetEventFd();
+size_t DispatchEvents();
+uint64_t GetDroppedEvents();
 
 class Watcher {
 public:
@@ -46,14 +69,16 @@ public:
     //void AlertPinChange();
     void RegisterOnChangeCallback(Callback callback);
     void UnregisterOnChangeCallback(Callback callback);
-    constexpr const int32_t Gpio() const;
+    int32_t Gpio() const { return mGpioDeviceNumber; }
     bool Read() const;
 
 private:
-    inline static int32_t sHandle = -1;
+    std::shared_ptr<Backend> mBackend;
     const int32_t mGpioDeviceNumber;
+    bool mClaimed;
+    std::vector<Callback> mCallbacks;
 
-    std::thread mThread;
+    friend size_t DispatchEvents();
 };
 
 } // namespace gpio
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "LgpioBackend.h"
+
+#include <array>
+
+#include "Logger.h"
+
+namespace thermal {
+namespace gpio {
+
+constexpr const int32_t kGpioChip0 = 0;
+constexpr const int32_t kDebounceTime = 500; // microseconds
+constexpr const size_t kMaxEdgesPerBatch = 64u;
+
+/// @brief runs on the lgpio alert thread. Only copies the reports into the
+///        queue, the edge level and time are already in the report.
+static void DelegateCallback(int32_t numEvents, lgGpioAlert_p alert, [[maybe_unused]] void* userData) {
+    std::array<EdgeEvent, kMaxEdgesPerBatch> events;
+    size_t count = 0u;
+
+    for (int32_t i = 0; i < numEvents; i++) {
+        const lgGpioReport_t& report = alert[i].report;
+
+        // level 2 is a watchdog timeout and flags are reserved, neither is an edge
+        if (report.flags != 0 || report.level > 1) {
+            continue;
+        }
+        events[count++] = EdgeEvent{ report.timestamp, report.gpio, (report.level == /* HIGH */ 1) };
+
+        if (count == events.size()) {
+            QueueEdges(events.data(), count);
+            count = 0u;
+        }
+    }
+
+    QueueEdges(events.data(), count);
+    return;
+}
+
+LgpioBackend::LgpioBackend() 
+    : mHandle(-1) {
+
+    // Open GPIO chip 0. This is what it is on my RPI Zero 2W.
+    mHandle = ::lgGpiochipOpen(kGpioChip0);
+    if (mHandle < 0) {
+        DLOG_ERROR("Failed to open GPIO /dev/gpiochip0 (err %d)", mHandle);
+    } else {
+        DLOG_INFO("successfully opened /dev/gpiochip0");
+    }
+    return;
+}
+
+LgpioBackend::~LgpioBackend() {
+    if (mHandle >= 0) {
+        ::lgGpiochipClose(mHandle);
+    }
+    return;
+}
+
+bool LgpioBackend::Claim(int32_t gpio, int32_t pullup) {
+    if (mHandle < 0) {
+        return false;
+    }
+
+    // Set the GPIO pin as an input
+    int32_t status = ::lgGpioClaimInput(mHandle, pullup, gpio);
+    if (status == 0) {
+        DLOG_DEBUG("claimed gpio%d", gpio);
+    } else {
+        DLOG_ERROR("Failed to set gpio%d as input (err %d)", gpio, status);
+        return false;
+    }
+
+    status = ::lgGpioSetDebounce(mHandle, gpio, kDebounceTime);
+    if (status == 0) {
+        DLOG_DEBUG("Successfully set debounce time on gpio%d", gpio);
+    } else {
+        DLOG_ERROR("Failed to set debounce time on gpio%d (err %d)", gpio, status);
+    }
+
+    status = ::lgGpioClaimAlert(mHandle, pullup, LG_BOTH_EDGES, gpio, gpio);
+    if (status == 0) {
+        DLOG_DEBUG("Successfully claimed alert on gpio%d", gpio);
+    } else {
+        DLOG_ERROR("Failed to claim alert for gpio%d (err %d)", gpio, status);
+        return false;
+    }
+
+    // Set up the alert function for the GPIO pin
+    status = ::lgGpioSetAlertsFunc(mHandle, gpio, &DelegateCallback, nullptr);
+    if (status == 0) {
+        DLOG_DEBUG("Successfully registered a callback on gpio%d", gpio);
+    } else {
+        DLOG_ERROR("Failed to set alert function for gpio%d (err %d)", gpio, status);
+        return false;
+    }
+    return true;
+}
+
+void LgpioBackend::Release(int32_t gpio) {
+    if (mHandle < 0) {
+        return;
+    }
+
+    int32_t status = ::lgGpioFree(mHandle, gpio);
+    if (status != 0) {
+        DLOG_WARN("failed to free gpio%d (err %d)", gpio, status);
+    }
+    return;
+}
+
+bool LgpioBackend::Read(int32_t gpio) const {
+    int32_t value = ::lgGpioRead(mHandle, gpio);
+    if (value < 0) {
+        DLOG_ERROR("failed to read the gpio%d (err %d)", gpio, value);
+    }
+
+    return (value == /* HIGH */ 1);
+}
+
+} // namespace gpio
+} // namespace thermal
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _LGPIO_BACKEND_H_
+#define _LGPIO_BACKEND_H_
+
+#include <stdint.h>
+
+#include "GpioBackend.h"
+
+namespace thermal {
+namespace gpio {
+
+/**
+ * @brief Backend for the real gpio chip through lgpio. Edges are reported
+ *        from the lgpio alert thread.
+ */
+class LgpioBackend : public Backend {
+public:
+    LgpioBackend();
+    ~LgpioBackend() override;
+
+    bool Claim(int32_t gpio, int32_t pullup) override;
+    void Release(int32_t gpio) override;
+    bool Read(int32_t gpio) const override;
+
+private:
+    int32_t mHandle;
+};
+
+} // namespace gpio
+} // namespace thermal
+
+#endif // _LGPIO_BACKEND_H_
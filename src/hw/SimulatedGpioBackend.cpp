@@ -0,0 +1,211 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "SimulatedGpioBackend.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+#include "Logger.h"
+
+namespace thermal {
+namespace gpio {
+
+// Quadrature states for one increment detent starting from rest, (A, B).
+// Matches the table in Encoder.cpp: 11 -> 10 -> 00 -> 01 -> 11.
+constexpr const bool kIncrementSequence[4][2] = {
+    { true, false }, { false, false }, { false, true }, { true, true }
+};
+
+static uint64_t MonotonicNow() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+Trace MakeQuadratureSpin(int32_t gpioA, int32_t gpioB, int32_t detents, double edgesPerSecond,
+        std::chrono::nanoseconds start) {
+    Trace trace;
+    if (detents == 0 || edgesPerSecond <= 0.0) {
+        return trace;
+    }
+
+    const std::chrono::nanoseconds period(static_cast<int64_t>(1e9 / edgesPerSecond));
+    const int32_t count = std::abs(detents);
+    trace.reserve(static_cast<size_t>(count) * 4u);
+
+    std::chrono::nanoseconds offset = start;
+    bool levelA = true;
+    bool levelB = true;
+    for (int32_t detent = 0; detent < count; detent++) {
+        for (int32_t i = 0; i < 4; i++) {
+            // the decrement sequence is the increment one backwards
+            const int32_t step = (detents > 0) ? i : (2 - i + 4) % 4;
+            const bool nextA = kIncrementSequence[step][0];
+            const bool nextB = kIncrementSequence[step][1];
+
+            if (nextA != levelA) {
+                trace.push_back(TraceEdge{ offset, gpioA, nextA });
+            } else if (nextB != levelB) {
+                trace.push_back(TraceEdge{ offset, gpioB, nextB });
+            }
+            levelA = nextA;
+            levelB = nextB;
+            offset += period;
+        }
+    }
+    return trace;
+}
+
+void AddContactBounce(Trace& trace, int32_t maxBounces, std::chrono::microseconds window, uint32_t seed) {
+    if (maxBounces <= 0 || window.count() <= 0) {
+        return;
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int32_t> bounces(0, maxBounces);
+    std::uniform_int_distribution<int64_t> when(1, std::chrono::nanoseconds(window).count());
+
+    Trace bounced;
+    bounced.reserve(trace.size() * static_cast<size_t>(1 + 2 * maxBounces));
+    for (const TraceEdge& edge : trace) {
+        bounced.push_back(edge);
+
+        // each bounce is a short dip back to the old level, so the line
+        // always settles on the level of the real edge
+        std::vector<int64_t> times;
+        const int32_t count = bounces(rng);
+        for (int32_t i = 0; i < count * 2; i++) {
+            times.push_back(when(rng));
+        }
+        std::sort(times.begin(), times.end());
+        for (size_t i = 0u; i < times.size(); i++) {
+            const bool level = (i % 2 == 0) ? !edge.level : edge.level;
+            bounced.push_back(TraceEdge{ edge.offset + std::chrono::nanoseconds(times[i]), edge.gpio, level });
+        }
+    }
+
+    std::stable_sort(bounced.begin(), bounced.end(), [](const TraceEdge& a, const TraceEdge& b) {
+        return a.offset < b.offset;
+    });
+    trace.swap(bounced);
+}
+
+SimulatedBackend::SimulatedBackend(std::chrono::microseconds debounce)
+    : mDebounce(debounce)
+    , mLevels()
+    , mClaimed()
+    , mFilteredEdges(0u) {
+    for (int32_t i = 0; i < kMaxGpio; i++) {
+        mLevels[i] = true;
+        mClaimed[i] = false;
+    }
+    return;
+}
+
+SimulatedBackend::~SimulatedBackend() {
+    return;
+}
+
+bool SimulatedBackend::Claim(int32_t gpio, int32_t pullup) {
+    if (gpio < 0 || gpio >= kMaxGpio) {
+        return false;
+    }
+
+    // an idle line sits wherever its pull puts it
+    mLevels[gpio] = (pullup != LG_SET_PULL_DOWN);
+    mClaimed[gpio] = true;
+    DLOG_DEBUG("claimed simulated gpio%d", gpio);
+    return true;
+}
+
+void SimulatedBackend::Release(int32_t gpio) {
+    if (gpio >= 0 && gpio < kMaxGpio) {
+        mClaimed[gpio] = false;
+    }
+    return;
+}
+
+bool SimulatedBackend::Read(int32_t gpio) const {
+    if (gpio < 0 || gpio >= kMaxGpio) {
+        return false;
+    }
+    return mLevels[gpio];
+}
+
+size_t SimulatedBackend::Replay(const Trace& trace, bool realtime) {
+    // Debounce first: an edge survives if the line doesn't change again
+    // within the debounce time and it actually changes the reported level.
+    std::array<int64_t, kMaxGpio> nextChange;
+    std::vector<bool> stable(trace.size(), false);
+    nextChange.fill(INT64_MAX);
+    for (size_t i = trace.size(); i-- > 0u;) {
+        const TraceEdge& edge = trace[i];
+        if (edge.gpio < 0 || edge.gpio >= kMaxGpio) {
+            continue;
+        }
+        stable[i] = (nextChange[edge.gpio] - edge.offset.count() >= mDebounce.count());
+        nextChange[edge.gpio] = edge.offset.count();
+    }
+
+    std::array<bool, kMaxGpio> reported;
+    for (int32_t i = 0; i < kMaxGpio; i++) {
+        reported[i] = mLevels[i];
+    }
+
+    const uint64_t start = MonotonicNow();
+    size_t count = 0u;
+    for (size_t i = 0u; i < trace.size(); i++) {
+        const TraceEdge& edge = trace[i];
+        if (edge.gpio < 0 || edge.gpio >= kMaxGpio || !mClaimed[edge.gpio]) {
+            continue;
+        }
+
+        if (!stable[i] || reported[edge.gpio] == edge.level) {
+            mFilteredEdges++;
+            continue;
+        }
+
+        const uint64_t timestamp = start + static_cast<uint64_t>(edge.offset.count());
+        if (realtime) {
+            // the kernel only reports once the debounce time has passed
+            const uint64_t due = timestamp + static_cast<uint64_t>(mDebounce.count());
+            const uint64_t now = MonotonicNow();
+            if (due > now) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+            }
+        }
+
+        reported[edge.gpio] = edge.level;
+        mLevels[edge.gpio] = edge.level;
+        EdgeEvent event{ timestamp, edge.gpio, edge.level };
+        QueueEdges(&event, 1u);
+        count++;
+    }
+    return count;
+}
+
+uint64_t SimulatedBackend::GetFilteredEdges() const {
+    return mFilteredEdges;
+}
+
+} // namespace gpio
+} // namespace thermal
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SIMULATED_GPIO_BACKEND_H_
+#define _SIMULATED_GPIO_BACKEND_H_
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "GpioBackend.h"
+
+namespace thermal {
+namespace gpio {
+
+/**
+ * @brief One raw level change on a simulated line, relative to the start of
+ *        the trace.
+ */
+struct TraceEdge {
+    std::chrono::nanoseconds offset;
+    int32_t gpio;
+    bool level;
+};
+
+typedef std::vector<TraceEdge> Trace;
+
+/**
+ * @brief Builds the edges of a quadrature encoder turning at a steady rate.
+ *        Starts and ends at rest (both lines high), 4 edges per detent.
+ * @param gpioA the A line.
+ * @param gpioB the B line.
+ * @param detents detents to turn, negative turns the other way.
+ * @param edgesPerSecond combined edge rate of A and B.
+ * @param start offset of the first edge.
+ * @return the trace, sorted by offset.
+ */
+Trace MakeQuadratureSpin(int32_t gpioA, int32_t gpioB, int32_t detents, double edgesPerSecond,
+    std::chrono::nanoseconds start = std::chrono::nanoseconds(0));
+
+/**
+ * @brief Adds contact bounce after every edge of a trace: up to maxBounces
+ *        pairs of short opposite pulses within window of the edge.
+ * @param trace the trace, kept sorted.
+ * @param maxBounces upper bound of bounce pulses per edge.
+ * @param window how long after the edge the contact may bounce.
+ * @param seed random seed, so runs are repeatable.
+ */
+void AddContactBounce(Trace& trace, int32_t maxBounces, std::chrono::microseconds window, uint32_t seed);
+
+/**
+ * @brief Gpio chip that replays recorded or generated edge traces.
+ *
+ * Applies the same debounce the lgpio backend asks the kernel for: a level is
+ * only reported once it has been stable for the debounce time, with the
+ * timestamp of the edge that started it. Replay() runs on the caller's thread,
+ * which then acts as the alert thread.
+ */
+class SimulatedBackend : public Backend {
+public:
+    explicit SimulatedBackend(std::chrono::microseconds debounce = std::chrono::microseconds(500));
+    ~SimulatedBackend() override;
+
+    bool Claim(int32_t gpio, int32_t pullup) override;
+    void Release(int32_t gpio) override;
+    bool Read(int32_t gpio) const override;
+
+    /**
+     * @brief Plays a trace into the claimed lines.
+     * @param trace raw edges, sorted by offset.
+     * @param realtime true to report each edge when it would really arrive
+     *        (edge plus debounce) with CLOCK_MONOTONIC timestamps, false to
+     *        push everything as fast as possible.
+     * @return number of edges reported after debouncing.
+     */
+    size_t Replay(const Trace& trace, bool realtime = true);
+
+    /**
+     * @brief Number of raw edges swallowed by the debounce so far.
+     */
+    uint64_t GetFilteredEdges() const;
+
+private:
+    const std::chrono::nanoseconds mDebounce;
+    std::array<std::atomic<bool>, kMaxGpio> mLevels;
+    std::array<std::atomic<bool>, kMaxGpio> mClaimed;
+    std::atomic<uint64_t> mFilteredEdges;
+};
+
+} // namespace gpio
+} // namespace thermal
+
+#endif // _SIMULATED_GPIO_BACKEND_H_
@@ -0,0 +1,271 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Renders a recording through the scope's frame path on every core: palette
+// and AGC for raw thermal frames, the zoom remap, the overlay. Frames are
+// cut into chunks that a work stealing pool spreads over the cores, and the
+// output is written in the original order, as a recording of RGBA display
+// frames. Without --out it only renders, to measure how it scales with
+// --threads.
+//
+//   thermal-scope-render --in <recording> [--out <recording>] [--threads N]
+//                        [--chunk N] [--palette <name>] [--zoom Z]
+//                        [--offset X,Y] [--no-overlay]
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "CameraBackend.h"
+#include "CommonDefs.h"
+#include "FramePipeline.h"
+#include "FrameRecording.h"
+#include "FrameTrace.h"
+#include "Logger.h"
+#include "ThermalColorizer.h"
+#include "VideoOverlay.h"
+#include "WorkStealingPool.h"
+
+using namespace thermal;
+using Camera = camera::ActiveCamera;
+
+namespace {
+
+constexpr const size_t kDefaultChunk = 16u;
+// chunks rendered ahead of the writer, per thread
+constexpr const size_t kChunksInFlight = 4u;
+
+enum class InputKind : uint8_t {
+    kBgr,             ///< already coloured by the camera
+    kYuyv,            ///< raw image without a thermal plane
+    kImageOverThermal,///< raw image with the 16 bit plane below it
+    kY16,             ///< 16 bit counts only
+};
+
+// everything a worker touches, so workers never share state
+struct Worker {
+    explicit Worker(trace::FrameTracer& tracer) : pipeline(tracer) {}
+
+    FramePipeline<Camera> pipeline;
+    VideoOverlay overlay;
+    ThermalColorizer colorizer;
+    cv::Mat bgr;
+};
+
+struct Chunk {
+    size_t first;
+    std::vector<cv::Mat> frames;   ///< rendered RGBA, reused
+    bool done;
+};
+
+bool ParseColorMode(const std::string& name, p2pro::ColorMode& mode) {
+    for (uint8_t i = 1u; i < static_cast<uint8_t>(p2pro::ColorMode::kCount); i++) {
+        if (name == p2pro::ColorToString(static_cast<p2pro::ColorMode>(i))) {
+            mode = static_cast<p2pro::ColorMode>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GetInputKind(const camera::RecordingReader& recording, InputKind& kind) {
+    if (recording.GetWidth() != Camera::kWidth) {
+        return false;
+    }
+    if (recording.GetType() == CV_8UC3 && recording.GetHeight() >= Camera::kHeight) {
+        kind = InputKind::kBgr;
+    } else if (recording.GetType() == CV_16UC1 && recording.GetHeight() == Camera::kHeight) {
+        kind = InputKind::kY16;
+    } else if (recording.GetType() == CV_8UC2 && recording.GetHeight() == Camera::kRawHeight) {
+        kind = (Camera::kRawLayout == camera::RawPlaneLayout::kImageOverThermal) ? InputKind::kImageOverThermal
+                                                                               : InputKind::kYuyv;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// the work OnCameraData does, plus the colouring the camera does on the scope
+void Render(Worker& worker, InputKind kind, const cv::Mat& frame, bool overlay, cv::Mat& output) {
+    const cv::Mat* input = &frame;
+    if (kind == InputKind::kImageOverThermal) {
+        worker.colorizer.Colorize(ThermalColorizer::GetThermalPlane(frame, Camera::kHeight), worker.bgr);
+        input = &worker.bgr;
+    } else if (kind == InputKind::kY16) {
+        worker.colorizer.Colorize(frame, worker.bgr);
+        input = &worker.bgr;
+    } else if (kind == InputKind::kYuyv) {
+        cv::cvtColor(frame, worker.bgr, cv::COLOR_YUV2BGR_YUYV);
+        input = &worker.bgr;
+    }
+
+    worker.pipeline.Process(*input, output);
+    if (overlay) {
+        worker.overlay.Overlay(output);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string in;
+    std::string out;
+    size_t threads = 0u;
+    size_t chunkFrames = kDefaultChunk;
+    p2pro::ColorMode palette = p2pro::ColorMode::kPseudoWhiteHot;
+    int32_t zoom = 0;
+    int32_t x = 0;
+    int32_t y = 0;
+    bool overlay = true;
+    for (int32_t i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--no-overlay") == 0) {
+            overlay = false;
+        } else if (i + 1 < argc && std::strcmp(argv[i], "--in") == 0) {
+            in = argv[++i];
+        } else if (i + 1 < argc && std::strcmp(argv[i], "--out") == 0) {
+            out = argv[++i];
+        } else if (i + 1 < argc && std::strcmp(argv[i], "--threads") == 0) {
+            threads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (i + 1 < argc && std::strcmp(argv[i], "--chunk") == 0) {
+            chunkFrames = std::max<size_t>(1u, std::strtoul(argv[++i], nullptr, 10));
+        } else if (i + 1 < argc && std::strcmp(argv[i], "--zoom") == 0) {
+            zoom = std::atoi(argv[++i]);
+        } else if (i + 1 < argc && std::strcmp(argv[i], "--offset") == 0) {
+            if (std::sscanf(argv[++i], "%d,%d", &x, &y) != 2) {
+                fprintf(stderr, "--offset takes X,Y\n");
+                return 2;
+            }
+        } else if (i + 1 < argc && std::strcmp(argv[i], "--palette") == 0) {
+            if (!ParseColorMode(argv[++i], palette)) {
+                fprintf(stderr, "unknown palette %s\n", argv[i]);
+                return 2;
+            }
+        } else {
+            fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (in.empty()) {
+        fprintf(stderr, "usage: %s --in <recording> [--out <recording>] [--threads N] [--chunk N]"
+                        " [--palette <name>] [--zoom Z] [--offset X,Y] [--no-overlay]\n", argv[0]);
+        return 2;
+    }
+
+    log::LogInit();
+    log::SetLogLevel(log::LogLevel::kNotice);
+
+    camera::RecordingReader recording;
+    InputKind kind = InputKind::kBgr;
+    if (!recording.Open(in) || !GetInputKind(recording, kind)) {
+        fprintf(stderr, "%s is not a %s recording\n", in.c_str(), Camera::kName);
+        log::LogDeinit();
+        return 1;
+    }
+    camera::FrameRecorder recorder;
+    if (!out.empty() && !recorder.Open(out)) {
+        log::LogDeinit();
+        return 1;
+    }
+
+    // the pool is the parallelism, OpenCV's own threads would only compete
+    cv::setNumThreads(0);
+    utils::WorkStealingPool pool(threads);
+    std::vector<std::unique_ptr<trace::FrameTracer>> tracers;
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t i = 0u; i < pool.GetThreadCount(); i++) {
+        tracers.push_back(std::make_unique<trace::FrameTracer>());
+        workers.push_back(std::make_unique<Worker>(*tracers.back()));
+        Worker& worker = *workers.back();
+        worker.pipeline.SetView(static_cast<uint32_t>(std::max(zoom, 0)), x, y);
+        worker.colorizer.SetColorMode(palette);
+        worker.overlay.SetColorMode(palette);
+        worker.overlay.SetZoom(zoom);
+        worker.overlay.SetOffset(x, y);
+    }
+
+    const size_t frameCount = recording.GetFrameCount();
+    const size_t chunkCount = (frameCount + chunkFrames - 1u) / chunkFrames;
+    std::vector<Chunk> chunks(std::min(chunkCount, kChunksInFlight * pool.GetThreadCount()));
+    std::mutex mutex;
+    std::condition_variable ready;
+
+    auto submit = [&](size_t index) {
+        Chunk& chunk = chunks[index % chunks.size()];
+        chunk.first = index * chunkFrames;
+        chunk.frames.resize(std::min(chunkFrames, frameCount - chunk.first));
+        chunk.done = false;
+        pool.Submit([&, index](size_t workerIndex) {
+            Worker& worker = *workers[workerIndex];
+            trace::FrameTracer& tracer = *tracers[workerIndex];
+            Chunk& chunk = chunks[index % chunks.size()];
+            for (size_t i = 0u; i < chunk.frames.size(); i++) {
+                tracer.BeginFrame(0u);
+                Render(worker, kind, recording.GetFrame(chunk.first + i), overlay, chunk.frames[i]);
+                tracer.Mark(trace::Stage::kPresent);
+                tracer.EndFrame();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                chunk.done = true;
+            }
+            ready.notify_one();
+        });
+    };
+
+    const uint64_t start = trace::Now();
+    for (size_t i = 0u; i < chunks.size(); i++) {
+        submit(i);
+    }
+
+    // write in order, each written chunk's slot goes to the next chunk
+    bool written = true;
+    for (size_t i = 0u; i < chunkCount; i++) {
+        Chunk& chunk = chunks[i % chunks.size()];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&]() { return chunk.done; });
+        }
+        for (size_t j = 0u; j < chunk.frames.size() && !out.empty(); j++) {
+            written &= recorder.Write(chunk.frames[j], recording.GetTimestamp(chunk.first + j));
+        }
+        if (i + chunks.size() < chunkCount) {
+            submit(i + chunks.size());
+        }
+    }
+    const double seconds = static_cast<double>(trace::Now() - start) / 1e9;
+    if (!out.empty()) {
+        written &= recorder.Close();
+    }
+
+    printf("{\"in\":\"%s\",\"frames\":%zu,\"threads\":%zu,\"chunk\":%zu,\"seconds\":%.3f,"
+           "\"frames_per_second\":%.1f,\"steals\":%llu}\n",
+           in.c_str(), frameCount, pool.GetThreadCount(), chunkFrames, seconds,
+           (seconds > 0.0) ? static_cast<double>(frameCount) / seconds : 0.0,
+           static_cast<unsigned long long>(pool.GetSteals()));
+
+    log::LogDeinit();
+    return written ? 0 : 1;
+}
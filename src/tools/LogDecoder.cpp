@@ -0,0 +1,166 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+// Prints a binary log dump (LogSink::kBinaryFile) as text, the same lines
+// the text sink would have written. Runs on the device or on a host.
+
+#include <stdio.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "LogRecord.h"
+
+using namespace thermal;
+
+namespace {
+
+struct Site {
+    uint8_t level;
+    int32_t line;
+    std::string file;
+    std::string function;
+    std::string fmt;
+};
+
+template <typename V>
+bool ReadValue(FILE* file, V& value) {
+    return fread(&value, sizeof(value), 1u, file) == 1u;
+}
+
+bool ReadString(FILE* file, std::string& text) {
+    uint16_t length;
+    if (!ReadValue(file, length)) {
+        return false;
+    }
+    text.resize(length);
+    return length == 0u || fread(text.data(), 1u, length, file) == length;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <dump>\n", argv[0]);
+        return 2;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (file == nullptr) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    uint32_t magic = 0u;
+    uint32_t version = 0u;
+    int64_t realtimeOffset = 0;
+    if (!ReadValue(file, magic) || !ReadValue(file, version) || !ReadValue(file, realtimeOffset)
+        || magic != log::kDumpMagic || version != log::kDumpVersion) {
+        fprintf(stderr, "%s: not a log dump or unsupported version\n", argv[1]);
+        fclose(file);
+        return 1;
+    }
+
+    std::unordered_map<uint32_t, Site> sites;
+    uint64_t entries = 0u;
+    uint8_t type;
+    bool complete = true;
+
+    while (ReadValue(file, type)) {
+        switch (static_cast<log::DumpRecord>(type)) {
+            case log::DumpRecord::kSite: {
+                uint32_t id;
+                Site site;
+                complete = ReadValue(file, id) && ReadValue(file, site.level) && ReadValue(file, site.line)
+                    && ReadString(file, site.file) && ReadString(file, site.function) && ReadString(file, site.fmt);
+                if (complete) {
+                    sites[id] = std::move(site);
+                }
+                break;
+            }
+
+            case log::DumpRecord::kEntry: {
+                uint32_t threadId;
+                log::LogEntry entry{};
+                complete = ReadValue(file, threadId) && ReadValue(file, entry.timestamp)
+                    && ReadValue(file, entry.siteId) && ReadValue(file, entry.argBytes)
+                    && ReadValue(file, entry.truncated) && entry.argBytes <= sizeof(entry.args)
+                    && fread(entry.args, 1u, entry.argBytes, file) == entry.argBytes;
+                if (!complete) {
+                    break;
+                }
+
+                const auto site = sites.find(entry.siteId);
+                if (site == sites.end()) {
+                    printf("<unknown site %u>\n", entry.siteId);
+                    break;
+                }
+
+                const Site& s = site->second;
+                const std::string line = log::FormatTextLine(static_cast<int64_t>(entry.timestamp) + realtimeOffset,
+                    threadId, s.level, s.file.c_str(), s.line, s.function.c_str(),
+                    log::FormatMessage(s.fmt.c_str(), entry));
+                printf("%s\n", line.c_str());
+                entries++;
+                break;
+            }
+
+            case log::DumpRecord::kDropped: {
+                uint32_t threadId;
+                uint64_t count;
+                complete = ReadValue(file, threadId) && ReadValue(file, count);
+                if (complete) {
+                    printf("logger: thread %u dropped %llu entries\n", threadId, static_cast<unsigned long long>(count));
+                }
+                break;
+            }
+
+            case log::DumpRecord::kSuppressed: {
+                uint64_t timestamp;
+                uint32_t id;
+                uint32_t count;
+                complete = ReadValue(file, timestamp) && ReadValue(file, id) && ReadValue(file, count);
+                const auto site = sites.find(id);
+                if (complete && site != sites.end()) {
+                    const Site& s = site->second;
+                    const std::string line = log::FormatTextLine(static_cast<int64_t>(timestamp) + realtimeOffset,
+                        0u, s.level, s.file.c_str(), s.line, s.function.c_str(),
+                        "suppressed " + std::to_string(count) + " messages");
+                    printf("%s\n", line.c_str());
+                }
+                break;
+            }
+
+            default:
+                complete = false;
+                break;
+        }
+
+        if (!complete) {
+            break;
+        }
+    }
+
+    fclose(file);
+    if (!complete) {
+        // the device may have been switched off mid write
+        fprintf(stderr, "%s: dump ends with a partial record after %llu entries\n", argv[1],
+                static_cast<unsigned long long>(entries));
+    }
+    return 0;
+}
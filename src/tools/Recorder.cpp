@@ -0,0 +1,133 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Records the camera (or a clip) into a recording that --replay, the
+// latency bench and the frame bench play back zero-copy. With --raw the
+// frames are kept as the sensor sent them, e.g. the P2 Pro's YUYV image
+// over the 16 bit thermal plane.
+//
+//   thermal-scope-record --out <file> [--frames N] [--raw] [--clip <file>]
+
+#include <stdio.h>
+
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "CameraBackend.h"
+#include "FrameRecording.h"
+#include "FrameTrace.h"
+#include "Logger.h"
+#include "Webcam.h"
+
+using namespace thermal;
+using Camera = camera::ActiveCamera;
+
+namespace {
+
+constexpr const size_t kDefaultFrames = 250u;
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string out;
+    std::string clip;
+    size_t frames = kDefaultFrames;
+    bool raw = false;
+    for (int32_t i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--raw") == 0) {
+            raw = true;
+        } else if (i + 1 < argc && std::strcmp(argv[i], "--out") == 0) {
+            out = argv[++i];
+        } else if (i + 1 < argc && std::strcmp(argv[i], "--clip") == 0) {
+            clip = argv[++i];
+        } else if (i + 1 < argc && std::strcmp(argv[i], "--frames") == 0) {
+            frames = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (out.empty() || frames == 0u) {
+        fprintf(stderr, "usage: %s --out <file> [--frames N] [--raw] [--clip <file>]\n", argv[0]);
+        return 2;
+    }
+
+    log::LogInit();
+    log::SetLogLevel(log::LogLevel::kNotice);
+
+    camera::FrameRecorder recorder;
+    if (!recorder.Open(out)) {
+        log::LogDeinit();
+        return 1;
+    }
+
+    // a clip is copied as fast as it decodes, the camera at its own rate
+    std::unique_ptr<p2pro::Webcam> webcam = nullptr;
+    if (clip.empty()) {
+        webcam = std::make_unique<p2pro::Webcam>(Camera::kWidth, Camera::kHeight, Camera::kFrameRate, Camera::kDeviceId);
+        webcam->SetRawCapture(raw, Camera::kRawHeight);
+    } else {
+        webcam = std::make_unique<p2pro::Webcam>(clip, Camera::kWidth, Camera::kHeight, Camera::kFrameRate);
+        webcam->SetReplayPacing(p2pro::ReplayPacing::kAsFastAsPossible);
+    }
+
+    trace::FrameTracer& tracer = trace::FrameTracer::Instance();
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t recorded = 0u;
+    bool failed = false;
+    webcam->RegisterOnDataCallback([&](cv::Mat& frame, bool) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (recorded >= frames || failed) {
+            return false;
+        }
+        if (!recorder.Write(frame, tracer.GetCaptureTime())) {
+            failed = true;
+        } else {
+            recorded++;
+        }
+        if (recorded == frames || failed) {
+            done.notify_one();
+        }
+        return !failed;
+    });
+
+    const std::string source = clip.empty() ? "the camera" : clip;
+    if (!webcam->Open() || !webcam->Start()) {
+        fprintf(stderr, "cannot capture from %s\n", source.c_str());
+        recorder.Close();
+        log::LogDeinit();
+        return 1;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]() { return recorded >= frames || failed; });
+    }
+    webcam->Stop();
+    webcam->ReleaseCamera();
+
+    const bool closed = recorder.Close();
+    printf("{\"source\":\"%s\",\"out\":\"%s\",\"frames\":%llu,\"bytes\":%llu}\n", source.c_str(), out.c_str(),
+           static_cast<unsigned long long>(recorder.GetFrameCount()),
+           static_cast<unsigned long long>(recorder.GetBytesWritten()));
+
+    log::LogDeinit();
+    return (closed && !failed) ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AlignedFileWriter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "Logger.h"
+
+namespace thermal {
+namespace utils {
+
+AlignedFileWriter::AlignedFileWriter()
+    : mFd(-1)
+    , mPath()
+    , mDirect(false)
+    , mBuffer(nullptr)
+    , mFill(0u)
+    , mWritten(0u)
+    , mReserved(0u) {
+    void* buffer = nullptr;
+    if (::posix_memalign(&buffer, kAlignment, kBufferBytes) == 0) {
+        mBuffer = static_cast<uint8_t*>(buffer);
+    }
+}
+
+AlignedFileWriter::~AlignedFileWriter() {
+    Close();
+    ::free(mBuffer);
+}
+
+bool AlignedFileWriter::Open(const std::string& path) {
+    Close();
+    if (mBuffer == nullptr) {
+        return false;
+    }
+
+    // tmpfs and some fuse mounts refuse O_DIRECT, they get the page cache
+    const int32_t flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    mFd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+    mDirect = (mFd >= 0);
+    if (mFd < 0 && errno == EINVAL) {
+        mFd = ::open(path.c_str(), flags, 0644);
+    }
+    if (mFd < 0) {
+        DLOG_ERROR("failed to create %s (%s)", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    mPath = path;
+    mFill = 0u;
+    mWritten = 0u;
+    mReserved = 0u;
+    DLOG_INFO("writing %s%s", path.c_str(), mDirect ? " (direct)" : "");
+    return true;
+}
+
+bool AlignedFileWriter::Append(const void* data, size_t size) {
+    if (mFd < 0) {
+        return false;
+    }
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0u) {
+        const size_t count = std::min(size, kBufferBytes - mFill);
+        std::memcpy(mBuffer + mFill, bytes, count);
+        mFill += count;
+        bytes += count;
+        size -= count;
+        if (mFill == kBufferBytes && !WriteBuffer(kBufferBytes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AlignedFileWriter::Close() {
+    if (mFd < 0) {
+        return true;
+    }
+
+    // the tail goes out padded to a whole block, then the file is cut back
+    // to what was appended (which also drops the unused reservation)
+    const uint64_t size = GetSize();
+    const size_t padded = (mFill + kAlignment - 1u) / kAlignment * kAlignment;
+    std::memset(mBuffer + mFill, 0, padded - mFill);
+    bool status = (padded == 0u) || WriteBuffer(padded);
+    if (::ftruncate(mFd, static_cast<off_t>(size)) != 0) {
+        DLOG_WARN("failed to trim %s (%s)", mPath.c_str(), strerror(errno));
+        status = false;
+    }
+    if (::fsync(mFd) != 0) {
+        DLOG_WARN("failed to sync %s (%s)", mPath.c_str(), strerror(errno));
+    }
+    ::close(mFd);
+    mFd = -1;
+    mWritten = size;
+    return status;
+}
+
+bool AlignedFileWriter::IsOpen() const {
+    return mFd >= 0;
+}
+
+bool AlignedFileWriter::IsDirect() const {
+    return mDirect;
+}
+
+uint64_t AlignedFileWriter::GetSize() const {
+    return mWritten + mFill;
+}
+
+bool AlignedFileWriter::WriteBuffer(size_t size) {
+    // keep the reservation a step ahead, a filesystem without fallocate
+    // just allocates as it goes
+    if (mWritten + size > mReserved) {
+        if (::fallocate(mFd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(mReserved),
+                        static_cast<off_t>(kPreallocateBytes)) == 0 || errno == EOPNOTSUPP) {
+            mReserved += kPreallocateBytes;
+        } else {
+            DLOG_WARN("failed to reserve space in %s (%s)", mPath.c_str(), strerror(errno));
+            mReserved = mWritten + size;
+        }
+    }
+
+    size_t written = 0u;
+    while (written < size) {
+        ssize_t n = ::pwrite(mFd, mBuffer + written, size - written, static_cast<off_t>(mWritten + written));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            DLOG_ERROR("failed to write %s (%s)", mPath.c_str(), strerror(errno));
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    mWritten += size;
+    mFill = 0u;
+    return true;
+}
+
+} // utils
+} // thermal
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALIGNED_FILE_WRITER_H_
+#define _ALIGNED_FILE_WRITER_H_
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <string>
+
+namespace thermal {
+namespace utils {
+
+/**
+ * @brief Append-only file writer for long sequential streams (recordings).
+ *
+ * Appends are collected in an aligned buffer and go to the file one full
+ * buffer at a time, with O_DIRECT where the filesystem allows it, so the SD
+ * card sees large aligned writes and the page cache doesn't fill up with
+ * data that is never read back. Space is reserved with fallocate() ahead of
+ * the write position, so the file doesn't fragment as it grows.
+ *
+ * One thread only, writes block.
+ */
+class AlignedFileWriter {
+public:
+    static constexpr size_t kAlignment = 4096u;
+    static constexpr size_t kBufferBytes = 1024u * 1024u;
+    static constexpr uint64_t kPreallocateBytes = 32u * 1024u * 1024u;
+
+    AlignedFileWriter();
+    ~AlignedFileWriter();
+
+    AlignedFileWriter(const AlignedFileWriter&) = delete;
+    AlignedFileWriter& operator=(const AlignedFileWriter&) = delete;
+
+    /**
+     * @brief Creates (or truncates) the file.
+     */
+    bool Open(const std::string& path);
+
+    /**
+     * @brief Appends data, writing out the buffer each time it fills.
+     */
+    bool Append(const void* data, size_t size);
+
+    /**
+     * @brief Writes what is buffered, trims the reserved space and closes.
+     */
+    bool Close();
+
+    bool IsOpen() const;
+
+    /**
+     * @brief Whether writes bypass the page cache.
+     */
+    bool IsDirect() const;
+
+    /**
+     * @brief Bytes appended so far, buffered or not.
+     */
+    uint64_t GetSize() const;
+
+private:
+    int32_t mFd;
+    std::string mPath;
+    bool mDirect;
+    uint8_t* mBuffer;     ///< kBufferBytes, kAlignment aligned
+    size_t mFill;
+    uint64_t mWritten;    ///< bytes on disk, a multiple of kAlignment until Close()
+    uint64_t mReserved;   ///< fallocate()d up to here
+
+    bool WriteBuffer(size_t size);
+};
+
+} // utils
+} // thermal
+
+#endif // _ALIGNED_FILE_WRITER_H_
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _CRC32_H_
+#define _CRC32_H_
+
+#include <stdint.h>
+
+#include <array>
+#include <cstddef>
+
+namespace thermal {
+namespace utils {
+
+/**
+ * @brief Lookup table for the reflected CRC-32 (IEEE 802.3, as used by zlib).
+ */
+inline constexpr std::array<uint32_t, 256> kCrc32Table = []() {
+    std::array<uint32_t, 256> table = {};
+    for (uint32_t i = 0; i < 256u; i++) {
+        uint32_t crc = i;
+        for (int32_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 1u) ? (crc >> 1) ^ 0xEDB88320u : (crc >> 1);
+        }
+        table[i] = crc;
+    }
+    return table;
+}();
+
+/**
+ * @brief Computes the CRC-32 of a buffer. Pass a previous result as crc to
+ *        continue over several buffers.
+ * @param data the bytes.
+ * @param length number of bytes.
+ * @param crc the running crc, 0 to start.
+ * @return the crc.
+ */
+inline uint32_t Crc32(const void* data, size_t length, uint32_t crc = 0u) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0u; i < length; i++) {
+        crc = kCrc32Table[(crc ^ bytes[i]) & 0xFFu] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+} // namespace utils
+} // namespace thermal
+
+#endif // _CRC32_H_
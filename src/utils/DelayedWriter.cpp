@@ -19,9 +19,7 @@
 #include <fstream>
 #include <sstream>
 #include <chrono>
-#include <thread>
 #include <mutex>
-#include <condition_variable>
 
 #include "Logger.h"
 
@@ -29,52 +27,90 @@ namespace thermal {
 namespace utils {
 
 DelayedWriterBuffer::DelayedWriterBuffer(std::chrono::seconds delay, std::string path)
-    : mLastData()
+    : DelayedWriterBuffer(delay, [path](const std::string& data) {
+        std::ofstream file(path, std::ios::out | std::ios::trunc);
+        if (file.is_open()) {
+            file << data;
+            file.close();
+        } else {
+            DLOG_WARN("Failed to open %s", path.c_str());
+        }
+    }) {
+    return;
+}
+
+DelayedWriterBuffer::DelayedWriterBuffer(std::chrono::seconds delay, FlushHandler handler)
+    : mTimerService(TimerService::Instance())
+    , mMutex()
+    , mFlushMutex()
+    , mBuffer()
+    , mDeadline()
+    , mTimerId(0u)
     , mDelay(delay)
-    , mPath(path)
-    , mThreadRunning(false)
-    , mPendingData(false) {
+    , mHandler(handler)
+    , mTimerPending(false)
+    , mClosing(false) {
     return;
 }
 
 DelayedWriterBuffer::~DelayedWriterBuffer() {
+    TimerService::TimerId timerId = 0u;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClosing = true;
+        timerId = mTimerPending ? mTimerId : 0u;
+    }
+
+    // waits if the timer is firing right now, it won't reschedule once closing
+    if (timerId != 0u) {
+        mTimerService.Cancel(timerId);
+    }
     Flush();
 }
 
 void DelayedWriterBuffer::Flush() {
-    DLOG_DEBUG("Flushing buffer to file %s", mPath.c_str());
-    if (!mBuffer.str().empty()) {
-        std::ofstream file(mPath, std::ios::out | std::ios::trunc);
-        if (file.is_open()) {
-            file << mBuffer.str();
-            file.close();
-        } else {
-            DLOG_WARN("Failed to open %s", mPath.c_str());
-        }
+    std::lock_guard<std::mutex> flushLock(mFlushMutex);
+
+    std::string data;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        data = mBuffer.str();
         mBuffer.str("");
     }
 
-    mPendingData = false;
+    if (!data.empty()) {
+        DLOG_DEBUG("Flushing %zu bytes", data.size());
+        if (mHandler) {
+            mHandler(data);
+        }
+    }
     return;
 }
 
 void DelayedWriterBuffer::Clear() {
     DLOG_DEBUG("Clearing");
+    std::lock_guard<std::mutex> lock(mMutex);
     mBuffer.str("");
-    mPendingData = false;
     return;
 }
 
 int DelayedWriterBuffer::overflow(int c) {
     if (c != EOF) {
-        mBuffer.sputc(c);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mBuffer.sputc(c);
+        }
         OnWrite();
     }
     return c;
 }
 
 std::streamsize DelayedWriterBuffer::xsputn(const char* s, std::streamsize n) {
-    std::streamsize written = mBuffer.sputn(s, n);
+    std::streamsize written = 0;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        written = mBuffer.sputn(s, n);
+    }
     if (written > 0) {
         OnWrite();
     }
@@ -87,54 +123,47 @@ int DelayedWriterBuffer::sync() {
     return 0; // return 0 to indicate success
 }
 
+/// @brief pushes the deadline out. Only the first write of a burst schedules
+///        a timer, the rest just move the deadline it checks when it fires.
 void DelayedWriterBuffer::OnWrite() {
-    std::unique_lock<std::mutex> lock(mMutex);
-    mLastData = std::chrono::system_clock::now();
-    mPendingData = true;
-
-    // if timer thread is not running, we need to start it
-    if (!mThreadRunning) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDeadline = TimerService::Clock::now() + mDelay;
 
-        // Check if thread needs to be joined
-        if (mWriterThread.joinable()) {
-            mWriterThread.join();
-        }
-        mWriterThread = std::thread(&DelayedWriterBuffer::WriteThread, this);
-
-    // if timer thread is already running, notify CV so that
-    // the timeout restarts. When the CV times out, the buffer will
-    // be flushed.
-    } else {
-        mCv.notify_all();
+    if (!mTimerPending && !mClosing) {
+        mTimerPending = true;
+        mTimerId = mTimerService.Schedule(mDelay, [this]() { OnTimer(); });
     }
-
-    mThreadRunning = true;
     return;
 }
 
-void DelayedWriterBuffer::WriteThread() {
-    DLOG_DEBUG("Starting delayed write thread");
-
-    // loop here until the pending data is flushed
-    while(mPendingData) {
-        std::unique_lock<std::mutex> lock(mWriterThreadMutex);
-        auto cvStatus = mCv.wait_until(lock, mLastData + mDelay);
+/// @brief runs on the timer service thread. Flushes if the writer has been
+///        quiet for the whole delay, otherwise waits for the rest of it.
+void DelayedWriterBuffer::OnTimer() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mClosing) {
+            mTimerPending = false;
+            return;
+        }
 
-        // if the CV was never notified it will timeout. This means we had no new data 
-        // in past period, and we can flush the buffer. If the CV is notified, then this
-        // means we got new data, and we should loop one more time to restart the timer.
-        if (cvStatus == std::cv_status::timeout) {
-            Flush();
+        const auto now = TimerService::Clock::now();
+        if (now < mDeadline) {
+            mTimerId = mTimerService.Schedule(mDeadline - now, [this]() { OnTimer(); });
+            return;
         }
+        mTimerPending = false;
     }
 
-    mThreadRunning = false;
+    Flush();
     return;
 }
 
 DelayedWriter::DelayedWriter(std::chrono::seconds delay, std::string path)
     : std::ostream(&mBuffer), mBuffer(delay, path) {};
 
+DelayedWriter::DelayedWriter(std::chrono::seconds delay, FlushHandler handler)
+    : std::ostream(&mBuffer), mBuffer(delay, handler) {};
+
 DelayedWriter::~DelayedWriter() {
     mBuffer.Flush();
     return;
@@ -145,5 +174,10 @@ void DelayedWriter::Clear() {
     return;
 }
 
+void DelayedWriter::Flush() {
+    mBuffer.Flush();
+    return;
+}
+
 } // namespace utils
 } // namespace thermal
@@ -22,17 +22,30 @@
 #include <fstream>
 #include <sstream>
 #include <chrono>
-#include <thread>
 #include <mutex>
-#include <condition_variable>
-#include <atomic>
+#include <functional>
+#include <string>
+
+#include "TimerService.h"
 
 namespace thermal {
 namespace utils {
 
+/**
+ * @brief Receives everything buffered since the last flush, once the writer
+ *        has been quiet for its delay.
+ */
+typedef std::function<void(const std::string&)> FlushHandler;
+
+/**
+ * @brief Buffers everything written to it and hands it to the flush handler
+ *        once nothing has been written for the delay. The delay runs on the
+ *        shared TimerService, so writing never starts a thread.
+ */
 class DelayedWriterBuffer : public std::streambuf {
 public:
     DelayedWriterBuffer(std::chrono::seconds delay, std::string path);
+    DelayedWriterBuffer(std::chrono::seconds delay, FlushHandler handler);
     ~DelayedWriterBuffer();
 
     void Flush();
@@ -44,27 +57,29 @@ protected:
     int sync() override;
 
 private:
-    std::thread mWriterThread;
-    std::mutex mMutex;
-    std::mutex mWriterThreadMutex;
-    std::condition_variable mCv;
+    TimerService& mTimerService;
+    std::mutex mMutex;       ///< guards everything below
+    std::mutex mFlushMutex;  ///< keeps flushes in order, held while the handler runs
     std::stringbuf mBuffer;
-    std::chrono::system_clock::time_point mLastData;
-    std::chrono::seconds mDelay;
-    std::string mPath;
-    bool mThreadRunning;
-    bool mPendingData;
+    TimerService::Clock::time_point mDeadline;
+    TimerService::TimerId mTimerId;
+    const std::chrono::seconds mDelay;
+    const FlushHandler mHandler;
+    bool mTimerPending;
+    bool mClosing;
 
     void OnWrite();
-    void WriteThread();
+    void OnTimer();
 };
 
 class DelayedWriter : public std::ostream {
 public:
     DelayedWriter(std::chrono::seconds delay, std::string path);
+    DelayedWriter(std::chrono::seconds delay, FlushHandler handler);
     ~DelayedWriter();
 
     void Clear();
+    void Flush();
 
 private:
     DelayedWriterBuffer mBuffer;
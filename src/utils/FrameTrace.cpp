@@ -0,0 +1,349 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "FrameTrace.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace thermal {
+namespace trace {
+
+namespace {
+
+// frame counters are refreshed over this window
+inline constexpr uint64_t kFpsWindowNs = 1000000000u;
+
+template <typename T>
+void Increment(std::atomic<T>& value) {
+    // single writer, a plain load + store is enough and cheaper than an RMW
+    value.store(value.load(std::memory_order_relaxed) + 1u, std::memory_order_relaxed);
+}
+
+double ToMicros(uint64_t ns) {
+    return static_cast<double>(ns) / 1000.0;
+}
+
+} // namespace
+
+const char* StageToStr(Stage stage) {
+    switch (stage) {
+        case Stage::kCapture:
+            return "capture";
+        case Stage::kTransform:
+            return "transform";
+        case Stage::kConvert:
+            return "convert";
+        case Stage::kOverlay:
+            return "overlay";
+        case Stage::kPresent:
+            return "present";
+        default:
+            return "ERR";
+    }
+}
+
+uint64_t Now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000u + static_cast<uint64_t>(now.tv_nsec);
+}
+
+LatencyHistogram::LatencyHistogram()
+    : mCounts()
+    , mCount(0u)
+    , mSum(0u)
+    , mMax(0u) {}
+
+size_t LatencyHistogram::BucketOf(uint64_t ns) {
+    if (ns < kSubBuckets) {
+        return static_cast<size_t>(ns);
+    }
+
+    // top 3 bits below the leading one pick the sub bucket
+    const size_t exponent = static_cast<size_t>(std::bit_width(ns)) - 1u;
+    const size_t sub = static_cast<size_t>(ns >> (exponent - 3u)) & (kSubBuckets - 1u);
+    return (exponent - 2u) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::BucketValue(size_t bucket) {
+    if (bucket < kSubBuckets) {
+        return bucket;
+    }
+
+    const size_t exponent = bucket / kSubBuckets + 2u;
+    const uint64_t sub = bucket % kSubBuckets;
+    const uint64_t width = UINT64_C(1) << (exponent - 3u);
+    return (kSubBuckets + sub) * width + width / 2u;
+}
+
+void LatencyHistogram::Record(uint64_t ns) {
+    Increment(mCounts[BucketOf(ns)]);
+    Increment(mCount);
+    mSum.store(mSum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    if (ns > mMax.load(std::memory_order_relaxed)) {
+        mMax.store(ns, std::memory_order_relaxed);
+    }
+}
+
+uint64_t LatencyHistogram::Count() const {
+    return mCount.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Max() const {
+    return mMax.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Mean() const {
+    const uint64_t count = Count();
+    return count == 0u ? 0u : mSum.load(std::memory_order_relaxed) / count;
+}
+
+uint64_t LatencyHistogram::Percentile(double fraction) const {
+    // the buckets are read while the writer runs, use their own total
+    std::array<uint32_t, kBuckets> counts;
+    uint64_t total = 0u;
+    for (size_t i = 0u; i < kBuckets; i++) {
+        counts[i] = mCounts[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0u) {
+        return 0u;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(1u, static_cast<uint64_t>(std::ceil(fraction * total)));
+    uint64_t seen = 0u;
+    for (size_t i = 0u; i < kBuckets; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(BucketValue(i), Max());
+        }
+    }
+    return Max();
+}
+
+FrameTracer& FrameTracer::Instance() {
+    static FrameTracer tracer;
+    return tracer;
+}
+
+FrameTracer::FrameTracer()
+    : mStages()
+    , mTotal()
+    , mRecent()
+    , mFrames(0u)
+    , mPresented(0u)
+    , mDropped(0u)
+    , mLate(0u)
+    , mPeriod(0u)
+    , mFps(0.0)
+    , mCapture(0u)
+    , mLastCapture(0u)
+    , mLastMark(0u)
+    , mEnds()
+    , mWindowStart(0u)
+    , mWindowFrames(0u) {}
+
+void FrameTracer::SetFramePeriod(uint64_t periodNs) {
+    mPeriod.store(periodNs, std::memory_order_relaxed);
+}
+
+void FrameTracer::BeginFrame(uint64_t captureNs) {
+    const uint64_t now = Now();
+    mEnds.fill(0u);
+
+    // a driver timestamp from the future or from long ago is not one
+    const bool known = captureNs != 0u && captureNs <= now && now - captureNs < kFpsWindowNs;
+    mCapture = known ? captureNs : now;
+    if (known) {
+        mEnds[static_cast<size_t>(Stage::kCapture)] = now;
+        mStages[static_cast<size_t>(Stage::kCapture)].Record(now - captureNs);
+    }
+
+    // frames the sensor produced but we never got show up as gaps
+    const uint64_t period = mPeriod.load(std::memory_order_relaxed);
+    if (period != 0u && mLastCapture != 0u && mCapture > mLastCapture) {
+        const uint64_t gap = mCapture - mLastCapture;
+        if (gap > period + period / 2u) {
+            const uint64_t missing = (gap + period / 2u) / period - 1u;
+            mDropped.store(mDropped.load(std::memory_order_relaxed) + missing, std::memory_order_relaxed);
+        }
+    }
+    mLastCapture = mCapture;
+    mLastMark = now;
+}
+
+void FrameTracer::Mark(Stage stage) {
+    const uint64_t now = Now();
+    const size_t index = static_cast<size_t>(stage);
+    mEnds[index] = now;
+    mStages[index].Record(now - mLastMark);
+    mLastMark = now;
+}
+
+void FrameTracer::EndFrame() {
+    const uint64_t sequence = mFrames.load(std::memory_order_relaxed);
+    const bool presented = mEnds[static_cast<size_t>(Stage::kPresent)] != 0u;
+    if (presented) {
+        const uint64_t total = mLastMark - mCapture;
+        mTotal.Record(total);
+        Increment(mPresented);
+
+        const uint64_t period = mPeriod.load(std::memory_order_relaxed);
+        if (period != 0u && total > period) {
+            Increment(mLate);
+        }
+    }
+
+    Slot& slot = mRecent[sequence % kRecentFrames];
+    slot.sequence.store(sequence, std::memory_order_relaxed);
+    slot.capture.store(mCapture, std::memory_order_relaxed);
+    for (size_t i = 0u; i < kStageCount; i++) {
+        slot.end[i].store(mEnds[i], std::memory_order_relaxed);
+    }
+    slot.presented.store(presented, std::memory_order_relaxed);
+    mFrames.store(sequence + 1u, std::memory_order_release);
+
+    if (presented) {
+        mWindowFrames++;
+    }
+    if (mLastMark - mWindowStart >= kFpsWindowNs) {
+        if (mWindowStart != 0u) {
+            mFps.store(static_cast<double>(mWindowFrames) * 1e9 / static_cast<double>(mLastMark - mWindowStart),
+                       std::memory_order_relaxed);
+        }
+        mWindowStart = mLastMark;
+        mWindowFrames = 0u;
+    }
+}
+
+uint64_t FrameTracer::GetCaptureTime() const {
+    return mCapture;
+}
+
+uint64_t FrameTracer::GetFrames() const {
+    return mFrames.load(std::memory_order_acquire);
+}
+
+uint64_t FrameTracer::GetPresented() const {
+    return mPresented.load(std::memory_order_relaxed);
+}
+
+uint64_t FrameTracer::GetDropped() const {
+    return mDropped.load(std::memory_order_relaxed);
+}
+
+uint64_t FrameTracer::GetLate() const {
+    return mLate.load(std::memory_order_relaxed);
+}
+
+double FrameTracer::GetFps() const {
+    return mFps.load(std::memory_order_relaxed);
+}
+
+const LatencyHistogram& FrameTracer::GetStage(Stage stage) const {
+    return mStages[static_cast<size_t>(stage)];
+}
+
+const LatencyHistogram& FrameTracer::GetTotal() const {
+    return mTotal;
+}
+
+size_t FrameTracer::GetRecent(FrameRecord* records, size_t count) const {
+    const uint64_t frames = GetFrames();
+    count = std::min<uint64_t>({ count, frames, kRecentFrames });
+
+    size_t copied = 0u;
+    for (uint64_t sequence = frames - count; sequence < frames; sequence++) {
+        const Slot& slot = mRecent[sequence % kRecentFrames];
+        FrameRecord& record = records[copied];
+        record.sequence = slot.sequence.load(std::memory_order_relaxed);
+        record.capture = slot.capture.load(std::memory_order_relaxed);
+        for (size_t i = 0u; i < kStageCount; i++) {
+            record.end[i] = slot.end[i].load(std::memory_order_relaxed);
+        }
+        record.presented = slot.presented.load(std::memory_order_relaxed);
+
+        // overwritten by the capture thread while we copied, skip it
+        if (record.sequence == sequence) {
+            copied++;
+        }
+    }
+    return copied;
+}
+
+std::string FrameTracer::Report(size_t recentFrames) const {
+    std::string report;
+    char line[160];
+
+    snprintf(line, sizeof(line), "frames %llu presented %llu dropped %llu late %llu fps %.1f\n",
+             static_cast<unsigned long long>(GetFrames()), static_cast<unsigned long long>(GetPresented()),
+             static_cast<unsigned long long>(GetDropped()), static_cast<unsigned long long>(GetLate()), GetFps());
+    report += line;
+
+    snprintf(line, sizeof(line), "%-10s %10s %10s %10s %10s %10s\n", "stage", "count", "p50_us", "p99_us", "max_us",
+             "mean_us");
+    report += line;
+
+    auto addRow = [&](const char* name, const LatencyHistogram& histogram) {
+        snprintf(line, sizeof(line), "%-10s %10llu %10.1f %10.1f %10.1f %10.1f\n", name,
+                 static_cast<unsigned long long>(histogram.Count()), ToMicros(histogram.Percentile(0.5)),
+                 ToMicros(histogram.Percentile(0.99)), ToMicros(histogram.Max()), ToMicros(histogram.Mean()));
+        report += line;
+    };
+    for (size_t i = 0u; i < kStageCount; i++) {
+        addRow(StageToStr(static_cast<Stage>(i)), mStages[i]);
+    }
+    addRow("total", mTotal);
+
+    if (recentFrames > 0u) {
+        std::array<FrameRecord, kRecentFrames> records;
+        const size_t count = GetRecent(records.data(), std::min(recentFrames, kRecentFrames));
+
+        snprintf(line, sizeof(line), "\n%-10s %10s %10s %10s %10s %10s %10s\n", "frame", "capture", "transform",
+                 "convert", "overlay", "present", "total");
+        report += line;
+        for (size_t i = 0u; i < count; i++) {
+            const FrameRecord& record = records[i];
+            snprintf(line, sizeof(line), "%-10llu", static_cast<unsigned long long>(record.sequence));
+            report += line;
+
+            // each stage from the end of the one before it, in us
+            uint64_t previous = record.capture;
+            for (size_t stage = 0u; stage < kStageCount; stage++) {
+                if (record.end[stage] == 0u) {
+                    snprintf(line, sizeof(line), " %10s", "-");
+                } else {
+                    snprintf(line, sizeof(line), " %10.1f", ToMicros(record.end[stage] - previous));
+                    previous = record.end[stage];
+                }
+                report += line;
+            }
+            snprintf(line, sizeof(line), " %10.1f%s\n", ToMicros(previous - record.capture),
+                     record.presented ? "" : " rejected");
+            report += line;
+        }
+    }
+    return report;
+}
+
+} // trace
+} // thermal
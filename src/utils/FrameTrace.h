@@ -0,0 +1,211 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _FRAME_TRACE_H_
+#define _FRAME_TRACE_H_
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+namespace thermal {
+namespace trace {
+
+/**
+ * @brief Stages of the frame path, each ends with a Mark().
+ */
+enum class Stage : uint8_t {
+    kCapture = 0,   ///< sensor timestamp to the frame reaching us
+    kTransform,     ///< scale, rotate and zoom
+    kConvert,       ///< colour conversion to RGBA
+    kOverlay,       ///< reticle and menus
+    kPresent,       ///< write to the framebuffer
+    kCount
+};
+
+inline constexpr size_t kStageCount = static_cast<size_t>(Stage::kCount);
+
+const char* StageToStr(Stage stage);
+
+/**
+ * @brief CLOCK_MONOTONIC in ns, the clock V4L2 stamps buffers with.
+ */
+uint64_t Now();
+
+/**
+ * @brief Latency histogram with log spaced buckets.
+ *
+ * Every power of two is split in 8 buckets, so percentiles are within ~6%
+ * of the real value over the whole range with a fixed 2KB of counters. One
+ * thread records, any thread may read.
+ */
+class LatencyHistogram {
+public:
+    static constexpr size_t kSubBuckets = 8u;
+    static constexpr size_t kBuckets = 62u * kSubBuckets;
+
+    LatencyHistogram();
+
+    /**
+     * @brief Adds a sample. Single writer.
+     */
+    void Record(uint64_t ns);
+
+    uint64_t Count() const;
+    uint64_t Max() const;
+    uint64_t Mean() const;
+
+    /**
+     * @brief Value below which a fraction of the samples fall.
+     * @param fraction 0.5 for the median, 0.99 for p99.
+     * @return the middle of the bucket holding it, 0 without samples.
+     */
+    uint64_t Percentile(double fraction) const;
+
+    static size_t BucketOf(uint64_t ns);
+    static uint64_t BucketValue(size_t bucket);
+
+private:
+    std::array<std::atomic<uint32_t>, kBuckets> mCounts;
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mSum;
+    std::atomic<uint64_t> mMax;
+};
+
+/**
+ * @brief Stage timestamps of one frame.
+ */
+struct FrameRecord {
+    uint64_t sequence;                        ///< frame number since start
+    uint64_t capture;                         ///< sensor / driver timestamp
+    std::array<uint64_t, kStageCount> end;    ///< end of each stage, 0 if skipped
+    bool presented;
+};
+
+/**
+ * @brief Low overhead tracing of the frame path.
+ *
+ * The frame thread stamps each stage boundary with the monotonic clock, the
+ * stamps of the last frames are kept in a ring and each stage's duration goes
+ * into a histogram. That is a handful of clock reads per frame, nothing
+ * allocates or locks. Readers (the stats exporter) take a consistent enough
+ * view from any thread.
+ *
+ * BeginFrame(), Mark() and EndFrame() are called from the capture thread only.
+ */
+class FrameTracer {
+public:
+    static constexpr size_t kRecentFrames = 64u;
+
+    static FrameTracer& Instance();
+
+    FrameTracer();
+
+    /**
+     * @brief Sets the expected frame period, used to spot dropped (missing)
+     * and late frames.
+     */
+    void SetFramePeriod(uint64_t periodNs);
+
+    /**
+     * @brief Starts a frame.
+     * @param captureNs when the sensor delivered it, on the Now() clock. 0
+     *        if unknown, the capture stage is then not recorded.
+     */
+    void BeginFrame(uint64_t captureNs);
+
+    /**
+     * @brief Marks the end of a stage of the current frame.
+     */
+    void Mark(Stage stage);
+
+    /**
+     * @brief Completes the current frame. A frame that never reached
+     * Mark(Stage::kPresent) counts as rejected.
+     */
+    void EndFrame();
+
+    /**
+     * @brief Capture time of the current frame, or when it was started if
+     * the sensor gave none. Capture thread only.
+     */
+    uint64_t GetCaptureTime() const;
+
+    uint64_t GetFrames() const;
+    uint64_t GetPresented() const;
+    uint64_t GetDropped() const;
+    uint64_t GetLate() const;
+
+    /**
+     * @brief Frames presented per second over the last second.
+     */
+    double GetFps() const;
+
+    const LatencyHistogram& GetStage(Stage stage) const;
+
+    /**
+     * @brief Capture to present, for presented frames.
+     */
+    const LatencyHistogram& GetTotal() const;
+
+    /**
+     * @brief Copies out up to count of the most recent frames, oldest first.
+     * @return the number copied.
+     */
+    size_t GetRecent(FrameRecord* records, size_t count) const;
+
+    /**
+     * @brief Human and script readable summary of the counters and
+     * histograms.
+     * @param recentFrames also list this many of the latest frames.
+     */
+    std::string Report(size_t recentFrames = 0u) const;
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint64_t> capture;
+        std::array<std::atomic<uint64_t>, kStageCount> end;
+        std::atomic<bool> presented;
+    };
+
+    std::array<LatencyHistogram, kStageCount> mStages;
+    LatencyHistogram mTotal;
+    std::array<Slot, kRecentFrames> mRecent;
+    std::atomic<uint64_t> mFrames;       ///< frames begun, also the ring head
+    std::atomic<uint64_t> mPresented;
+    std::atomic<uint64_t> mDropped;      ///< gaps in the capture timestamps
+    std::atomic<uint64_t> mLate;         ///< capture to present over a period
+    std::atomic<uint64_t> mPeriod;
+    std::atomic<double> mFps;
+
+    // current frame, capture thread only
+    uint64_t mCapture;
+    uint64_t mLastCapture;
+    uint64_t mLastMark;
+    std::array<uint64_t, kStageCount> mEnds;
+    uint64_t mWindowStart;
+    uint64_t mWindowFrames;
+};
+
+} // trace
+} // thermal
+
+#endif // _FRAME_TRACE_H_
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "LogRecord.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace thermal {
+namespace log {
+
+namespace {
+
+// walks the tagged arguments of one entry
+class ArgReader {
+public:
+    explicit ArgReader(const LogEntry& entry)
+        : mData(entry.args)
+        , mEnd(entry.args + std::min<size_t>(entry.argBytes, sizeof(entry.args))) {}
+
+    bool Next(ArgType& type, uint64_t& bits, std::string& text) {
+        if (mData >= mEnd) {
+            return false;
+        }
+
+        type = static_cast<ArgType>(*mData++);
+        if (type == ArgType::kString) {
+            if (mData >= mEnd) {
+                return false;
+            }
+            const size_t stored = *mData++;
+            const size_t length = std::min<size_t>(stored, mEnd - mData);
+            text.assign(reinterpret_cast<const char*>(mData), length);
+            mData += length;
+            return true;
+        }
+
+        if (mEnd - mData < static_cast<ptrdiff_t>(sizeof(bits))) {
+            mData = mEnd;
+            return false;
+        }
+        std::memcpy(&bits, mData, sizeof(bits));
+        mData += sizeof(bits);
+        return true;
+    }
+
+private:
+    const uint8_t* mData;
+    const uint8_t* mEnd;
+};
+
+template <typename V>
+void AppendFormatted(std::string& out, const std::string& spec, V value) {
+    char buffer[320];
+    const int32_t written = snprintf(buffer, sizeof(buffer), spec.c_str(), value);
+    if (written > 0) {
+        out.append(buffer, std::min<size_t>(written, sizeof(buffer) - 1u));
+    }
+}
+
+bool IsFlag(char c) {
+    return c == '-' || c == '+' || c == ' ' || c == '#' || c == '0';
+}
+
+bool IsLengthModifier(char c) {
+    return c == 'h' || c == 'l' || c == 'L' || c == 'q' || c == 'j' || c == 'z' || c == 't';
+}
+
+} // namespace
+
+std::string FormatMessage(const char* fmt, const LogEntry& entry) {
+    std::string out;
+    if (fmt == nullptr) {
+        return out;
+    }
+
+    ArgReader reader(entry);
+    ArgType type;
+    uint64_t bits = 0u;
+    std::string text;
+
+    const char* p = fmt;
+    while (*p != '\0') {
+        if (*p != '%') {
+            out.push_back(*p++);
+            continue;
+        }
+
+        if (p[1] == '%') {
+            out.push_back('%');
+            p += 2;
+            continue;
+        }
+
+        // keep flags, width and precision, the length modifier is replaced
+        // since every integer was widened to 64 bits when it was queued
+        std::string spec("%");
+        ++p;
+        while (IsFlag(*p)) {
+            spec.push_back(*p++);
+        }
+        while (*p >= '0' && *p <= '9') {
+            spec.push_back(*p++);
+        }
+        if (*p == '.') {
+            spec.push_back(*p++);
+            while (*p >= '0' && *p <= '9') {
+                spec.push_back(*p++);
+            }
+        }
+        while (IsLengthModifier(*p)) {
+            ++p;
+        }
+
+        const char conversion = *p;
+        if (conversion == '\0') {
+            break;
+        }
+        ++p;
+
+        if (!reader.Next(type, bits, text)) {
+            out += entry.truncated ? "<cut>" : "<missing>";
+            continue;
+        }
+
+        switch (conversion) {
+            case 'd':
+            case 'i':
+                if (type == ArgType::kSigned || type == ArgType::kUnsigned) {
+                    AppendFormatted(out, spec + "lld", static_cast<long long>(bits));
+                    continue;
+                }
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                if (type == ArgType::kSigned || type == ArgType::kUnsigned || type == ArgType::kPointer) {
+                    AppendFormatted(out, spec + "ll" + conversion, static_cast<unsigned long long>(bits));
+                    continue;
+                }
+                break;
+            case 'c':
+                if (type == ArgType::kSigned || type == ArgType::kUnsigned) {
+                    AppendFormatted(out, spec + "c", static_cast<int32_t>(bits));
+                    continue;
+                }
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                if (type == ArgType::kDouble) {
+                    double value;
+                    std::memcpy(&value, &bits, sizeof(value));
+                    AppendFormatted(out, spec + conversion, value);
+                    continue;
+                }
+                break;
+            case 's':
+                if (type == ArgType::kString) {
+                    AppendFormatted(out, spec + "s", text.c_str());
+                    continue;
+                }
+                break;
+            case 'p':
+                if (type == ArgType::kPointer) {
+                    AppendFormatted(out, spec + "p", reinterpret_cast<void*>(static_cast<uintptr_t>(bits)));
+                    continue;
+                }
+                break;
+            default:
+                break;
+        }
+
+        out += "<bad %";
+        out.push_back(conversion);
+        out += ">";
+    }
+
+    return out;
+}
+
+const char* LevelName(uint8_t level) {
+    static constexpr const char* kNames[] = {
+        "EMERG", "ALERT", "CRIT", "ERROR", "WARN", "NOTICE", "INFO", "DEBUG"
+    };
+    return level < (sizeof(kNames) / sizeof(kNames[0])) ? kNames[level] : "?";
+}
+
+std::string FormatTextLine(int64_t realtimeNs, uint32_t threadId, uint8_t level, const char* file,
+                           int32_t line, const char* function, const std::string& message) {
+    const time_t seconds = static_cast<time_t>(realtimeNs / 1000000000);
+    const int64_t micros = (realtimeNs % 1000000000) / 1000;
+
+    struct tm local;
+    localtime_r(&seconds, &local);
+
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    char prefix[96];
+    snprintf(prefix, sizeof(prefix), "%s.%06lld [%u] %-6s ", stamp, static_cast<long long>(micros),
+             threadId, LevelName(level));
+
+    return std::string(prefix) + file + ":" + std::to_string(line) + " " + function + "(): " + message;
+}
+
+} // log
+} // thermal
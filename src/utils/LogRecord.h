@@ -0,0 +1,203 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _LOG_RECORD_H_
+#define _LOG_RECORD_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace thermal {
+namespace log {
+
+/**
+ * @brief Size of one queued log entry, header included.
+ */
+inline constexpr size_t kLogEntrySize = 128u;
+
+/**
+ * @brief Longest string argument kept, longer ones are cut.
+ */
+inline constexpr size_t kMaxStringArg = 255u;
+
+/**
+ * @brief Tag in front of every raw argument in LogEntry::args.
+ */
+enum class ArgType : uint8_t {
+    kSigned = 1,    ///< int64_t
+    kUnsigned = 2,  ///< uint64_t
+    kDouble = 3,    ///< double
+    kPointer = 4,   ///< uint64_t address
+    kString = 5     ///< uint8_t length followed by the bytes, no terminator
+};
+
+/**
+ * @brief One log call as it sits in a thread's ring or in a dump.
+ *
+ * Only the call site id and the raw arguments are kept, the format string
+ * lives in the site table and the text is made later by FormatMessage().
+ */
+struct LogEntry {
+    uint64_t timestamp;     ///< CLOCK_MONOTONIC in ns
+    uint32_t siteId;        ///< index into the site table
+    uint16_t argBytes;      ///< bytes used in args
+    uint8_t truncated;      ///< non zero if arguments did not fit
+    uint8_t reserved;
+    uint8_t args[kLogEntrySize - 16u];
+};
+static_assert(sizeof(LogEntry) == kLogEntrySize, "log entries must stay fixed size");
+
+/**
+ * @brief Binary dump layout, host byte order.
+ *
+ * The file starts with magic, version and the realtime minus monotonic
+ * offset in ns (u32, u32, i64), followed by records that each start with a
+ * DumpRecord byte:
+ *  - kSite: u32 id, u8 level, i32 line, then file, function and format as
+ *    u16 length plus bytes. Written once, before the first entry using it.
+ *  - kEntry: u32 thread id, u64 timestamp, u32 site id, u16 arg bytes,
+ *    u8 truncated, then the raw arguments.
+ *  - kDropped: u32 thread id, u64 entries lost since the last kDropped.
+ *  - kSuppressed: u64 timestamp, u32 site id, u32 entries the site's rate
+ *    limit refused since its last kSuppressed.
+ */
+inline constexpr uint32_t kDumpMagic = 0x474C5354u;   // "TSLG"
+inline constexpr uint32_t kDumpVersion = 2u;
+
+enum class DumpRecord : uint8_t {
+    kSite = 1,
+    kEntry = 2,
+    kDropped = 3,
+    kSuppressed = 4
+};
+
+/**
+ * @brief Appends tagged raw arguments to a LogEntry.
+ */
+class ArgWriter {
+public:
+    explicit ArgWriter(LogEntry& entry) : mEntry(entry) {
+        mEntry.argBytes = 0u;
+        mEntry.truncated = 0u;
+    }
+
+    template <typename T>
+    void Put(const T& value) {
+        using Arg = std::decay_t<T>;
+        if constexpr (std::is_same_v<Arg, bool>) {
+            PutScalar(ArgType::kUnsigned, static_cast<uint64_t>(value));
+        } else if constexpr (std::is_enum_v<Arg>) {
+            PutScalar(ArgType::kSigned, static_cast<int64_t>(value));
+        } else if constexpr (std::is_integral_v<Arg> && std::is_signed_v<Arg>) {
+            PutScalar(ArgType::kSigned, static_cast<int64_t>(value));
+        } else if constexpr (std::is_integral_v<Arg>) {
+            PutScalar(ArgType::kUnsigned, static_cast<uint64_t>(value));
+        } else if constexpr (std::is_floating_point_v<Arg>) {
+            PutScalar(ArgType::kDouble, static_cast<double>(value));
+        } else if constexpr (std::is_convertible_v<Arg, const char*>) {
+            PutString(value);
+        } else if constexpr (std::is_pointer_v<Arg> || std::is_null_pointer_v<Arg>) {
+            PutScalar(ArgType::kPointer, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+        } else {
+            static_assert(std::is_pointer_v<Arg>, "unsupported log argument type");
+        }
+    }
+
+private:
+    template <typename V>
+    void PutScalar(ArgType type, V value) {
+        if (mEntry.truncated != 0u || mEntry.argBytes + 1u + sizeof(V) > sizeof(mEntry.args)) {
+            mEntry.truncated = 1u;
+            return;
+        }
+
+        uint8_t* out = mEntry.args + mEntry.argBytes;
+        out[0] = static_cast<uint8_t>(type);
+        std::memcpy(out + 1, &value, sizeof(V));
+        mEntry.argBytes = static_cast<uint16_t>(mEntry.argBytes + 1u + sizeof(V));
+    }
+
+    void PutString(const char* value) {
+        if (value == nullptr) {
+            value = "(null)";
+        }
+
+        const size_t room = sizeof(mEntry.args) - mEntry.argBytes;
+        if (mEntry.truncated != 0u || room < 2u) {
+            mEntry.truncated = 1u;
+            return;
+        }
+
+        // cut long strings to what is left rather than dropping them
+        const size_t limit = std::min(kMaxStringArg, room - 2u);
+        const size_t length = strnlen(value, limit);
+        if (length == limit && value[limit] != '\0') {
+            mEntry.truncated = 1u;
+        }
+
+        uint8_t* out = mEntry.args + mEntry.argBytes;
+        out[0] = static_cast<uint8_t>(ArgType::kString);
+        out[1] = static_cast<uint8_t>(length);
+        std::memcpy(out + 2, value, length);
+        mEntry.argBytes = static_cast<uint16_t>(mEntry.argBytes + 2u + length);
+    }
+
+    LogEntry& mEntry;
+};
+
+/**
+ * @brief Expands a printf style format with the raw arguments of an entry.
+ *
+ * Each conversion is checked against the tag of its argument, a mismatch or
+ * a missing argument prints a marker instead of reading garbage, so a dump
+ * from another build can't crash the decoder.
+ *
+ * @param fmt the call site's format string.
+ * @param entry the entry holding the arguments.
+ * @return the formatted message.
+ */
+std::string FormatMessage(const char* fmt, const LogEntry& entry);
+
+/**
+ * @brief Short upper case name of a syslog level, "?" if out of range.
+ */
+const char* LevelName(uint8_t level);
+
+/**
+ * @brief Formats one line the way the text sink and the decoder print it.
+ *
+ * @param realtimeNs wall clock time of the entry in ns.
+ * @param threadId the thread that logged it.
+ * @param level syslog level.
+ * @param file source file basename.
+ * @param line source line.
+ * @param function function name.
+ * @param message the formatted message.
+ * @return the line, without a trailing newline.
+ */
+std::string FormatTextLine(int64_t realtimeNs, uint32_t threadId, uint8_t level, const char* file,
+                           int32_t line, const char* function, const std::string& message);
+
+} // log
+} // thermal
+
+#endif // _LOG_RECORD_H_
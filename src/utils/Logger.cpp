@@ -14,54 +14,495 @@
  * limitations under the License.
  */
 
+
 #include "Logger.h"
 
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/syscall.h>
 #include <sys/syslog.h>
+#include <time.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include "SpscRing.h"
 
 namespace thermal {
 namespace log {
 
-LogLevel logLevelSetting = LogLevel::kDebug;
+namespace {
+
 inline constexpr const char * const kAppName = "thermal-scope-app"; 
+// entries per thread, 32 KiB each
+inline constexpr size_t kRingSize = 256u;
+// how often the logger thread drains, producers never wake it
+inline constexpr std::chrono::milliseconds kDrainInterval(20);
+
+// default rate limit, a site may log 10 entries back to back then one per
+// second, enough to see a fault without drowning the card in it
+inline constexpr uint32_t kDefaultBurst = 10u;
+inline constexpr uint32_t kDefaultPerSecond = 1u;
+// suppressed counts are summed up and reported at most this often
+inline constexpr uint64_t kSummaryIntervalNs = 1000000000u;
+
+std::atomic<LogLevel> logLevelSetting{ LogLevel::kDebug };
+inline constexpr uint64_t kDefaultInterval = 1000000000u / kDefaultPerSecond;
+
+std::atomic<uint64_t> rateInterval{ kDefaultInterval };
+std::atomic<uint64_t> rateTolerance{ (kDefaultBurst - 1u) * kDefaultInterval };
+std::atomic<bool> rateLimited{ true };
+// set when any site suppressed an entry, saves scanning every site per drain
+std::atomic<bool> suppressionPending{ false };
+
+// call site as the logger thread sees it, with the basename already cut
+struct SiteInfo {
+    LogSite* site;
+    uint8_t level;
+    int32_t line;
+    std::string file;
+    const char* function;
+    const char* fmt;
+};
+
+struct ThreadRing {
+    utils::SpscRing<LogEntry, kRingSize> ring;
+    uint32_t threadId = 0u;
+    uint64_t reportedDrops = 0u;
+    std::atomic<bool> retired{ false };
+};
+
+// marks the ring retired when its thread exits, the logger thread frees it
+// once drained
+struct RingHandle {
+    std::shared_ptr<ThreadRing> ring;
+
+    ~RingHandle() {
+        if (ring) {
+            ring->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local RingHandle tRing;
+// entries written synchronously are built here instead of in the ring
+thread_local LogEntry tScratch;
+
+struct Logger {
+    std::mutex mutex;
+    std::deque<SiteInfo> sites;
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    std::atomic<bool> running{ false };
+    std::atomic<uint64_t> dropped{ 0u };
+
+    // sink state, only touched with writeMutex held
+    std::mutex writeMutex;
+    LogSink sink = LogSink::kSyslog;
+    FILE* file = nullptr;
+    std::vector<bool> sitesWritten;
+    int64_t realtimeOffset = 0;
+    uint64_t lastSummary = 0u;
+
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread;
+};
+
+// never destroyed, threads may still log while statics are torn down
+Logger& GetLogger() {
+    static Logger* logger = new Logger();
+    return *logger;
+}
+
+uint32_t CurrentThreadId() {
+    return static_cast<uint32_t>(syscall(SYS_gettid));
+}
+
+int64_t RealtimeOffset() {
+    struct timespec real;
+    clock_gettime(CLOCK_REALTIME, &real);
+    const int64_t realNs = static_cast<int64_t>(real.tv_sec) * 1000000000 + real.tv_nsec;
+    return realNs - static_cast<int64_t>(LogClock());
+}
+
+template <typename V>
+void WriteValue(FILE* file, V value) {
+    fwrite(&value, sizeof(value), 1u, file);
+}
+
+void WriteString(FILE* file, const char* text) {
+    const uint16_t length = static_cast<uint16_t>(std::min<size_t>(strlen(text), UINT16_MAX));
+    WriteValue(file, length);
+    fwrite(text, 1u, length, file);
+}
+
+// writeMutex held
+void WriteSite(Logger& logger, uint32_t id, const SiteInfo& site) {
+    if (logger.sitesWritten.size() <= id) {
+        logger.sitesWritten.resize(id + 1u, false);
+    }
+    if (logger.sitesWritten[id]) {
+        return;
+    }
+
+    WriteValue(logger.file, static_cast<uint8_t>(DumpRecord::kSite));
+    WriteValue(logger.file, id);
+    WriteValue(logger.file, site.level);
+    WriteValue(logger.file, site.line);
+    WriteString(logger.file, site.file.c_str());
+    WriteString(logger.file, site.function);
+    WriteString(logger.file, site.fmt);
+    logger.sitesWritten[id] = true;
+}
+
+// writeMutex held, site looked up by the caller
+void WriteEntry(Logger& logger, uint32_t threadId, const SiteInfo& site, const LogEntry& entry) {
+    switch (logger.sink) {
+        case LogSink::kSyslog:
+            syslog(site.level, "%s:%d %s(): %s", site.file.c_str(), site.line, site.function,
+                   FormatMessage(site.fmt, entry).c_str());
+            break;
+
+        case LogSink::kTextFile: {
+            const std::string line = FormatTextLine(static_cast<int64_t>(entry.timestamp) + logger.realtimeOffset,
+                threadId, site.level, site.file.c_str(), site.line, site.function, FormatMessage(site.fmt, entry));
+            fprintf(logger.file, "%s\n", line.c_str());
+            break;
+        }
+
+        case LogSink::kBinaryFile:
+            WriteSite(logger, entry.siteId, site);
+            WriteValue(logger.file, static_cast<uint8_t>(DumpRecord::kEntry));
+            WriteValue(logger.file, threadId);
+            WriteValue(logger.file, entry.timestamp);
+            WriteValue(logger.file, entry.siteId);
+            WriteValue(logger.file, entry.argBytes);
+            WriteValue(logger.file, entry.truncated);
+            fwrite(entry.args, 1u, entry.argBytes, logger.file);
+            break;
+    }
+}
+
+// writeMutex held
+void WriteDropped(Logger& logger, uint32_t threadId, uint64_t count) {
+    switch (logger.sink) {
+        case LogSink::kSyslog:
+            syslog(LOG_WARNING, "logger: thread %u dropped %llu entries", threadId,
+                   static_cast<unsigned long long>(count));
+            break;
+
+        case LogSink::kTextFile:
+            fprintf(logger.file, "logger: thread %u dropped %llu entries\n", threadId,
+                    static_cast<unsigned long long>(count));
+            break;
+
+        case LogSink::kBinaryFile:
+            WriteValue(logger.file, static_cast<uint8_t>(DumpRecord::kDropped));
+            WriteValue(logger.file, threadId);
+            WriteValue(logger.file, count);
+            break;
+    }
+}
+
+// writeMutex held
+void WriteSuppressed(Logger& logger, uint32_t id, const SiteInfo& site, uint64_t timestamp, uint32_t count) {
+    switch (logger.sink) {
+        case LogSink::kSyslog:
+            syslog(site.level, "%s:%d %s(): suppressed %u messages", site.file.c_str(), site.line,
+                   site.function, count);
+            break;
+
+        case LogSink::kTextFile: {
+            const std::string line = FormatTextLine(static_cast<int64_t>(timestamp) + logger.realtimeOffset, 0u,
+                site.level, site.file.c_str(), site.line, site.function,
+                "suppressed " + std::to_string(count) + " messages");
+            fprintf(logger.file, "%s\n", line.c_str());
+            break;
+        }
+
+        case LogSink::kBinaryFile:
+            WriteSite(logger, id, site);
+            WriteValue(logger.file, static_cast<uint8_t>(DumpRecord::kSuppressed));
+            WriteValue(logger.file, timestamp);
+            WriteValue(logger.file, id);
+            WriteValue(logger.file, count);
+            break;
+    }
+}
+
+struct Pending {
+    uint32_t threadId;
+    LogEntry entry;
+};
+
+// logger thread, or LogDeinit() once the thread has stopped
+void Drain(Logger& logger) {
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    {
+        std::lock_guard<std::mutex> lock(logger.mutex);
+        rings = logger.rings;
+    }
+
+    // threads only keep their own order, merge them by time
+    std::vector<Pending> batch;
+    std::vector<std::pair<uint32_t, uint64_t>> drops;
+    Pending pending;
+    for (const auto& ring : rings) {
+        const bool retired = ring->retired.load(std::memory_order_acquire);
+        pending.threadId = ring->threadId;
+        while (ring->ring.Pop(pending.entry)) {
+            batch.push_back(pending);
+        }
+
+        const uint64_t dropped = ring->ring.Dropped();
+        if (dropped != ring->reportedDrops) {
+            drops.emplace_back(ring->threadId, dropped - ring->reportedDrops);
+            ring->reportedDrops = dropped;
+        }
+
+        if (retired) {
+            std::lock_guard<std::mutex> lock(logger.mutex);
+            logger.rings.erase(std::remove(logger.rings.begin(), logger.rings.end(), ring), logger.rings.end());
+        }
+    }
+
+    const uint64_t now = LogClock();
+    bool suppressed = false;
+    if (now - logger.lastSummary >= kSummaryIntervalNs) {
+        suppressed = suppressionPending.exchange(false, std::memory_order_acq_rel);
+        logger.lastSummary = now;
+    }
+    if (batch.empty() && drops.empty() && !suppressed) {
+        return;
+    }
+
+    std::stable_sort(batch.begin(), batch.end(), [](const Pending& a, const Pending& b) {
+        return a.entry.timestamp < b.entry.timestamp;
+    });
+
+    std::lock_guard<std::mutex> siteLock(logger.mutex);
+    std::lock_guard<std::mutex> writeLock(logger.writeMutex);
+    for (const auto& [threadId, count] : drops) {
+        logger.dropped.fetch_add(count, std::memory_order_relaxed);
+        WriteDropped(logger, threadId, count);
+    }
+    for (const Pending& item : batch) {
+        WriteEntry(logger, item.threadId, logger.sites[item.entry.siteId - 1u], item.entry);
+    }
+    if (suppressed) {
+        for (size_t i = 0u; i < logger.sites.size(); ++i) {
+            const uint32_t count = logger.sites[i].site->suppressed.exchange(0u, std::memory_order_relaxed);
+            if (count != 0u) {
+                WriteSuppressed(logger, static_cast<uint32_t>(i + 1u), logger.sites[i], now, count);
+            }
+        }
+    }
+    if (logger.file != nullptr) {
+        fflush(logger.file);
+    }
+}
+
+void Worker(Logger& logger) {
+    std::unique_lock<std::mutex> lock(logger.wakeMutex);
+    while (!logger.stopping) {
+        logger.wake.wait_for(lock, kDrainInterval);
+        lock.unlock();
+        Drain(logger);
+        lock.lock();
+    }
+}
+
+ThreadRing* AttachThread(Logger& logger) {
+    auto ring = std::make_shared<ThreadRing>();
+    ring->threadId = CurrentThreadId();
+    {
+        std::lock_guard<std::mutex> lock(logger.mutex);
+        logger.rings.push_back(ring);
+    }
+    tRing.ring = ring;
+    return ring.get();
+}
+
+} // namespace
 
 void LogInit() {
+    Logger& logger = GetLogger();
     openlog(kAppName, LOG_PID | LOG_CONS, LOG_USER);
+
+    std::lock_guard<std::mutex> lock(logger.wakeMutex);
+    if (!logger.thread.joinable()) {
+        // The drain thread starts before the reactor routes SIGINT/SIGTERM
+        // to its signalfd, so it would not inherit that mask. Spawn it with
+        // every signal blocked, a signal must never land on it.
+        sigset_t all;
+        sigset_t previous;
+        sigfillset(&all);
+        ::pthread_sigmask(SIG_SETMASK, &all, &previous);
+        logger.stopping = false;
+        logger.thread = std::thread(Worker, std::ref(logger));
+        ::pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+        logger.running.store(true, std::memory_order_release);
+    }
 }
 
 void LogDeinit() {
+    Logger& logger = GetLogger();
+    logger.running.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(logger.wakeMutex);
+        logger.stopping = true;
+    }
+    logger.wake.notify_all();
+    if (logger.thread.joinable()) {
+        logger.thread.join();
+    }
+
+    // whatever was queued before running went false, and any suppressed
+    // counts not reported yet
+    logger.lastSummary = 0u;
+    Drain(logger);
+
+    std::lock_guard<std::mutex> lock(logger.writeMutex);
+    if (logger.file != nullptr) {
+        fclose(logger.file);
+        logger.file = nullptr;
+    }
+    logger.sink = LogSink::kSyslog;
     closelog();
 }
 
+bool SetLogSink(LogSink sink, const std::string& path) {
+    Logger& logger = GetLogger();
+
+    FILE* file = nullptr;
+    if (sink != LogSink::kSyslog) {
+        file = fopen(path.c_str(), sink == LogSink::kBinaryFile ? "wb" : "a");
+        if (file == nullptr) {
+            return false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(logger.writeMutex);
+        if (logger.file != nullptr) {
+            fclose(logger.file);
+        }
+        logger.sink = sink;
+        logger.file = file;
+        logger.sitesWritten.clear();
+        logger.realtimeOffset = RealtimeOffset();
+
+        if (sink == LogSink::kBinaryFile) {
+            WriteValue(file, kDumpMagic);
+            WriteValue(file, kDumpVersion);
+            WriteValue(file, logger.realtimeOffset);
+        }
+    }
+    return true;
+}
+
 LogLevel GetLogLevel() {
-    return logLevelSetting;
+    return logLevelSetting.load(std::memory_order_relaxed);
 }
 
 void SetLogLevel(LogLevel logLevel) {
-    logLevelSetting = logLevel;
+    logLevelSetting.store(logLevel, std::memory_order_relaxed);
+}
+
+uint64_t GetDroppedLogs() {
+    return GetLogger().dropped.load(std::memory_order_relaxed);
+}
+
+void SetLogRateLimit(uint32_t burst, uint32_t perSecond) {
+    if (burst == 0u || perSecond == 0u) {
+        rateLimited.store(false, std::memory_order_relaxed);
+        return;
+    }
+
+    const uint64_t interval = UINT64_C(1000000000) / perSecond;
+    rateInterval.store(interval, std::memory_order_relaxed);
+    rateTolerance.store((burst - 1u) * interval, std::memory_order_relaxed);
+    rateLimited.store(true, std::memory_order_relaxed);
 }
 
-void LogInternal(LogLevel level, int32_t lineNumber, const char * filename, const char * function, const char * fmt, ...) {
-    if (level <= logLevelSetting) {
-        const char* begin = filename + std::char_traits<char>::length(filename);
+bool AdmitEntry(LogSite& site, uint64_t now) {
+    if (site.level <= LogLevel::kCritical || !rateLimited.load(std::memory_order_relaxed)) {
+        return true;
+    }
+
+    const uint64_t interval = rateInterval.load(std::memory_order_relaxed);
+    const uint64_t tolerance = rateTolerance.load(std::memory_order_relaxed);
 
-        while ((begin > filename) && (*(begin - 1) != '/') && (*(begin - 1) != '\\')) {
-            begin--;
+    uint64_t allowed = site.nextAllowed.load(std::memory_order_relaxed);
+    do {
+        // bucket empty, allowed is when it would have a token again plus the
+        // burst it may hold
+        if (allowed > now + tolerance) {
+            site.suppressed.fetch_add(1u, std::memory_order_relaxed);
+            suppressionPending.store(true, std::memory_order_release);
+            return false;
         }
+    } while (!site.nextAllowed.compare_exchange_weak(allowed, std::max(allowed, now) + interval,
+                                                      std::memory_order_relaxed));
+    return true;
+}
+
+uint32_t RegisterSite(LogSite& site) {
+    Logger& logger = GetLogger();
+    std::lock_guard<std::mutex> lock(logger.mutex);
+
+    // another thread may have won the race while we waited
+    uint32_t id = site.id.load(std::memory_order_relaxed);
+    if (id == 0u) {
+        logger.sites.push_back(SiteInfo{ &site, static_cast<uint8_t>(site.level), site.line,
+                                         std::string(site.file, site.fileLength), site.function, site.fmt });
+        id = static_cast<uint32_t>(logger.sites.size());
+        site.id.store(id, std::memory_order_release);
+    }
+    return id;
+}
+
+uint64_t LogClock() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000u + static_cast<uint64_t>(now.tv_nsec);
+}
 
-        const char* ptr = begin;
-        while ((*ptr != '\0') && (*ptr != '.')) {
-            ptr++;
+LogEntry* ClaimEntry(const LogSite& site) {
+    if (site.level > LogLevel::kCritical && GetLogger().running.load(std::memory_order_acquire)) {
+        ThreadRing* ring = tRing.ring.get();
+        if (ring == nullptr) {
+            ring = AttachThread(GetLogger());
         }
+        return ring->ring.Claim();
+    }
 
-        std::string message(begin, ptr - begin);
-        message = message + ":" + std::to_string(lineNumber) + " " + function + "(): " + fmt;
+    return &tScratch;
+}
+
+void CommitEntry(LogEntry* entry) {
+    if (entry != &tScratch) {
+        tRing.ring->ring.Publish();
+        return;
+    }
 
-        va_list args;
-        va_start(args, fmt);
-        vsyslog(static_cast<int32_t>(level), message.c_str(), args);
-        va_end(args);
+    Logger& logger = GetLogger();
+    std::lock_guard<std::mutex> siteLock(logger.mutex);
+    std::lock_guard<std::mutex> writeLock(logger.writeMutex);
+    WriteEntry(logger, CurrentThreadId(), logger.sites[entry->siteId - 1u], *entry);
+    if (logger.file != nullptr) {
+        fflush(logger.file);
     }
 }
 
@@ -20,14 +20,45 @@
 #include <syslog.h>
 #include <stdint.h>
 
-#include <cstdarg>
+#include <atomic>
+#include <string>
+
+#include "LogRecord.h"
+
+/**
+ * @brief Lowest priority level compiled in, as a syslog number (7 = debug).
+ *
+ * Set by THERMAL_SCOPE_LOG_LEVEL in CMake. Calls below it are removed
+ * entirely, their arguments are never evaluated.
+ */
+#ifndef THERMAL_SCOPE_MIN_LOG_LEVEL
+#define THERMAL_SCOPE_MIN_LOG_LEVEL 7
+#endif
+
+/**
+ * @brief Logs a message at the given level through a static call site.
+ *
+ * The site (level, file, line, function and format) is a constant emitted
+ * once per call site, a log call only queues the site id, a timestamp and
+ * the raw arguments. Formatting happens on the logger thread.
+ */
+#define DLOG_AT(lvl, fmt, ...)                                                                  \
+    do {                                                                                        \
+        if constexpr ((lvl) <= thermal::log::kCompiledLogLevel) {                               \
+            static constinit thermal::log::LogSite sLogSite{ (lvl), __LINE__,                   \
+                thermal::log::SourceBasename(__FILE__), thermal::log::SourceStemLength(__FILE__), \
+                __func__, (fmt) };                                                              \
+            thermal::log::Log(sLogSite, ##__VA_ARGS__);                                         \
+        }                                                                                       \
+    } while (0)
+
 /**
  * @brief Logs a debug message with the specified format.
  *
  * @param fmt The format string.
  * @param ... The format arguments.
  */
-#define DLOG_DEBUG(fmt, ...) LogInternal(thermal::log::LogLevel::kDebug, __LINE__, __FILE__, __func__, (fmt), ##__VA_ARGS__)
+#define DLOG_DEBUG(fmt, ...) DLOG_AT(thermal::log::LogLevel::kDebug, (fmt), ##__VA_ARGS__)
 
 /**
  * @brief Logs an informational message with the specified format.
@@ -35,7 +66,7 @@
  * @param fmt The format string.
  * @param ... The format arguments.
  */
-#define DLOG_INFO(fmt, ...) LogInternal(thermal::log::LogLevel::kInformational, __LINE__, __FILE__, __func__, (fmt), ##__VA_ARGS__)
+#define DLOG_INFO(fmt, ...) DLOG_AT(thermal::log::LogLevel::kInformational, (fmt), ##__VA_ARGS__)
 
 /**
  * @brief Logs a notice message with the specified format.
@@ -43,7 +74,7 @@
  * @param fmt The format string.
  * @param ... The format arguments.
  */
-#define DLOG_NOTICE(fmt, ...) LogInternal(thermal::log::LogLevel::kNotice, __LINE__, __FILE__, __func__, (fmt), ##__VA_ARGS__)
+#define DLOG_NOTICE(fmt, ...) DLOG_AT(thermal::log::LogLevel::kNotice, (fmt), ##__VA_ARGS__)
 
 /**
  * @brief Logs a warning message with the specified format.
@@ -51,7 +82,7 @@
  * @param fmt The format string.
  * @param ... The format arguments.
  */
-#define DLOG_WARN(fmt, ...) LogInternal(thermal::log::LogLevel::kWarning, __LINE__, __FILE__, __func__, (fmt), ##__VA_ARGS__)
+#define DLOG_WARN(fmt, ...) DLOG_AT(thermal::log::LogLevel::kWarning, (fmt), ##__VA_ARGS__)
 
 /**
  * @brief Logs an error message with the specified format.
@@ -59,7 +90,7 @@
  * @param fmt The format string.
  * @param ... The format arguments.
  */
-#define DLOG_ERROR(fmt, ...) LogInternal(thermal::log::LogLevel::kError, __LINE__, __FILE__, __func__, (fmt), ##__VA_ARGS__)
+#define DLOG_ERROR(fmt, ...) DLOG_AT(thermal::log::LogLevel::kError, (fmt), ##__VA_ARGS__)
 
 /**
  * @brief Logs a critical message with the specified format.
@@ -67,7 +98,7 @@
  * @param fmt The format string.
  * @param ... The format arguments.
  */
-#define DLOG_CRIT(fmt, ...) LogInternal(thermal::log::LogLevel::kCritical, __LINE__, __FILE__, __func__, (fmt), ##__VA_ARGS__)
+#define DLOG_CRIT(fmt, ...) DLOG_AT(thermal::log::LogLevel::kCritical, (fmt), ##__VA_ARGS__)
 
 /**
  * @brief Logs an alert message with the specified format.
@@ -75,7 +106,7 @@
  * @param fmt The format string.
  * @param ... The format arguments.
  */
-#define DLOG_ALERT(fmt, ...) LogInternal(thermal::log::LogLevel::kAlert, __LINE__, __FILE__, __func__, (fmt), ##__VA_ARGS__)
+#define DLOG_ALERT(fmt, ...) DLOG_AT(thermal::log::LogLevel::kAlert, (fmt), ##__VA_ARGS__)
 
 /**
  * @brief Logs an emergency message with the specified format.
@@ -83,7 +114,7 @@
  * @param fmt The format string.
  * @param ... The format arguments.
  */
-#define DLOG_EMERGENCY(fmt, ...) LogInternal(thermal::log::LogLevel::kEmergency, __LINE__, __FILE__, __func__, (fmt), ##__VA_ARGS__)
+#define DLOG_EMERGENCY(fmt, ...) DLOG_AT(thermal::log::LogLevel::kEmergency, (fmt), ##__VA_ARGS__)
 
 namespace thermal {
 namespace log {
@@ -103,15 +134,82 @@ enum class LogLevel : uint8_t {
 };
 
 /**
- * @brief Initializes the logging system.
+ * @brief THERMAL_SCOPE_MIN_LOG_LEVEL as a level.
+ */
+inline constexpr LogLevel kCompiledLogLevel = static_cast<LogLevel>(THERMAL_SCOPE_MIN_LOG_LEVEL);
+
+/**
+ * @brief Start of the file name in a path, evaluated at compile time for
+ * __FILE__.
+ */
+constexpr const char* SourceBasename(const char* path) {
+    const char* begin = path;
+    for (const char* p = path; *p != '\0'; ++p) {
+        if (*p == '/' || *p == '\\') {
+            begin = p + 1;
+        }
+    }
+    return begin;
+}
+
+/**
+ * @brief Length of a file name without its extension.
+ */
+constexpr uint32_t SourceStemLength(const char* path) {
+    const char* begin = SourceBasename(path);
+    uint32_t length = 0u;
+    while (begin[length] != '\0' && begin[length] != '.') {
+        ++length;
+    }
+    return length;
+}
+
+/**
+ * @brief Where the logger thread sends formatted entries.
+ */
+enum class LogSink : uint8_t {
+    kSyslog,     ///< syslog, the default.
+    kTextFile,   ///< formatted lines appended to a file.
+    kBinaryFile  ///< raw entries appended to a dump, see thermal-scope-logdecode.
+};
+
+/**
+ * @brief One logging call site, a static emitted by the DLOG macros.
+ */
+struct LogSite {
+    LogLevel level;
+    int32_t line;
+    const char* file;         ///< basename, see SourceBasename()
+    uint32_t fileLength;      ///< without the extension
+    const char* function;
+    const char* fmt;
+    std::atomic<uint32_t> id{ 0u };             ///< 0 until the site is registered
+    std::atomic<uint64_t> nextAllowed{ 0u };    ///< rate limit state, see AdmitEntry()
+    std::atomic<uint32_t> suppressed{ 0u };     ///< entries refused since the last summary
+};
+
+/**
+ * @brief Initializes the logging system and starts the logger thread.
+ *
+ * Before this (and after LogDeinit()) entries are written synchronously.
  */
 void LogInit();
 
 /**
- * @brief Deinitializes the logging system.
+ * @brief Drains every thread's ring, stops the logger thread and closes the
+ * sink.
  */
 void LogDeinit();
 
+/**
+ * @brief Selects where entries go. May be called at any time.
+ *
+ * @param sink the sink.
+ * @param path file for the file sinks, ignored for syslog.
+ * @return false if the file could not be opened, the sink is then unchanged.
+ */
+bool SetLogSink(LogSink sink, const std::string& path = "");
+
 /**
  * @brief Gets the current log level.
  *
@@ -127,20 +225,93 @@ LogLevel GetLogLevel();
 void SetLogLevel(LogLevel logLevel);
 
 /**
- * @brief Internal logging function.
+ * @brief Number of entries lost because a thread's ring was full.
+ */
+uint64_t GetDroppedLogs();
+
+/**
+ * @brief Sets the per call site rate limit, a token bucket refilled at
+ * perSecond holding up to burst entries.
  *
- * This function is used by the logging macros to log messages at the specified
- * log level with additional context information such as line number, filename,
- * and function name.
+ * Refused entries are counted and reported as "suppressed N messages" from
+ * that site. Critical and worse levels are never limited.
  *
- * @param level The log level.
- * @param lineNumber The line number where the log is generated.
- * @param filename The filename where the log is generated.
- * @param function The function name where the log is generated.
- * @param fmt The format string.
- * @param ... The format arguments.
+ * @param burst entries a site may log back to back, 0 disables the limit.
+ * @param perSecond sustained entries per second per site.
+ */
+void SetLogRateLimit(uint32_t burst, uint32_t perSecond);
+
+/**
+ * @brief Takes a token from the site's bucket.
+ *
+ * The bucket is kept as the single timestamp at which it would be full
+ * again (GCRA), so one compare and swap updates it from any thread.
+ *
+ * @return false if the entry must be dropped and counted as suppressed.
+ */
+bool AdmitEntry(LogSite& site, uint64_t now);
+
+/**
+ * @brief Gives a site its id, the first time it logs.
+ */
+uint32_t RegisterSite(LogSite& site);
+
+/**
+ * @brief Reads the timestamp stored in entries.
+ */
+uint64_t LogClock();
+
+/**
+ * @brief Reserves an entry for a log call on the calling thread's ring.
+ *
+ * Critical and worse levels, and anything logged while the logger thread
+ * isn't running, get a per-thread scratch entry that CommitEntry() writes
+ * synchronously so they can't be lost.
+ *
+ * @return the entry to fill, nullptr if the ring is full (counted as dropped).
+ */
+LogEntry* ClaimEntry(const LogSite& site);
+
+/**
+ * @brief Hands an entry from ClaimEntry() to the logger thread.
+ */
+void CommitEntry(LogEntry* entry);
+
+/**
+ * @brief Logs through a call site, used by the DLOG macros.
+ *
+ * @param site the static call site.
+ * @param args the raw arguments, copied as they are.
  */
-void LogInternal(LogLevel level, int32_t lineNumber, const char * filename, const char * function, const char * fmt, ...);
+template <typename... Args>
+inline void Log(LogSite& site, const Args&... args) {
+    if (site.level > GetLogLevel()) {
+        return;
+    }
+
+    uint32_t id = site.id.load(std::memory_order_acquire);
+    if (id == 0u) {
+        id = RegisterSite(site);
+    }
+
+    const uint64_t now = LogClock();
+    if (!AdmitEntry(site, now)) {
+        return;
+    }
+
+    LogEntry* entry = ClaimEntry(site);
+    if (entry == nullptr) {
+        return;
+    }
+
+    entry->timestamp = now;
+    entry->siteId = id;
+    entry->reserved = 0u;
+    ArgWriter writer(*entry);
+    (writer.Put(args), ...);
+
+    CommitEntry(entry);
+}
 
 } // log
 } // thermal
@@ -27,13 +27,14 @@
 #include <string>
 
 #include "Logger.h"
+#include "Platform.h"
 #include "Utils.h"
-#include "DelayedWriter.h"
+#include "SettingsStore.h"
 
 namespace thermal {
 namespace persistent {
 
-inline constexpr const char * const kPersistentPath = "/var/data/persist/";
+inline constexpr const char * const kPersistentPath = kPersistentDirectory;
 
 /**
  * @brief A base class for objects that can be saved and loaded persistently.
@@ -48,12 +49,10 @@ public:
     /**
      * @brief Constructs a new BaseSaveable object.
      * 
-     * @param key The key used for persistence (i.e., the filename).
+     * @param key The key used for persistence (i.e., the key in the settings store).
      */
     BaseSaveable(std::string key) 
-        : mKey(key)
-        , mDelayedWriter(std::chrono::seconds(3), kPersistentPath + mKey) {
-        utils::EnsureDirectoryExists(kPersistentPath);
+        : mKey(key) {
         return;
     }
 
@@ -69,43 +68,46 @@ public:
      * @return false If there was an error loading the value.
      */
     bool Load() {
-        // Ensure directory exists
-        std::string path = kPersistentPath + mKey;
-        std::ifstream f(path, std::ios::in);
-
-        // read from file
-        if (f.is_open()) {
-            Json::Value json;
-            f >> json;
+        Json::Value json;
+        if (Store::Instance().Get(mKey, json)) {
             Deserialize(json);
-            f.close();
-            DLOG_DEBUG("loaded %s", path.c_str());
+            DLOG_DEBUG("loaded %s", mKey.c_str());
             return true;
+        }
 
-        } else {
-            DLOG_WARN("error opening %s", path.c_str());
-            return false;
+        // Settings used to be one file per key, pick those up once and move
+        // them into the store.
+        std::string path = kPersistentPath + mKey;
+        std::ifstream f(path, std::ios::in);
+        if (f.is_open()) {
+            Json::CharReaderBuilder builder;
+            std::string errors;
+            if (Json::parseFromStream(builder, f, &json, &errors)) {
+                Deserialize(json);
+                Store::Instance().Set(mKey, json);
+                DLOG_INFO("migrated %s into the settings store", path.c_str());
+                return true;
+            }
+            DLOG_WARN("failed to parse %s (%s)", path.c_str(), errors.c_str());
         }
+
+        DLOG_WARN("no saved value for %s", mKey.c_str());
+        return false;
     }
 
     /**
-     * @brief Saves the value to persistent storage.
+     * @brief Saves the value to persistent storage. The write itself is
+     *        delayed and shared with every other key in the store.
      * 
      * @return true If the value was successfully saved.
      * @return false If there was an error saving the value.
      */
     bool Save() {
-
-        // Ensure directory exists
-        std::string path = kPersistentPath + mKey;
-
-        // write to file
-        DLOG_DEBUG("saving %s", path.c_str());
+        DLOG_DEBUG("saving %s", mKey.c_str());
         Json::Value json = Serialize();
 
         if  (!json.empty()) {
-            mDelayedWriter.Clear();
-            mDelayedWriter << json;
+            Store::Instance().Set(mKey, json);
             return true;
         } else {
             return false;
@@ -146,8 +148,6 @@ public:
 
 protected:
     std::string mKey; ///< The key used for persistence.
-    utils::DelayedWriter mDelayedWriter; ///< Due to NANDflash concerns, we use a delayed
-                                         ///  writer to ease the number of reads or writes. 
 };
 
 /**
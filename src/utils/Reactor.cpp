@@ -0,0 +1,268 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Reactor.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <chrono>
+#include <mutex>
+
+#include "Logger.h"
+
+namespace thermal {
+namespace utils {
+
+constexpr const int32_t kMaxEvents = 16;
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::seconds;
+
+Reactor::Reactor()
+    : mEpollFd(-1)
+    , mWakeFd(-1)
+    , mTimerFd(-1)
+    , mSignalFd(-1)
+    , mRunning(false)
+    , mLoopThread()
+    , mNextTimerId(1u) {
+
+    mEpollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd < 0) {
+        DLOG_ERROR("failed to create epoll fd (%s)", strerror(errno));
+        return;
+    }
+
+    mWakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    mTimerFd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    // Route SIGINT/SIGTERM through the loop so shutdown runs destructors
+    // (and flushes pending settings) instead of killing the process.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    if (::pthread_sigmask(SIG_BLOCK, &mask, nullptr) == 0) {
+        mSignalFd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    }
+
+    AddFd(mWakeFd, EPOLLIN, [this](uint32_t) {
+        uint64_t count = 0;
+        while (::read(mWakeFd, &count, sizeof(count)) > 0) {}
+        RunPosted();
+    });
+
+    AddFd(mTimerFd, EPOLLIN, [this](uint32_t) {
+        uint64_t expirations = 0;
+        while (::read(mTimerFd, &expirations, sizeof(expirations)) > 0) {}
+        RunTimers();
+    });
+
+    if (mSignalFd >= 0) {
+        AddFd(mSignalFd, EPOLLIN, [this](uint32_t) { OnSignal(); });
+    } else {
+        DLOG_WARN("failed to route signals through the reactor");
+    }
+    return;
+}
+
+Reactor::~Reactor() {
+    for (int32_t fd : { mSignalFd, mTimerFd, mWakeFd, mEpollFd }) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    return;
+}
+
+bool Reactor::AddFd(int32_t fd, uint32_t events, FdCallback callback) {
+    if (fd < 0) {
+        DLOG_ERROR("invalid fd");
+        return false;
+    }
+
+    epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+    if (::epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        DLOG_ERROR("failed to watch fd %d (%s)", fd, strerror(errno));
+        return false;
+    }
+
+    mFdCallbacks[fd] = callback;
+    return true;
+}
+
+void Reactor::RemoveFd(int32_t fd) {
+    ::epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+    mFdCallbacks.erase(fd);
+    return;
+}
+
+TimerId Reactor::AddTimer(milliseconds delay, Task task, milliseconds period) {
+    TimerId id = mNextTimerId++;
+    mTimers[id] = Timer{ task, period };
+    mTimerQueue.push(TimerEntry{ steady_clock::now() + delay, id });
+    ArmTimerFd();
+    return id;
+}
+
+void Reactor::CancelTimer(TimerId id) {
+    // the heap entry is dropped lazily when it reaches the top
+    mTimers.erase(id);
+    return;
+}
+
+void Reactor::Post(Task task) {
+    {
+        std::unique_lock<std::mutex> lock(mPostMutex);
+        mPosted.push_back(std::move(task));
+    }
+    Wake();
+    return;
+}
+
+void Reactor::Run() {
+    mLoopThread = std::this_thread::get_id();
+    mRunning = true;
+    DLOG_INFO("reactor running");
+
+    epoll_event events[kMaxEvents];
+    while (mRunning) {
+        int32_t count = ::epoll_wait(mEpollFd, events, kMaxEvents, -1);
+        if (count < 0) {
+            if (errno != EINTR) {
+                DLOG_ERROR("epoll_wait failed (%s)", strerror(errno));
+                break;
+            }
+            continue;
+        }
+
+        for (int32_t i = 0; i < count && mRunning; i++) {
+            auto it = mFdCallbacks.find(events[i].data.fd);
+            if (it != mFdCallbacks.end()) {
+                // copy, the callback may remove itself
+                FdCallback callback = it->second;
+                callback(events[i].events);
+            }
+        }
+    }
+
+    mLoopThread = std::thread::id();
+    DLOG_INFO("reactor stopped");
+    return;
+}
+
+void Reactor::Stop() {
+    mRunning = false;
+    Wake();
+    return;
+}
+
+bool Reactor::IsInLoopThread() const {
+    return mLoopThread.load() == std::this_thread::get_id();
+}
+
+void Reactor::Wake() {
+    uint64_t one = 1;
+    if (::write(mWakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        DLOG_ERROR("failed to wake reactor (%s)", strerror(errno));
+    }
+    return;
+}
+
+void Reactor::RunPosted() {
+    std::vector<Task> tasks;
+    {
+        std::unique_lock<std::mutex> lock(mPostMutex);
+        tasks.swap(mPosted);
+    }
+
+    for (auto& task : tasks) {
+        task();
+    }
+    return;
+}
+
+void Reactor::RunTimers() {
+    TimePoint now = steady_clock::now();
+    while (!mTimerQueue.empty() && mTimerQueue.top().deadline <= now) {
+        TimerEntry entry = mTimerQueue.top();
+        mTimerQueue.pop();
+
+        auto it = mTimers.find(entry.id);
+        if (it == mTimers.end()) {
+            continue; // cancelled
+        }
+
+        Timer timer = it->second;
+        if (timer.period.count() > 0) {
+            mTimerQueue.push(TimerEntry{ entry.deadline + timer.period, entry.id });
+        } else {
+            mTimers.erase(it);
+        }
+        timer.task();
+    }
+    ArmTimerFd();
+    return;
+}
+
+void Reactor::ArmTimerFd() {
+    // drop cancelled entries so they don't cause spurious wakeups
+    while (!mTimerQueue.empty() && !mTimers.contains(mTimerQueue.top().id)) {
+        mTimerQueue.pop();
+    }
+
+    itimerspec spec = {};
+    if (!mTimerQueue.empty()) {
+        auto deadline = duration_cast<nanoseconds>(mTimerQueue.top().deadline.time_since_epoch());
+        auto secs = duration_cast<seconds>(deadline);
+        spec.it_value.tv_sec = secs.count();
+        spec.it_value.tv_nsec = (deadline - secs).count();
+
+        // an all-zero it_value disarms the timer, so nudge it
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+            spec.it_value.tv_nsec = 1;
+        }
+    }
+
+    if (::timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+        DLOG_ERROR("failed to arm timer (%s)", strerror(errno));
+    }
+    return;
+}
+
+void Reactor::OnSignal() {
+    signalfd_siginfo info;
+    while (::read(mSignalFd, &info, sizeof(info)) == sizeof(info)) {
+        DLOG_NOTICE("received signal %u, stopping", info.ssi_signo);
+        mRunning = false;
+    }
+    return;
+}
+
+} // namespace utils
+} // namespace thermal
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _REACTOR_H_
+#define _REACTOR_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace thermal {
+namespace utils {
+
+/**
+ * @brief Callback for a file descriptor, given the epoll events that fired.
+ */
+typedef std::function<void(uint32_t)> FdCallback;
+
+/**
+ * @brief A unit of work run on the reactor thread.
+ */
+typedef std::function<void()> Task;
+
+/**
+ * @brief Handle returned by AddTimer, used to cancel it.
+ */
+typedef uint64_t TimerId;
+
+/**
+ * @brief Single threaded epoll event loop.
+ *
+ * Everything that changes application state runs on the thread that called
+ * Run(): file descriptor readiness, timers and tasks posted from other
+ * threads. Only Post() and Stop() may be called from other threads.
+ */
+class Reactor {
+public:
+    /**
+     * @brief Creates the epoll instance and its wakeup, timer and signal fds.
+     */
+    Reactor();
+
+    /**
+     * @brief Closes all fds owned by the reactor.
+     */
+    ~Reactor();
+
+    /**
+     * @brief Watches a file descriptor. The reactor does not take ownership.
+     * @param fd the file descriptor.
+     * @param events epoll event mask, e.g. EPOLLIN.
+     * @param callback called on the reactor thread when the fd is ready.
+     * @return true if the fd was added.
+     */
+    bool AddFd(int32_t fd, uint32_t events, FdCallback callback);
+
+    /**
+     * @brief Stops watching a file descriptor.
+     * @param fd the file descriptor.
+     */
+    void RemoveFd(int32_t fd);
+
+    /**
+     * @brief Runs a task after a delay, optionally repeating.
+     * @param delay time until the first run.
+     * @param task the task to run.
+     * @param period time between repeats, zero for a one-shot timer.
+     * @return id that can be passed to CancelTimer.
+     */
+    TimerId AddTimer(std::chrono::milliseconds delay, Task task, std::chrono::milliseconds period = std::chrono::milliseconds(0));
+
+    /**
+     * @brief Cancels a timer. Cancelling a fired one-shot timer is a no-op.
+     * @param id the timer id.
+     */
+    void CancelTimer(TimerId id);
+
+    /**
+     * @brief Queues a task for the reactor thread. Safe from any thread.
+     * @param task the task to run.
+     */
+    void Post(Task task);
+
+    /**
+     * @brief Dispatches events until Stop() is called or SIGINT/SIGTERM arrives.
+     */
+    void Run();
+
+    /**
+     * @brief Makes Run() return. Safe from any thread.
+     */
+    void Stop();
+
+    /**
+     * @brief Checks if the caller is the thread inside Run().
+     * @return true if called from the reactor thread.
+     */
+    bool IsInLoopThread() const;
+
+private:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    struct TimerEntry {
+        TimePoint deadline;
+        TimerId id;
+        bool operator>(const TimerEntry& other) const { return deadline > other.deadline; }
+    };
+
+    struct Timer {
+        Task task;
+        std::chrono::milliseconds period;
+    };
+
+    int32_t mEpollFd;
+    int32_t mWakeFd;
+    int32_t mTimerFd;
+    int32_t mSignalFd;
+    std::atomic<bool> mRunning;
+    std::atomic<std::thread::id> mLoopThread;
+
+    std::unordered_map<int32_t, FdCallback> mFdCallbacks;
+
+    std::priority_queue<TimerEntry, std::vector<TimerEntry>, std::greater<TimerEntry>> mTimerQueue;
+    std::unordered_map<TimerId, Timer> mTimers;
+    TimerId mNextTimerId;
+
+    std::mutex mPostMutex;
+    std::vector<Task> mPosted;
+
+    void Wake();
+    void RunPosted();
+    void RunTimers();
+    void ArmTimerFd();
+    void OnSignal();
+};
+
+} // namespace utils
+} // namespace thermal
+
+#endif // _REACTOR_H_
@@ -0,0 +1,301 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "SettingsJournal.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+
+#include "Crc32.h"
+#include "Logger.h"
+
+namespace thermal {
+namespace persistent {
+
+constexpr const uint16_t kRecordMagic = 0x4A54; // "TJ"
+constexpr const size_t kHeaderSize = 8u;        // magic, length, key id
+constexpr const size_t kCrcSize = 4u;
+
+template <typename T>
+static void PutLe(std::string& out, T value) {
+    for (size_t i = 0u; i < sizeof(T); i++) {
+        out.push_back(static_cast<char>((value >> (8u * i)) & 0xFFu));
+    }
+}
+
+template <typename T>
+static T GetLe(const uint8_t* data) {
+    T value = 0;
+    for (size_t i = 0u; i < sizeof(T); i++) {
+        value |= static_cast<T>(data[i]) << (8u * i);
+    }
+    return value;
+}
+
+uint32_t KeyId(const std::string& key) {
+    uint32_t hash = 2166136261u;
+    for (char c : key) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+Journal::Journal(std::string path, size_t compactThreshold)
+    : mPath(path)
+    , mCompactThreshold(compactThreshold)
+    , mLive()
+    , mSize(0u)
+    , mStats{ 0u, 0u, 0u, 0u } {
+    return;
+}
+
+Journal::~Journal() {
+    return;
+}
+
+bool Journal::Replay() {
+    int32_t fd = ::open(mPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        mSize = 0u;
+        return true;
+    }
+
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        DLOG_ERROR("failed to map %s (%s)", mPath.c_str(), strerror(errno));
+        return false;
+    }
+
+    mLive.clear();
+    size_t count = 0u;
+    const size_t valid = Parse(static_cast<const uint8_t*>(map), size, count);
+    ::munmap(map, size);
+
+    // cut off a torn tail so the next append starts on a record boundary
+    if (valid != size) {
+        DLOG_WARN("%s has %zu bad bytes at the end, dropping them", mPath.c_str(), size - valid);
+        if (::truncate(mPath.c_str(), static_cast<off_t>(valid)) != 0) {
+            DLOG_ERROR("failed to truncate %s (%s)", mPath.c_str(), strerror(errno));
+        }
+    }
+
+    mSize = valid;
+    DLOG_DEBUG("replayed %s, %zu keys from %zu records", mPath.c_str(), mLive.size(), count);
+    return true;
+}
+
+bool Journal::Get(uint32_t keyId, std::string& payload) const {
+    auto it = mLive.find(keyId);
+    if (it == mLive.end()) {
+        return false;
+    }
+    payload = it->second;
+    return true;
+}
+
+bool Journal::EncodeRecord(uint32_t keyId, const std::string& payload, std::string& record) {
+    // a cut payload would pass the crc and then fail to parse on replay
+    if (payload.size() > kMaxPayload) {
+        DLOG_ERROR("payload of key %08x is %zu bytes, the limit is %zu", keyId, payload.size(), kMaxPayload);
+        return false;
+    }
+
+    record.clear();
+    record.reserve(kHeaderSize + payload.size() + kCrcSize);
+    PutLe<uint16_t>(record, kRecordMagic);
+    PutLe<uint16_t>(record, static_cast<uint16_t>(payload.size()));
+    PutLe<uint32_t>(record, keyId);
+    record.append(payload);
+    PutLe<uint32_t>(record, utils::Crc32(record.data(), record.size()));
+    return true;
+}
+
+bool Journal::Append(const std::string& records) {
+    if (records.empty()) {
+        return true;
+    }
+
+    int32_t fd = ::open(mPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        DLOG_ERROR("failed to open %s (%s)", mPath.c_str(), strerror(errno));
+        return false;
+    }
+
+    size_t written = 0u;
+    while (written < records.size()) {
+        ssize_t n = ::write(fd, records.data() + written, records.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            DLOG_ERROR("failed to append to %s (%s)", mPath.c_str(), strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+
+    if (::fdatasync(fd) != 0) {
+        DLOG_ERROR("failed to sync %s (%s)", mPath.c_str(), strerror(errno));
+    }
+    ::close(fd);
+
+    size_t count = 0u;
+    Parse(reinterpret_cast<const uint8_t*>(records.data()), records.size(), count);
+    mSize += records.size();
+    mStats.recordsAppended += count;
+    mStats.bytesAppended += records.size();
+
+    // compact once the journal is mostly stale records, never more often
+    // than every other full set of keys
+    size_t liveSize = 0u;
+    for (const auto& [id, payload] : mLive) {
+        liveSize += kHeaderSize + payload.size() + kCrcSize;
+    }
+    if (mSize > std::max(mCompactThreshold, 2u * liveSize)) {
+        Compact();
+    }
+    return true;
+}
+
+bool Journal::Compact() {
+    std::string data;
+    std::string record;
+    for (const auto& [id, payload] : mLive) {
+        // live payloads were parsed from records, they always fit one
+        if (EncodeRecord(id, payload, record)) {
+            data += record;
+        }
+    }
+
+    if (!WriteAtomically(mPath, data)) {
+        return false;
+    }
+
+    DLOG_INFO("compacted %s from %zu to %zu bytes", mPath.c_str(), mSize, data.size());
+    mSize = data.size();
+    mStats.compactions++;
+    mStats.bytesCompacted += data.size();
+    return true;
+}
+
+JournalStats Journal::GetStats() const {
+    return mStats;
+}
+
+size_t Journal::GetSize() const {
+    return mSize;
+}
+
+/// @brief walks the records, keeping the last payload of each key.
+/// @param count - incremented for every valid record
+/// @return number of bytes that are whole, valid records.
+size_t Journal::Parse(const uint8_t* data, size_t size, size_t& count) {
+    size_t offset = 0u;
+    while (size - offset >= kHeaderSize + kCrcSize) {
+        const uint8_t* record = data + offset;
+        if (GetLe<uint16_t>(record) != kRecordMagic) {
+            break;
+        }
+
+        const size_t length = GetLe<uint16_t>(record + 2);
+        const size_t total = kHeaderSize + length + kCrcSize;
+        if (size - offset < total) {
+            break;
+        }
+
+        const uint32_t crc = GetLe<uint32_t>(record + kHeaderSize + length);
+        if (utils::Crc32(record, kHeaderSize + length) != crc) {
+            break;
+        }
+
+        const uint32_t keyId = GetLe<uint32_t>(record + 4);
+        mLive[keyId].assign(reinterpret_cast<const char*>(record + kHeaderSize), length);
+        count++;
+        offset += total;
+    }
+    return offset;
+}
+
+/// @brief writes to a temp file next to the target, syncs it and renames it
+///        over the target. A power loss leaves either the old or the new file.
+bool Journal::WriteAtomically(const std::string& path, const std::string& data) {
+    const std::string tmpPath = path + ".tmp";
+
+    int32_t fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        DLOG_ERROR("failed to open %s (%s)", tmpPath.c_str(), strerror(errno));
+        return false;
+    }
+
+    size_t written = 0u;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            DLOG_ERROR("failed to write %s (%s)", tmpPath.c_str(), strerror(errno));
+            ::close(fd);
+            ::unlink(tmpPath.c_str());
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+
+    if (::fsync(fd) != 0) {
+        DLOG_ERROR("failed to sync %s (%s)", tmpPath.c_str(), strerror(errno));
+        ::close(fd);
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+    ::close(fd);
+
+    if (::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        DLOG_ERROR("failed to rename %s (%s)", tmpPath.c_str(), strerror(errno));
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+
+    // make the rename itself durable
+    const std::string directory = std::filesystem::path(path).parent_path().string();
+    int32_t dirFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        ::fsync(dirFd);
+        ::close(dirFd);
+    }
+    return true;
+}
+
+} // namespace persistent
+} // namespace thermal
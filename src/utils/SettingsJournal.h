@@ -0,0 +1,134 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SETTINGS_JOURNAL_H_
+#define _SETTINGS_JOURNAL_H_
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace thermal {
+namespace persistent {
+
+/**
+ * @brief Write counters, used to keep an eye on flash wear.
+ */
+struct JournalStats {
+    uint64_t recordsAppended; ///< Setting changes written
+    uint64_t bytesAppended;   ///< Bytes appended for those changes
+    uint64_t compactions;     ///< Times the journal was rewritten
+    uint64_t bytesCompacted;  ///< Bytes written by the rewrites
+};
+
+/**
+ * @brief Stable id of a settings key, FNV-1a over the key name.
+ */
+uint32_t KeyId(const std::string& key);
+
+/**
+ * @brief Append-only binary log of setting changes.
+ *
+ * Every change is one record appended to the end of the file:
+ *
+ *     uint16 magic | uint16 length | uint32 key id | payload | uint32 crc
+ *
+ * little-endian, with the CRC-32 covering everything before it. The last
+ * record for a key wins. Once the file grows past the compaction threshold it
+ * is rewritten atomically with one record per live key, so the card sees small
+ * appends most of the time and a full rewrite only rarely.
+ *
+ * Not thread safe, the store serializes access.
+ */
+class Journal {
+public:
+    static constexpr size_t kMaxPayload = 0xFFFFu; ///< the record length is 16 bits
+
+    /**
+     * @brief Creates a journal backed by a file.
+     * @param path the journal file.
+     * @param compactThreshold size in bytes above which the journal is compacted.
+     */
+    Journal(std::string path, size_t compactThreshold);
+    ~Journal();
+
+    /**
+     * @brief Reads the journal through a memory map and collects the latest
+     *        payload of every key. A torn or corrupt tail (power loss during
+     *        an append) is dropped and cut off the file.
+     * @return true if the file was read, false if it doesn't exist.
+     */
+    bool Replay();
+
+    /**
+     * @brief Gets the latest payload of a key, after Replay() or Append().
+     * @param keyId the key id.
+     * @param payload receives the payload.
+     * @return true if the key has a record.
+     */
+    bool Get(uint32_t keyId, std::string& payload) const;
+
+    /**
+     * @brief Encodes one record.
+     * @param keyId the key id.
+     * @param payload the value, at most kMaxPayload bytes.
+     * @param record receives the record bytes.
+     * @return false if the payload is too long to fit a record.
+     */
+    static bool EncodeRecord(uint32_t keyId, const std::string& payload, std::string& record);
+
+    /**
+     * @brief Appends already encoded records with a single write and sync,
+     *        then compacts if the file has grown past the threshold.
+     * @param records one or more records from EncodeRecord().
+     * @return true if the records are on disk.
+     */
+    bool Append(const std::string& records);
+
+    /**
+     * @brief Rewrites the journal with one record per key.
+     * @return true if the journal was rewritten.
+     */
+    bool Compact();
+
+    /**
+     * @brief Gets the write counters since construction.
+     */
+    JournalStats GetStats() const;
+
+    /**
+     * @brief Current size of the journal file in bytes.
+     */
+    size_t GetSize() const;
+
+private:
+    const std::string mPath;
+    const size_t mCompactThreshold;
+    std::map<uint32_t, std::string> mLive; ///< latest payload per key id
+    size_t mSize;
+    JournalStats mStats;
+
+    size_t Parse(const uint8_t* data, size_t size, size_t& count);
+    static bool WriteAtomically(const std::string& path, const std::string& data);
+};
+
+} // namespace persistent
+} // namespace thermal
+
+#endif // _SETTINGS_JOURNAL_H_
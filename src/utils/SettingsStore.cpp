@@ -0,0 +1,147 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "SettingsStore.h"
+
+#include <json/reader.h>
+#include <json/writer.h>
+
+#include <filesystem>
+#include <sstream>
+
+#include "Logger.h"
+#include "Platform.h"
+#include "Utils.h"
+
+namespace thermal {
+namespace persistent {
+
+constexpr const char * const kSettingsFile = THERMAL_SCOPE_DATA_DIR "/settings.journal";
+constexpr const std::chrono::seconds kSettingsDelay(3);
+
+// A handful of keys make a few hundred bytes of live records, this leaves
+// room for a long time of appends between rewrites.
+constexpr const size_t kCompactThreshold = 16u * 1024u;
+
+Store& Store::Instance() {
+    static Store store(kSettingsFile, kSettingsDelay, kCompactThreshold);
+    return store;
+}
+
+Store::Store(std::string path, std::chrono::seconds delay, size_t compactThreshold)
+    : mPath(path)
+    , mMutex()
+    , mValues(Json::objectValue)
+    , mLoaded(false)
+    , mJournal(path, compactThreshold)
+    , mDelayedWriter(delay, [this](const std::string& records) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJournal.Append(records);
+    }) {
+    utils::EnsureDirectoryExists(std::filesystem::path(path).parent_path().string());
+    return;
+}
+
+Store::~Store() {
+    return;
+}
+
+bool Store::Get(const std::string& key, Json::Value& value) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return GetLocked(key, value);
+}
+
+bool Store::GetLocked(const std::string& key, Json::Value& value) {
+    LoadLocked();
+
+    if (mValues.isMember(key)) {
+        value = mValues[key];
+        return true;
+    }
+
+    std::string payload;
+    if (!mJournal.Get(KeyId(key), payload)) {
+        return false;
+    }
+
+    Json::CharReaderBuilder builder;
+    std::string errors;
+    std::istringstream stream(payload);
+    if (!Json::parseFromStream(builder, stream, &value, &errors)) {
+        DLOG_ERROR("failed to parse %s (%s)", key.c_str(), errors.c_str());
+        return false;
+    }
+
+    mValues[key] = value;
+    return true;
+}
+
+bool Store::Set(const std::string& key, const Json::Value& value) {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    Json::Value current;
+    if (GetLocked(key, current) && current == value) {
+        return true;
+    }
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    const std::string payload = Json::writeString(builder, value);
+
+    // refused rather than written as a record that can never be read back
+    std::string record;
+    if (!Journal::EncodeRecord(KeyId(key), payload, record)) {
+        DLOG_ERROR("not saving %s, %zu bytes is over the record limit", key.c_str(), payload.size());
+        return false;
+    }
+    mValues[key] = value;
+
+    // only the changed key is written, records of one burst go out together
+    mDelayedWriter << record;
+    mDelayedWriter.flush();
+    return true;
+}
+
+void Store::Sync() {
+    // not under mMutex, the flush handler takes it
+    mDelayedWriter.Flush();
+    return;
+}
+
+const std::string& Store::GetPath() const {
+    return mPath;
+}
+
+JournalStats Store::GetStats() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mJournal.GetStats();
+}
+
+void Store::LoadLocked() {
+    if (mLoaded) {
+        return;
+    }
+    mLoaded = true;
+
+    if (!mJournal.Replay()) {
+        DLOG_WARN("no settings at %s, using defaults", mPath.c_str());
+    }
+    return;
+}
+
+} // namespace persistent
+} // namespace thermal
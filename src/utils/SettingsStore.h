@@ -0,0 +1,113 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SETTINGS_STORE_H_
+#define _SETTINGS_STORE_H_
+
+#include <json/value.h>
+
+#include <stdint.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#include "DelayedWriter.h"
+#include "SettingsJournal.h"
+
+namespace thermal {
+namespace persistent {
+
+/**
+ * @brief All persistent settings in one journal file.
+ *
+ * Each change is encoded as one small journal record (see Journal). Records
+ * are coalesced by a single delayed writer, so a burst of changes to any
+ * number of keys is one append once things have been quiet for a while. The
+ * journal compacts itself atomically when it grows, and every record carries
+ * a CRC that is checked on load.
+ */
+class Store {
+public:
+    /**
+     * @brief Gets the store used by all persistent::Value objects.
+     */
+    static Store& Instance();
+
+    /**
+     * @brief Creates a store backed by a file.
+     * @param path the journal file.
+     * @param delay quiet time before changes are written.
+     * @param compactThreshold journal size in bytes that triggers compaction.
+     */
+    Store(std::string path, std::chrono::seconds delay, size_t compactThreshold);
+
+    /**
+     * @brief Writes out any pending changes.
+     */
+    ~Store();
+
+    /**
+     * @brief Gets the value stored for a key.
+     * @param key the key.
+     * @param value receives the value.
+     * @return true if the key exists.
+     */
+    bool Get(const std::string& key, Json::Value& value);
+
+    /**
+     * @brief Sets the value of a key and schedules a write.
+     * @param key the key.
+     * @param value the value.
+     * @return false if the value is too large for a journal record, it is
+     *         not stored.
+     */
+    bool Set(const std::string& key, const Json::Value& value);
+
+    /**
+     * @brief Writes pending changes now instead of after the quiet time.
+     */
+    void Sync();
+
+    /**
+     * @brief Path of the journal file.
+     */
+    const std::string& GetPath() const;
+
+    /**
+     * @brief Gets the journal write counters, bytes written per change is
+     *        the write amplification.
+     */
+    JournalStats GetStats();
+
+private:
+    const std::string mPath;
+    std::mutex mMutex;
+    Json::Value mValues; ///< values already decoded from the journal or set since
+    bool mLoaded;
+    Journal mJournal;
+    utils::DelayedWriter mDelayedWriter; ///< Due to NANDflash concerns, all keys share one
+                                         ///  delayed writer to ease the number of writes.
+
+    bool GetLocked(const std::string& key, Json::Value& value);
+    void LoadLocked();
+};
+
+} // namespace persistent
+} // namespace thermal
+
+#endif // _SETTINGS_STORE_H_
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SNAPSHOT_POOL_H_
+#define _SNAPSHOT_POOL_H_
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace thermal {
+namespace utils {
+
+/**
+ * @brief Publishes immutable, versioned snapshots from one writer to any
+ *        number of readers without locks.
+ *
+ * The writer fills a free slot off to the side and swaps it in with a single
+ * atomic store. Readers pin the current slot with a reference count for as
+ * long as they use it. Slots are recycled, never freed, so whatever T
+ * allocated (e.g. cv::Mat pixels) is reused by the next snapshot.
+ *
+ * With one reader thread at most two slots are ever busy (the current one and
+ * the one being read), so N = 3 always leaves one for the writer.
+ *
+ * @tparam T the snapshot payload.
+ * @tparam N the number of slots in the pool.
+ */
+template <typename T, size_t N = 3>
+class SnapshotPool {
+public:
+    struct Slot {
+        T value;
+        uint64_t version = 0u;
+        mutable std::atomic<uint32_t> readers{0u};
+    };
+
+    /**
+     * @brief Pins a snapshot for reading, released when it goes out of scope.
+     */
+    class ReadRef {
+    public:
+        ReadRef() : mSlot(nullptr) {}
+        explicit ReadRef(const Slot* slot) : mSlot(slot) {}
+        ReadRef(ReadRef&& other) : mSlot(other.mSlot) { other.mSlot = nullptr; }
+        ReadRef(const ReadRef&) = delete;
+        ReadRef& operator=(const ReadRef&) = delete;
+        ~ReadRef() {
+            if (mSlot != nullptr) {
+                mSlot->readers.fetch_sub(1u);
+            }
+        }
+
+        explicit operator bool() const { return mSlot != nullptr; }
+        const T& operator*() const { return mSlot->value; }
+        const T* operator->() const { return &mSlot->value; }
+        uint64_t Version() const { return (mSlot != nullptr) ? mSlot->version : 0u; }
+
+    private:
+        const Slot* mSlot;
+    };
+
+    SnapshotPool() : mSlots(), mCurrent(nullptr), mVersion(0u) {}
+
+    /**
+     * @brief Pins the latest snapshot. Never blocks.
+     * @return the snapshot, empty if nothing was published yet.
+     */
+    ReadRef Acquire() const {
+        while (true) {
+            const Slot* slot = mCurrent.load();
+            if (slot == nullptr) {
+                return ReadRef();
+            }
+
+            // Pin, then make sure it is still current. If the writer swapped
+            // in between it may already be recycling this slot, so retry.
+            slot->readers.fetch_add(1u);
+            if (mCurrent.load() == slot) {
+                return ReadRef(slot);
+            }
+            slot->readers.fetch_sub(1u);
+        }
+    }
+
+    /**
+     * @brief Gets a slot to build the next snapshot in. Writer thread only.
+     * @return a recycled slot, or nullptr if every slot is pinned.
+     */
+    T* BeginWrite() {
+        const Slot* current = mCurrent.load();
+        for (auto& slot : mSlots) {
+            if (&slot != current && slot.readers.load() == 0u) {
+                mPending = &slot;
+                return &slot.value;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Makes the slot from BeginWrite() the current snapshot.
+     * @return the new version number.
+     */
+    uint64_t Publish() {
+        if (mPending == nullptr) {
+            return mVersion;
+        }
+        mPending->version = ++mVersion;
+        mCurrent.store(mPending);
+        mPending = nullptr;
+        return mVersion;
+    }
+
+    /**
+     * @brief Version of the latest published snapshot.
+     */
+    uint64_t Version() const {
+        const Slot* slot = mCurrent.load();
+        return (slot != nullptr) ? slot->version : 0u;
+    }
+
+private:
+    std::array<Slot, N> mSlots;
+    std::atomic<const Slot*> mCurrent;
+    Slot* mPending = nullptr;
+    uint64_t mVersion;
+};
+
+} // namespace utils
+} // namespace thermal
+
+#endif // _SNAPSHOT_POOL_H_
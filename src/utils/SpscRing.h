@@ -0,0 +1,130 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace thermal {
+namespace utils {
+
+/**
+ * @brief Fixed size, lock-free, single producer / single consumer ring.
+ *
+ * Push() is only ever called from one thread and Pop() from one other
+ * thread. Nothing allocates and nothing blocks, so it is safe to feed from a
+ * callback thread that must not stall (e.g. the lgpio alert thread).
+ *
+ * @tparam T element type, copied in and out.
+ * @tparam N capacity, must be a power of two.
+ */
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+    SpscRing() : mHead(0u), mTail(0u), mDropped(0u) {}
+
+    /**
+     * @brief Adds an element. Producer thread only.
+     * @param value the element.
+     * @return false (and counts a drop) if the ring is full.
+     */
+    bool Push(const T& value) {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        if (head - mTail.load(std::memory_order_acquire) >= N) {
+            mDropped.fetch_add(1u, std::memory_order_relaxed);
+            return false;
+        }
+
+        mBuffer[head & (N - 1)] = value;
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Hands out the next free slot to fill in place. Producer thread
+     * only, the element becomes visible to the consumer on Publish().
+     * @return the slot, or nullptr (and counts a drop) if the ring is full.
+     */
+    T* Claim() {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        if (head - mTail.load(std::memory_order_acquire) >= N) {
+            mDropped.fetch_add(1u, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        return &mBuffer[head & (N - 1)];
+    }
+
+    /**
+     * @brief Makes the slot returned by the last Claim() visible.
+     */
+    void Publish() {
+        mHead.store(mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Removes the oldest element. Consumer thread only.
+     * @param value receives the element.
+     * @return false if the ring is empty.
+     */
+    bool Pop(T& value) {
+        const size_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail == mHead.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = mBuffer[tail & (N - 1)];
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Checks for pending elements.
+     */
+    bool Empty() const {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Number of elements lost because the ring was full.
+     */
+    uint64_t Dropped() const {
+        return mDropped.load(std::memory_order_relaxed);
+    }
+
+    static constexpr size_t Capacity() {
+        return N;
+    }
+
+private:
+    // head and tail on their own cache lines so the two threads don't fight
+    alignas(64) std::atomic<size_t> mHead;
+    alignas(64) std::atomic<size_t> mTail;
+    alignas(64) std::atomic<uint64_t> mDropped;
+    std::array<T, N> mBuffer;
+};
+
+} // namespace utils
+} // namespace thermal
+
+#endif // _SPSC_RING_H_
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "StatsExporter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+#include "Logger.h"
+
+namespace thermal {
+namespace trace {
+
+inline constexpr const char* const kStatsFile = "frame-stats";
+inline constexpr const char* const kSocketFile = "stats.sock";
+
+StatsExporter::StatsExporter(utils::Reactor& reactor, const FrameTracer& tracer, std::string directory,
+                             std::chrono::milliseconds period)
+    : mReactor(reactor)
+    , mTracer(tracer)
+    , mStatsPath(directory + "/" + kStatsFile)
+    , mSocketPath(directory + "/" + kSocketFile)
+    , mPeriod(period)
+    , mTimer(0u)
+    , mTimerActive(false)
+    , mListenFd(-1)
+    , mSections() {
+    if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        DLOG_WARN("failed to create %s (%s)", directory.c_str(), strerror(errno));
+    }
+}
+
+StatsExporter::~StatsExporter() {
+    Stop();
+}
+
+bool StatsExporter::Start() {
+    mTimer = mReactor.AddTimer(mPeriod, std::bind(&StatsExporter::WriteStatsFile, this), mPeriod);
+    mTimerActive = true;
+
+    if (!OpenSocket()) {
+        DLOG_WARN("no stats socket, only %s", mStatsPath.c_str());
+    }
+    return true;
+}
+
+void StatsExporter::Stop() {
+    if (mTimerActive) {
+        mReactor.CancelTimer(mTimer);
+        mTimerActive = false;
+    }
+
+    if (mListenFd >= 0) {
+        mReactor.RemoveFd(mListenFd);
+        ::close(mListenFd);
+        ::unlink(mSocketPath.c_str());
+        mListenFd = -1;
+    }
+}
+
+void StatsExporter::AddSection(ReportSection section) {
+    mSections.push_back(section);
+}
+
+std::string StatsExporter::BuildReport(size_t recentFrames) const {
+    std::string report = mTracer.Report(recentFrames);
+    for (const ReportSection& section : mSections) {
+        report += section();
+    }
+    return report;
+}
+
+void StatsExporter::WriteStatsFile() {
+    const std::string report = BuildReport(0u);
+    const std::string tmpPath = mStatsPath + ".tmp";
+
+    // tmpfs, no fsync needed, the rename is only so readers never see half
+    FILE* file = fopen(tmpPath.c_str(), "w");
+    if (file == nullptr) {
+        DLOG_WARN("failed to open %s (%s)", tmpPath.c_str(), strerror(errno));
+        return;
+    }
+
+    const bool written = fwrite(report.data(), 1u, report.size(), file) == report.size();
+    if (fclose(file) != 0 || !written || ::rename(tmpPath.c_str(), mStatsPath.c_str()) != 0) {
+        DLOG_WARN("failed to write %s (%s)", mStatsPath.c_str(), strerror(errno));
+    }
+}
+
+bool StatsExporter::OpenSocket() {
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (mSocketPath.size() >= sizeof(address.sun_path)) {
+        DLOG_ERROR("socket path %s is too long", mSocketPath.c_str());
+        return false;
+    }
+    strncpy(address.sun_path, mSocketPath.c_str(), sizeof(address.sun_path) - 1u);
+
+    mListenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (mListenFd < 0) {
+        DLOG_ERROR("failed to create stats socket (%s)", strerror(errno));
+        return false;
+    }
+
+    // left behind if we were killed
+    ::unlink(mSocketPath.c_str());
+    if (::bind(mListenFd, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) != 0
+        || ::listen(mListenFd, 4) != 0) {
+        DLOG_ERROR("failed to listen on %s (%s)", mSocketPath.c_str(), strerror(errno));
+        ::close(mListenFd);
+        mListenFd = -1;
+        return false;
+    }
+
+    mReactor.AddFd(mListenFd, EPOLLIN, [this](uint32_t) { OnAccept(); });
+    DLOG_INFO("frame stats on %s", mSocketPath.c_str());
+    return true;
+}
+
+void StatsExporter::OnAccept() {
+    while (true) {
+        int32_t fd = ::accept4(mListenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                DLOG_WARN("stats socket accept failed (%s)", strerror(errno));
+            }
+            return;
+        }
+
+        // a few KB, fits the socket buffer, a reader that isn't there gets
+        // a short report rather than stalling the reactor
+        const std::string report = BuildReport(kSocketRecentFrames);
+        if (::send(fd, report.data(), report.size(), MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+            DLOG_WARN("stats socket send failed (%s)", strerror(errno));
+        }
+        ::close(fd);
+    }
+}
+
+} // trace
+} // thermal
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _STATS_EXPORTER_H_
+#define _STATS_EXPORTER_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "FrameTrace.h"
+#include "Reactor.h"
+
+namespace thermal {
+namespace trace {
+
+/**
+ * @brief Publishes the frame tracer's report.
+ *
+ * The report is rewritten (atomically, tmp + rename) to a file on tmpfs
+ * every period, and a Unix stream socket hands out a fresh report, with the
+ * latest frames listed, to anyone who connects:
+ *
+ *     cat /run/thermal-scope/frame-stats
+ *     socat - UNIX-CONNECT:/run/thermal-scope/stats.sock
+ *
+ * Everything runs on the reactor thread, the frame thread only ever writes
+ * to the tracer.
+ */
+class StatsExporter {
+public:
+    /**
+     * @brief Extra text appended to every report, called on the reactor.
+     */
+    typedef std::function<std::string()> ReportSection;
+
+    static constexpr size_t kSocketRecentFrames = 32u;
+
+    /**
+     * @param reactor the loop the timer and the socket run on.
+     * @param tracer the tracer to report.
+     * @param directory where the stats file and the socket are created.
+     * @param period how often the stats file is refreshed.
+     */
+    StatsExporter(utils::Reactor& reactor, const FrameTracer& tracer, std::string directory,
+                  std::chrono::milliseconds period);
+    ~StatsExporter();
+
+    /**
+     * @brief Creates the directory, the socket and the refresh timer.
+     * @return false if none of them could be set up.
+     */
+    bool Start();
+
+    /**
+     * @brief Removes the timer, closes the socket and removes its file.
+     */
+    void Stop();
+
+    /**
+     * @brief Appends a section (e.g. the latency probe) to the reports.
+     */
+    void AddSection(ReportSection section);
+
+private:
+    utils::Reactor& mReactor;
+    const FrameTracer& mTracer;
+    std::string mStatsPath;
+    std::string mSocketPath;
+    std::chrono::milliseconds mPeriod;
+    utils::TimerId mTimer;
+    bool mTimerActive;
+    int32_t mListenFd;
+    std::vector<ReportSection> mSections;
+
+    std::string BuildReport(size_t recentFrames) const;
+    void WriteStatsFile();
+    bool OpenSocket();
+    void OnAccept();
+};
+
+} // trace
+} // thermal
+
+#endif // _STATS_EXPORTER_H_
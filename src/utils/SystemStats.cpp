@@ -0,0 +1,81 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SystemStats.h"
+
+#include <cmath>
+#include <cstdio>
+
+#include "Logger.h"
+
+namespace thermal {
+namespace utils {
+
+inline constexpr const char* const kProcStat = "/proc/stat";
+inline constexpr const char* const kSocThermalZone = "/sys/class/thermal/thermal_zone0/temp";
+
+SystemStats::SystemStats()
+    : mLastBusy(0u)
+    , mLastTotal(0u) {
+}
+
+float SystemStats::SampleCpuLoad() {
+    FILE* file = fopen(kProcStat, "r");
+    if (file == nullptr) {
+        return -1.0f;
+    }
+
+    // first line is the sum over all cores, in jiffies
+    unsigned long long user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+    int fields = fscanf(file, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+                        &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+    fclose(file);
+    if (fields < 4) {
+        DLOG_WARN("unexpected %s format", kProcStat);
+        return -1.0f;
+    }
+
+    const uint64_t idleAll = idle + iowait;
+    const uint64_t busy = user + nice + system + irq + softirq + steal;
+    const uint64_t total = busy + idleAll;
+
+    float load = -1.0f;
+    if (mLastTotal != 0u && total > mLastTotal) {
+        load = static_cast<float>(busy - mLastBusy) / static_cast<float>(total - mLastTotal);
+    }
+    mLastBusy = busy;
+    mLastTotal = total;
+    return load;
+}
+
+float SystemStats::ReadSocTemperature() const {
+    FILE* file = fopen(kSocThermalZone, "r");
+    if (file == nullptr) {
+        return NAN;
+    }
+
+    // millidegrees
+    long milliC = 0;
+    int fields = fscanf(file, "%ld", &milliC);
+    fclose(file);
+    if (fields != 1) {
+        return NAN;
+    }
+    return static_cast<float>(milliC) / 1000.0f;
+}
+
+} // namespace utils
+} // namespace thermal
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SYSTEM_STATS_H_
+#define _SYSTEM_STATS_H_
+
+#include <stdint.h>
+
+#include <string>
+
+namespace thermal {
+namespace utils {
+
+/**
+ * @brief Samples the CPU load and SoC temperature for the performance HUD.
+ *
+ * Both are a read of a small procfs / sysfs file, cheap enough for a couple
+ * of samples a second but not something to do per frame.
+ */
+class SystemStats {
+public:
+    SystemStats();
+
+    /**
+     * @brief Busy fraction of all cores since the previous call.
+     * @return 0..1, or a negative value if /proc/stat could not be read or
+     *         this is the first sample.
+     */
+    float SampleCpuLoad();
+
+    /**
+     * @brief Temperature of the SoC thermal zone.
+     * @return degrees C, or a NaN if the zone could not be read.
+     */
+    float ReadSocTemperature() const;
+
+private:
+    uint64_t mLastBusy;
+    uint64_t mLastTotal;
+};
+
+} // namespace utils
+} // namespace thermal
+
+#endif // _SYSTEM_STATS_H_
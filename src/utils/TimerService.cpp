@@ -0,0 +1,119 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "TimerService.h"
+
+namespace thermal {
+namespace utils {
+
+constexpr const TimerService::TimerId kNoTimer = 0u;
+
+TimerService& TimerService::Instance() {
+    static TimerService service;
+    return service;
+}
+
+TimerService::TimerService()
+    : mMutex()
+    , mCv()
+    , mDoneCv()
+    , mQueue()
+    , mTasks()
+    , mNextId(kNoTimer + 1u)
+    , mRunning(kNoTimer)
+    , mStopping(false)
+    , mThread() {
+    mThread = std::thread(&TimerService::Loop, this);
+    return;
+}
+
+TimerService::~TimerService() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mCv.notify_all();
+
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    return;
+}
+
+TimerService::TimerId TimerService::Schedule(Clock::duration delay, Task task) {
+    TimerId id = kNoTimer;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        id = mNextId++;
+        mTasks.emplace(id, std::move(task));
+        mQueue.push(Entry{ Clock::now() + delay, id });
+    }
+
+    // the new deadline may be earlier than the one being waited for
+    mCv.notify_all();
+    return id;
+}
+
+void TimerService::Cancel(TimerId id) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mTasks.erase(id);
+
+    // the heap entry is skipped when it comes up. A task can't wait for
+    // itself, so only block when called from somewhere else.
+    if (std::this_thread::get_id() != mThread.get_id()) {
+        mDoneCv.wait(lock, [this, id]() { return mRunning != id; });
+    }
+    return;
+}
+
+void TimerService::Loop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mStopping) {
+        if (mQueue.empty()) {
+            mCv.wait(lock);
+            continue;
+        }
+
+        const Entry entry = mQueue.top();
+        auto it = mTasks.find(entry.id);
+        if (it == mTasks.end()) {
+            mQueue.pop(); // cancelled
+            continue;
+        }
+
+        if (Clock::now() < entry.deadline) {
+            mCv.wait_until(lock, entry.deadline);
+            continue;
+        }
+
+        mQueue.pop();
+        Task task = std::move(it->second);
+        mTasks.erase(it);
+        mRunning = entry.id;
+
+        lock.unlock();
+        task();
+        lock.lock();
+
+        mRunning = kNoTimer;
+        mDoneCv.notify_all();
+    }
+    return;
+}
+
+} // namespace utils
+} // namespace thermal
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _TIMER_SERVICE_H_
+#define _TIMER_SERVICE_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace thermal {
+namespace utils {
+
+/**
+ * @brief One background thread running deadlines for everyone.
+ *
+ * Deadlines are kept in a min-heap and the thread sleeps until the earliest
+ * one. Used by the delayed writers so a write never has to start a thread.
+ * Tasks run on the service thread and should be short.
+ */
+class TimerService {
+public:
+    typedef uint64_t TimerId;
+    typedef std::function<void()> Task;
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * @brief Gets the shared service.
+     */
+    static TimerService& Instance();
+
+    /**
+     * @brief Starts the service thread.
+     */
+    TimerService();
+
+    /**
+     * @brief Stops the service thread, pending tasks are dropped.
+     */
+    ~TimerService();
+
+    /**
+     * @brief Runs a task once after a delay.
+     * @param delay time from now.
+     * @param task the task.
+     * @return id that can be passed to Cancel().
+     */
+    TimerId Schedule(Clock::duration delay, Task task);
+
+    /**
+     * @brief Cancels a task. If it is running right now on another thread,
+     *        waits for it to finish, so whatever it uses can be destroyed
+     *        after this returns.
+     * @param id the id from Schedule(), cancelling a finished task is a no-op.
+     */
+    void Cancel(TimerId id);
+
+private:
+    struct Entry {
+        Clock::time_point deadline;
+        TimerId id;
+        bool operator>(const Entry& other) const { return deadline > other.deadline; }
+    };
+
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    std::condition_variable mDoneCv;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> mQueue;
+    std::unordered_map<TimerId, Task> mTasks;
+    TimerId mNextId;
+    TimerId mRunning;
+    bool mStopping;
+    std::thread mThread;
+
+    void Loop();
+};
+
+} // namespace utils
+} // namespace thermal
+
+#endif // _TIMER_SERVICE_H_
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+
+namespace thermal {
+namespace utils {
+
+WorkStealingPool::WorkStealingPool(size_t threads)
+    : mQueues()
+    , mThreads()
+    , mMutex()
+    , mWake()
+    , mPending(0u)
+    , mNextQueue(0u)
+    , mSteals(0u)
+    , mStop(false) {
+    if (threads == 0u) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0u; i < threads; i++) {
+        mQueues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0u; i < threads; i++) {
+        mThreads.emplace_back(&WorkStealingPool::Run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_all();
+    for (std::thread& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::Submit(Task task) {
+    // counted before the push so mPending never goes below zero, a worker
+    // that wakes up in between just looks again
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPending.fetch_add(1u, std::memory_order_relaxed);
+    }
+
+    Queue& queue = *mQueues[mNextQueue.fetch_add(1u, std::memory_order_relaxed) % mQueues.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    mWake.notify_one();
+}
+
+size_t WorkStealingPool::GetThreadCount() const {
+    return mThreads.size();
+}
+
+uint64_t WorkStealingPool::GetSteals() const {
+    return mSteals.load(std::memory_order_relaxed);
+}
+
+void WorkStealingPool::Run(size_t index) {
+    Task task;
+    while (true) {
+        if (Take(index, task)) {
+            task(index);
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mWake.wait(lock, [this]() { return mStop || mPending.load(std::memory_order_relaxed) > 0u; });
+        if (mStop && mPending.load(std::memory_order_relaxed) == 0u) {
+            return;
+        }
+    }
+}
+
+bool WorkStealingPool::Take(size_t index, Task& task) {
+    // own queue newest first
+    {
+        Queue& own = *mQueues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            mPending.fetch_sub(1u, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // then the oldest task of the next busy worker
+    for (size_t i = 1u; i < mQueues.size(); i++) {
+        Queue& victim = *mQueues[(index + i) % mQueues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            mPending.fetch_sub(1u, std::memory_order_relaxed);
+            mSteals.fetch_add(1u, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+} // utils
+} // thermal
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2024 Brian Tipold
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _WORK_STEALING_POOL_H_
+#define _WORK_STEALING_POOL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace thermal {
+namespace utils {
+
+/**
+ * @brief Thread pool where every worker has its own queue and idle workers
+ *        steal from the others.
+ *
+ * Submitted tasks are spread round robin over the queues. A worker runs its
+ * own queue newest first, which keeps the data it just touched in cache, and
+ * when it runs dry takes the oldest task of another worker. Uneven tasks
+ * (a chunk of frames that happens to be slow) then don't leave cores idle
+ * while one queue is still full.
+ *
+ * Meant for offline batch work, nothing here is real time.
+ */
+class WorkStealingPool {
+public:
+    /**
+     * @brief A task, given the index of the worker running it so it can use
+     *        per worker state without locking.
+     */
+    typedef std::function<void(size_t worker)> Task;
+
+    /**
+     * @param threads number of workers, 0 for one per core.
+     */
+    explicit WorkStealingPool(size_t threads);
+
+    /**
+     * @brief Runs the tasks still queued, then joins the workers.
+     */
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * @brief Queues a task. Any thread.
+     */
+    void Submit(Task task);
+
+    size_t GetThreadCount() const;
+
+    /**
+     * @brief Tasks that ran on another worker than the one they were queued on.
+     */
+    uint64_t GetSteals() const;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> mQueues;
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::atomic<size_t> mPending;    ///< queued and not yet taken
+    std::atomic<size_t> mNextQueue;  ///< round robin for Submit()
+    std::atomic<uint64_t> mSteals;
+    bool mStop;                      ///< guarded by mMutex
+
+    void Run(size_t index);
+    bool Take(size_t index, Task& task);
+};
+
+} // utils
+} // thermal
+
+#endif // _WORK_STEALING_POOL_H_